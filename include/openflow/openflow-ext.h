@@ -90,6 +90,36 @@ OFP_ASSERT(sizeof(struct openflow_ext_set_dp_desc) == 272);
 #define ofq_error_string(rv) (((rv) < OFQ_ERR_COUNT) && ((rv) >= 0) ? \
     openflow_queue_error_strings[rv] : "Unknown error code")
 
+/****************************************************************
+ *
+ * Implementation statistics
+ *
+ ****************************************************************/
+
+/* Subtypes of OFPST_VENDOR statistics whose vendor is OPENFLOW_VENDOR_ID. */
+enum ofp_extension_stats_types {
+    OFP_EXT_STATS_COUNTERS      /* Implementation-specific counters. */
+};
+
+/* Body of an OFPST_VENDOR statistics request or reply whose vendor is
+ * OPENFLOW_VENDOR_ID.  For OFP_EXT_STATS_COUNTERS, the request has no
+ * further data and the reply is followed by an array of struct
+ * ofp_ext_counter. */
+struct ofp_extension_stats_header {
+    uint32_t vendor;            /* OPENFLOW_VENDOR_ID. */
+    uint32_t subtype;           /* One of OFP_EXT_STATS_*. */
+};
+OFP_ASSERT(sizeof(struct ofp_extension_stats_header) == 8);
+
+#define OFP_EXT_COUNTER_NAME_LEN 40
+
+/* A single named counter maintained by the switch implementation. */
+struct ofp_ext_counter {
+    char name[OFP_EXT_COUNTER_NAME_LEN]; /* Null-terminated name. */
+    uint64_t value;
+};
+OFP_ASSERT(sizeof(struct ofp_ext_counter) == 48);
+
 /****************************************************************
  *
  * Unsupported, but potential extended queue properties
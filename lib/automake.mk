@@ -105,6 +105,10 @@ lib_libopenflow_a_SOURCES += \
 	lib/vconn-netlink.c
 endif
 
+if HAVE_SHM
+lib_libopenflow_a_SOURCES += lib/vconn-shm.c
+endif
+
 if HAVE_OPENSSL
 lib_libopenflow_a_SOURCES += \
 	lib/vconn-ssl.c 
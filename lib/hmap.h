@@ -79,13 +79,28 @@ static inline void hmap_insert_fast(struct hmap *,
 static inline void hmap_insert(struct hmap *, struct hmap_node *, size_t hash);
 static inline void hmap_remove(struct hmap *, struct hmap_node *);
 
+/* Like CONTAINER_OF, but maps a null 'NODE' to a null pointer.
+ *
+ * The iteration macros below test the resulting pointer rather than
+ * '&(NODE)->MEMBER != NULL', because a compiler is entitled to assume that the
+ * address of a member of an object is never null and optimize the latter test
+ * away. */
+#define HMAP_NODE_CONTAINER(NODE, STRUCT, MEMBER)                       \
+    ((STRUCT *) hmap_node_container__(NODE, offsetof(STRUCT, MEMBER)))
+
+static inline void *
+hmap_node_container__(const struct hmap_node *node, size_t offset)
+{
+    return node ? (char *) node - offset : NULL;
+}
+
 /* Search. */
 #define HMAP_FOR_EACH_WITH_HASH(NODE, STRUCT, MEMBER, HASH, HMAP)       \
-    for ((NODE) = CONTAINER_OF(hmap_first_with_hash(HMAP, HASH),        \
-                               STRUCT, MEMBER);                         \
-         &(NODE)->MEMBER != NULL;                                       \
-         (NODE) = CONTAINER_OF(hmap_next_with_hash(&(NODE)->MEMBER),    \
-                               STRUCT, MEMBER))
+    for ((NODE) = HMAP_NODE_CONTAINER(hmap_first_with_hash(HMAP, HASH), \
+                                      STRUCT, MEMBER);                  \
+         (NODE) != NULL;                                                \
+         (NODE) = HMAP_NODE_CONTAINER(hmap_next_with_hash(&(NODE)->MEMBER), \
+                                      STRUCT, MEMBER))
 
 static inline struct hmap_node *hmap_first_with_hash(const struct hmap *,
                                                      size_t hash);
@@ -96,18 +111,18 @@ static inline struct hmap_node *hmap_next_with_hash(const struct hmap_node *);
  * The _SAFE version is needed when NODE may be freed.  It is not needed when
  * NODE may be removed from the hash map but its members remain accessible and
  * intact. */
-#define HMAP_FOR_EACH(NODE, STRUCT, MEMBER, HMAP)                   \
-    for ((NODE) = CONTAINER_OF(hmap_first(HMAP), STRUCT, MEMBER);   \
-         &(NODE)->MEMBER != NULL;                                   \
-         (NODE) = CONTAINER_OF(hmap_next(HMAP, &(NODE)->MEMBER),    \
-                               STRUCT, MEMBER))
-
-#define HMAP_FOR_EACH_SAFE(NODE, NEXT, STRUCT, MEMBER, HMAP)        \
-    for ((NODE) = CONTAINER_OF(hmap_first(HMAP), STRUCT, MEMBER);   \
-         (&(NODE)->MEMBER != NULL                                   \
-          ? (NEXT) = CONTAINER_OF(hmap_next(HMAP, &(NODE)->MEMBER), \
-                                  STRUCT, MEMBER), 1                \
-          : 0);                                                     \
+#define HMAP_FOR_EACH(NODE, STRUCT, MEMBER, HMAP)                       \
+    for ((NODE) = HMAP_NODE_CONTAINER(hmap_first(HMAP), STRUCT, MEMBER); \
+         (NODE) != NULL;                                                \
+         (NODE) = HMAP_NODE_CONTAINER(hmap_next(HMAP, &(NODE)->MEMBER), \
+                                      STRUCT, MEMBER))
+
+#define HMAP_FOR_EACH_SAFE(NODE, NEXT, STRUCT, MEMBER, HMAP)            \
+    for ((NODE) = HMAP_NODE_CONTAINER(hmap_first(HMAP), STRUCT, MEMBER); \
+         ((NODE) != NULL                                                \
+          ? (NEXT) = HMAP_NODE_CONTAINER(hmap_next(HMAP, &(NODE)->MEMBER), \
+                                         STRUCT, MEMBER), 1             \
+          : 0);                                                         \
          (NODE) = (NEXT))
 
 static inline struct hmap_node *hmap_first(const struct hmap *);
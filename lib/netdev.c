@@ -63,12 +63,13 @@
 #include <linux/version.h>
 #include <sys/types.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
-#include <netpacket/packet.h>
+#include <sys/uio.h>
+#include <linux/if_packet.h>
 #include <net/ethernet.h>
 #include <net/if.h>
 #include <net/if_arp.h>
-#include <net/if_packet.h>
 #include <net/route.h>
 #include <netinet/in.h>
 #include <stdlib.h>
@@ -127,8 +128,31 @@ struct netdev {
 
     int save_flags;             /* Initial device flags. */
     int changed_flags;          /* Flags that we changed. */
+
+    /* Batched receive. */
+    bool is_tap;                /* Receive with read() on 'tap_fd'? */
+    bool rx_ring_tried;         /* Tried to set up 'rx_ring'? */
+    struct netdev_rx_ring *rx_ring; /* Memory-mapped receive ring, if any. */
+};
+
+/* A TPACKET_V3 memory-mapped receive ring.  The kernel fills fixed-size
+ * blocks with variable-size frames and hands each block to userspace when it
+ * is full or when RX_RING_TIMEOUT_MS has passed since its first frame, so that
+ * a single poll() can make hundreds of packets available without any further
+ * system calls. */
+struct netdev_rx_ring {
+    uint8_t *map;               /* Start of the ring. */
+    unsigned int cur_block;     /* Block being consumed or to be consumed. */
+    unsigned int n_left;        /* Frames left in 'cur_block', or 0 if
+                                 * 'cur_block' has not been opened yet. */
+    uint8_t *next_frame;        /* Next frame in 'cur_block', if 'n_left'. */
 };
 
+#define RX_RING_BLOCK_SIZE (1u << 16)
+#define RX_RING_N_BLOCKS 32
+#define RX_RING_FRAME_SIZE 2048
+#define RX_RING_TIMEOUT_MS 1
+
 /* All open network devices. */
 static struct list netdev_list = LIST_INITIALIZER(&netdev_list);
 
@@ -139,6 +163,8 @@ static int af_inet_sock = -1;
  * additional log messages. */
 static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(5, 20);
 
+static int rx_ring_recv(struct netdev *, struct ofpbuf *buffers[], int n);
+
 static void init_netdev(void);
 static int do_open_netdev(const char *name, int ethertype, int tap_fd,
                           struct netdev **netdev_);
@@ -788,6 +814,9 @@ do_open_netdev(const char *name, int ethertype, int tap_fd,
     netdev->mtu = mtu;
     netdev->in6 = in6;
     netdev->num_queues = 0;
+    netdev->is_tap = tap_fd >= 0;
+    netdev->rx_ring_tried = false;
+    netdev->rx_ring = NULL;
 
     /* Get speed, features. */
     do_ethtool(netdev);
@@ -801,6 +830,7 @@ do_open_netdev(const char *name, int ethertype, int tap_fd,
     fatal_signal_block();
     list_push_back(&netdev_list, &netdev->node);
     fatal_signal_unblock();
+    poll_fd_register(netdev->tap_fd);
 
     /* Success! */
     *netdev_ = netdev;
@@ -837,6 +867,12 @@ netdev_close(struct netdev *netdev)
 
         /* Free. */
         free(netdev->name);
+        if (netdev->rx_ring) {
+            munmap(netdev->rx_ring->map,
+                   RX_RING_BLOCK_SIZE * RX_RING_N_BLOCKS);
+            free(netdev->rx_ring);
+        }
+        poll_fd_unregister(netdev->tap_fd);
         close(netdev->netdev_fd);
         if (netdev->netdev_fd != netdev->tap_fd) {
             close(netdev->tap_fd);
@@ -881,12 +917,16 @@ netdev_recv(struct netdev *netdev, struct ofpbuf *buffer)
     assert(buffer->size == 0);
     assert(ofpbuf_tailroom(buffer) >= ETH_TOTAL_MIN);
 
+    if (netdev->rx_ring) {
+        return rx_ring_recv(netdev, &buffer, 1) ? 0 : EAGAIN;
+    }
+
     /* prepare to call recvfrom */
     memset(&sll,0,sizeof sll);
     sll_len = sizeof sll;
 
     /* cannot execute recvfrom over a tap device */
-    if (!strncmp(netdev->name, "tap", 3)) {
+    if (netdev->is_tap) {
         do {
             n_bytes = read(netdev->tap_fd, ofpbuf_tail(buffer),
                            (ssize_t)ofpbuf_tailroom(buffer));
@@ -913,7 +953,6 @@ netdev_recv(struct netdev *netdev, struct ofpbuf *buffer)
             return EAGAIN;
         }
 
-
         buffer->size += n_bytes;
 
         /* When the kernel internally sends out an Ethernet frame on an
@@ -926,19 +965,270 @@ netdev_recv(struct netdev *netdev, struct ofpbuf *buffer)
     }
 }
 
+/* Attempts to set up a memory-mapped receive ring for 'netdev'.  Returns 0 if
+ * successful, otherwise a positive errno value, in which case 'netdev' keeps
+ * receiving through its socket. */
+static int
+rx_ring_create(struct netdev *netdev)
+{
+#ifdef TPACKET3_HDRLEN
+    int fd = netdev->netdev_fd;
+    int version = TPACKET_V3;
+    struct tpacket_req3 req;
+    void *map;
+    int error;
+
+    if (setsockopt(fd, SOL_PACKET, PACKET_VERSION,
+                   &version, sizeof version) < 0) {
+        return errno;
+    }
+
+    memset(&req, 0, sizeof req);
+    req.tp_block_size = RX_RING_BLOCK_SIZE;
+    req.tp_block_nr = RX_RING_N_BLOCKS;
+    req.tp_frame_size = RX_RING_FRAME_SIZE;
+    req.tp_frame_nr = (RX_RING_BLOCK_SIZE / RX_RING_FRAME_SIZE
+                       * RX_RING_N_BLOCKS);
+    req.tp_retire_blk_tov = RX_RING_TIMEOUT_MS;
+    if (setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof req) < 0) {
+        return errno;
+    }
+
+    map = mmap(NULL, RX_RING_BLOCK_SIZE * RX_RING_N_BLOCKS,
+               PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        error = errno;
+        memset(&req, 0, sizeof req);
+        setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof req);
+        return error;
+    }
+
+    netdev->rx_ring = xmalloc(sizeof *netdev->rx_ring);
+    netdev->rx_ring->map = map;
+    netdev->rx_ring->cur_block = 0;
+    netdev->rx_ring->n_left = 0;
+    netdev->rx_ring->next_frame = NULL;
+    return 0;
+#else
+    return EOPNOTSUPP;
+#endif
+}
+
+#ifdef TPACKET3_HDRLEN
+static struct tpacket_block_desc *
+rx_ring_block(const struct netdev_rx_ring *ring)
+{
+    return (struct tpacket_block_desc *) (ring->map
+                                          + (ring->cur_block
+                                             * RX_RING_BLOCK_SIZE));
+}
+
+/* Returns the block at the head of 'ring' to the kernel. */
+static void
+rx_ring_release_block(struct netdev_rx_ring *ring)
+{
+    struct tpacket_block_desc *bd = rx_ring_block(ring);
+
+    /* Finish reading the block before the kernel may overwrite it. */
+    __sync_synchronize();
+    bd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+    ring->cur_block = (ring->cur_block + 1) % RX_RING_N_BLOCKS;
+    ring->n_left = 0;
+}
+
+/* Makes the block at the head of 'ring' current, if the kernel has handed it
+ * to userspace.  Returns true if successful, false if no packets are ready. */
+static bool
+rx_ring_open_block(struct netdev_rx_ring *ring)
+{
+    struct tpacket_block_desc *bd = rx_ring_block(ring);
+
+    while (!ring->n_left) {
+        if (!(bd->hdr.bh1.block_status & TP_STATUS_USER)) {
+            return false;
+        }
+        /* Read the block status before the block contents. */
+        __sync_synchronize();
+        ring->n_left = bd->hdr.bh1.num_pkts;
+        ring->next_frame = (uint8_t *) bd + bd->hdr.bh1.offset_to_first_pkt;
+        if (!ring->n_left) {
+            rx_ring_release_block(ring);
+            bd = rx_ring_block(ring);
+        }
+    }
+    return true;
+}
+#endif
+
+/* Receives up to 'n' packets from 'netdev''s receive ring into 'buffers',
+ * copying them out of the ring so that its blocks can be returned to the
+ * kernel promptly.  Returns the number of packets received. */
+static int
+rx_ring_recv(struct netdev *netdev, struct ofpbuf *buffers[], int n)
+{
+    int n_recv = 0;
+#ifdef TPACKET3_HDRLEN
+    struct netdev_rx_ring *ring = netdev->rx_ring;
+
+    while (n_recv < n && rx_ring_open_block(ring)) {
+        struct tpacket3_hdr *frame = (struct tpacket3_hdr *) ring->next_frame;
+        const struct sockaddr_ll *sll;
+
+        ring->next_frame += frame->tp_next_offset;
+        sll = (const struct sockaddr_ll *)
+            ((uint8_t *) frame + TPACKET_ALIGN(sizeof *frame));
+        if (sll->sll_pkttype != PACKET_OUTGOING) {
+            struct ofpbuf *buffer = buffers[n_recv++];
+            size_t len = MIN(frame->tp_snaplen, ofpbuf_tailroom(buffer));
+
+            ofpbuf_put(buffer, (uint8_t *) frame + frame->tp_mac, len);
+            pad_to_minimum_length(buffer);
+        }
+        if (!--ring->n_left) {
+            rx_ring_release_block(ring);
+        }
+    }
+#endif
+    return n_recv;
+}
+
+/* Returns true if 'netdev''s receive ring has packets ready to receive. */
+static bool
+rx_ring_ready(const struct netdev *netdev)
+{
+#ifdef TPACKET3_HDRLEN
+    const struct netdev_rx_ring *ring = netdev->rx_ring;
+    return (ring->n_left
+            || rx_ring_block(ring)->hdr.bh1.block_status & TP_STATUS_USER);
+#else
+    return false;
+#endif
+}
+
+/* Receives up to 'n' packets from 'netdev''s socket into 'buffers' with a
+ * single recvmmsg() call.  Returns the number of packets received or a
+ * negative errno value. */
+static int
+recvmmsg_batch(struct netdev *netdev, struct ofpbuf *buffers[], int n)
+{
+    struct mmsghdr msgs[NETDEV_MAX_BATCH];
+    struct iovec iovs[NETDEV_MAX_BATCH];
+    struct sockaddr_ll slls[NETDEV_MAX_BATCH];
+    int retval;
+    int i, n_recv;
+
+    n = MIN(n, NETDEV_MAX_BATCH);
+    memset(msgs, 0, n * sizeof *msgs);
+    for (i = 0; i < n; i++) {
+        iovs[i].iov_base = ofpbuf_tail(buffers[i]);
+        iovs[i].iov_len = ofpbuf_tailroom(buffers[i]);
+        msgs[i].msg_hdr.msg_name = &slls[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof slls[i];
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    do {
+        retval = recvmmsg(netdev->tap_fd, msgs, n, MSG_DONTWAIT, NULL);
+    } while (retval < 0 && errno == EINTR);
+    if (retval < 0) {
+        return -errno;
+    }
+
+    /* Drop our own transmitted packets, moving the packets that we keep to
+     * the front of 'buffers'. */
+    n_recv = 0;
+    for (i = 0; i < retval; i++) {
+        if (slls[i].sll_pkttype != PACKET_OUTGOING) {
+            struct ofpbuf *buffer = buffers[i];
+
+            buffer->size += msgs[i].msg_len;
+            pad_to_minimum_length(buffer);
+            buffers[i] = buffers[n_recv];
+            buffers[n_recv++] = buffer;
+        }
+    }
+    return n_recv;
+}
+
+/* Attempts to receive up to 'n' packets from 'netdev' into 'buffers', each of
+ * which the caller must have initialized as for netdev_recv().  This is more
+ * efficient than calling netdev_recv() 'n' times: packets come from a
+ * memory-mapped ring if the kernel supports one, otherwise from a single
+ * recvmmsg() call.
+ *
+ * If any packets are received, returns 0 and stores the number received in
+ * '*n_recvp'.  The packets are in buffers[0] through buffers[*n_recvp - 1];
+ * the order of the pointers in 'buffers' may change.  Otherwise, returns a
+ * positive errno value, EAGAIN if no packet is ready to be returned. */
+int
+netdev_recv_batch(struct netdev *netdev, struct ofpbuf *buffers[], int n,
+                  int *n_recvp)
+{
+    int n_recv;
+
+    *n_recvp = 0;
+    if (!netdev->rx_ring_tried && !netdev->is_tap) {
+        int error = rx_ring_create(netdev);
+        if (error) {
+            VLOG_INFO("%s: not using memory-mapped receive ring (%s)",
+                      netdev->name, strerror(error));
+        }
+        netdev->rx_ring_tried = true;
+    }
+
+    if (netdev->rx_ring) {
+        n_recv = rx_ring_recv(netdev, buffers, n);
+    } else if (!netdev->is_tap) {
+        n_recv = recvmmsg_batch(netdev, buffers, n);
+        if (n_recv < 0) {
+            if (n_recv != -EAGAIN) {
+                VLOG_WARN_RL(&rl, "error receiving Ethernet packets on %s: "
+                             "%s", netdev->name, strerror(-n_recv));
+            }
+            return -n_recv;
+        }
+    } else {
+        for (n_recv = 0; n_recv < n; n_recv++) {
+            int error = netdev_recv(netdev, buffers[n_recv]);
+            if (error) {
+                if (!n_recv) {
+                    return error;
+                }
+                break;
+            }
+        }
+    }
+
+    *n_recvp = n_recv;
+    return n_recv ? 0 : EAGAIN;
+}
+
 /* Registers with the poll loop to wake up from the next call to poll_block()
  * when a packet is ready to be received with netdev_recv() on 'netdev'. */
 void
 netdev_recv_wait(struct netdev *netdev)
 {
-    poll_fd_wait(netdev->tap_fd, POLLIN);
+    if (netdev->rx_ring && rx_ring_ready(netdev)) {
+        /* A batch stopped partway through a block. */
+        poll_immediate_wake();
+    } else {
+        poll_fd_wait(netdev->tap_fd, POLLIN);
+    }
 }
 
 /* Discards all packets waiting to be received from 'netdev'. */
 int
 netdev_drain(struct netdev *netdev)
 {
-    if (netdev->tap_fd != netdev->netdev_fd) {
+    if (netdev->rx_ring) {
+#ifdef TPACKET3_HDRLEN
+        while (rx_ring_open_block(netdev->rx_ring)) {
+            rx_ring_release_block(netdev->rx_ring);
+        }
+#endif
+        return 0;
+    } else if (netdev->tap_fd != netdev->netdev_fd) {
         drain_fd(netdev->tap_fd, netdev->txqlen);
         return 0;
     } else {
@@ -992,6 +1282,80 @@ netdev_send(struct netdev *netdev, const struct ofpbuf *buffer,
     }
 }
 
+/* Sends the 'n' packets in 'buffers' on 'netdev', in order, with as few
+ * system calls as possible: sendmmsg() on packet sockets, one write() per
+ * packet on tap devices.  Stores 0 in errors[i] if buffers[i] was sent,
+ * otherwise a positive errno value with the same meaning as for
+ * netdev_send().  A packet that cannot be sent does not prevent the packets
+ * after it from being sent.  Returns the number of packets sent.
+ *
+ * class_id and ownership of 'buffers' are as for netdev_send(). */
+int
+netdev_send_batch(struct netdev *netdev, struct ofpbuf *const buffers[],
+                  int n, uint16_t class_id, int errors[])
+{
+    struct mmsghdr msgs[NETDEV_MAX_BATCH];
+    struct iovec iovs[NETDEV_MAX_BATCH];
+    int n_sent = 0;
+    int fd;
+    int i;
+
+    assert(class_id <= NETDEV_MAX_QUEUES);
+    fd = netdev->queue_fd[class_id];
+
+    if (netdev->is_tap) {
+        for (i = 0; i < n; i++) {
+            errors[i] = netdev_send(netdev, buffers[i], class_id);
+            n_sent += !errors[i];
+        }
+        return n_sent;
+    }
+
+    for (i = 0; i < n; ) {
+        int n_batch = MIN(n - i, NETDEV_MAX_BATCH);
+        int retval;
+        int j;
+
+        memset(msgs, 0, n_batch * sizeof *msgs);
+        for (j = 0; j < n_batch; j++) {
+            iovs[j].iov_base = buffers[i + j]->data;
+            iovs[j].iov_len = buffers[i + j]->size;
+            msgs[j].msg_hdr.msg_iov = &iovs[j];
+            msgs[j].msg_hdr.msg_iovlen = 1;
+        }
+
+        do {
+            retval = sendmmsg(fd, msgs, n_batch, 0);
+        } while (retval < 0 && errno == EINTR);
+
+        if (retval < 0) {
+            /* sendmmsg() stops at the first packet that fails and reports
+             * the error only if that was the first packet, so this is always
+             * the error for buffers[i]. */
+            int error = errno == ENOBUFS ? EAGAIN : errno;
+            if (error != EAGAIN) {
+                VLOG_WARN_RL(&rl, "error sending Ethernet packet on %s: %s",
+                             netdev->name, strerror(error));
+            }
+            errors[i++] = error;
+            continue;
+        }
+
+        for (j = 0; j < retval; j++, i++) {
+            if (msgs[j].msg_len != buffers[i]->size) {
+                VLOG_WARN_RL(&rl, "send partial Ethernet packet (%u bytes of "
+                             "%zu) on %s", msgs[j].msg_len,
+                             buffers[i]->size, netdev->name);
+                errors[i] = EMSGSIZE;
+            } else {
+                errors[i] = 0;
+                n_sent++;
+            }
+        }
+    }
+    return n_sent;
+}
+
 /* Registers with the poll loop to wake up from the next call to poll_block()
  * when the packet transmission queue has sufficient room to transmit a packet
  * with netdev_send().
@@ -1046,6 +1410,14 @@ netdev_get_name(const struct netdev *netdev)
     return netdev->name;
 }
 
+/* Returns a file descriptor that becomes readable when a packet can be
+ * received on 'netdev', for use by threads that cannot use the poll loop. */
+int
+netdev_get_fd(const struct netdev *netdev)
+{
+    return netdev->tap_fd;
+}
+
 /* Returns the maximum size of transmitted (and received) packets on 'netdev',
  * in bytes, not including the hardware header; thus, this is typically 1500
  * bytes for Ethernet devices. */
@@ -70,6 +70,10 @@ enum netdev_pseudo_ethertype {
 
 #define NETDEV_MAX_QUEUES 8
 
+/* Maximum number of packets received by one call to netdev_recv_batch(), and
+ * sent by one system call in netdev_send_batch(). */
+#define NETDEV_MAX_BATCH 64
+
 struct netdev;
 
 int netdev_open(const char *name, int ethertype, struct netdev **);
@@ -77,14 +81,19 @@ int netdev_open_tap(const char *name, struct netdev **);
 void netdev_close(struct netdev *);
 
 int netdev_recv(struct netdev *, struct ofpbuf *);
+int netdev_recv_batch(struct netdev *, struct ofpbuf *buffers[], int n,
+                      int *n_recvp);
 void netdev_recv_wait(struct netdev *);
 int netdev_drain(struct netdev *);
 int netdev_send(struct netdev *, const struct ofpbuf *, uint16_t class_id);
+int netdev_send_batch(struct netdev *, struct ofpbuf *const buffers[], int n,
+                      uint16_t class_id, int errors[]);
 void netdev_send_wait(struct netdev *);
 int netdev_set_etheraddr(struct netdev *, const uint8_t mac[6]);
 const uint8_t *netdev_get_etheraddr(const struct netdev *);
 const char *netdev_get_name(const struct netdev *);
 int netdev_get_mtu(const struct netdev *);
+int netdev_get_fd(const struct netdev *);
 uint32_t netdev_get_features(struct netdev *, int);
 bool netdev_get_in4(const struct netdev *, struct in_addr *);
 int netdev_set_in4(struct netdev *, struct in_addr addr, struct in_addr mask);
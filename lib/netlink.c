@@ -180,6 +180,7 @@ nl_sock_create(int protocol, int multicast_group,
         goto error_free_pid;
     }
 
+    poll_fd_register(sock->fd);
     *sockp = sock;
     return 0;
 
@@ -204,6 +205,7 @@ void
 nl_sock_destroy(struct nl_sock *sock) 
 {
     if (sock) {
+        poll_fd_unregister(sock->fd);
         close(sock->fd);
         free_pid(sock->pid);
         free(sock);
@@ -49,6 +49,7 @@
 #include "ofpbuf.h"
 #include "openflow/openflow.h"
 #include "openflow/nicira-ext.h"
+#include "openflow/openflow-ext.h"
 #include "packets.h"
 #include "pcap.h"
 #include "util.h"
@@ -1159,10 +1160,35 @@ ofp_table_stats_reply(struct ds *string, const void *body, size_t len,
      }
 }
 
+static void
+ext_counters_stats_reply(struct ds *string, const void *body, size_t len)
+{
+    const struct ofp_ext_counter *oec = body;
+    size_t n = len / sizeof *oec;
+
+    for (; n--; oec++) {
+        ds_put_format(string, "  %-*.*s %"PRIu64"\n",
+                      OFP_EXT_COUNTER_NAME_LEN, OFP_EXT_COUNTER_NAME_LEN,
+                      oec->name, ntohll(oec->value));
+    }
+}
+
 static void
 vendor_stat(struct ds *string, const void *body, size_t len,
             int verbosity UNUSED)
 {
+    const struct ofp_extension_stats_header *osh = body;
+
+    if (len >= sizeof *osh && ntohl(osh->vendor) == OPENFLOW_VENDOR_ID) {
+        uint32_t subtype = ntohl(osh->subtype);
+
+        ds_put_format(string, " vendor=openflow subtype=%"PRIu32"\n",
+                      subtype);
+        if (subtype == OFP_EXT_STATS_COUNTERS) {
+            ext_counters_stats_reply(string, osh + 1, len - sizeof *osh);
+        }
+        return;
+    }
     ds_put_format(string, " vendor=%08"PRIx32, ntohl(*(uint32_t *) body));
     ds_put_format(string, " %zu bytes additional data",
                   len - sizeof(uint32_t));
@@ -1249,15 +1275,15 @@ print_stats(struct ds *string, int type, const void *body, size_t body_len,
     const struct stats_type *s;
     const struct stats_msg *m;
 
-    if (type >= ARRAY_SIZE(stats_types) || !stats_types[type].name) {
-        ds_put_format(string, " ***unknown type %d***", type);
-        return;
-    }
     for (s = stats_types; s->type >= 0; s++) {
         if (s->type == type) {
             break;
         }
     }
+    if (s->type < 0) {
+        ds_put_format(string, " ***unknown type %d***", type);
+        return;
+    }
     ds_put_format(string, " type=%d(%s)\n", type, s->name);
 
     m = direction == REQUEST ? &s->request : &s->reply;
@@ -54,6 +54,9 @@ ofpbuf_use(struct ofpbuf *b, void *base, size_t allocated)
     b->l2 = b->l3 = b->l4 = b->l7 = NULL;
     b->next = NULL;
     b->private = NULL;
+    b->pool = NULL;
+    b->shared = NULL;
+    b->n_refs = 0;
 }
 
 /* Initializes 'b' as an empty ofpbuf with an initial capacity of 'size'
@@ -64,12 +67,18 @@ ofpbuf_init(struct ofpbuf *b, size_t size)
     ofpbuf_use(b, size ? xmalloc(size) : NULL, size);
 }
 
+static void ofpbuf_unref(struct ofpbuf *);
+
 /* Frees memory that 'b' points to. */
 void
 ofpbuf_uninit(struct ofpbuf *b) 
 {
     if (b) {
-        free(b->base);
+        if (b->shared) {
+            ofpbuf_unref(b->shared);
+        } else {
+            free(b->base);
+        }
     }
 }
 
@@ -91,9 +100,19 @@ ofpbuf_new(size_t size)
     return b;
 }
 
+/* Creates and returns a new ofpbuf that contains a copy of the data in
+ * 'buffer'.  If 'buffer' came from a pool and its data fits, so does the
+ * copy. */
 struct ofpbuf *
 ofpbuf_clone(const struct ofpbuf *buffer)
 {
+    struct ofpbuf_pool *pool = (buffer->shared ? buffer->shared->pool
+                                : buffer->pool);
+    if (pool && buffer->size <= pool->size) {
+        struct ofpbuf *b = ofpbuf_pool_get(pool);
+        ofpbuf_put(b, buffer->data, buffer->size);
+        return b;
+    }
     return ofpbuf_clone_data(buffer->data, buffer->size);
 }
 
@@ -105,14 +124,199 @@ ofpbuf_clone_data(const void *data, size_t size)
     return b;
 }
 
-/* Frees memory that 'b' points to, as well as 'b' itself. */
+static void ofpbuf_pool_put(struct ofpbuf_pool *, struct ofpbuf *);
+
+/* Frees memory that 'b' points to, as well as 'b' itself, or returns 'b' to
+ * the pool that it came from. */
 void
 ofpbuf_delete(struct ofpbuf *b) 
 {
     if (b) {
+        if (b->pool) {
+            ofpbuf_pool_put(b->pool, b);
+        } else {
+            ofpbuf_uninit(b);
+            free(b);
+        }
+    }
+}
+
+/* Drops a reference to 'owner', the owner of some shared data, and frees it
+ * when the last reference goes away. */
+static void
+ofpbuf_unref(struct ofpbuf *owner)
+{
+    assert(owner->n_refs > 0);
+    if (!--owner->n_refs) {
+        ofpbuf_delete(owner);
+    }
+}
+
+/* Points 'b' at the 'new_allocated' bytes at 'new_base', which must already
+ * contain a copy of its data at the same offset as in its old memory. */
+static void
+ofpbuf_rebase(struct ofpbuf *b, void *new_base, size_t new_allocated)
+{
+    uintptr_t base_delta = (char*)new_base - (char*)b->base;
+
+    b->base = new_base;
+    b->allocated = new_allocated;
+    b->data = (char*)b->data + base_delta;
+    if (b->l2) {
+        b->l2 = (char*)b->l2 + base_delta;
+    }
+    if (b->l3) {
+        b->l3 = (char*)b->l3 + base_delta;
+    }
+    if (b->l4) {
+        b->l4 = (char*)b->l4 + base_delta;
+    }
+    if (b->l7) {
+        b->l7 = (char*)b->l7 + base_delta;
+    }
+}
+
+/* Creates and returns a new ofpbuf that refers to the same data as 'b',
+ * without copying it, e.g. to send one packet to several ports or several
+ * controllers.  'b' and the new ofpbuf each have their own 'data', 'size' and
+ * layer pointers, so either may pull or truncate its data freely, but each
+ * must call ofpbuf_make_writable() before modifying the data in place.
+ * Functions that add data to an ofpbuf, such as ofpbuf_put() and
+ * ofpbuf_push(), do so automatically.
+ *
+ * The data is freed when the last ofpbuf that refers to it is deleted. */
+struct ofpbuf *
+ofpbuf_share(struct ofpbuf *b)
+{
+    struct ofpbuf *copy;
+
+    if (!b->shared) {
+        /* Hand 'b''s memory, and its place in a pool, to a new owner. */
+        struct ofpbuf *owner = xmemdup(b, sizeof *b);
+        owner->next = NULL;
+        owner->private = NULL;
+        owner->n_refs = 1;
+        b->pool = NULL;
+        b->shared = owner;
+    }
+
+    copy = xmemdup(b, sizeof *b);
+    copy->next = NULL;
+    copy->private = NULL;
+    b->shared->n_refs++;
+    return copy;
+}
+
+/* Ensures that 'b''s data may be modified in place, by copying it if it is
+ * shared with another ofpbuf. */
+void
+ofpbuf_make_writable(struct ofpbuf *b)
+{
+    if (ofpbuf_is_shared(b)) {
+        struct ofpbuf_pool *pool = b->shared->pool;
+        struct ofpbuf *owner = NULL;
+        size_t headroom = ofpbuf_headroom(b);
+
+        /* Take the copy from the pool that the original came from, if its
+         * buffers are big enough. */
+        if (pool) {
+            owner = ofpbuf_pool_get(pool);
+            if (owner->allocated < b->allocated) {
+                ofpbuf_delete(owner);
+                owner = NULL;
+            }
+        }
+        if (!owner) {
+            owner = ofpbuf_new(b->allocated);
+        }
+        memcpy((char*)owner->base + headroom, b->data, b->size);
+        owner->n_refs = 1;
+
+        ofpbuf_unref(b->shared);
+        b->shared = owner;
+        ofpbuf_rebase(b, owner->base, owner->allocated);
+    }
+}
+
+/* Initializes 'pool' to hand out ofpbufs with 'headroom' bytes of headroom and
+ * at least 'size' bytes of tailroom, keeping at most 'max_buffers' of them. */
+void
+ofpbuf_pool_init(struct ofpbuf_pool *pool, size_t headroom, size_t size,
+                 unsigned int max_buffers)
+{
+    pool->free = NULL;
+    pool->headroom = headroom;
+    pool->size = size;
+    pool->n_buffers = 0;
+    pool->n_free = 0;
+    pool->max_buffers = max_buffers;
+    pool->n_exhausted = 0;
+}
+
+/* Increases the minimum tailroom of ofpbufs obtained from 'pool' to 'size',
+ * if it is not already at least that large.  Smaller ofpbufs are freed as
+ * they come back to the pool. */
+void
+ofpbuf_pool_set_size(struct ofpbuf_pool *pool, size_t size)
+{
+    if (size > pool->size) {
+        pool->size = size;
+        while (pool->free) {
+            struct ofpbuf *b = pool->free;
+            pool->free = b->next;
+            pool->n_free--;
+            pool->n_buffers--;
+            ofpbuf_uninit(b);
+            free(b);
+        }
+    }
+}
+
+/* Returns an empty ofpbuf with 'pool->headroom' bytes of headroom and at least
+ * 'pool->size' bytes of tailroom.  The caller should eventually free it with
+ * ofpbuf_delete(). */
+struct ofpbuf *
+ofpbuf_pool_get(struct ofpbuf_pool *pool)
+{
+    struct ofpbuf *b = pool->free;
+
+    if (b) {
+        pool->free = b->next;
+        pool->n_free--;
+        b->next = NULL;
+        return b;
+    }
+
+    b = ofpbuf_new(pool->headroom + pool->size);
+    ofpbuf_reserve(b, pool->headroom);
+    if (pool->n_buffers < pool->max_buffers) {
+        pool->n_buffers++;
+        b->pool = pool;
+    } else {
+        pool->n_exhausted++;
+    }
+    return b;
+}
+
+static void
+ofpbuf_pool_put(struct ofpbuf_pool *pool, struct ofpbuf *b)
+{
+    if (b->allocated < pool->headroom + pool->size) {
+        /* Reinitialized by its user, or allocated before the last call to
+         * ofpbuf_pool_set_size(). */
+        pool->n_buffers--;
         ofpbuf_uninit(b);
         free(b);
+        return;
     }
+
+    b->data = (char *) b->base + pool->headroom;
+    b->size = 0;
+    b->l2 = b->l3 = b->l4 = b->l7 = NULL;
+    b->private = NULL;
+    b->next = pool->free;
+    pool->free = b;
+    pool->n_free++;
 }
 
 /* Returns the number of bytes of headroom in 'b', that is, the number of bytes
@@ -141,24 +345,14 @@ ofpbuf_prealloc_tailroom(struct ofpbuf *b, size_t size)
     if (size > ofpbuf_tailroom(b)) {
         size_t new_allocated = b->allocated + MAX(size, 64);
         void *new_base = xmalloc(new_allocated);
-        uintptr_t base_delta = (char*)new_base - (char*)b->base;
         memcpy(new_base, b->base, b->allocated);
-        free(b->base);
-        b->base = new_base;
-        b->allocated = new_allocated;
-        b->data = (char*)b->data + base_delta;
-        if (b->l2) {
-            b->l2 = (char*)b->l2 + base_delta;
-        }
-        if (b->l3) {
-            b->l3 = (char*)b->l3 + base_delta;
-        }
-        if (b->l4) {
-            b->l4 = (char*)b->l4 + base_delta;
-        }
-        if (b->l7) {
-            b->l7 = (char*)b->l7 + base_delta;
+        if (b->shared) {
+            ofpbuf_unref(b->shared);
+            b->shared = NULL;
+        } else {
+            free(b->base);
         }
+        ofpbuf_rebase(b, new_base, new_allocated);
     }
 }
 
@@ -175,6 +369,7 @@ void *
 ofpbuf_put_uninit(struct ofpbuf *b, size_t size) 
 {
     void *p;
+    ofpbuf_make_writable(b);
     ofpbuf_prealloc_tailroom(b, size);
     p = ofpbuf_tail(b);
     b->size += size;
@@ -216,6 +411,7 @@ ofpbuf_reserve(struct ofpbuf *b, size_t size)
 void *
 ofpbuf_push_uninit(struct ofpbuf *b, size_t size) 
 {
+    ofpbuf_make_writable(b);
     ofpbuf_prealloc_headroom(b, size);
     b->data = (char*)b->data - size;
     b->size += size;
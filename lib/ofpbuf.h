@@ -34,6 +34,7 @@
 #ifndef OFPBUF_H
 #define OFPBUF_H 1
 
+#include <stdbool.h>
 #include <stddef.h>
 
 /* Buffer for holding arbitrary data.  An ofpbuf is automatically reallocated
@@ -52,6 +53,31 @@ struct ofpbuf {
 
     struct ofpbuf *next;        /* Next in a list of ofpbufs. */
     void *private;              /* Private pointer for use by owner. */
+    struct ofpbuf_pool *pool;   /* Pool that owns this ofpbuf, or NULL. */
+
+    /* Shared data.  An ofpbuf created by ofpbuf_share() points into memory
+     * owned by a hidden ofpbuf 'shared', which counts its sharers in
+     * 'n_refs'. */
+    struct ofpbuf *shared;      /* Owner of the memory 'base' points to. */
+    unsigned int n_refs;        /* In an owner, the number of sharers. */
+};
+
+/* A pool of ofpbufs that all have the same amount of headroom and at least the
+ * same amount of tailroom, for code that allocates and frees many packet-sized
+ * buffers.  ofpbuf_delete() returns an ofpbuf obtained from the pool to the
+ * pool instead of freeing it.
+ *
+ * The pool holds at most 'max_buffers' ofpbufs.  When all of them are in use,
+ * ofpbuf_pool_get() falls back to ordinary allocation. */
+struct ofpbuf_pool {
+    struct ofpbuf *free;        /* Free ofpbufs, linked through 'next'. */
+    size_t headroom;            /* Headroom of each ofpbuf. */
+    size_t size;                /* Minimum tailroom of each ofpbuf. */
+    unsigned int n_buffers;     /* Number of ofpbufs owned by the pool. */
+    unsigned int n_free;        /* Number of ofpbufs in 'free'. */
+    unsigned int max_buffers;   /* Maximum value of 'n_buffers'. */
+    unsigned long long int n_exhausted; /* ofpbuf_pool_get() calls that found
+                                         * every buffer in use. */
 };
 
 void ofpbuf_use(struct ofpbuf *, void *, size_t);
@@ -65,6 +91,20 @@ struct ofpbuf *ofpbuf_clone(const struct ofpbuf *);
 struct ofpbuf *ofpbuf_clone_data(const void *, size_t);
 void ofpbuf_delete(struct ofpbuf *);
 
+struct ofpbuf *ofpbuf_share(struct ofpbuf *);
+void ofpbuf_make_writable(struct ofpbuf *);
+
+static inline bool
+ofpbuf_is_shared(const struct ofpbuf *b)
+{
+    return b->shared && b->shared->n_refs > 1;
+}
+
+void ofpbuf_pool_init(struct ofpbuf_pool *, size_t headroom, size_t size,
+                      unsigned int max_buffers);
+void ofpbuf_pool_set_size(struct ofpbuf_pool *, size_t size);
+struct ofpbuf *ofpbuf_pool_get(struct ofpbuf_pool *);
+
 void *ofpbuf_at(const struct ofpbuf *, size_t offset, size_t size);
 void *ofpbuf_at_assert(const struct ofpbuf *, size_t offset, size_t size);
 void *ofpbuf_tail(const struct ofpbuf *);
@@ -36,8 +36,12 @@
 #include <assert.h>
 #include <errno.h>
 #include <poll.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
 #include "backtrace.h"
 #include "dynamic-string.h"
 #include "list.h"
@@ -57,8 +61,8 @@ struct poll_waiter {
     struct backtrace *backtrace; /* Optionally, event that created waiter. */
 
     /* Set only when poll_block() is called. */
-    struct pollfd *pollfd;      /* Pointer to element of the pollfds array
-                                   (null if added from a callback). */
+    short int revents;          /* Events that occurred on 'fd' (always 0 if
+                                   added from a callback). */
 };
 
 /* All active poll waiters. */
@@ -67,6 +71,11 @@ static struct list waiters = LIST_INITIALIZER(&waiters);
 /* Number of elements in the waiters list. */
 static size_t n_waiters;
 
+/* Poll waiters that have been canceled, kept for reuse so that a main loop
+ * that waits on the same fds each time around does not call malloc() for
+ * them every time. */
+static struct list free_waiters = LIST_INITIALIZER(&free_waiters);
+
 /* Max time to wait in next call to poll_block(), in milliseconds, or -1 to
  * wait forever. */
 static int timeout = -1;
@@ -81,6 +90,46 @@ static struct poll_waiter *running_cb;
 #endif
 
 static struct poll_waiter *new_waiter(int fd, short int events);
+static int poll_wait(void);
+#ifdef HAVE_EPOLL
+/* When epoll is available, poll_block() waits with it instead of with poll(),
+ * so that fds that are waited on every time around the main loop do not have
+ * to be passed to the kernel and examined afresh each time.  An fd passed to
+ * poll_fd_register() stays registered with 'epoll_fd' between calls and costs
+ * a system call only when the events waited for on it change.  Any other fd is
+ * registered just for the duration of one call to poll_block(), because
+ * nothing tells the poll loop when it is closed and its number reused.
+ *
+ * The EPOLL* and POLL* event bits have the same values. */
+BUILD_ASSERT_DECL(EPOLLIN == POLLIN);
+BUILD_ASSERT_DECL(EPOLLOUT == POLLOUT);
+BUILD_ASSERT_DECL(EPOLLERR == POLLERR);
+BUILD_ASSERT_DECL(EPOLLHUP == POLLHUP);
+
+/* State of one fd, in 'poll_fds' indexed by fd number. */
+struct poll_fd {
+    unsigned int serial;        /* 'epoll_serial' when last waited on. */
+    uint32_t events;            /* Events waited for, if 'serial' current. */
+    uint32_t revents;           /* Events that occurred, if 'serial' current. */
+    uint32_t kernel_events;     /* Events registered with 'epoll_fd'. */
+    bool in_kernel;             /* Registered with 'epoll_fd'? */
+    bool persistent;            /* Passed to poll_fd_register()? */
+};
+
+static struct poll_fd *poll_fds;
+static int n_poll_fds;
+
+/* Incremented by each call to epoll_block(). */
+static unsigned int epoll_serial;
+
+/* The epoll fd, or -1 if not yet created or if epoll cannot be used. */
+static int epoll_fd = -1;
+
+static struct poll_fd *get_poll_fd(int fd);
+static bool epoll_open(void);
+static int epoll_block(void);
+static void epoll_remove(int fd, struct poll_fd *);
+#endif
 
 /* Registers 'fd' as waiting for the specified 'events' (which should be POLLIN
  * or POLLOUT or POLLIN | POLLOUT).  The following call to poll_block() will
@@ -153,30 +202,16 @@ log_wakeup(const struct backtrace *backtrace, const char *format, ...)
 void
 poll_block(void)
 {
-    static struct pollfd *pollfds;
-    static size_t max_pollfds;
-
     struct poll_waiter *pw;
     struct list *node;
-    int n_pollfds;
     int retval;
 
     assert(!running_cb);
-    if (max_pollfds < n_waiters) {
-        max_pollfds = n_waiters;
-        pollfds = xrealloc(pollfds, max_pollfds * sizeof *pollfds);
-    }
-
-    n_pollfds = 0;
-    LIST_FOR_EACH (pw, struct poll_waiter, node, &waiters) {
-        pw->pollfd = &pollfds[n_pollfds];
-        pollfds[n_pollfds].fd = pw->fd;
-        pollfds[n_pollfds].events = pw->events;
-        pollfds[n_pollfds].revents = 0;
-        n_pollfds++;
-    }
-
-    retval = time_poll(pollfds, n_pollfds, timeout);
+#ifdef HAVE_EPOLL
+    retval = epoll_open() ? epoll_block() : poll_wait();
+#else
+    retval = poll_wait();
+#endif
     if (retval < 0) {
         static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(1, 5);
         VLOG_ERR_RL(&rl, "poll: %s", strerror(-retval));
@@ -186,7 +221,7 @@ poll_block(void)
 
     for (node = waiters.next; node != &waiters; ) {
         pw = CONTAINER_OF(node, struct poll_waiter, node);
-        if (!pw->pollfd || !pw->pollfd->revents) {
+        if (!pw->revents) {
             if (pw->function) {
                 node = node->next;
                 continue;
@@ -194,11 +229,11 @@ poll_block(void)
         } else {
             if (VLOG_IS_DBG_ENABLED()) {
                 log_wakeup(pw->backtrace, "%s%s%s%s%s on fd %d",
-                           pw->pollfd->revents & POLLIN ? "[POLLIN]" : "",
-                           pw->pollfd->revents & POLLOUT ? "[POLLOUT]" : "",
-                           pw->pollfd->revents & POLLERR ? "[POLLERR]" : "",
-                           pw->pollfd->revents & POLLHUP ? "[POLLHUP]" : "",
-                           pw->pollfd->revents & POLLNVAL ? "[POLLNVAL]" : "",
+                           pw->revents & POLLIN ? "[POLLIN]" : "",
+                           pw->revents & POLLOUT ? "[POLLOUT]" : "",
+                           pw->revents & POLLERR ? "[POLLERR]" : "",
+                           pw->revents & POLLHUP ? "[POLLHUP]" : "",
+                           pw->revents & POLLNVAL ? "[POLLNVAL]" : "",
                            pw->fd);
             }
 
@@ -206,7 +241,7 @@ poll_block(void)
 #ifndef NDEBUG
                 running_cb = pw;
 #endif
-                pw->function(pw->fd, pw->pollfd->revents, pw->aux);
+                pw->function(pw->fd, pw->revents, pw->aux);
 #ifndef NDEBUG
                 running_cb = NULL;
 #endif
@@ -256,17 +291,60 @@ poll_cancel(struct poll_waiter *pw)
         assert(pw != running_cb);
         list_remove(&pw->node);
         free(pw->backtrace);
-        free(pw);
+        list_push_front(&free_waiters, &pw->node);
         n_waiters--;
     }
 }
 
+/* Tells the poll loop that 'fd' is long-lived, so that it may keep 'fd'
+ * registered with the kernel from one call to poll_block() to the next
+ * instead of registering it afresh each time it is waited on.  The caller
+ * must call poll_fd_unregister() before closing 'fd'.
+ *
+ * This is only an optimization: poll_fd_wait() and poll_fd_callback() work
+ * the same way whether or not 'fd' is registered. */
+void
+poll_fd_register(int fd)
+{
+#ifdef HAVE_EPOLL
+    get_poll_fd(fd)->persistent = true;
+#else
+    (void) fd;
+#endif
+}
+
+/* Undoes the effect of poll_fd_register() for 'fd', which the caller is about
+ * to close. */
+void
+poll_fd_unregister(int fd)
+{
+#ifdef HAVE_EPOLL
+    if (fd >= 0 && fd < n_poll_fds) {
+        struct poll_fd *pf = &poll_fds[fd];
+        if (pf->in_kernel) {
+            epoll_remove(fd, pf);
+        }
+        pf->persistent = false;
+    }
+#else
+    (void) fd;
+#endif
+}
+
 /* Creates and returns a new poll_waiter for 'fd' and 'events'. */
 static struct poll_waiter *
 new_waiter(int fd, short int events)
 {
-    struct poll_waiter *waiter = xcalloc(1, sizeof *waiter);
+    struct poll_waiter *waiter;
+
     assert(fd >= 0);
+    if (!list_is_empty(&free_waiters)) {
+        waiter = CONTAINER_OF(list_pop_front(&free_waiters),
+                              struct poll_waiter, node);
+        memset(waiter, 0, sizeof *waiter);
+    } else {
+        waiter = xcalloc(1, sizeof *waiter);
+    }
     waiter->fd = fd;
     waiter->events = events;
     if (VLOG_IS_DBG_ENABLED()) {
@@ -277,3 +355,233 @@ new_waiter(int fd, short int events)
     n_waiters++;
     return waiter;
 }
+
+/* Waits for events with poll(), setting the 'revents' member of each poll
+ * waiter.  Returns the value returned by time_poll(). */
+static int
+poll_wait(void)
+{
+    static struct pollfd *pollfds;
+    static size_t max_pollfds;
+
+    struct poll_waiter *pw;
+    int n_pollfds;
+    int retval;
+
+    if (max_pollfds < n_waiters) {
+        max_pollfds = n_waiters;
+        pollfds = xrealloc(pollfds, max_pollfds * sizeof *pollfds);
+    }
+
+    n_pollfds = 0;
+    LIST_FOR_EACH (pw, struct poll_waiter, node, &waiters) {
+        pollfds[n_pollfds].fd = pw->fd;
+        pollfds[n_pollfds].events = pw->events;
+        pollfds[n_pollfds].revents = 0;
+        n_pollfds++;
+    }
+
+    retval = time_poll(pollfds, n_pollfds, timeout);
+
+    n_pollfds = 0;
+    LIST_FOR_EACH (pw, struct poll_waiter, node, &waiters) {
+        pw->revents = pollfds[n_pollfds++].revents;
+    }
+    return retval;
+}
+
+#ifdef HAVE_EPOLL
+/* Returns the poll_fd for 'fd', expanding 'poll_fds' if necessary. */
+static struct poll_fd *
+get_poll_fd(int fd)
+{
+    assert(fd >= 0);
+    if (fd >= n_poll_fds) {
+        int n = MAX(fd + 1, n_poll_fds * 2);
+        poll_fds = xrealloc(poll_fds, n * sizeof *poll_fds);
+        memset(&poll_fds[n_poll_fds], 0,
+               (n - n_poll_fds) * sizeof *poll_fds);
+        n_poll_fds = n;
+    }
+    return &poll_fds[fd];
+}
+
+/* Creates 'epoll_fd' if it has not been created yet.  Returns true if epoll
+ * may be used, false if poll_block() should fall back to poll(). */
+static bool
+epoll_open(void)
+{
+    static bool tried;
+
+    if (!tried) {
+        tried = true;
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd < 0) {
+            VLOG_WARN("epoll_create1 failed (%s), falling back to poll()",
+                      strerror(errno));
+        }
+    }
+    return epoll_fd >= 0;
+}
+
+/* Registers 'fd' with 'epoll_fd' for the events in 'pf->events', or modifies
+ * its existing registration.  Returns 0 if successful, otherwise a positive
+ * errno value. */
+static int
+epoll_update(int fd, struct poll_fd *pf)
+{
+    struct epoll_event event;
+    int op = pf->in_kernel ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+
+    memset(&event, 0, sizeof event);
+    event.events = pf->events;
+    event.data.fd = fd;
+    if (epoll_ctl(epoll_fd, op, fd, &event)) {
+        /* 'fd' might have been closed and its number reused without a call to
+         * poll_fd_unregister(). */
+        op = (errno == ENOENT ? EPOLL_CTL_ADD
+              : errno == EEXIST ? EPOLL_CTL_MOD
+              : -1);
+        if (op < 0 || epoll_ctl(epoll_fd, op, fd, &event)) {
+            pf->in_kernel = false;
+            return errno;
+        }
+    }
+    pf->in_kernel = true;
+    pf->kernel_events = pf->events;
+    return 0;
+}
+
+/* Removes 'fd' from 'epoll_fd'. */
+static void
+epoll_remove(int fd, struct poll_fd *pf)
+{
+    struct epoll_event event;
+
+    /* Linux before 2.6.9 requires a non-null 'event' even for removal. */
+    memset(&event, 0, sizeof event);
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, &event);
+    pf->in_kernel = false;
+}
+
+/* Waits for events with epoll, setting the 'revents' member of each poll
+ * waiter.  Returns the number of fds with events, 0 on timeout, or a negative
+ * errno value on failure. */
+static int
+epoll_block(void)
+{
+    static struct epoll_event *events;
+    static size_t max_events;
+    static int *fds;
+    static size_t max_fds;
+
+    struct poll_waiter *pw;
+    long long int start;
+    size_t n_fds, i;
+    int wait_timeout;
+    int n_ready;
+    int retval;
+
+    /* Gather the events wanted on each fd. */
+    epoll_serial++;
+    n_fds = 0;
+    LIST_FOR_EACH (pw, struct poll_waiter, node, &waiters) {
+        struct poll_fd *pf = get_poll_fd(pw->fd);
+        if (pf->serial != epoll_serial) {
+            pf->serial = epoll_serial;
+            pf->events = pf->revents = 0;
+            if (n_fds >= max_fds) {
+                fds = x2nrealloc(fds, &max_fds, sizeof *fds);
+            }
+            fds[n_fds++] = pw->fd;
+        }
+        pf->events |= pw->events;
+    }
+
+    /* Bring the kernel's registrations up to date. */
+    wait_timeout = timeout;
+    n_ready = 0;
+    for (i = 0; i < n_fds; i++) {
+        struct poll_fd *pf = &poll_fds[fds[i]];
+        if (!pf->in_kernel || pf->kernel_events != pf->events) {
+            int error = epoll_update(fds[i], pf);
+            if (error) {
+                if (error == EPERM) {
+                    /* epoll does not support regular files, which poll()
+                     * always reports as ready. */
+                    pf->revents = pf->events;
+                } else if (error == EBADF) {
+                    pf->revents = POLLNVAL;
+                } else {
+                    static struct vlog_rate_limit rl
+                        = VLOG_RATE_LIMIT_INIT(1, 5);
+                    VLOG_ERR_RL(&rl, "epoll_ctl on fd %d: %s",
+                                fds[i], strerror(error));
+                    pf->revents = POLLERR;
+                }
+                wait_timeout = 0;
+                n_ready++;
+            }
+        }
+    }
+
+    /* Wait.  An fd that stayed registered from an earlier call may report an
+     * event even though no one is waiting on it now.  It is removed, and if
+     * nothing else happened then we go back to waiting.  This cannot go on
+     * forever, because each time around removes at least one fd. */
+    if (max_events < MAX(n_fds, 1)) {
+        max_events = MAX(n_fds, 1);
+        events = xrealloc(events, max_events * sizeof *events);
+    }
+    start = time_msec();
+    for (;;) {
+        int n_events = time_epoll_wait(epoll_fd, events, max_events,
+                                       wait_timeout);
+        bool woke = false;
+        int j;
+
+        if (n_events < 0) {
+            retval = n_events;
+            goto done;
+        }
+        for (j = 0; j < n_events; j++) {
+            int fd = events[j].data.fd;
+            struct poll_fd *pf = &poll_fds[fd];
+            if (pf->serial == epoll_serial) {
+                pf->revents |= events[j].events;
+                woke = true;
+                n_ready++;
+            } else {
+                epoll_remove(fd, pf);
+            }
+        }
+        if (woke || !n_events) {
+            break;
+        }
+        if (wait_timeout > 0) {
+            long long int elapsed = time_msec() - start;
+            if (elapsed >= timeout) {
+                break;
+            }
+            wait_timeout = timeout - elapsed;
+        }
+    }
+    retval = n_ready;
+
+done:
+    /* Drop fds that are registered only for this call. */
+    for (i = 0; i < n_fds; i++) {
+        struct poll_fd *pf = &poll_fds[fds[i]];
+        if (pf->in_kernel && !pf->persistent) {
+            epoll_remove(fds[i], pf);
+        }
+    }
+
+    LIST_FOR_EACH (pw, struct poll_waiter, node, &waiters) {
+        pw->revents = (poll_fds[pw->fd].revents
+                       & (pw->events | POLLERR | POLLHUP | POLLNVAL));
+    }
+    return retval;
+}
+#endif
+
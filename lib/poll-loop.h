@@ -69,4 +69,8 @@ struct poll_waiter *poll_fd_callback(int fd, short int events,
 /* Cancel a file descriptor callback or event. */
 void poll_cancel(struct poll_waiter *);
 
+/* Long-lived file descriptors. */
+void poll_fd_register(int fd);
+void poll_fd_unregister(int fd);
+
 #endif /* poll-loop.h */
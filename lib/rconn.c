@@ -85,6 +85,7 @@ struct rconn {
     bool reliable;
 
     struct ofp_queue txq;
+    size_t txq_bytes;           /* Number of bytes in 'txq'. */
 
     int backoff;
     int max_backoff;
@@ -196,6 +197,7 @@ rconn_create(int probe_interval, int max_backoff)
     rc->reliable = false;
 
     queue_init(&rc->txq);
+    rc->txq_bytes = 0;
 
     rc->backoff = 0;
     rc->max_backoff = max_backoff ? max_backoff : 60;
@@ -542,6 +544,7 @@ rconn_send(struct rconn *rc, struct ofpbuf *b, int *n_queued)
             ++*n_queued;
         }
         queue_push_tail(&rc->txq, b);
+        rc->txq_bytes += b->size;
 
         /* If the queue was empty before we added 'b', try to send some
          * packets.  (But if the queue had packets in it, it's because the
@@ -589,6 +592,15 @@ rconn_packets_sent(const struct rconn *rc)
     return rc->packets_sent;
 }
 
+/* Returns the number of bytes in the messages waiting in 'rc''s send queue.
+ * Like rconn_packets_sent(), this does not count a message once it has been
+ * passed to the vconn. */
+size_t
+rconn_queued_bytes(const struct rconn *rc)
+{
+    return rc->txq_bytes;
+}
+
 /* Adds 'vconn' to 'rc' as a monitoring connection, to which all messages sent
  * and received on 'rconn' will be copied.  'rc' takes ownership of 'vconn'. */
 void
@@ -780,6 +792,7 @@ try_send(struct rconn *rc)
     struct ofpbuf *next = rc->txq.head->next;
     struct ofp_header *h = rc->txq.head->data;
     int *n_queued = rc->txq.head->private;
+    size_t size = rc->txq.head->size;
     ofpstat_inc_protocol_stat(&rc->ofps_sent, h);
     rc->idle_echo_xid = h->xid;
     retval = vconn_send(rc->vconn, rc->txq.head);
@@ -794,6 +807,7 @@ try_send(struct rconn *rc)
     if (n_queued) {
         --*n_queued;
     }
+    rc->txq_bytes -= size;
     queue_advance_head(&rc->txq, next);
     return 0;
 }
@@ -856,6 +870,7 @@ flush_queue(struct rconn *rc)
         }
         ofpbuf_delete(b);
     }
+    rc->txq_bytes = 0;
     poll_immediate_wake();
 }
 
@@ -36,6 +36,7 @@
 
 #include "queue.h"
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <time.h>
 
@@ -72,6 +73,7 @@ int rconn_send(struct rconn *, struct ofpbuf *, int *n_queued);
 int rconn_send_with_limit(struct rconn *, struct ofpbuf *,
                           int *n_queued, int queue_limit);
 unsigned int rconn_packets_sent(const struct rconn *);
+size_t rconn_queued_bytes(const struct rconn *);
 unsigned int rconn_packets_received(const struct rconn *);
 
 void rconn_add_monitor(struct rconn *, struct vconn *);
@@ -79,6 +79,7 @@ signal_init(void)
         }
         set_nonblocking(fds[0]);
         set_nonblocking(fds[1]);
+        poll_fd_register(fds[0]);
     }
 }
 
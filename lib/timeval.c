@@ -39,6 +39,9 @@
 #include <signal.h>
 #include <string.h>
 #include <sys/time.h>
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
 #include "fatal-signal.h"
 #include "util.h"
 
@@ -132,18 +135,10 @@ time_alarm(unsigned int secs)
     unblock_sigalrm(&oldsigs);
 }
 
-/* Like poll(), except:
- *
- *      - On error, returns a negative error code (instead of setting errno).
- *
- *      - If interrupted by a signal, retries automatically until the original
- *        'timeout' expires.  (Because of this property, this function will
- *        never return -EINTR.)
- *
- *      - As a side effect, refreshes the current time (like time_refresh()).
- */
-int
-time_poll(struct pollfd *pollfds, int n_pollfds, int timeout)
+/* Calls 'wait' with 'aux' and a timeout in ms, retrying as described for
+ * time_poll() until it returns something other than -EINTR. */
+static int
+time_wait(int (*wait)(void *aux, int timeout), void *aux, int timeout)
 {
     long long int start;
     sigset_t oldsigs;
@@ -162,7 +157,7 @@ time_poll(struct pollfd *pollfds, int n_pollfds, int timeout)
             time_left = timeout;
         }
 
-        retval = poll(pollfds, n_pollfds, time_left);
+        retval = wait(aux, time_left);
         if (retval < 0) {
             retval = -errno;
         }
@@ -182,6 +177,66 @@ time_poll(struct pollfd *pollfds, int n_pollfds, int timeout)
     return retval;
 }
 
+struct poll_args {
+    struct pollfd *pollfds;
+    int n_pollfds;
+};
+
+static int
+do_poll(void *args_, int timeout)
+{
+    struct poll_args *args = args_;
+    return poll(args->pollfds, args->n_pollfds, timeout);
+}
+
+/* Like poll(), except:
+ *
+ *      - On error, returns a negative error code (instead of setting errno).
+ *
+ *      - If interrupted by a signal, retries automatically until the original
+ *        'timeout' expires.  (Because of this property, this function will
+ *        never return -EINTR.)
+ *
+ *      - As a side effect, refreshes the current time (like time_refresh()).
+ */
+int
+time_poll(struct pollfd *pollfds, int n_pollfds, int timeout)
+{
+    struct poll_args args;
+
+    args.pollfds = pollfds;
+    args.n_pollfds = n_pollfds;
+    return time_wait(do_poll, &args, timeout);
+}
+
+#ifdef HAVE_EPOLL
+struct epoll_args {
+    int epfd;
+    struct epoll_event *events;
+    int max_events;
+};
+
+static int
+do_epoll_wait(void *args_, int timeout)
+{
+    struct epoll_args *args = args_;
+    return epoll_wait(args->epfd, args->events, args->max_events, timeout);
+}
+
+/* Like epoll_wait(), with the same differences as time_poll(). */
+int
+time_epoll_wait(int epfd, struct epoll_event *events, int max_events,
+                int timeout)
+{
+    struct epoll_args args;
+
+    args.epfd = epfd;
+    args.events = events;
+    args.max_events = max_events;
+    return time_wait(do_epoll_wait, &args, timeout);
+}
+#endif
+
 /* Returns the sum of 'a' and 'b', with saturation on overflow or underflow. */
 static time_t
 time_add(time_t a, time_t b)
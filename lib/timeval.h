@@ -38,6 +38,7 @@
 #include "type-props.h"
 #include "util.h"
 
+struct epoll_event;
 struct pollfd;
 
 /* POSIX allows floating-point time_t, but we don't support it. */
@@ -62,5 +63,7 @@ time_t time_now(void);
 long long int time_msec(void);
 void time_alarm(unsigned int secs);
 int time_poll(struct pollfd *, int n_pollfds, int timeout);
+int time_epoll_wait(int epfd, struct epoll_event *, int max_events,
+                    int timeout);
 
 #endif /* timeval.h */
@@ -68,6 +68,17 @@ static inline void vconn_assert_class(const struct vconn *vconn,
     assert(vconn->class == class);
 }
 
+/* Headroom that a vconn should reserve in front of each message that it
+ * receives.  A datapath that sends out the frame carried in a packet_out can
+ * then use the received buffer in place, even if it has to push a VLAN header
+ * or an ofp_packet_in header onto the frame.  The extra 2 bytes align the IP
+ * header of such a frame, as with DP_HEADROOM in udatapath. */
+#define VCONN_RX_HEADROOM (32 + 2)
+
+/* Number of bytes that a vconn may hold in its transmit queue before its send
+ * function starts returning EAGAIN. */
+#define VCONN_TX_HIGH_WATER (256 * 1024)
+
 struct vconn_class {
     /* Prefix for connection names, e.g. "nl", "tcp". */
     const char *name;
@@ -105,6 +116,8 @@ struct vconn_class {
      * failure, returns a positive errno value and stores a null pointer into
      * '*msgp'.
      *
+     * The message should have VCONN_RX_HEADROOM bytes of headroom.
+     *
      * If the connection has been closed in the normal fashion, returns EOF.
      *
      * The recv function must not block waiting for a packet to arrive.  If no
@@ -126,6 +139,14 @@ struct vconn_class {
     /* Arranges for the poll loop to wake up when 'vconn' is ready to take an
      * action of the given 'type'. */
     void (*wait)(struct vconn *vconn, enum vconn_wait_type type);
+
+    /* Tries to pass every message that 'send' has queued on 'vconn' to the
+     * operating system.  Returns 0 if successful, EAGAIN if some remain, or a
+     * positive errno value on failure.  After returning EAGAIN, the vconn must
+     * have arranged for poll_block() to make progress with the rest.
+     *
+     * May be null if 'send' never holds on to messages. */
+    int (*flush)(struct vconn *vconn);
 };
 
 /* Passive virtual connection to an OpenFlow device.
@@ -190,5 +211,9 @@ extern struct pvconn_class pssl_pvconn_class;
 #ifdef HAVE_NETLINK
 extern struct vconn_class netlink_vconn_class;
 #endif
+#ifdef HAVE_SHM
+extern struct vconn_class shm_vconn_class;
+extern struct pvconn_class pshm_pvconn_class;
+#endif
 
 #endif /* vconn-provider.h */
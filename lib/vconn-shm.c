@@ -0,0 +1,665 @@
+/* Copyright (c) 2008, 2009 The Board of Trustees of The Leland Stanford
+ * Junior University
+ *
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#include <config.h>
+#include "vconn.h"
+#include <assert.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "ofpbuf.h"
+#include "openflow/openflow.h"
+#include "poll-loop.h"
+#include "socket-util.h"
+#include "util.h"
+#include "vconn-provider.h"
+#include "vconn-stream.h"
+
+#include "vlog.h"
+#define THIS_MODULE VLM_vconn_shm
+
+/* Shared memory vconn, for a pair of processes on the same host, such as
+ * ofprotocol and ofdatapath.
+ *
+ * The two processes first meet on a Unix domain socket.  The passive side
+ * creates a memfd holding one ring of bytes for each direction, plus an
+ * eventfd for each kind of wakeup, and passes them all to the active side
+ * over the socket.  From then on OpenFlow messages are copied straight into
+ * and out of the rings, with no system call for each message.
+ *
+ * Each ring has a single producer and a single consumer.  A side that runs
+ * out of messages to receive, or of room to send, sets a flag in the ring
+ * before it sleeps, and its peer rings the matching eventfd ("doorbell") only
+ * if it finds the flag set.  Thus a busy pair of processes exchanges at most
+ * one doorbell per trip around each one's poll loop, however many messages
+ * that trip carries.
+ *
+ * The socket itself carries nothing after the handshake.  It only tells each
+ * side when the other one goes away. */
+
+/* Size of each ring.  A power of 2, much larger than any OpenFlow message. */
+#define SHM_RING_SIZE (1u << 20)
+
+/* Room that a ring must have for the producer to be sure that it can send any
+ * OpenFlow message. */
+#define SHM_MAX_MSG 65535
+
+#define SHM_CACHE_LINE 64
+#define SHM_MAGIC 0x4f465348    /* "OFSH". */
+
+/* One direction of a connection. */
+struct shm_ring {
+    /* Written by the producer. */
+    uint32_t tail;              /* Total bytes ever sent. */
+    uint32_t producer_waiting;  /* Nonzero if producer waits for room. */
+    uint8_t pad0[SHM_CACHE_LINE - 8];
+
+    /* Written by the consumer. */
+    uint32_t head;              /* Total bytes ever received. */
+    uint32_t consumer_waiting;  /* Nonzero if consumer waits for data. */
+    uint8_t pad1[SHM_CACHE_LINE - 8];
+
+    uint8_t data[SHM_RING_SIZE];
+};
+
+/* Layout of the memfd shared by the two sides of a connection. */
+struct shm_region {
+    uint32_t magic;             /* SHM_MAGIC. */
+    uint32_t ring_size;         /* SHM_RING_SIZE. */
+    uint8_t pad[SHM_CACHE_LINE - 8];
+
+    /* rings[0] carries messages from the passive side to the active side,
+     * rings[1] from the active side to the passive side. */
+    struct shm_ring rings[2];
+};
+
+/* Eventfds passed with the memfd, in the order they are passed. */
+enum {
+    SHM_EFD_DATA0,              /* rings[0] has data. */
+    SHM_EFD_ROOM0,              /* rings[0] has room. */
+    SHM_EFD_DATA1,              /* rings[1] has data. */
+    SHM_EFD_ROOM1,              /* rings[1] has room. */
+    SHM_N_EFDS
+};
+
+struct shm_vconn
+{
+    struct vconn vconn;
+    int sock;                   /* Unix domain socket to the peer. */
+    struct shm_region *region;  /* Null until the handshake completes. */
+    struct shm_ring *rx;        /* Ring that we consume. */
+    struct shm_ring *tx;        /* Ring that we produce. */
+    bool passive;               /* Created by the passive side? */
+    int efds[SHM_N_EFDS];
+
+    /* Doorbells that we may have to drain before waiting again. */
+    bool rx_armed;              /* We set rx->consumer_waiting. */
+    bool tx_armed;              /* We set tx->producer_waiting. */
+};
+
+static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(10, 25);
+
+static void
+init_efds(int efds[SHM_N_EFDS])
+{
+    int i;
+
+    for (i = 0; i < SHM_N_EFDS; i++) {
+        efds[i] = -1;
+    }
+}
+
+static void
+close_efds(int efds[SHM_N_EFDS])
+{
+    int i;
+
+    for (i = 0; i < SHM_N_EFDS; i++) {
+        if (efds[i] >= 0) {
+            poll_fd_unregister(efds[i]);
+            close(efds[i]);
+        }
+    }
+}
+
+static struct shm_vconn *
+shm_vconn_cast(struct vconn *vconn)
+{
+    vconn_assert_class(vconn, &shm_vconn_class);
+    return CONTAINER_OF(vconn, struct shm_vconn, vconn);
+}
+
+/* Starts using 'region' and the eventfds in 'efds', which 's' takes over. */
+static void
+shm_attach(struct shm_vconn *s, struct shm_region *region,
+           const int efds[SHM_N_EFDS])
+{
+    int i;
+
+    s->region = region;
+    s->rx = &region->rings[s->passive ? 1 : 0];
+    s->tx = &region->rings[s->passive ? 0 : 1];
+    memcpy(s->efds, efds, sizeof s->efds);
+    for (i = 0; i < SHM_N_EFDS; i++) {
+        poll_fd_register(efds[i]);
+    }
+}
+
+static int
+new_shm_vconn(const char *name, int sock, bool passive,
+              struct shm_region *region, const int efds[SHM_N_EFDS],
+              struct vconn **vconnp)
+{
+    struct shm_vconn *s;
+
+    s = xcalloc(1, sizeof *s);
+    vconn_init(&s->vconn, &shm_vconn_class, region ? 0 : EAGAIN, 0, name,
+               !passive);
+    s->sock = sock;
+    poll_fd_register(sock);
+    s->passive = passive;
+    init_efds(s->efds);
+    if (region) {
+        shm_attach(s, region, efds);
+    }
+    *vconnp = &s->vconn;
+    return 0;
+}
+
+static int
+shm_vconn_open(const char *name, char *suffix, struct vconn **vconnp)
+{
+    int fd;
+
+    fd = make_unix_socket(SOCK_STREAM, true, false, NULL, suffix);
+    if (fd < 0) {
+        VLOG_ERR("%s: connection failed: %s", suffix, strerror(-fd));
+        return -fd;
+    }
+    return new_shm_vconn(name, fd, false, NULL, NULL, vconnp);
+}
+
+static void
+shm_close(struct vconn *vconn)
+{
+    struct shm_vconn *s = shm_vconn_cast(vconn);
+
+    if (s->region) {
+        munmap(s->region, sizeof *s->region);
+    }
+    close_efds(s->efds);
+    poll_fd_unregister(s->sock);
+    close(s->sock);
+    free(s);
+}
+
+/* Receives the memfd and eventfds that the passive side sends on 'sock'.  On
+ * success, maps the memfd into '*regionp' and stores the eventfds in
+ * 'efds'. */
+static int
+recv_region(int sock, struct shm_region **regionp, int efds[SHM_N_EFDS])
+{
+    union {
+        struct cmsghdr cm;
+        char buf[CMSG_SPACE(sizeof(int) * (SHM_N_EFDS + 1))];
+    } control;
+    struct shm_region *region;
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    struct stat st;
+    int fds[SHM_N_EFDS + 1];
+    ssize_t retval;
+    char byte;
+    int i;
+
+    iov.iov_base = &byte;
+    iov.iov_len = 1;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = &control;
+    msg.msg_controllen = sizeof control;
+    do {
+        retval = recvmsg(sock, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+    } while (retval < 0 && errno == EINTR);
+    if (retval < 0) {
+        return errno;
+    } else if (!retval) {
+        return ECONNRESET;
+    }
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET
+        || cmsg->cmsg_type != SCM_RIGHTS
+        || cmsg->cmsg_len != CMSG_LEN(sizeof fds)) {
+        VLOG_WARN_RL(&rl, "handshake did not carry shared memory");
+        return EPROTO;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), sizeof fds);
+
+    if (fstat(fds[0], &st) || st.st_size != sizeof *region) {
+        VLOG_WARN_RL(&rl, "shared memory has wrong size");
+        goto error;
+    }
+    region = mmap(NULL, sizeof *region, PROT_READ | PROT_WRITE, MAP_SHARED,
+                  fds[0], 0);
+    if (region == MAP_FAILED) {
+        VLOG_WARN_RL(&rl, "mmap failed (%s)", strerror(errno));
+        goto error;
+    }
+    if (region->magic != SHM_MAGIC || region->ring_size != SHM_RING_SIZE) {
+        VLOG_WARN_RL(&rl, "shared memory has wrong format");
+        munmap(region, sizeof *region);
+        goto error;
+    }
+    close(fds[0]);
+
+    *regionp = region;
+    memcpy(efds, &fds[1], sizeof(int) * SHM_N_EFDS);
+    return 0;
+
+error:
+    for (i = 0; i < ARRAY_SIZE(fds); i++) {
+        close(fds[i]);
+    }
+    return EPROTO;
+}
+
+static int
+shm_connect(struct vconn *vconn)
+{
+    struct shm_vconn *s = shm_vconn_cast(vconn);
+    struct shm_region *region;
+    int efds[SHM_N_EFDS];
+    int retval;
+
+    if (s->region) {
+        return 0;
+    }
+    retval = recv_region(s->sock, &region, efds);
+    if (!retval) {
+        shm_attach(s, region, efds);
+    }
+    return retval;
+}
+
+/* Returns 0 if the peer of 's' is still there, otherwise EOF or a positive
+ * errno value. */
+static int
+shm_check_peer(struct shm_vconn *s)
+{
+    ssize_t retval;
+    char byte;
+
+    retval = recv(s->sock, &byte, 1, MSG_DONTWAIT | MSG_PEEK);
+    if (!retval) {
+        return EOF;
+    } else if (retval < 0 && errno != EAGAIN && errno != EINTR) {
+        return errno;
+    } else {
+        /* The peer never sends anything after the handshake, but if it did,
+         * there would be nothing to do with it. */
+        return 0;
+    }
+}
+
+/* Copies 'n' bytes at position 'pos' in 'ring' into 'dst'. */
+static void
+ring_copy_out(const struct shm_ring *ring, uint32_t pos, void *dst, size_t n)
+{
+    size_t ofs = pos & (SHM_RING_SIZE - 1);
+    size_t chunk = MIN(n, SHM_RING_SIZE - ofs);
+
+    memcpy(dst, &ring->data[ofs], chunk);
+    memcpy((uint8_t *) dst + chunk, ring->data, n - chunk);
+}
+
+/* Copies the 'n' bytes in 'src' to position 'pos' in 'ring'. */
+static void
+ring_copy_in(struct shm_ring *ring, uint32_t pos, const void *src, size_t n)
+{
+    size_t ofs = pos & (SHM_RING_SIZE - 1);
+    size_t chunk = MIN(n, SHM_RING_SIZE - ofs);
+
+    memcpy(&ring->data[ofs], src, chunk);
+    memcpy(ring->data, (const uint8_t *) src + chunk, n - chunk);
+}
+
+/* Returns the number of bytes that 'ring''s consumer may receive. */
+static uint32_t
+ring_used(const struct shm_ring *ring)
+{
+    return (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)
+            - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE));
+}
+
+/* Rings doorbell 'efd' if '*waiting' says that the peer is about to sleep
+ * waiting for it, after making the change that the peer waits for visible. */
+static void
+ring_doorbell(uint32_t *waiting, int efd)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(waiting, __ATOMIC_RELAXED)
+        && __atomic_exchange_n(waiting, 0, __ATOMIC_ACQ_REL)) {
+        uint64_t one = 1;
+        if (write(efd, &one, sizeof one) < 0) {
+            VLOG_WARN_RL(&rl, "eventfd write failed (%s)", strerror(errno));
+        }
+    }
+}
+
+/* Tells the peer that we are about to sleep until it rings the doorbell that
+ * goes with '*waiting', then makes sure that the ring state we check next is
+ * no older than the flag. */
+static void
+set_waiting(uint32_t *waiting)
+{
+    __atomic_store_n(waiting, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/* Clears doorbell 'efd'. */
+static void
+drain_doorbell(int efd)
+{
+    uint64_t count;
+
+    if (read(efd, &count, sizeof count) < 0 && errno != EAGAIN) {
+        VLOG_WARN_RL(&rl, "eventfd read failed (%s)", strerror(errno));
+    }
+}
+
+static int
+shm_recv(struct vconn *vconn, struct ofpbuf **msgp)
+{
+    struct shm_vconn *s = shm_vconn_cast(vconn);
+    struct shm_ring *ring = s->rx;
+    uint32_t head = ring->head;
+    uint32_t used = ring_used(ring);
+    struct ofp_header oh;
+    struct ofpbuf *msg;
+    size_t length;
+
+    if (!used) {
+        int error = shm_check_peer(s);
+        return error ? error : EAGAIN;
+    } else if (used < sizeof oh) {
+        VLOG_ERR_RL(&rl, "received partial message header");
+        return EPROTO;
+    }
+
+    ring_copy_out(ring, head, &oh, sizeof oh);
+    length = ntohs(oh.length);
+    if (length < sizeof oh || length > used) {
+        VLOG_ERR_RL(&rl, "received bad message length %zu", length);
+        return EPROTO;
+    }
+
+    msg = ofpbuf_new(VCONN_RX_HEADROOM + length);
+    ofpbuf_reserve(msg, VCONN_RX_HEADROOM);
+    ring_copy_out(ring, head, ofpbuf_put_uninit(msg, length), length);
+    __atomic_store_n(&ring->head, head + length, __ATOMIC_RELEASE);
+    ring_doorbell(&ring->producer_waiting, s->efds[s->passive
+                                                    ? SHM_EFD_ROOM1
+                                                    : SHM_EFD_ROOM0]);
+    *msgp = msg;
+    return 0;
+}
+
+static int
+shm_send(struct vconn *vconn, struct ofpbuf *buffer)
+{
+    struct shm_vconn *s = shm_vconn_cast(vconn);
+    struct shm_ring *ring = s->tx;
+    uint32_t tail = ring->tail;
+
+    if (SHM_RING_SIZE - ring_used(ring) < buffer->size) {
+        /* Ask the consumer to tell us when it makes room, then check again in
+         * case it made room before it could see the request. */
+        int error;
+
+        set_waiting(&ring->producer_waiting);
+        s->tx_armed = true;
+        if (SHM_RING_SIZE - ring_used(ring) < buffer->size) {
+            error = shm_check_peer(s);
+            return error == EOF ? EPIPE : error ? error : EAGAIN;
+        }
+    }
+
+    ring_copy_in(ring, tail, buffer->data, buffer->size);
+    __atomic_store_n(&ring->tail, tail + buffer->size, __ATOMIC_RELEASE);
+    ring_doorbell(&ring->consumer_waiting, s->efds[s->passive
+                                                    ? SHM_EFD_DATA0
+                                                    : SHM_EFD_DATA1]);
+    ofpbuf_delete(buffer);
+    return 0;
+}
+
+static void
+shm_wait(struct vconn *vconn, enum vconn_wait_type wait)
+{
+    struct shm_vconn *s = shm_vconn_cast(vconn);
+    int efd;
+
+    switch (wait) {
+    case WAIT_CONNECT:
+        if (s->region) {
+            poll_immediate_wake();
+        } else {
+            poll_fd_wait(s->sock, POLLIN);
+        }
+        break;
+
+    case WAIT_RECV:
+        efd = s->efds[s->passive ? SHM_EFD_DATA1 : SHM_EFD_DATA0];
+        if (s->rx_armed) {
+            drain_doorbell(efd);
+            s->rx_armed = false;
+        }
+        if (!ring_used(s->rx)) {
+            set_waiting(&s->rx->consumer_waiting);
+            s->rx_armed = true;
+        }
+        if (ring_used(s->rx)) {
+            poll_immediate_wake();
+        } else {
+            poll_fd_wait(efd, POLLIN);
+        }
+
+        /* Wakes up when the peer goes away. */
+        poll_fd_wait(s->sock, POLLIN);
+        break;
+
+    case WAIT_SEND:
+        efd = s->efds[s->passive ? SHM_EFD_ROOM0 : SHM_EFD_ROOM1];
+        if (s->tx_armed) {
+            drain_doorbell(efd);
+            s->tx_armed = false;
+        }
+        if (SHM_RING_SIZE - ring_used(s->tx) < SHM_MAX_MSG) {
+            set_waiting(&s->tx->producer_waiting);
+            s->tx_armed = true;
+        }
+        if (SHM_RING_SIZE - ring_used(s->tx) >= SHM_MAX_MSG) {
+            poll_immediate_wake();
+        } else {
+            poll_fd_wait(efd, POLLIN);
+            poll_fd_wait(s->sock, POLLIN);
+        }
+        break;
+
+    default:
+        NOT_REACHED();
+    }
+}
+
+struct vconn_class shm_vconn_class = {
+    "shm",                      /* name */
+    shm_vconn_open,             /* open */
+    shm_close,                  /* close */
+    shm_connect,                /* connect */
+    shm_recv,                   /* recv */
+    shm_send,                   /* send */
+    shm_wait,                   /* wait */
+    NULL,                       /* flush */
+};
+
+/* Passive shared memory vconn. */
+
+/* Creates the shared memory and eventfds for a new connection on 'sock' and
+ * sends them to the peer.  On success, stores the mapped memory in '*regionp'
+ * and the eventfds in 'efds'. */
+static int
+send_region(int sock, struct shm_region **regionp, int efds[SHM_N_EFDS])
+{
+    union {
+        struct cmsghdr cm;
+        char buf[CMSG_SPACE(sizeof(int) * (SHM_N_EFDS + 1))];
+    } control;
+    struct shm_region *region = MAP_FAILED;
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    int memfd;
+    int error;
+    char byte;
+    int i;
+
+    init_efds(efds);
+    memfd = memfd_create("vconn-shm", MFD_CLOEXEC);
+    if (memfd < 0 || ftruncate(memfd, sizeof *region) < 0) {
+        error = errno;
+        goto error;
+    }
+    region = mmap(NULL, sizeof *region, PROT_READ | PROT_WRITE, MAP_SHARED,
+                  memfd, 0);
+    if (region == MAP_FAILED) {
+        error = errno;
+        goto error;
+    }
+    region->magic = SHM_MAGIC;
+    region->ring_size = SHM_RING_SIZE;
+    for (i = 0; i < SHM_N_EFDS; i++) {
+        efds[i] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (efds[i] < 0) {
+            error = errno;
+            goto error;
+        }
+    }
+
+    byte = 0;
+    iov.iov_base = &byte;
+    iov.iov_len = 1;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = &control;
+    msg.msg_controllen = sizeof control;
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * (SHM_N_EFDS + 1));
+    memcpy(CMSG_DATA(cmsg), &memfd, sizeof memfd);
+    memcpy(CMSG_DATA(cmsg) + sizeof memfd, efds, sizeof(int) * SHM_N_EFDS);
+
+    /* The socket was just accepted, so its send buffer has plenty of room. */
+    if (sendmsg(sock, &msg, MSG_DONTWAIT | MSG_NOSIGNAL) != 1) {
+        error = errno;
+        goto error;
+    }
+    close(memfd);
+
+    *regionp = region;
+    return 0;
+
+error:
+    VLOG_WARN_RL(&rl, "setting up shared memory failed (%s)",
+                 strerror(error));
+    if (region != MAP_FAILED) {
+        munmap(region, sizeof *region);
+    }
+    if (memfd >= 0) {
+        close(memfd);
+    }
+    close_efds(efds);
+    return error;
+}
+
+static int pshm_accept(int fd, const struct sockaddr *sa, size_t sa_len,
+                       struct vconn **vconnp);
+
+static int
+pshm_open(const char *name UNUSED, char *suffix, struct pvconn **pvconnp)
+{
+    int fd;
+
+    fd = make_unix_socket(SOCK_STREAM, true, true, suffix, NULL);
+    if (fd < 0) {
+        VLOG_ERR("%s: binding failed: %s", suffix, strerror(-fd));
+        return -fd;
+    }
+
+    return new_pstream_pvconn("pshm", fd, pshm_accept, pvconnp);
+}
+
+static int
+pshm_accept(int fd, const struct sockaddr *sa UNUSED, size_t sa_len UNUSED,
+            struct vconn **vconnp)
+{
+    struct shm_region *region = NULL;
+    int efds[SHM_N_EFDS];
+    int error;
+
+    error = send_region(fd, &region, efds);
+    if (error) {
+        close(fd);
+        return error;
+    }
+    return new_shm_vconn("shm", fd, true, region, efds, vconnp);
+}
+
+struct pvconn_class pshm_pvconn_class = {
+    "pshm",
+    pshm_open,
+    NULL,
+    NULL,
+    NULL
+};
@@ -53,6 +53,7 @@
 #include "openflow/openflow.h"
 #include "packets.h"
 #include "poll-loop.h"
+#include "queue.h"
 #include "socket-util.h"
 #include "socket-util.h"
 #include "util.h"
@@ -69,6 +70,10 @@ enum ssl_state {
     STATE_SSL_CONNECTING
 };
 
+/* Number of bytes of queued messages to pass to a single SSL_write(), the
+ * maximum payload of a TLS record. */
+#define SSL_TX_COALESCE 16384
+
 enum session_type {
     CLIENT,
     SERVER
@@ -83,7 +88,14 @@ struct ssl_vconn
     int fd;
     SSL *ssl;
     struct ofpbuf *rxbuf;
-    struct ofpbuf *txbuf;
+
+    /* Messages to send are queued in 'txq', up to VCONN_TX_HIGH_WATER bytes,
+     * and copied together into 'txbuf' so that one SSL_write() sends many
+     * small messages. */
+    struct ofp_queue txq;       /* Messages not yet copied into 'txbuf'. */
+    struct ofpbuf *txbuf;       /* Bytes being passed to SSL_write(). */
+    size_t tx_bytes;            /* Number of bytes in 'txq' and 'txbuf'. */
+    int tx_error;               /* Error that ended transmission, or 0. */
     struct poll_waiter *tx_waiter;
 
     /* rx_want and tx_want record the result of the last call to SSL_read()
@@ -171,7 +183,8 @@ static int ssl_init(void);
 static int do_ssl_init(void);
 static bool ssl_wants_io(int ssl_error);
 static void ssl_close(struct vconn *);
-static void ssl_clear_txbuf(struct ssl_vconn *);
+static void ssl_clear_tx(struct ssl_vconn *);
+static int ssl_flush(struct vconn *);
 static int interpret_ssl_error(const char *function, int ret, int error,
                                int *want);
 static void ssl_tx_poll_callback(int fd, short int revents, void *vconn_);
@@ -255,9 +268,13 @@ new_ssl_vconn(const char *name, int fd, enum session_type type,
     sslv->state = state;
     sslv->type = type;
     sslv->fd = fd;
+    poll_fd_register(fd);
     sslv->ssl = ssl;
     sslv->rxbuf = NULL;
+    queue_init(&sslv->txq);
     sslv->txbuf = NULL;
+    sslv->tx_bytes = 0;
+    sslv->tx_error = 0;
     sslv->tx_waiter = NULL;
     sslv->rx_want = sslv->tx_want = SSL_NOTHING;
     *vconnp = &sslv->vconn;
@@ -483,10 +500,16 @@ static void
 ssl_close(struct vconn *vconn)
 {
     struct ssl_vconn *sslv = ssl_vconn_cast(vconn);
+    /* Give queued messages a last chance to go out, e.g. a message sent just
+     * before closing. */
+    if (sslv->tx_bytes) {
+        ssl_flush(vconn);
+    }
     poll_cancel(sslv->tx_waiter);
-    ssl_clear_txbuf(sslv);
+    ssl_clear_tx(sslv);
     ofpbuf_delete(sslv->rxbuf);
     SSL_free(sslv->ssl);
+    poll_fd_unregister(sslv->fd);
     close(sslv->fd);
     free(sslv);
 }
@@ -576,7 +599,8 @@ ssl_recv(struct vconn *vconn, struct ofpbuf **bufferp)
     ssize_t ret;
 
     if (sslv->rxbuf == NULL) {
-        sslv->rxbuf = ofpbuf_new(1564);
+        sslv->rxbuf = ofpbuf_new(VCONN_RX_HEADROOM + 1564);
+        ofpbuf_reserve(sslv->rxbuf, VCONN_RX_HEADROOM);
     }
     rx = sslv->rxbuf;
 
@@ -643,39 +667,67 @@ again:
 }
 
 static void
-ssl_clear_txbuf(struct ssl_vconn *sslv)
+ssl_clear_tx(struct ssl_vconn *sslv)
 {
+    queue_clear(&sslv->txq);
     ofpbuf_delete(sslv->txbuf);
     sslv->txbuf = NULL;
-    sslv->tx_waiter = NULL;
+    sslv->tx_bytes = 0;
 }
 
 static void
 ssl_register_tx_waiter(struct vconn *vconn)
 {
     struct ssl_vconn *sslv = ssl_vconn_cast(vconn);
-    sslv->tx_waiter = poll_fd_callback(sslv->fd,
-                                       want_to_poll_events(sslv->tx_want),
+    short int events = (sslv->tx_want != SSL_NOTHING
+                        ? want_to_poll_events(sslv->tx_want)
+                        : POLLOUT);
+    sslv->tx_waiter = poll_fd_callback(sslv->fd, events,
                                        ssl_tx_poll_callback, vconn);
 }
 
+/* Refills 'sslv->txbuf', which must be empty, from 'sslv->txq'.  Copies at
+ * least one message, then more as long as 'txbuf' stays within the size of a
+ * TLS record. */
+static void
+ssl_fill_txbuf(struct ssl_vconn *sslv)
+{
+    if (!sslv->txbuf) {
+        sslv->txbuf = ofpbuf_new(SSL_TX_COALESCE);
+    }
+    ofpbuf_clear(sslv->txbuf);
+    do {
+        struct ofpbuf *msg = queue_pop_head(&sslv->txq);
+        ofpbuf_put(sslv->txbuf, msg->data, msg->size);
+        ofpbuf_delete(msg);
+    } while (sslv->txq.n
+             && sslv->txbuf->size + sslv->txq.head->size <= SSL_TX_COALESCE);
+}
+
 static int
 ssl_do_tx(struct vconn *vconn)
 {
     struct ssl_vconn *sslv = ssl_vconn_cast(vconn);
 
     for (;;) {
-        int old_state = SSL_get_state(sslv->ssl);
-        int ret = SSL_write(sslv->ssl, sslv->txbuf->data, sslv->txbuf->size);
+        int old_state, ret;
+
+        if (!sslv->txbuf || !sslv->txbuf->size) {
+            if (!sslv->txq.n) {
+                return 0;
+            }
+            ssl_fill_txbuf(sslv);
+        }
+
+        old_state = SSL_get_state(sslv->ssl);
+        ret = SSL_write(sslv->ssl, sslv->txbuf->data, sslv->txbuf->size);
         if (old_state != SSL_get_state(sslv->ssl)) {
             sslv->rx_want = SSL_NOTHING;
         }
         sslv->tx_want = SSL_NOTHING;
         if (ret > 0) {
             ofpbuf_pull(sslv->txbuf, ret);
-            if (sslv->txbuf->size == 0) {
-                return 0;
-            }
+            sslv->tx_bytes -= ret;
         } else {
             int ssl_error = SSL_get_error(sslv->ssl, ret);
             if (ssl_error == SSL_ERROR_ZERO_RETURN) {
@@ -689,17 +741,44 @@ ssl_do_tx(struct vconn *vconn)
     }
 }
 
+/* Passes as much of 'vconn''s transmit queue to SSL as it will take.  Returns
+ * 0 if the queue is now empty, EAGAIN if some of it remains, in which case it
+ * will be sent when SSL can make progress, or a positive errno value if
+ * sending failed, in which case the queue is discarded. */
+static int
+ssl_flush(struct vconn *vconn)
+{
+    struct ssl_vconn *sslv = ssl_vconn_cast(vconn);
+    int error;
+
+    if (sslv->tx_error) {
+        return sslv->tx_error;
+    }
+
+    error = ssl_do_tx(vconn);
+    if (error == EAGAIN) {
+        if (!sslv->tx_waiter) {
+            ssl_register_tx_waiter(vconn);
+        }
+    } else {
+        poll_cancel(sslv->tx_waiter);
+        sslv->tx_waiter = NULL;
+        if (error) {
+            sslv->tx_error = error;
+            ssl_clear_tx(sslv);
+        }
+    }
+    return error;
+}
+
 static void
 ssl_tx_poll_callback(int fd UNUSED, short int revents UNUSED, void *vconn_)
 {
     struct vconn *vconn = vconn_;
     struct ssl_vconn *sslv = ssl_vconn_cast(vconn);
-    int error = ssl_do_tx(vconn);
-    if (error != EAGAIN) {
-        ssl_clear_txbuf(sslv);
-    } else {
-        ssl_register_tx_waiter(vconn);
-    }
+
+    sslv->tx_waiter = NULL;
+    ssl_flush(vconn);
 }
 
 static int
@@ -707,26 +786,23 @@ ssl_send(struct vconn *vconn, struct ofpbuf *buffer)
 {
     struct ssl_vconn *sslv = ssl_vconn_cast(vconn);
 
-    if (sslv->txbuf) {
+    if (sslv->tx_bytes >= VCONN_TX_HIGH_WATER) {
+        /* Make room if SSL will take some of the queue now. */
+        ssl_flush(vconn);
+    }
+    if (sslv->tx_error) {
+        return sslv->tx_error;
+    } else if (sslv->tx_bytes >= VCONN_TX_HIGH_WATER) {
         return EAGAIN;
-    } else {
-        int error;
+    }
 
-        sslv->txbuf = buffer;
-        error = ssl_do_tx(vconn);
-        switch (error) {
-        case 0:
-            ssl_clear_txbuf(sslv);
-            return 0;
-        case EAGAIN:
-            leak_checker_claim(buffer);
-            ssl_register_tx_waiter(vconn);
-            return 0;
-        default:
-            sslv->txbuf = NULL;
-            return error;
-        }
+    leak_checker_claim(buffer);
+    queue_push_tail(&sslv->txq, buffer);
+    sslv->tx_bytes += buffer->size;
+    if (!sslv->tx_waiter) {
+        ssl_register_tx_waiter(vconn);
     }
+    return 0;
 }
 
 static void
@@ -766,7 +842,7 @@ ssl_wait(struct vconn *vconn, enum vconn_wait_type wait)
         break;
 
     case WAIT_SEND:
-        if (!sslv->txbuf) {
+        if (sslv->tx_bytes < VCONN_TX_HIGH_WATER || sslv->tx_error) {
             /* We have room in our tx queue. */
             poll_immediate_wake();
         } else {
@@ -787,6 +863,7 @@ struct vconn_class ssl_vconn_class = {
     ssl_recv,                   /* recv */
     ssl_send,                   /* send */
     ssl_wait,                   /* wait */
+    ssl_flush,                  /* flush */
 };
 
 /* Passive SSL. */
@@ -863,6 +940,7 @@ pssl_open(const char *name, char *suffix, struct pvconn **pvconnp)
     pssl = xmalloc(sizeof *pssl);
     pvconn_init(&pssl->pvconn, &pssl_pvconn_class, name);
     pssl->fd = fd;
+    poll_fd_register(fd);
     *pvconnp = &pssl->pvconn;
     return 0;
 }
@@ -871,6 +949,7 @@ static void
 pssl_close(struct pvconn *pvconn)
 {
     struct pssl_pvconn *pssl = pssl_pvconn_cast(pvconn);
+    poll_fd_unregister(pssl->fd);
     close(pssl->fd);
     free(pssl);
 }
@@ -39,11 +39,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include "leak-checker.h"
 #include "ofpbuf.h"
 #include "openflow/openflow.h"
 #include "poll-loop.h"
+#include "queue.h"
 #include "socket-util.h"
 #include "util.h"
 #include "vconn-provider.h"
@@ -52,14 +54,43 @@
 #include "vlog.h"
 #define THIS_MODULE VLM_vconn_stream
 
-/* Active stream socket vconn. */
+/* Active stream socket vconn.
+ *
+ * Received bytes are read, as many as are available, into a receive ring from
+ * which complete messages are then handed out one by one, so that a burst of
+ * small messages costs one read() rather than two per message.  Each message
+ * shares the ring's memory, as with ofpbuf_share(), instead of being copied.
+ * The bytes that a message refers to are never reused while it exists: if
+ * messages are still around when the ring runs short of room, the start of
+ * the next message is copied into a new ring and the old one is freed along
+ * with the last of them.  A long message that arrives only in part is moved
+ * out of the ring instead, and the rest of it is read straight into its own
+ * buffer.
+ *
+ * Sent messages are queued, up to VCONN_TX_HIGH_WATER bytes, and written
+ * together with writev() when the poll loop next finds the socket writable. */
+
+/* Size of the receive ring.  Any OpenFlow message fits in it.  The ring also
+ * has VCONN_RX_HEADROOM bytes in front of this, so that every message in it
+ * has that much headroom. */
+#define STREAM_RX_RING_SIZE 65536
+
+/* Minimum length of a message that is moved out of the ring when only part of
+ * it has arrived. */
+#define STREAM_RX_DIRECT_MIN 4096
+
+/* Maximum number of messages written by a single writev(). */
+#define STREAM_TX_IOVECS 64
 
 struct stream_vconn
 {
     struct vconn vconn;
     int fd;
-    struct ofpbuf *rxbuf;
-    struct ofpbuf *txbuf;
+    struct ofpbuf rxring;       /* Bytes received but not yet returned. */
+    struct ofpbuf *rxbuf;       /* Long message being received, if any. */
+    struct ofp_queue txq;       /* Messages not yet completely written. */
+    size_t tx_bytes;            /* Number of bytes in 'txq'. */
+    int tx_error;               /* Error that ended transmission, or 0. */
     struct poll_waiter *tx_waiter;
 };
 
@@ -67,7 +98,7 @@ static struct vconn_class stream_vconn_class;
 
 static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(10, 25);
 
-static void stream_clear_txbuf(struct stream_vconn *);
+static int stream_flush(struct vconn *);
 
 int
 new_stream_vconn(const char *name, int fd, int connect_status,
@@ -79,8 +110,13 @@ new_stream_vconn(const char *name, int fd, int connect_status,
     vconn_init(&s->vconn, &stream_vconn_class, connect_status, ip, name,
                reconnectable);
     s->fd = fd;
-    s->txbuf = NULL;
+    poll_fd_register(fd);
+    queue_init(&s->txq);
+    s->tx_bytes = 0;
+    s->tx_error = 0;
     s->tx_waiter = NULL;
+    ofpbuf_init(&s->rxring, VCONN_RX_HEADROOM + STREAM_RX_RING_SIZE);
+    ofpbuf_reserve(&s->rxring, VCONN_RX_HEADROOM);
     s->rxbuf = NULL;
     *vconnp = &s->vconn;
     return 0;
@@ -97,9 +133,14 @@ static void
 stream_close(struct vconn *vconn)
 {
     struct stream_vconn *s = stream_vconn_cast(vconn);
+    /* Give queued messages a last chance to go out, e.g. a message sent just
+     * before closing. */
+    stream_flush(vconn);
     poll_cancel(s->tx_waiter);
-    stream_clear_txbuf(s);
+    queue_destroy(&s->txq);
+    ofpbuf_uninit(&s->rxring);
     ofpbuf_delete(s->rxbuf);
+    poll_fd_unregister(s->fd);
     close(s->fd);
     free(s);
 }
@@ -111,70 +152,145 @@ stream_connect(struct vconn *vconn)
     return check_connection_completion(s->fd);
 }
 
-static int
-stream_recv(struct vconn *vconn, struct ofpbuf **bufferp)
+/* Returns true if 's''s receive ring holds a complete message, or at least
+ * a header that stream_recv() will reject. */
+static bool
+stream_rx_ready(const struct stream_vconn *s)
 {
-    struct stream_vconn *s = stream_vconn_cast(vconn);
-    struct ofpbuf *rx;
-    size_t want_bytes;
-    ssize_t retval;
+    const struct ofp_header *oh = s->rxring.data;
 
-    if (s->rxbuf == NULL) {
-        s->rxbuf = ofpbuf_new(1564);
-    }
-    rx = s->rxbuf;
+    return (s->rxring.size >= sizeof *oh
+            && s->rxring.size >= ntohs(oh->length));
+}
 
-again:
-    if (sizeof(struct ofp_header) > rx->size) {
-        want_bytes = sizeof(struct ofp_header) - rx->size;
-    } else {
-        struct ofp_header *oh = rx->data;
-        size_t length = ntohs(oh->length);
-        if (length < sizeof(struct ofp_header)) {
-            VLOG_ERR_RL(&rl, "received too-short ofp_header (%zu bytes)",
-                        length);
-            return EPROTO;
-        }
-        want_bytes = length - rx->size;
-        if (!want_bytes) {
-            *bufferp = rx;
-            s->rxbuf = NULL;
-            return 0;
-        }
+/* Removes the first 'length' bytes from 's''s receive ring and returns them as
+ * a new message that shares the ring's memory. */
+static struct ofpbuf *
+stream_rx_take(struct stream_vconn *s, size_t length)
+{
+    struct ofpbuf *msg = ofpbuf_share(&s->rxring);
+
+    /* Limit the message to its own bytes and the headroom in front of them,
+     * so that ofpbuf_make_writable() copies no more than that. */
+    msg->base = (char *) msg->data - VCONN_RX_HEADROOM;
+    msg->allocated = VCONN_RX_HEADROOM + length;
+    msg->size = length;
+    ofpbuf_pull(&s->rxring, length);
+    return msg;
+}
+
+/* Makes room at the end of 's''s receive ring for the rest of the partial
+ * message, if any, at its start.  The partial message moves to the front of
+ * the ring, unless messages taken from the ring still refer to the bytes in
+ * front of it, in which case it is copied into a new ring if the old one is
+ * short of room. */
+static void
+stream_rx_rewind(struct stream_vconn *s)
+{
+    struct ofpbuf *ring = &s->rxring;
+    char *start = (char *) ring->base + VCONN_RX_HEADROOM;
+
+    if (!ofpbuf_is_shared(ring)) {
+        memmove(start, ring->data, ring->size);
+        ring->data = start;
+    } else if (ofpbuf_tailroom(ring) < STREAM_RX_DIRECT_MIN) {
+        struct ofpbuf old = *ring;
+
+        ofpbuf_init(ring, VCONN_RX_HEADROOM + STREAM_RX_RING_SIZE);
+        ofpbuf_reserve(ring, VCONN_RX_HEADROOM);
+        ofpbuf_put(ring, old.data, old.size);
+        ofpbuf_uninit(&old);
     }
-    ofpbuf_prealloc_tailroom(rx, want_bytes);
+}
+
+/* Reads the rest of the long message in 's->rxbuf'. */
+static int
+stream_recv_direct(struct stream_vconn *s, struct ofpbuf **bufferp)
+{
+    struct ofpbuf *rx = s->rxbuf;
+    struct ofp_header *oh = rx->data;
+    size_t want_bytes = ntohs(oh->length) - rx->size;
+    ssize_t retval;
 
     retval = read(s->fd, ofpbuf_tail(rx), want_bytes);
     if (retval > 0) {
         rx->size += retval;
         if (retval == want_bytes) {
-            if (rx->size > sizeof(struct ofp_header)) {
-                *bufferp = rx;
-                s->rxbuf = NULL;
-                return 0;
-            } else {
-                goto again;
-            }
+            *bufferp = rx;
+            s->rxbuf = NULL;
+            return 0;
         }
         return EAGAIN;
     } else if (retval == 0) {
-        if (rx->size) {
-            VLOG_ERR_RL(&rl, "connection dropped mid-packet");
-            return EPROTO;
-        } else {
-            return EOF;
-        }
+        VLOG_ERR_RL(&rl, "connection dropped mid-packet");
+        return EPROTO;
     } else {
         return errno;
     }
 }
 
-static void
-stream_clear_txbuf(struct stream_vconn *s)
+static int
+stream_recv(struct vconn *vconn, struct ofpbuf **bufferp)
 {
-    ofpbuf_delete(s->txbuf);
-    s->txbuf = NULL;
-    s->tx_waiter = NULL;
+    struct stream_vconn *s = stream_vconn_cast(vconn);
+    struct ofpbuf *ring = &s->rxring;
+    bool drained = false;
+
+    if (s->rxbuf) {
+        return stream_recv_direct(s, bufferp);
+    }
+
+    for (;;) {
+        size_t room;
+        ssize_t retval;
+
+        if (ring->size >= sizeof(struct ofp_header)) {
+            struct ofp_header *oh = ring->data;
+            size_t length = ntohs(oh->length);
+
+            if (length < sizeof(struct ofp_header)) {
+                VLOG_ERR_RL(&rl, "received too-short ofp_header (%zu bytes)",
+                            length);
+                return EPROTO;
+            } else if (ring->size >= length) {
+                *bufferp = stream_rx_take(s, length);
+                return 0;
+            } else if (length >= STREAM_RX_DIRECT_MIN) {
+                s->rxbuf = ofpbuf_new(VCONN_RX_HEADROOM + length);
+                ofpbuf_reserve(s->rxbuf, VCONN_RX_HEADROOM);
+                ofpbuf_put(s->rxbuf, ring->data, ring->size);
+                ofpbuf_pull(ring, ring->size);
+                return stream_recv_direct(s, bufferp);
+            }
+        }
+        if (drained) {
+            /* The last read() did not fill the ring, so another one would
+             * most likely just fail with EAGAIN. */
+            return EAGAIN;
+        }
+
+        /* Fill the ring after the start of the partial message, if any.  The
+         * bytes past the ring's tail belong to no message yet, even if the
+         * ring is shared. */
+        if (ring->data != (char *) ring->base + VCONN_RX_HEADROOM) {
+            stream_rx_rewind(s);
+        }
+        room = ofpbuf_tailroom(ring);
+        retval = read(s->fd, ofpbuf_tail(ring), room);
+        if (retval > 0) {
+            ring->size += retval;
+            drained = retval < room;
+        } else if (retval == 0) {
+            if (ring->size) {
+                VLOG_ERR_RL(&rl, "connection dropped mid-packet");
+                return EPROTO;
+            } else {
+                return EOF;
+            }
+        } else {
+            return errno;
+        }
+    }
 }
 
 static void
@@ -182,48 +298,96 @@ stream_do_tx(int fd UNUSED, short int revents UNUSED, void *vconn_)
 {
     struct vconn *vconn = vconn_;
     struct stream_vconn *s = stream_vconn_cast(vconn);
-    ssize_t n = write(s->fd, s->txbuf->data, s->txbuf->size);
-    if (n < 0) {
-        if (errno != EAGAIN) {
+
+    s->tx_waiter = NULL;
+    stream_flush(vconn);
+}
+
+/* Writes as much of 's''s transmit queue as the socket will take.  Returns 0
+ * if the queue is now empty, EAGAIN if some of it remains, in which case it
+ * will be written when the socket becomes writable, or a positive errno value
+ * if writing failed, in which case the queue is discarded. */
+static int
+stream_flush(struct vconn *vconn)
+{
+    struct stream_vconn *s = stream_vconn_cast(vconn);
+
+    while (s->txq.n && !s->tx_error) {
+        struct iovec iov[STREAM_TX_IOVECS];
+        struct ofpbuf *b;
+        size_t n_bytes = 0;
+        ssize_t retval;
+        int n_iov = 0;
+
+        for (b = s->txq.head; b && n_iov < STREAM_TX_IOVECS; b = b->next) {
+            iov[n_iov].iov_base = b->data;
+            iov[n_iov].iov_len = b->size;
+            n_bytes += b->size;
+            n_iov++;
+        }
+
+        retval = writev(s->fd, iov, n_iov);
+        if (retval < 0) {
+            if (errno == EAGAIN || errno == EINTR) {
+                break;
+            }
             VLOG_ERR_RL(&rl, "send: %s", strerror(errno));
-            stream_clear_txbuf(s);
-            return;
+            s->tx_error = errno;
+            queue_clear(&s->txq);
+            s->tx_bytes = 0;
+            break;
+        }
+
+        s->tx_bytes -= retval;
+        if (retval < n_bytes) {
+            /* The socket's buffer is full. */
+            while (retval >= s->txq.head->size) {
+                retval -= s->txq.head->size;
+                ofpbuf_delete(queue_pop_head(&s->txq));
+            }
+            ofpbuf_pull(s->txq.head, retval);
+            break;
         }
-    } else if (n > 0) {
-        ofpbuf_pull(s->txbuf, n);
-        if (!s->txbuf->size) {
-            stream_clear_txbuf(s);
-            return;
+        while (n_iov-- > 0) {
+            ofpbuf_delete(queue_pop_head(&s->txq));
         }
     }
-    s->tx_waiter = poll_fd_callback(s->fd, POLLOUT, stream_do_tx, vconn);
+
+    if (s->tx_error) {
+        return s->tx_error;
+    } else if (s->txq.n) {
+        if (!s->tx_waiter) {
+            s->tx_waiter = poll_fd_callback(s->fd, POLLOUT, stream_do_tx,
+                                            vconn);
+        }
+        return EAGAIN;
+    } else {
+        return 0;
+    }
 }
 
 static int
 stream_send(struct vconn *vconn, struct ofpbuf *buffer)
 {
     struct stream_vconn *s = stream_vconn_cast(vconn);
-    ssize_t retval;
 
-    if (s->txbuf) {
+    if (s->tx_bytes >= VCONN_TX_HIGH_WATER) {
+        /* Make room if the socket will take some of the queue now. */
+        stream_flush(vconn);
+    }
+    if (s->tx_error) {
+        return s->tx_error;
+    } else if (s->tx_bytes >= VCONN_TX_HIGH_WATER) {
         return EAGAIN;
     }
 
-    retval = write(s->fd, buffer->data, buffer->size);
-    if (retval == buffer->size) {
-        ofpbuf_delete(buffer);
-        return 0;
-    } else if (retval >= 0 || errno == EAGAIN) {
-        leak_checker_claim(buffer);
-        s->txbuf = buffer;
-        if (retval > 0) {
-            ofpbuf_pull(buffer, retval);
-        }
+    leak_checker_claim(buffer);
+    queue_push_tail(&s->txq, buffer);
+    s->tx_bytes += buffer->size;
+    if (!s->tx_waiter) {
         s->tx_waiter = poll_fd_callback(s->fd, POLLOUT, stream_do_tx, vconn);
-        return 0;
-    } else {
-        return errno;
     }
+    return 0;
 }
 
 static void
@@ -236,15 +400,20 @@ stream_wait(struct vconn *vconn, enum vconn_wait_type wait)
         break;
 
     case WAIT_SEND:
-        if (!s->txbuf) {
-            poll_fd_wait(s->fd, POLLOUT);
+        if (s->tx_bytes < VCONN_TX_HIGH_WATER || s->tx_error) {
+            /* There is room in the transmit queue. */
+            poll_immediate_wake();
         } else {
-            /* Nothing to do: need to drain txbuf first. */
+            /* The call to stream_do_tx() will wake us up. */
         }
         break;
 
     case WAIT_RECV:
-        poll_fd_wait(s->fd, POLLIN);
+        if (stream_rx_ready(s)) {
+            poll_immediate_wake();
+        } else {
+            poll_fd_wait(s->fd, POLLIN);
+        }
         break;
 
     default:
@@ -260,6 +429,7 @@ static struct vconn_class stream_vconn_class = {
     stream_recv,                /* recv */
     stream_send,                /* send */
     stream_wait,                /* wait */
+    stream_flush,               /* flush */
 };
 
 /* Passive stream socket vconn. */
@@ -306,6 +476,7 @@ new_pstream_pvconn(const char *name, int fd,
     ps = xmalloc(sizeof *ps);
     pvconn_init(&ps->pvconn, &pstream_pvconn_class, name);
     ps->fd = fd;
+    poll_fd_register(fd);
     ps->accept_cb = accept_cb;
     *pvconnp = &ps->pvconn;
     return 0;
@@ -315,6 +486,7 @@ static void
 pstream_close(struct pvconn *pvconn)
 {
     struct pstream_pvconn *ps = pstream_pvconn_cast(pvconn);
+    poll_fd_unregister(ps->fd);
     close(ps->fd);
     free(ps);
 }
@@ -74,6 +74,9 @@ static struct vconn_class *vconn_classes[] = {
 #ifdef HAVE_OPENSSL
     &ssl_vconn_class,
 #endif
+#ifdef HAVE_SHM
+    &shm_vconn_class,
+#endif
 };
 
 static struct pvconn_class *pvconn_classes[] = {
@@ -82,6 +85,9 @@ static struct pvconn_class *pvconn_classes[] = {
 #ifdef HAVE_OPENSSL
     &pssl_pvconn_class,
 #endif
+#ifdef HAVE_SHM
+    &pshm_pvconn_class,
+#endif
 };
 
 /* High rate limit because most of the rate-limiting here is individual
@@ -152,6 +158,10 @@ vconn_usage(bool active, bool passive, bool bootstrap UNUSED)
                "SSL PORT (default: %d) on remote HOST\n", OFP_SSL_PORT);
 #endif
         printf("  unix:FILE               Unix domain socket named FILE\n");
+#ifdef HAVE_SHM
+        printf("  shm:FILE                "
+               "shared memory, set up through Unix socket FILE\n");
+#endif
         printf("  fd:N                    File descriptor N\n");
     }
 
@@ -167,6 +177,10 @@ vconn_usage(bool active, bool passive, bool bootstrap UNUSED)
 #endif
         printf("  punix:FILE              "
                "listen on Unix domain socket FILE\n");
+#ifdef HAVE_SHM
+        printf("  pshm:FILE               "
+               "listen for shared memory on Unix socket FILE\n");
+#endif
     }
 
 #ifdef HAVE_OPENSSL
@@ -565,7 +579,8 @@ do_send(struct vconn *vconn, struct ofpbuf *msg)
     return retval;
 }
 
-/* Same as vconn_send, except that it waits until 'msg' can be transmitted. */
+/* Same as vconn_send, except that it waits until 'msg' has been transmitted,
+ * so that the caller may close 'vconn' right away. */
 int
 vconn_send_block(struct vconn *vconn, struct ofpbuf *msg)
 {
@@ -574,6 +589,11 @@ vconn_send_block(struct vconn *vconn, struct ofpbuf *msg)
         vconn_send_wait(vconn);
         poll_block();
     }
+    if (!retval && vconn->class->flush) {
+        while ((retval = (vconn->class->flush)(vconn)) == EAGAIN) {
+            poll_block();
+        }
+    }
     return retval;
 }
 
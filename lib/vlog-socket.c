@@ -111,6 +111,7 @@ vlog_server_listen(const char *path, struct vlog_server **serverp)
         return fd;
     }
 
+    poll_fd_register(server->fd);
     server->waiter = poll_fd_callback(server->fd, POLLIN, poll_server, server);
 
     if (serverp) {
@@ -125,6 +126,7 @@ vlog_server_close(struct vlog_server *server)
 {
     if (server) {
         poll_cancel(server->waiter);
+        poll_fd_unregister(server->fd);
         close(server->fd);
         unlink(server->path);
         fatal_signal_remove_file_to_unlink(server->path);
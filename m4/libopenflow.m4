@@ -60,6 +60,29 @@ AC_DEFUN([OFP_CHECK_NETLINK],
                 [Define to 1 if Netlink protocol is available.])
    fi])
 
+dnl Checks for memfd_create() and eventfds, which the shared memory vconn
+dnl needs.
+AC_DEFUN([OFP_CHECK_SHM],
+  [AC_CHECK_HEADER([sys/eventfd.h], [HAVE_SHM=yes], [HAVE_SHM=no])
+   if test "$HAVE_SHM" = yes; then
+      AC_CHECK_FUNC([memfd_create], [], [HAVE_SHM=no])
+   fi
+   AM_CONDITIONAL([HAVE_SHM], [test "$HAVE_SHM" = yes])
+   if test "$HAVE_SHM" = yes; then
+      AC_DEFINE([HAVE_SHM], [1],
+                [Define to 1 if memfd_create() and eventfds are available.])
+   fi])
+
+dnl Checks for epoll, which lib/poll-loop.c uses in preference to poll().
+AC_DEFUN([OFP_CHECK_EPOLL],
+  [AC_CHECK_HEADER([sys/epoll.h], [HAVE_EPOLL=yes], [HAVE_EPOLL=no])
+   if test "$HAVE_EPOLL" = yes; then
+      AC_CHECK_FUNC([epoll_create1], [], [HAVE_EPOLL=no])
+   fi
+   if test "$HAVE_EPOLL" = yes; then
+      AC_DEFINE([HAVE_EPOLL], [1], [Define to 1 if epoll is available.])
+   fi])
+
 dnl Checks for OpenSSL, if --enable-ssl is passed in.
 AC_DEFUN([OFP_CHECK_OPENSSL],
   [AC_ARG_ENABLE(
@@ -157,6 +180,8 @@ AC_DEFUN([OFP_CHECK_LIBOPENFLOW],
   [AC_REQUIRE([AC_USE_SYSTEM_EXTENSIONS])
    AC_REQUIRE([OFP_CHECK_NDEBUG])
    AC_REQUIRE([OFP_CHECK_NETLINK])
+   AC_REQUIRE([OFP_CHECK_SHM])
+   AC_REQUIRE([OFP_CHECK_EPOLL])
    AC_REQUIRE([OFP_CHECK_OPENSSL])
    AC_REQUIRE([OFP_CHECK_FAULT_LIBS])
    AC_REQUIRE([OFP_CHECK_SOCKET_LIBS])
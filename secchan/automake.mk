@@ -10,8 +10,12 @@ secchan_ofprotocol_SOURCES = \
 	secchan/fail-open.h \
 	secchan/failover.c \
 	secchan/failover.h \
+	secchan/hook-dispatch.c \
+	secchan/hook-dispatch.h \
 	secchan/in-band.c \
 	secchan/in-band.h \
+	secchan/port-queue.c \
+	secchan/port-queue.h \
 	secchan/port-watcher.c \
 	secchan/port-watcher.h \
 	secchan/protocol-stat.c \
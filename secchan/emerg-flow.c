@@ -128,6 +128,8 @@ emerg_flow_start(struct secchan *secchan, const struct settings *settings,
 		emerg_flow_periodic_cb,	/* periodic_cb */
 		NULL,		/* wait_cb */
 		NULL,		/* closing_cb */
+		NULL,		/* local_msgs */
+		NULL,		/* remote_msgs */
 	};
 
 	context = xmalloc(sizeof(*context));
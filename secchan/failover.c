@@ -123,6 +123,8 @@ failover_start(struct secchan *secchan, const struct settings *settings,
 		failover_periodic_cb,	/* periodic_cb */
 		NULL,		/* wait_cb */
 		NULL,		/* closing_cb */
+		NULL,		/* local_msgs */
+		NULL,		/* remote_msgs */
 	};
 
 	context = xmalloc(sizeof(*context));
@@ -0,0 +1,136 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ *
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#include <config.h>
+#include "hook-dispatch.h"
+#include <arpa/inet.h>
+#include <assert.h>
+#include "ofpbuf.h"
+#include "openflow/nicira-ext.h"
+#include "openflow/openflow.h"
+#include "openflow/private-ext.h"
+#include "secchan.h"
+#include "util.h"
+
+static void
+add_hook_sub(struct hook_dispatch *d, bool (*cb)(struct relay *, void *aux),
+             void *aux, uint32_t vendor, uint32_t subtype)
+{
+    struct hook_sub *sub;
+
+    if (d->n_subs >= d->allocated_subs) {
+        d->subs = x2nrealloc(d->subs, &d->allocated_subs, sizeof *d->subs);
+    }
+    sub = &d->subs[d->n_subs++];
+    sub->cb = cb;
+    sub->aux = aux;
+    sub->vendor = vendor;
+    sub->subtype = subtype;
+}
+
+/* Adds 'cb' to 'table', an array of N_MSG_TYPES elements, for each of the
+ * messages in 'msgs' (or for every message, if 'msgs' is null).  Does nothing
+ * if 'cb' is null. */
+void
+hook_dispatch_add(struct hook_dispatch table[],
+                  bool (*cb)(struct relay *, void *aux), void *aux,
+                  const struct hook_msg *msgs)
+{
+    const struct hook_msg *m;
+    int type;
+
+    if (!cb) {
+        return;
+    } else if (!msgs) {
+        for (type = 0; type < N_MSG_TYPES; type++) {
+            add_hook_sub(&table[type], cb, aux, HOOK_ANY, HOOK_ANY);
+        }
+    } else {
+        for (m = msgs; m->type >= 0; m++) {
+            assert(m->type < N_MSG_TYPES);
+            if (m->type == OFPT_VENDOR) {
+                add_hook_sub(&table[m->type], cb, aux, m->vendor, m->subtype);
+            } else {
+                add_hook_sub(&table[m->type], cb, aux, HOOK_ANY, HOOK_ANY);
+            }
+        }
+    }
+}
+
+/* Passes relay 'r''s message, whose header is decoded in 'hm', to the
+ * callbacks in 'table' that asked for its kind of message, in the order they
+ * were added, until one of them takes it.  Returns true if one did. */
+bool
+hook_dispatch_call(const struct hook_dispatch table[],
+                   const struct hook_msg *hm, struct relay *r)
+{
+    const struct hook_dispatch *d = &table[hm->type];
+    const struct hook_sub *sub;
+
+    for (sub = d->subs; sub < &d->subs[d->n_subs]; sub++) {
+        if ((sub->vendor == HOOK_ANY || sub->vendor == hm->vendor)
+            && (sub->subtype == HOOK_ANY || sub->subtype == hm->subtype)
+            && sub->cb(r, sub->aux)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Decodes the header of 'msg' into 'hm'.  The vendor and subtype are 0 if
+ * 'msg' is not a vendor message or too short to have them. */
+void
+hook_msg_parse(const struct ofpbuf *msg, struct hook_msg *hm)
+{
+    const struct ofp_header *oh = msg->data;
+
+    hm->type = oh->type;
+    hm->vendor = hm->subtype = 0;
+    if (oh->type == OFPT_VENDOR
+        && msg->size >= sizeof(struct ofp_vendor_header)) {
+        const struct ofp_vendor_header *ovh = msg->data;
+
+        hm->vendor = ntohl(ovh->vendor);
+        if (hm->vendor == NX_VENDOR_ID
+            && msg->size >= sizeof(struct nicira_header)) {
+            const struct nicira_header *nh = msg->data;
+            hm->subtype = ntohl(nh->subtype);
+        } else if (hm->vendor == PRIVATE_VENDOR_ID
+                   && msg->size >= (sizeof(struct private_vxhdr)
+                                    + sizeof(struct private_vxopt))) {
+            const struct private_vxhdr *pvh = msg->data;
+            const struct private_vxopt *pvo = (const void *) (pvh + 1);
+            hm->subtype = ntohs(pvo->pvo_type);
+        }
+    }
+}
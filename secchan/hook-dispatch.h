@@ -0,0 +1,75 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ *
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#ifndef HOOK_DISPATCH_H
+#define HOOK_DISPATCH_H 1
+
+/* Routing of relayed messages to the packet callbacks that asked for them.
+ *
+ * A table has one entry per OpenFlow message type.  Each entry lists the
+ * callbacks that want that type, in the order they were added, along with
+ * the vendor and subtype each wants for OFPT_VENDOR messages. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct hook_msg;
+struct ofpbuf;
+struct relay;
+
+/* Number of possible OpenFlow message types. */
+#define N_MSG_TYPES 256
+
+/* A packet callback that wants to see messages of one type. */
+struct hook_sub {
+    bool (*cb)(struct relay *, void *aux);
+    void *aux;
+    uint32_t vendor;            /* Vendor ID, or HOOK_ANY. */
+    uint32_t subtype;           /* Vendor subtype, or HOOK_ANY. */
+};
+
+/* The packet callbacks for one message type, in the order they were added. */
+struct hook_dispatch {
+    struct hook_sub *subs;
+    size_t n_subs, allocated_subs;
+};
+
+void hook_dispatch_add(struct hook_dispatch table[],
+                       bool (*cb)(struct relay *, void *aux), void *aux,
+                       const struct hook_msg *msgs);
+bool hook_dispatch_call(const struct hook_dispatch table[],
+                        const struct hook_msg *, struct relay *);
+void hook_msg_parse(const struct ofpbuf *, struct hook_msg *);
+
+#endif /* hook-dispatch.h */
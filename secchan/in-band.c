@@ -304,12 +304,19 @@ in_band_wait_cb(void *in_band_)
     mac_learning_wait(in_band->ml);
 }
 
+static const struct hook_msg in_band_local_msgs[] = {
+    { OFPT_PACKET_IN, 0, 0 },
+    HOOK_MSG_END
+};
+
 static struct hook_class in_band_hook_class = {
     in_band_local_packet_cb,    /* local_packet_cb */
     NULL,                       /* remote_packet_cb */
     in_band_periodic_cb,        /* periodic_cb */
     in_band_wait_cb,            /* wait_cb */
     NULL,                       /* closing_cb */
+    in_band_local_msgs,         /* local_msgs */
+    NULL,                       /* remote_msgs */
 };
 
 void
@@ -0,0 +1,219 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ *
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#include <config.h>
+#include "port-queue.h"
+#include <stdlib.h>
+#include "hash.h"
+#include "ofpbuf.h"
+#include "random.h"
+#include "util.h"
+
+void
+port_queues_init(struct port_queues *pqs)
+{
+    hmap_init(&pqs->ports);
+    list_init(&pqs->active);
+    pqs->by_len = NULL;
+    pqs->n_by_len = 0;
+    pqs->max_len = 0;
+    pqs->n_queued = 0;
+}
+
+/* Frees 'pqs', its queues, and the packets queued in them. */
+void
+port_queues_destroy(struct port_queues *pqs)
+{
+    struct port_queue *pq, *next;
+
+    HMAP_FOR_EACH_SAFE (pq, next, struct port_queue, hmap_node,
+                        &pqs->ports) {
+        hmap_remove(&pqs->ports, &pq->hmap_node);
+        queue_destroy(&pq->q);
+        free(pq);
+    }
+    hmap_destroy(&pqs->ports);
+    free(pqs->by_len);
+}
+
+/* Returns the queue for 'port' in 'pqs', creating it if necessary. */
+static struct port_queue *
+get_port_queue(struct port_queues *pqs, uint16_t port)
+{
+    uint32_t hash = hash_bytes(&port, sizeof port, 0);
+    struct port_queue *pq;
+
+    HMAP_FOR_EACH_WITH_HASH (pq, struct port_queue, hmap_node, hash,
+                             &pqs->ports) {
+        if (pq->port == port) {
+            return pq;
+        }
+    }
+
+    pq = xcalloc(1, sizeof *pq);
+    pq->port = port;
+    queue_init(&pq->q);
+    hmap_insert(&pqs->ports, &pq->hmap_node, hash);
+    return pq;
+}
+
+/* Makes room in 'pqs->by_len' for a queue of 'len' packets. */
+static void
+grow_by_len(struct port_queues *pqs, int len)
+{
+    int n = MAX(len + 1, pqs->n_by_len * 2);
+    struct list *by_len = xmalloc(n * sizeof *by_len);
+    int i;
+
+    /* The lists are linked through their heads, so each one has to be moved
+     * to its new head before the old ones are freed. */
+    for (i = 0; i < pqs->n_by_len; i++) {
+        if (list_is_empty(&pqs->by_len[i])) {
+            list_init(&by_len[i]);
+        } else {
+            list_replace(&by_len[i], &pqs->by_len[i]);
+        }
+    }
+    for (; i < n; i++) {
+        list_init(&by_len[i]);
+    }
+    free(pqs->by_len);
+    pqs->by_len = by_len;
+    pqs->n_by_len = n;
+}
+
+/* Moves 'pq' to the length index bucket for its current length, after its
+ * length changed by one from 'old_len'. */
+static void
+update_len(struct port_queues *pqs, struct port_queue *pq, int old_len)
+{
+    int len = pq->q.n;
+
+    if (old_len) {
+        list_remove(&pq->len_node);
+    }
+    if (len) {
+        if (len >= pqs->n_by_len) {
+            grow_by_len(pqs, len);
+        }
+        list_push_back(&pqs->by_len[len], &pq->len_node);
+        pqs->max_len = MAX(pqs->max_len, len);
+    }
+    if (pqs->max_len && list_is_empty(&pqs->by_len[pqs->max_len])) {
+        /* Lengths only change by one at a time, so if the longest bucket just
+         * emptied, the queue that was in it is now in the next one down. */
+        pqs->max_len--;
+    }
+}
+
+/* Adds 'msg' to the tail of the queue for 'port' in 'pqs'. */
+void
+port_queues_enqueue(struct port_queues *pqs, uint16_t port,
+                    struct ofpbuf *msg)
+{
+    struct port_queue *pq = get_port_queue(pqs, port);
+
+    if (!pq->q.n) {
+        list_push_back(&pqs->active, &pq->active_node);
+    }
+    queue_push_tail(&pq->q, msg);
+    update_len(pqs, pq, pq->q.n - 1);
+    pqs->n_queued++;
+}
+
+/* Removes and returns the packet at the head of 'pq', which must be
+ * nonempty. */
+static struct ofpbuf *
+pop_packet(struct port_queues *pqs, struct port_queue *pq)
+{
+    struct ofpbuf *msg = queue_pop_head(&pq->q);
+
+    update_len(pqs, pq, pq->q.n + 1);
+    if (!pq->q.n) {
+        /* A queue that goes idle gives up whatever deficit it had left, as
+         * in deficit round robin, so that it cannot save up for a burst. */
+        list_remove(&pq->active_node);
+        pq->deficit = 0;
+    }
+    pqs->n_queued--;
+    return msg;
+}
+
+/* Drops a packet from one of the longest queues in 'pqs', which must not be
+ * empty. */
+void
+port_queues_drop(struct port_queues *pqs)
+{
+    struct port_queue *longest = NULL;
+    struct port_queue *pq;
+    int n_longest = 0;
+
+    /* Randomly select one of the longest queues, with a uniform distribution
+     * (Knuth algorithm 3.4.2R). */
+    LIST_FOR_EACH (pq, struct port_queue, len_node,
+                   &pqs->by_len[pqs->max_len]) {
+        if (!random_range(++n_longest)) {
+            longest = pq;
+        }
+    }
+
+    /* FIXME: do we want to pop the tail instead? */
+    ofpbuf_delete(pop_packet(pqs, longest));
+    longest->n_dropped++;
+}
+
+/* Removes and returns the next packet to transmit from 'pqs', which must not
+ * be empty, choosing among the ports in deficit round-robin order.  Stores
+ * the packet's queue in '*pqp'. */
+struct ofpbuf *
+port_queues_dequeue(struct port_queues *pqs, struct port_queue **pqp)
+{
+    for (;;) {
+        struct port_queue *pq = CONTAINER_OF(list_front(&pqs->active),
+                                             struct port_queue, active_node);
+        int size = pq->q.head->size;
+
+        if (pq->deficit >= size) {
+            pq->deficit -= size;
+            *pqp = pq;
+            return pop_packet(pqs, pq);
+        }
+
+        /* Move on to the next port, giving this one its quantum for its next
+         * turn.  A packet_in is never much bigger than the quantum, so this
+         * loop runs only a few times. */
+        pq->deficit += PORT_QUEUE_QUANTUM;
+        list_remove(&pq->active_node);
+        list_push_back(&pqs->active, &pq->active_node);
+    }
+}
@@ -0,0 +1,84 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ *
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#ifndef PORT_QUEUE_H
+#define PORT_QUEUE_H 1
+
+/* Per-port queues of packet_in messages, for the rate limiter.
+ *
+ * Queues are created on demand, one per port that has ever had a packet_in
+ * queued.  Only the ports with packets queued are in 'active' and 'by_len', so
+ * that picking a packet to send or to drop does not depend on the number of
+ * ports.  Packets are sent in deficit round robin order across the active
+ * queues, and dropped from a randomly chosen one of the longest queues. */
+
+#include <stdint.h>
+#include "hmap.h"
+#include "list.h"
+#include "queue.h"
+
+struct ofpbuf;
+
+/* Number of bytes of packet_in messages that a port's queue may send each
+ * time its turn comes up in deficit round robin.  Roughly one full-size frame,
+ * so that ports that send big packet_ins get no more than their share. */
+#define PORT_QUEUE_QUANTUM 1500
+
+/* Packet_in messages queued for a single port. */
+struct port_queue {
+    struct hmap_node hmap_node; /* In port_queues's 'ports'. */
+    struct list active_node;    /* In port_queues's 'active', if q.n > 0. */
+    struct list len_node;       /* In port_queues's 'by_len[q.n]'. */
+    uint16_t port;              /* Port number, in host byte order. */
+    struct ofp_queue q;         /* Queued packet_in messages. */
+    int deficit;                /* Bytes that may be sent in this turn. */
+    unsigned long long n_dropped; /* # dropped from this queue. */
+};
+
+struct port_queues {
+    struct hmap ports;          /* Contains "struct port_queue"s. */
+    struct list active;         /* Nonempty queues, in round-robin order. */
+    struct list *by_len;        /* by_len[i] has the queues with i packets. */
+    int n_by_len;               /* Number of elements in 'by_len'. */
+    int max_len;                /* Length of the longest queue. */
+    int n_queued;               /* Sum of queue lengths. */
+};
+
+void port_queues_init(struct port_queues *);
+void port_queues_destroy(struct port_queues *);
+
+void port_queues_enqueue(struct port_queues *, uint16_t port, struct ofpbuf *);
+struct ofpbuf *port_queues_dequeue(struct port_queues *, struct port_queue **);
+void port_queues_drop(struct port_queues *);
+
+#endif /* port-queue.h */
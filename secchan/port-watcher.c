@@ -588,12 +588,25 @@ port_watcher_is_ready(const struct port_watcher *pw)
     return pw->got_feature_reply;
 }
 
+static const struct hook_msg port_watcher_local_msgs[] = {
+    { OFPT_FEATURES_REPLY, 0, 0 },
+    { OFPT_PORT_STATUS, 0, 0 },
+    HOOK_MSG_END
+};
+
+static const struct hook_msg port_watcher_remote_msgs[] = {
+    { OFPT_PORT_MOD, 0, 0 },
+    HOOK_MSG_END
+};
+
 static struct hook_class port_watcher_hook_class = { 
     port_watcher_local_packet_cb,                        /* local_packet_cb */
     port_watcher_remote_packet_cb,                       /* remote_packet_cb */
     port_watcher_periodic_cb,                            /* periodic_cb */
     port_watcher_wait_cb,                                /* wait_cb */
     NULL,                                                /* closing_cb */
+    port_watcher_local_msgs,                             /* local_msgs */
+    port_watcher_remote_msgs,                            /* remote_msgs */
 };
 
 void
@@ -127,6 +127,11 @@ struct protocol_stat_context {
 
 static bool protocol_stat_remote_packet_cb(struct relay *, void *);
 
+static const struct hook_msg protocol_stat_remote_msgs[] = {
+	{ OFPT_VENDOR, PRIVATE_VENDOR_ID, HOOK_ANY },
+	HOOK_MSG_END
+};
+
 static bool
 protocol_stat_remote_packet_cb(struct relay *relay, void *context_)
 {
@@ -136,25 +141,19 @@ protocol_stat_remote_packet_cb(struct relay *relay, void *context_)
 	struct ofpbuf *pbuf = NULL;
 	struct private_vxhdr *qvxhdr = NULL;
 	struct private_vxhdr *pvxhdr = NULL;
-	struct private_vxopt *qvxopt = NULL;
 	struct private_vxopt *pvxopt = NULL;
 	struct ofpstat *ofps = NULL;
 	struct ofpstat ofps_rcvd;
 	struct ofpstat ofps_sent;
 	int error = 0;
 
-	if (qbuf->size < sizeof(*qvxhdr))
-		return false;
-	qvxhdr = qbuf->data;
-	if (qvxhdr->ofp_hdr.type != OFPT_VENDOR)
-		return false;
-	if (ntohl(qvxhdr->ofp_vxid) != PRIVATE_VENDOR_ID) {
-		return false;
-	}
-	qvxopt = (struct private_vxopt *)(qvxhdr + 1);
-	if (ntohs(qvxopt->pvo_type) != PRIVATEOPT_PROTOCOL_STATS_REQUEST) {
+	/* Only PRIVATE_VENDOR_ID messages get here.  Swallow all but the
+	 * requests for protocol statistics. */
+	if (relay->halves[HALF_REMOTE].rxmsg.subtype
+	    != PRIVATEOPT_PROTOCOL_STATS_REQUEST) {
 		return true;
 	}
+	qvxhdr = qbuf->data;
 
 	pvxhdr = make_openflow_xid(sizeof(*pvxhdr) + sizeof(*pvxopt)
 				   + (sizeof(*ofps) * 2),
@@ -190,6 +189,8 @@ protocol_stat_start(struct secchan *secchan, const struct settings *settings,
 		NULL,		/* periodic_cb */
 		NULL,		/* wait_cb */
 		NULL,		/* closing_cb */
+		NULL,		/* local_msgs */
+		protocol_stat_remote_msgs,	/* remote_msgs */
 	};
 
 	context = xmalloc(sizeof(*context));
@@ -34,11 +34,13 @@
 #include <config.h>
 #include "ratelimit.h"
 #include <arpa/inet.h>
+#include <inttypes.h>
 #include <stdlib.h>
+#include "hmap.h"
 #include "ofpbuf.h"
 #include "openflow/openflow.h"
 #include "poll-loop.h"
-#include "queue.h"
+#include "port-queue.h"
 #include "rconn.h"
 #include "secchan.h"
 #include "status.h"
@@ -49,10 +51,8 @@ struct rate_limiter {
     const struct settings *s;
     struct rconn *remote_rconn;
 
-    /* One queue per physical port. */
-    struct ofp_queue queues[OFPP_MAX];
-    int n_queued;               /* Sum over queues[*].n. */
-    int next_tx_port;           /* Next port to check in round-robin. */
+    /* Packet_ins waiting for tokens. */
+    struct port_queues queues;
 
     /* Token bucket.
      *
@@ -73,54 +73,6 @@ struct rate_limiter {
     unsigned long long n_tx_dropped;    /* # dropped due to tx overflow. */
 };
 
-/* Drop a packet from the longest queue in 'rl'. */
-static void
-drop_packet(struct rate_limiter *rl)
-{
-    struct ofp_queue *longest;  /* Queue currently selected as longest. */
-    int n_longest;              /* # of queues of same length as 'longest'. */
-    struct ofp_queue *q;
-
-    longest = &rl->queues[0];
-    n_longest = 1;
-    for (q = &rl->queues[0]; q < &rl->queues[OFPP_MAX]; q++) {
-        if (longest->n < q->n) {
-            longest = q;
-            n_longest = 1;
-        } else if (longest->n == q->n) {
-            n_longest++;
-
-            /* Randomly select one of the longest queues, with a uniform
-             * distribution (Knuth algorithm 3.4.2R). */
-            if (!random_range(n_longest)) {
-                longest = q;
-            }
-        }
-    }
-
-    /* FIXME: do we want to pop the tail instead? */
-    ofpbuf_delete(queue_pop_head(longest));
-    rl->n_queued--;
-}
-
-/* Remove and return the next packet to transmit (in round-robin order). */
-static struct ofpbuf *
-dequeue_packet(struct rate_limiter *rl)
-{
-    unsigned int i;
-
-    for (i = 0; i < OFPP_MAX; i++) {
-        unsigned int port = (rl->next_tx_port + i) % OFPP_MAX;
-        struct ofp_queue *q = &rl->queues[port];
-        if (q->n) {
-            rl->next_tx_port = (port + 1) % OFPP_MAX;
-            rl->n_queued--;
-            return queue_pop_head(q);
-        }
-    }
-    NOT_REACHED();
-}
-
 /* Add tokens to the bucket based on elapsed time. */
 static void
 refill_bucket(struct rate_limiter *rl)
@@ -167,7 +119,7 @@ rate_limit_local_packet_cb(struct relay *r, void *rl_)
         return false;
     }
 
-    if (!rl->n_queued && get_token(rl)) {
+    if (!rl->queues.n_queued && get_token(rl)) {
         /* In the common case where we are not constrained by the rate limit,
          * let the packet take the normal path. */
         rl->n_normal++;
@@ -175,12 +127,12 @@ rate_limit_local_packet_cb(struct relay *r, void *rl_)
     } else {
         /* Otherwise queue it up for the periodic callback to drain out. */
         struct ofpbuf *msg = r->halves[HALF_LOCAL].rxbuf;
-        int port = ntohs(opi->in_port) % OFPP_MAX;
-        if (rl->n_queued >= s->burst_limit) {
-            drop_packet(rl);
+        if (rl->queues.n_queued >= s->burst_limit) {
+            port_queues_drop(&rl->queues);
+            rl->n_queue_dropped++;
         }
-        queue_push_tail(&rl->queues[port], ofpbuf_clone(msg));
-        rl->n_queued++;
+        port_queues_enqueue(&rl->queues, ntohs(opi->in_port),
+                            ofpbuf_clone(msg));
         rl->n_limited++;
         return true;
     }
@@ -190,11 +142,18 @@ static void
 rate_limit_status_cb(struct status_reply *sr, void *rl_)
 {
     struct rate_limiter *rl = rl_;
+    struct port_queue *pq;
 
     status_reply_put(sr, "normal=%llu", rl->n_normal);
     status_reply_put(sr, "limited=%llu", rl->n_limited);
     status_reply_put(sr, "queue-dropped=%llu", rl->n_queue_dropped);
     status_reply_put(sr, "tx-dropped=%llu", rl->n_tx_dropped);
+    HMAP_FOR_EACH (pq, struct port_queue, hmap_node, &rl->queues.ports) {
+        if (pq->n_dropped) {
+            status_reply_put(sr, "port%"PRIu16"-dropped=%llu",
+                             pq->port, pq->n_dropped);
+        }
+    }
 }
 
 static void
@@ -206,13 +165,15 @@ rate_limit_periodic_cb(void *rl_)
     /* Drain some packets out of the bucket if possible, but limit the number
      * of iterations to allow other code to get work done too. */
     refill_bucket(rl);
-    for (i = 0; rl->n_queued && get_token(rl) && i < 50; i++) {
+    for (i = 0; rl->queues.n_queued && get_token(rl) && i < 50; i++) {
         /* Use a small, arbitrary limit for the amount of queuing to do here,
          * because the TCP connection is responsible for buffering and there is
          * no point in trying to transmit faster than the TCP connection can
          * handle. */
-        struct ofpbuf *b = dequeue_packet(rl);
+        struct port_queue *pq;
+        struct ofpbuf *b = port_queues_dequeue(&rl->queues, &pq);
         if (rconn_send_with_limit(rl->remote_rconn, b, &rl->n_txq, 10)) {
+            pq->n_dropped++;
             rl->n_tx_dropped++;
         }
     }
@@ -222,7 +183,7 @@ static void
 rate_limit_wait_cb(void *rl_)
 {
     struct rate_limiter *rl = rl_;
-    if (rl->n_queued) {
+    if (rl->queues.n_queued) {
         if (rl->tokens >= 1000) {
             /* We can transmit more packets as soon as we're called again. */
             poll_immediate_wake();
@@ -234,12 +195,19 @@ rate_limit_wait_cb(void *rl_)
     }
 }
 
+static const struct hook_msg rate_limit_local_msgs[] = {
+    { OFPT_PACKET_IN, 0, 0 },
+    HOOK_MSG_END
+};
+
 static struct hook_class rate_limit_hook_class = {
     rate_limit_local_packet_cb, /* local_packet_cb */
     NULL,                       /* remote_packet_cb */
     rate_limit_periodic_cb,     /* periodic_cb */
     rate_limit_wait_cb,         /* wait_cb */
     NULL,                       /* closing_cb */
+    rate_limit_local_msgs,      /* local_msgs */
+    NULL,                       /* remote_msgs */
 };
 
 void
@@ -247,14 +215,11 @@ rate_limit_start(struct secchan *secchan, const struct settings *s,
                  struct switch_status *ss, struct rconn *remote)
 {
     struct rate_limiter *rl;
-    size_t i;
 
     rl = xcalloc(1, sizeof *rl);
     rl->s = s;
     rl->remote_rconn = remote;
-    for (i = 0; i < ARRAY_SIZE(rl->queues); i++) {
-        queue_init(&rl->queues[i]);
-    }
+    port_queues_init(&rl->queues);
     rl->last_fill = time_msec();
     rl->tokens = s->rate_limit * 100;
     switch_status_register_category(ss, "rate-limit",
@@ -50,6 +50,7 @@
 #include "fail-open.h"
 #include "failover.h"
 #include "fault.h"
+#include "hook-dispatch.h"
 #include "in-band.h"
 #include "leak-checker.h"
 #include "list.h"
@@ -80,10 +81,20 @@ struct hook {
 struct secchan {
     struct hook *hooks;
     size_t n_hooks, allocated_hooks;
+
+    /* Packet callbacks for each half of a relay, indexed by message type. */
+    struct hook_dispatch dispatch[2][N_MSG_TYPES];
 };
 
 static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
 
+/* A relay stops reading from one side when this many bytes wait in the send
+ * queue of the other side's rconn, i.e. beyond what its vconn has taken. */
+#define RELAY_TXQ_BYTES (64 * 1024)
+
+/* Bytes that a relay forwards in each direction per call to relay_run(). */
+#define RELAY_BATCH_BYTES (256 * 1024)
+
 static void parse_options(int argc, char *argv[], struct settings *);
 static void usage(void) NO_RETURN;
 
@@ -129,9 +140,7 @@ main(int argc, char *argv[])
     parse_options(argc, argv, &s);
     signal(SIGPIPE, SIG_IGN);
 
-    secchan.hooks = NULL;
-    secchan.n_hooks = 0;
-    secchan.allocated_hooks = 0;
+    memset(&secchan, 0, sizeof secchan);
 
     /* Start listening for management and monitoring connections. */
     n_listeners = 0;
@@ -338,14 +347,18 @@ add_hook(struct secchan *secchan, const struct hook_class *class, void *aux)
     hook = &secchan->hooks[secchan->n_hooks++];
     hook->class = class;
     hook->aux = aux;
+
+    hook_dispatch_add(secchan->dispatch[HALF_LOCAL], class->local_packet_cb,
+                      aux, class->local_msgs);
+    hook_dispatch_add(secchan->dispatch[HALF_REMOTE], class->remote_packet_cb,
+                      aux, class->remote_msgs);
 }
 
 struct ofp_packet_in *
 get_ofp_packet_in(struct relay *r)
 {
     struct ofpbuf *msg = r->halves[HALF_LOCAL].rxbuf;
-    struct ofp_header *oh = msg->data;
-    if (oh->type == OFPT_PACKET_IN) {
+    if (r->halves[HALF_LOCAL].rxmsg.type == OFPT_PACKET_IN) {
         if (msg->size >= offsetof (struct ofp_packet_in, data)) {
             return msg->data;
         } else {
@@ -441,36 +454,49 @@ relay_create(struct rconn *async, struct rconn *local, struct rconn *remote,
     return r;
 }
 
+/* Passes the message just received on 'r''s half 'i' to the hooks that asked
+ * for its kind of message, in the order they were added, until one of them
+ * takes it.  Returns true if one did. */
 static bool
-call_local_packet_cbs(struct secchan *secchan, struct relay *r)
+call_packet_cbs(struct secchan *secchan, struct relay *r, int i)
 {
-    const struct hook *h;
-    for (h = secchan->hooks; h < &secchan->hooks[secchan->n_hooks]; h++) {
-        bool (*cb)(struct relay *, void *aux) = h->class->local_packet_cb;
-        if (cb && (cb)(r, h->aux)) {
-            return true;
-        }
+    return hook_dispatch_call(secchan->dispatch[i], &r->halves[i].rxmsg, r);
+}
+
+/* Receives a message for 'r''s half 'i', or returns a null pointer if none is
+ * waiting.  The local half of the primary relay takes turns between its two
+ * connections to the datapath, so that a flood of asynchronous events cannot
+ * hold up replies to requests, nor the other way around. */
+static struct ofpbuf *
+relay_recv(struct relay *r, int i)
+{
+    struct rconn *rc = r->halves[i].rconn;
+    struct ofpbuf *msg;
+
+    if (i == HALF_LOCAL && r->async_rconn) {
+        struct rconn *first = r->async_first ? r->async_rconn : rc;
+        struct rconn *second = r->async_first ? rc : r->async_rconn;
+
+        r->async_first = !r->async_first;
+        msg = rconn_recv(first);
+        return msg ? msg : rconn_recv(second);
+    } else {
+        return rconn_recv(rc);
     }
-    return false;
 }
 
+/* Returns true if the rconn of 'r''s half 'i' has room to take messages from
+ * the other half. */
 static bool
-call_remote_packet_cbs(struct secchan *secchan, struct relay *r)
+relay_has_room(const struct relay *r, int i)
 {
-    const struct hook *h;
-    for (h = secchan->hooks; h < &secchan->hooks[secchan->n_hooks]; h++) {
-        bool (*cb)(struct relay *, void *aux) = h->class->remote_packet_cb;
-        if (cb && (cb)(r, h->aux)) {
-            return true;
-        }
-    }
-    return false;
+    return rconn_queued_bytes(r->halves[i].rconn) < RELAY_TXQ_BYTES;
 }
 
 static void
 relay_run(struct relay *r, struct secchan *secchan)
 {
-    int iteration;
+    size_t budget[2];
     int i;
 
     if (r->async_rconn) {
@@ -480,42 +506,40 @@ relay_run(struct relay *r, struct secchan *secchan)
         rconn_run(r->halves[i].rconn);
     }
 
-    /* Limit the number of iterations to prevent other tasks from starving. */
-    for (iteration = 0; iteration < 50; iteration++) {
+    /* Forward messages in both directions until each has stalled or used up
+     * its budget, which keeps other tasks from starving. */
+    budget[HALF_LOCAL] = budget[HALF_REMOTE] = RELAY_BATCH_BYTES;
+    for (;;) {
         bool progress = false;
         for (i = 0; i < 2; i++) {
             struct half *this = &r->halves[i];
             struct half *peer = &r->halves[!i];
 
-            if (!this->rxbuf) {
-                this->rxbuf = rconn_recv(this->rconn);
-                if (!this->rxbuf && i == HALF_LOCAL && r->async_rconn) {
-                    this->rxbuf = rconn_recv(r->async_rconn);
+            if (!this->rxbuf && budget[i] && relay_has_room(r, !i)) {
+                this->rxbuf = relay_recv(r, i);
+                if (!this->rxbuf) {
+                    continue;
                 }
-                if (this->rxbuf && (i == HALF_REMOTE || !r->is_mgmt_conn)) {
-                    if (i == HALF_LOCAL
-                        ? call_local_packet_cbs(secchan, r)
-                        : call_remote_packet_cbs(secchan, r))
-                    {
+                budget[i] -= MIN(budget[i], this->rxbuf->size);
+                if (i == HALF_REMOTE || !r->is_mgmt_conn) {
+                    hook_msg_parse(this->rxbuf, &this->rxmsg);
+                    if (call_packet_cbs(secchan, r, i)) {
                         ofpbuf_delete(this->rxbuf);
                         this->rxbuf = NULL;
                         progress = true;
-                        break;
+                        continue;
                     }
                 }
             }
 
-            if (this->rxbuf && !this->n_txq) {
-                int retval = rconn_send(peer->rconn, this->rxbuf,
-                                        &this->n_txq);
-                if (retval != EAGAIN) {
-                    if (!retval) {
-                        progress = true;
-                    } else {
-                        ofpbuf_delete(this->rxbuf);
-                    }
-                    this->rxbuf = NULL;
+            if (this->rxbuf && relay_has_room(r, !i)) {
+                int retval = rconn_send(peer->rconn, this->rxbuf, NULL);
+                if (!retval) {
+                    progress = true;
+                } else {
+                    ofpbuf_delete(this->rxbuf);
                 }
+                this->rxbuf = NULL;
             }
         }
         if (!progress) {
@@ -546,7 +570,9 @@ relay_wait(struct relay *r)
         struct half *this = &r->halves[i];
 
         rconn_run_wait(this->rconn);
-        if (!this->rxbuf) {
+
+        /* While the peer's queue is full, wait for it to drain instead. */
+        if (!this->rxbuf && relay_has_room(r, !i)) {
             rconn_recv_wait(this->rconn);
             if (i == HALF_LOCAL && r->async_rconn) {
                 rconn_recv_wait(r->async_rconn);
@@ -89,10 +89,28 @@ struct settings {
     bool emerg_flow;
 };
 
+/* The kind of an OpenFlow message: its type and, for OFPT_VENDOR messages,
+ * its vendor ID and the vendor's subtype (for vendors whose subtypes secchan
+ * knows how to find, otherwise 0).
+ *
+ * Used both to describe the messages that a hook wants to see and, in struct
+ * half, to hold the decoded header of a received message. */
+struct hook_msg {
+    int type;                   /* OFPT_*, or -1 to end a list. */
+    uint32_t vendor;            /* Vendor ID, or HOOK_ANY. */
+    uint32_t subtype;           /* Vendor subtype, or HOOK_ANY. */
+};
+
+/* In a hook's list of messages, matches any vendor ID or subtype. */
+#define HOOK_ANY UINT32_MAX
+
+/* Ends a list of "struct hook_msg"s. */
+#define HOOK_MSG_END { -1, 0, 0 }
+
 struct half {
     struct rconn *rconn;
-    struct ofpbuf *rxbuf;
-    int n_txq;                  /* No. of packets queued for tx on 'rconn'. */
+    struct ofpbuf *rxbuf;       /* Message received but not yet forwarded. */
+    struct hook_msg rxmsg;      /* Decoded header of 'rxbuf'. */
 };
 
 struct relay {
@@ -114,6 +132,7 @@ struct relay {
      * events and thus have a null 'async_rconn'. */
     bool is_mgmt_conn;          /* Is this a management connection? */
     struct rconn *async_rconn;  /* For receiving asynchronous events. */
+    bool async_first;           /* Try 'async_rconn' first on next receive? */
 };
 
 struct hook_class {
@@ -122,6 +141,13 @@ struct hook_class {
     void (*periodic_cb)(void *aux);
     void (*wait_cb)(void *aux);
     void (*closing_cb)(struct relay *, void *aux);
+
+    /* The messages to pass to local_packet_cb and remote_packet_cb,
+     * respectively, each terminated by HOOK_MSG_END.  A null pointer passes
+     * every message.  A callback is only called for the messages that it
+     * asked for. */
+    const struct hook_msg *local_msgs;
+    const struct hook_msg *remote_msgs;
 };
 
 void add_hook(struct secchan *, const struct hook_class *, void *);
@@ -80,15 +80,12 @@ switch_status_remote_packet_cb(struct relay *r, void *ss_)
     struct ofpbuf *b;
     int retval;
 
+    /* Only NXT_STATUS_REQUEST messages get here, but one too short to hold
+     * a subtype decodes as subtype 0. */
     if (msg->size < sizeof(struct nicira_header)) {
         return false;
     }
     request = msg->data;
-    if (request->header.type != OFPT_VENDOR
-        || request->vendor != htonl(NX_VENDOR_ID)
-        || request->subtype != htonl(NXT_STATUS_REQUEST)) {
-        return false;
-    }
 
     sr.request.string = (void *) (request + 1);
     sr.request.length = msg->size - sizeof *request;
@@ -165,12 +162,19 @@ switch_status_cb(struct status_reply *sr, void *ss_)
     status_reply_put(sr, "pid=%ld", (long int) getpid());
 }
 
+static const struct hook_msg switch_status_remote_msgs[] = {
+    { OFPT_VENDOR, NX_VENDOR_ID, NXT_STATUS_REQUEST },
+    HOOK_MSG_END
+};
+
 static struct hook_class switch_status_hook_class = {
     NULL,                           /* local_packet_cb */
     switch_status_remote_packet_cb, /* remote_packet_cb */
     NULL,                           /* periodic_cb */
     NULL,                           /* wait_cb */
     NULL,                           /* closing_cb */
+    NULL,                           /* local_msgs */
+    switch_status_remote_msgs,      /* remote_msgs */
 };
 
 void
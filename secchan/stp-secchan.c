@@ -263,12 +263,20 @@ stp_local_port_changed_cb(const struct ofp_phy_port *port, void *stp_)
     }
 }
 
+static const struct hook_msg stp_local_msgs[] = {
+    { OFPT_FEATURES_REPLY, 0, 0 },
+    { OFPT_PACKET_IN, 0, 0 },
+    HOOK_MSG_END
+};
+
 static struct hook_class stp_hook_class = {
     stp_local_packet_cb,        /* local_packet_cb */
     NULL,                       /* remote_packet_cb */
     stp_periodic_cb,            /* periodic_cb */
     stp_wait_cb,                /* wait_cb */
     NULL,                       /* closing_cb */
+    stp_local_msgs,             /* local_msgs */
+    NULL,                       /* remote_msgs */
 };
 
 void
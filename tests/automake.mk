@@ -9,11 +9,126 @@ noinst_PROGRAMS += tests/test-hmap
 tests_test_hmap_SOURCES = tests/test-hmap.c
 tests_test_hmap_LDADD = lib/libopenflow.a
 
+TESTS += tests/test-buffer-store
+noinst_PROGRAMS += tests/test-buffer-store
+tests_test_buffer_store_SOURCES = \
+	tests/test-buffer-store.c \
+	udatapath/buffer-store.c
+tests_test_buffer_store_CPPFLAGS = $(AM_CPPFLAGS) -I $(top_srcdir)/udatapath
+tests_test_buffer_store_LDADD = lib/libopenflow.a
+
+TESTS += tests/test-chain
+noinst_PROGRAMS += tests/test-chain
+tests_test_chain_SOURCES = \
+	tests/test-chain.c \
+	udatapath/chain.c \
+	udatapath/crc32.c \
+	udatapath/dp_act.c \
+	udatapath/epoch.c \
+	udatapath/slab.c \
+	udatapath/switch-flow.c \
+	udatapath/sw-queue.c \
+	udatapath/table-hash.c \
+	udatapath/table-linear.c \
+	udatapath/table-tuple.c \
+	udatapath/timer-wheel.c
+tests_test_chain_CPPFLAGS = $(AM_CPPFLAGS) -I $(top_srcdir)/udatapath
+tests_test_chain_LDADD = lib/libopenflow.a -lpthread
+
+TESTS += tests/test-crc32
+noinst_PROGRAMS += tests/test-crc32
+tests_test_crc32_SOURCES = tests/test-crc32.c udatapath/crc32.c
+tests_test_crc32_CPPFLAGS = $(AM_CPPFLAGS) -I $(top_srcdir)/udatapath
+tests_test_crc32_LDADD = lib/libopenflow.a
+
+TESTS += tests/test-slab
+noinst_PROGRAMS += tests/test-slab
+tests_test_slab_SOURCES = tests/test-slab.c udatapath/slab.c
+tests_test_slab_CPPFLAGS = $(AM_CPPFLAGS) -I $(top_srcdir)/udatapath
+tests_test_slab_LDADD = lib/libopenflow.a
+
+TESTS += tests/test-pending-miss
+noinst_PROGRAMS += tests/test-pending-miss
+tests_test_pending_miss_SOURCES = \
+	tests/test-pending-miss.c \
+	udatapath/dp_act.c \
+	udatapath/epoch.c \
+	udatapath/pending-miss.c \
+	udatapath/slab.c \
+	udatapath/switch-flow.c
+tests_test_pending_miss_CPPFLAGS = $(AM_CPPFLAGS) -I $(top_srcdir)/udatapath
+tests_test_pending_miss_LDADD = lib/libopenflow.a -lpthread
+
+TESTS += tests/test-packet-out
+noinst_PROGRAMS += tests/test-packet-out
+tests_test_packet_out_SOURCES = \
+	tests/test-packet-out.c \
+	udatapath/buffer-store.c \
+	udatapath/chain.c \
+	udatapath/crc32.c \
+	udatapath/datapath.c \
+	udatapath/dp_act.c \
+	udatapath/epoch.c \
+	udatapath/of_ext_msg.c \
+	udatapath/pending-miss.c \
+	udatapath/private-msg.c \
+	udatapath/slab.c \
+	udatapath/switch-flow.c \
+	udatapath/sw-queue.c \
+	udatapath/table-hash.c \
+	udatapath/table-linear.c \
+	udatapath/table-tuple.c \
+	udatapath/timer-wheel.c
+tests_test_packet_out_CPPFLAGS = $(AM_CPPFLAGS) -I $(top_srcdir)/udatapath
+tests_test_packet_out_LDADD = lib/libopenflow.a $(SSL_LIBS) -lpthread
+
+TESTS += tests/test-port-queue
+noinst_PROGRAMS += tests/test-port-queue
+tests_test_port_queue_SOURCES = tests/test-port-queue.c secchan/port-queue.c
+tests_test_port_queue_CPPFLAGS = $(AM_CPPFLAGS) -I $(top_srcdir)/secchan
+tests_test_port_queue_LDADD = lib/libopenflow.a
+
+TESTS += tests/test-hook-dispatch
+noinst_PROGRAMS += tests/test-hook-dispatch
+tests_test_hook_dispatch_SOURCES = \
+	tests/test-hook-dispatch.c \
+	secchan/hook-dispatch.c
+tests_test_hook_dispatch_CPPFLAGS = $(AM_CPPFLAGS) -I $(top_srcdir)/secchan
+tests_test_hook_dispatch_LDADD = lib/libopenflow.a
+
+TESTS += tests/test-dp-act
+noinst_PROGRAMS += tests/test-dp-act
+tests_test_dp_act_SOURCES = tests/test-dp-act.c udatapath/dp_act.c
+tests_test_dp_act_CPPFLAGS = $(AM_CPPFLAGS) -I $(top_srcdir)/udatapath
+tests_test_dp_act_LDADD = lib/libopenflow.a
+
 TESTS += tests/test-list
 noinst_PROGRAMS += tests/test-list
 tests_test_list_SOURCES = tests/test-list.c
 tests_test_list_LDADD = lib/libopenflow.a
 
+TESTS += tests/test-ofpbuf
+noinst_PROGRAMS += tests/test-ofpbuf
+tests_test_ofpbuf_SOURCES = tests/test-ofpbuf.c
+tests_test_ofpbuf_LDADD = lib/libopenflow.a
+
+TESTS += tests/test-vconn-stream
+noinst_PROGRAMS += tests/test-vconn-stream
+tests_test_vconn_stream_SOURCES = tests/test-vconn-stream.c
+tests_test_vconn_stream_LDADD = lib/libopenflow.a $(SSL_LIBS)
+
+if HAVE_SHM
+TESTS += tests/test-vconn-shm
+noinst_PROGRAMS += tests/test-vconn-shm
+tests_test_vconn_shm_SOURCES = tests/test-vconn-shm.c
+tests_test_vconn_shm_LDADD = lib/libopenflow.a $(SSL_LIBS)
+endif
+
+TESTS += tests/test-poll-loop
+noinst_PROGRAMS += tests/test-poll-loop
+tests_test_poll_loop_SOURCES = tests/test-poll-loop.c
+tests_test_poll_loop_LDADD = lib/libopenflow.a
+
 TESTS += tests/test-type-props
 noinst_PROGRAMS += tests/test-type-props
 tests_test_type_props_SOURCES = tests/test-type-props.c
@@ -0,0 +1,153 @@
+/* Tests for the packet buffers in udatapath/buffer-store.c. */
+
+#include <config.h>
+#include "buffer-store.h"
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "ofpbuf.h"
+#include "util.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+#define N_BUFFERS 8
+
+/* The number of buffers is rounded up to a power of 2, at least 2. */
+static void
+test_n_buffers(void)
+{
+    static const unsigned int sizes[][2] = {
+        { 0, 2 }, { 1, 2 }, { 2, 2 }, { 3, 4 }, { 256, 256 }, { 257, 512 },
+    };
+    struct buffer_store bs;
+    size_t i;
+
+    buffer_store_init(&bs, 1);
+    for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+        buffer_store_set_n_buffers(&bs, sizes[i][0]);
+        assert(buffer_store_n_buffers(&bs) == sizes[i][1]);
+    }
+    buffer_store_destroy(&bs);
+}
+
+/* Every buffer can be used, a packet that finds them all in use is left with
+ * the caller, and a packet is handed out only once. */
+static void
+test_save_retrieve(void)
+{
+    struct ofpbuf *packets[N_BUFFERS];
+    uint32_t ids[N_BUFFERS];
+    struct buffer_store bs;
+    struct ofpbuf *extra;
+    int i, j;
+
+    buffer_store_init(&bs, N_BUFFERS);
+    for (i = 0; i < N_BUFFERS; i++) {
+        packets[i] = ofpbuf_new(64);
+        ids[i] = buffer_store_save(&bs, packets[i], 0);
+        assert(ids[i] != UINT32_MAX);
+        for (j = 0; j < i; j++) {
+            assert(ids[i] % N_BUFFERS != ids[j] % N_BUFFERS);
+        }
+    }
+    assert(bs.n_used == N_BUFFERS);
+
+    extra = ofpbuf_new(64);
+    assert(buffer_store_save(&bs, extra, 0) == UINT32_MAX);
+    assert(bs.n_full == 1);
+
+    for (i = 0; i < N_BUFFERS; i += 2) {
+        assert(buffer_store_retrieve(&bs, ids[i]) == packets[i]);
+        assert(buffer_store_retrieve(&bs, ids[i]) == NULL);
+        ofpbuf_delete(packets[i]);
+    }
+    assert(bs.n_used == N_BUFFERS / 2);
+    for (i = 1; i < N_BUFFERS; i += 2) {
+        buffer_store_discard(&bs, ids[i]);
+        assert(buffer_store_retrieve(&bs, ids[i]) == NULL);
+    }
+    assert(bs.n_used == 0);
+
+    /* A bad buffer number or cookie is not found. */
+    assert(buffer_store_retrieve(&bs, UINT32_MAX) == NULL);
+    buffer_store_discard(&bs, UINT32_MAX);
+
+    assert(buffer_store_save(&bs, extra, 0) != UINT32_MAX);
+    buffer_store_destroy(&bs);
+}
+
+/* A freed buffer is the next to be reused, under a new ID, and the old ID
+ * does not refer to the new packet. */
+static void
+test_free_list(void)
+{
+    struct ofpbuf *a, *b, *c;
+    struct buffer_store bs;
+    uint32_t id_a, id_b, id_c;
+
+    buffer_store_init(&bs, N_BUFFERS);
+    a = ofpbuf_new(64);
+    b = ofpbuf_new(64);
+    c = ofpbuf_new(64);
+
+    id_a = buffer_store_save(&bs, a, 0);
+    id_b = buffer_store_save(&bs, b, 0);
+    assert(buffer_store_retrieve(&bs, id_a) == a);
+
+    id_c = buffer_store_save(&bs, c, 0);
+    assert(id_c != id_a);
+    assert(id_c % N_BUFFERS == id_a % N_BUFFERS);
+    assert(buffer_store_retrieve(&bs, id_a) == NULL);
+    assert(buffer_store_retrieve(&bs, id_c) == c);
+    assert(buffer_store_retrieve(&bs, id_b) == b);
+
+    ofpbuf_delete(a);
+    ofpbuf_delete(b);
+    ofpbuf_delete(c);
+    buffer_store_destroy(&bs);
+}
+
+/* Packets expire BUFFER_EXPIRE_MSECS after they are saved, oldest first, and
+ * the caller learns when to check again. */
+static void
+test_expiry(void)
+{
+    struct buffer_store bs;
+    struct ofpbuf *b;
+    uint32_t id_a, id_b;
+
+    buffer_store_init(&bs, N_BUFFERS);
+    assert(buffer_store_expire(&bs, 0) == LLONG_MAX);
+
+    id_a = buffer_store_save(&bs, ofpbuf_new(64), 0);
+    b = ofpbuf_new(64);
+    id_b = buffer_store_save(&bs, b, 300);
+
+    assert(buffer_store_expire(&bs, BUFFER_EXPIRE_MSECS - 1)
+           == BUFFER_EXPIRE_MSECS);
+    assert(bs.n_used == 2);
+    assert(buffer_store_expire(&bs, BUFFER_EXPIRE_MSECS)
+           == 300 + BUFFER_EXPIRE_MSECS);
+    assert(bs.n_used == 1);
+    assert(bs.n_expired == 1);
+    assert(buffer_store_retrieve(&bs, id_a) == NULL);
+
+    /* A packet that was claimed does not expire. */
+    assert(buffer_store_retrieve(&bs, id_b) == b);
+    assert(buffer_store_expire(&bs, LLONG_MAX - 1) == LLONG_MAX);
+    assert(bs.n_expired == 1);
+
+    ofpbuf_delete(b);
+    buffer_store_destroy(&bs);
+}
+
+int
+main(void)
+{
+    test_n_buffers();
+    test_save_retrieve();
+    test_free_list();
+    test_expiry();
+    return 0;
+}
@@ -0,0 +1,755 @@
+/* Tests for the tuple space and cuckoo hash tables in udatapath/table-tuple.c
+ * and udatapath/table-hash.c, followed by a stress test for looking up flows in
+ * udatapath/chain.c from several threads while another thread inserts,
+ * modifies, and deletes them, as the forwarding threads and the main thread of
+ * the datapath do, and a similar one for the queues of a port in
+ * udatapath/sw-queue.c.
+ *
+ * Readers check that every flow they find matches the packet and has intact
+ * actions, and that every queue they find keeps its slot until they are done
+ * with it.  A flow or action list that is freed while a reader can still see
+ * it usually shows up only in a build with -fsanitize=address or
+ * -fsanitize=thread, which report the use after free. */
+
+#include <config.h>
+#include "chain.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "datapath.h"
+#include "dp_act.h"
+#include "epoch.h"
+#include "flow.h"
+#include "openflow/openflow.h"
+#include "switch-flow.h"
+#include "sw-queue.h"
+#include "table.h"
+#include "timeval.h"
+#include "util.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+#define N_READERS 3
+#define N_KEYS 512
+#define N_OPS 8000
+#define N_QUEUE_OPS 500
+#define COOKIE 0x5ca1ab1e
+
+/* Stubs for the parts of the datapath that the chain and actions call. */
+void
+dp_send_flow_end(struct datapath *dp UNUSED, struct sw_flow *flow UNUSED,
+                 enum ofp_flow_removed_reason reason UNUSED)
+{
+}
+
+void
+dp_output_port(struct datapath *dp UNUSED, struct ofpbuf *buffer UNUSED,
+               int in_port UNUSED, int out_port UNUSED,
+               uint32_t queue_id UNUSED, bool ignore_no_fwd UNUSED)
+{
+}
+
+void
+dp_output_control(struct datapath *dp UNUSED, struct ofpbuf *buffer UNUSED,
+                  int in_port UNUSED, size_t max_len UNUSED,
+                  int reason UNUSED)
+{
+}
+
+void
+dp_reset_queue_stats(struct sw_queue *q UNUSED)
+{
+}
+
+/* Wildcards of the flows that go into the tuple table, so that subtables are
+ * created, reordered, and destroyed as flows come and go. */
+static const uint32_t wildcard_sets[] = {
+    OFPFW_ALL & ~OFPFW_IN_PORT,
+    OFPFW_ALL & ~(OFPFW_DL_TYPE | OFPFW_NW_PROTO | OFPFW_TP_DST),
+    ((OFPFW_ALL & ~(OFPFW_DL_TYPE | OFPFW_NW_SRC_MASK))
+     | (8 << OFPFW_NW_SRC_SHIFT)),
+};
+#define N_WILDCARD_SETS ARRAY_SIZE(wildcard_sets)
+
+static struct sw_chain *chain;
+static struct flow keys[N_KEYS];
+static bool stop;
+
+static void
+make_keys(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < N_KEYS; i++) {
+        struct flow *f = &keys[i];
+
+        f->in_port = htons(1 + i % 4);
+        f->dl_vlan = htons(OFP_VLAN_NONE);
+        f->dl_type = htons(0x0800);
+        f->dl_src[5] = i;
+        f->dl_dst[5] = 1;
+        f->nw_src = htonl(0x0a000000 | (i % 8) << 8 | i);
+        f->nw_dst = htonl(0xc0a80001);
+        f->nw_proto = 6;
+        f->tp_src = htons(1024 + i);
+        f->tp_dst = htons(i % 2 ? 80 : 443);
+    }
+}
+
+/* Initializes 'key' to match 'flow' with the given 'wildcards'. */
+static void
+make_key(const struct flow *flow, uint32_t wildcards, struct sw_flow_key *key)
+{
+    struct ofp_match match;
+
+    memset(&match, 0, sizeof match);
+    match.wildcards = htonl(wildcards);
+    match.in_port = flow->in_port;
+    memcpy(match.dl_src, flow->dl_src, ETH_ADDR_LEN);
+    memcpy(match.dl_dst, flow->dl_dst, ETH_ADDR_LEN);
+    match.dl_vlan = flow->dl_vlan;
+    match.dl_type = flow->dl_type;
+    match.nw_proto = flow->nw_proto;
+    match.nw_src = flow->nw_src;
+    match.nw_dst = flow->nw_dst;
+    match.tp_src = flow->tp_src;
+    match.tp_dst = flow->tp_dst;
+    flow_extract_match(key, &match);
+}
+
+static void
+make_action(uint16_t port, struct ofp_action_output *oa)
+{
+    memset(oa, 0, sizeof *oa);
+    oa->type = htons(OFPAT_OUTPUT);
+    oa->len = htons(sizeof *oa);
+    oa->port = htons(port);
+}
+
+static void
+add_flow(const struct sw_flow_key *key, uint16_t priority, int emerg)
+{
+    struct ofp_action_output oa;
+    struct sw_flow *flow;
+
+    flow = flow_alloc(sizeof oa);
+    flow->key = *key;
+    flow->priority = priority;
+    flow->cookie = COOKIE;
+    make_action(1 + random() % 16, &oa);
+    flow_setup_actions(flow, (struct ofp_action_header *) &oa, sizeof oa);
+    if (chain_insert(chain, flow, emerg)) {
+        flow_free(flow);
+    }
+}
+
+/* Checks that 'flow', found by looking up 'key', is intact. */
+static void
+check_flow(const struct sw_flow *flow, const struct sw_flow_key *key)
+{
+    const struct sw_flow_actions *sf_acts = epoch_get(flow->sf_acts);
+
+    assert(flow->cookie == COOKIE);
+    assert(flow_matches_1wild(key, &flow->key));
+    assert(sf_acts->n_ops == 1);
+    assert(sf_acts->ops[0].type == OFPAT_OUTPUT);
+    assert(sf_acts->ops[0].u.output.port >= 1
+           && sf_acts->ops[0].u.output.port <= 16);
+}
+
+static void *
+reader_main(void *cache_)
+{
+    struct chain_cache *cache = cache_;
+    unsigned int seed = (uintptr_t) cache;
+    unsigned long long n_lookups = 0;
+
+    epoch_register();
+    while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+        int i;
+
+        epoch_enter();
+        for (i = 0; i < 64; i++) {
+            struct sw_flow_key key;
+            struct sw_flow *flow;
+
+            memset(&key, 0, sizeof key);
+            key.flow = keys[rand_r(&seed) % N_KEYS];
+
+            flow = chain_lookup(chain, cache, &key, 0);
+            if (flow) {
+                check_flow(flow, &key);
+            }
+            flow = chain_lookup(chain, cache, &key, 1);
+            if (flow) {
+                check_flow(flow, &key);
+            }
+            n_lookups++;
+        }
+        epoch_exit();
+    }
+    epoch_unregister();
+    return (void *) (uintptr_t) n_lookups;
+}
+
+/* Performs one random change to 'chain'. */
+static void
+change_chain(void)
+{
+    const struct flow *flow = &keys[random() % N_KEYS];
+    uint32_t wildcards = wildcard_sets[random() % N_WILDCARD_SETS];
+    uint16_t priority = 1 + random() % 4;
+    struct ofp_action_output oa;
+    struct sw_flow_key key;
+
+    switch (random() % 8) {
+    case 0:
+    case 1:
+        make_key(flow, 0, &key);
+        add_flow(&key, priority, 0);
+        break;
+
+    case 2:
+        make_key(flow, wildcards, &key);
+        add_flow(&key, priority, 0);
+        break;
+
+    case 3:
+        make_key(flow, 0, &key);
+        chain_delete(chain, &key, htons(OFPP_NONE), 0, 1, 0);
+        break;
+
+    case 4:
+        make_key(flow, wildcards, &key);
+        chain_delete(chain, &key, htons(OFPP_NONE), priority, 1, 0);
+        break;
+
+    case 5:
+        /* Deletes a whole group of flows, often emptying a subtable. */
+        make_key(flow, wildcards, &key);
+        chain_delete(chain, &key, htons(OFPP_NONE), 0, 0, 0);
+        break;
+
+    case 6:
+        make_key(flow, random() % 2 ? 0 : wildcards, &key);
+        make_action(1 + random() % 16, &oa);
+        chain_modify(chain, &key, priority, 0,
+                     (struct ofp_action_header *) &oa, sizeof oa, 0);
+        break;
+
+    case 7:
+        make_key(flow, wildcards, &key);
+        if (random() % 2) {
+            add_flow(&key, priority, 1);
+        } else {
+            chain_delete(chain, &key, htons(OFPP_NONE), 0, 0, 1);
+        }
+        break;
+    }
+}
+
+/* Returns a new flow with 'key', 'priority', and a cookie of 'cookie', whose
+ * action outputs to port 1. */
+static struct sw_flow *
+new_flow(const struct sw_flow_key *key, uint16_t priority, uint64_t cookie)
+{
+    struct ofp_action_output oa;
+    struct sw_flow *flow;
+
+    flow = flow_alloc(sizeof oa);
+    flow->key = *key;
+    flow->priority = priority;
+    flow->cookie = cookie;
+    make_action(1, &oa);
+    flow_setup_actions(flow, (struct ofp_action_header *) &oa, sizeof oa);
+    return flow;
+}
+
+/* Initializes 'flow' to the 'i'th of a large set of distinct exact-match
+ * flows. */
+static void
+make_nth_flow(unsigned int i, struct flow *flow)
+{
+    memset(flow, 0, sizeof *flow);
+    flow->in_port = htons(1 + i % 4);
+    flow->dl_vlan = htons(OFP_VLAN_NONE);
+    flow->dl_type = htons(0x0800);
+    flow->dl_dst[5] = 1;
+    flow->nw_src = htonl(0x0a000000 | i);
+    flow->nw_dst = htonl(0xc0a80001);
+    flow->nw_proto = 6;
+    flow->tp_src = htons(1024 + i % 50000);
+    flow->tp_dst = htons(80);
+}
+
+/* Inserts into 'table' a flow matching 'flow' with 'wildcards' and
+ * 'priority', with 'cookie' as its cookie. */
+static void
+insert_flow(struct sw_table *table, const struct flow *flow,
+            uint32_t wildcards, uint16_t priority, uint64_t cookie)
+{
+    struct sw_flow_key key;
+
+    make_key(flow, wildcards, &key);
+    assert(table->insert(table, new_flow(&key, priority, cookie)));
+}
+
+/* Deletes from 'table' the flow matching 'flow' with 'wildcards' and
+ * 'priority'. */
+static void
+delete_flow(struct sw_table *table, const struct flow *flow,
+            uint32_t wildcards, uint16_t priority)
+{
+    struct sw_flow_key key;
+
+    make_key(flow, wildcards, &key);
+    assert(table->delete(NULL, table, &key, htons(OFPP_NONE), priority, 1)
+           == 1);
+}
+
+/* Returns the cookie of the flow that 'table' finds for a packet with 'flow'
+ * as its key, or 0 if it finds none. */
+static uint64_t
+lookup_cookie(struct sw_table *table, const struct flow *flow)
+{
+    struct sw_flow_key key;
+    struct sw_flow *found;
+
+    memset(&key, 0, sizeof key);
+    key.flow = *flow;
+    found = table->lookup(table, &key);
+    return found ? found->cookie : 0;
+}
+
+/* The tuple table returns the highest-priority match, or the first inserted
+ * among equals, even when the subtable searched first has a higher maximum
+ * priority than the flow it matches.  Subtables whose maximum priority is
+ * lower than the best match so far are not searched, and that must not cut
+ * short a search that could still find a better match. */
+static void
+test_tuple_priorities(void)
+{
+    const uint32_t by_port = OFPFW_ALL & ~OFPFW_IN_PORT;
+    const uint32_t by_tp_dst = OFPFW_ALL & ~(OFPFW_DL_TYPE | OFPFW_NW_PROTO
+                                             | OFPFW_TP_DST);
+    const uint32_t by_nw_src = ((OFPFW_ALL & ~(OFPFW_DL_TYPE
+                                               | OFPFW_NW_SRC_MASK))
+                                | (8 << OFPFW_NW_SRC_SHIFT));
+    struct sw_table *table = table_tuple_create(64);
+    struct flow pkt, other;
+
+    make_nth_flow(1, &pkt);
+    make_nth_flow(2, &other);
+    assert(pkt.in_port != other.in_port);
+    assert(!lookup_cookie(table, &pkt));
+
+    insert_flow(table, &pkt, by_port, 10, 1);
+    assert(lookup_cookie(table, &pkt) == 1);
+
+    /* Searched second, but higher priority. */
+    insert_flow(table, &pkt, by_tp_dst, 20, 2);
+    assert(lookup_cookie(table, &pkt) == 2);
+
+    /* Now the by-port subtable is searched first, because of a flow that does
+     * not match 'pkt', so its match for 'pkt' must not end the search. */
+    insert_flow(table, &other, by_port, 30, 3);
+    assert(lookup_cookie(table, &pkt) == 2);
+    assert(lookup_cookie(table, &other) == 3);
+
+    /* A tie goes to the flow inserted first. */
+    insert_flow(table, &pkt, by_nw_src, 20, 4);
+    assert(lookup_cookie(table, &pkt) == 2);
+
+    /* A lower-priority match in a subtable searched after the best match so
+     * far does not replace it. */
+    insert_flow(table, &pkt, by_nw_src, 5, 5);
+    assert(lookup_cookie(table, &pkt) == 2);
+
+    delete_flow(table, &pkt, by_tp_dst, 20);
+    assert(lookup_cookie(table, &pkt) == 4);
+    delete_flow(table, &pkt, by_nw_src, 20);
+    assert(lookup_cookie(table, &pkt) == 1);
+    delete_flow(table, &other, by_port, 30);
+    assert(lookup_cookie(table, &pkt) == 1);
+    delete_flow(table, &pkt, by_port, 10);
+    assert(lookup_cookie(table, &pkt) == 5);
+    delete_flow(table, &pkt, by_nw_src, 5);
+    assert(!lookup_cookie(table, &pkt));
+
+    table->destroy(table);
+}
+
+/* Cookies of the flows visited by iterate_cb(), as counts indexed by cookie,
+ * and the number of visits until iterate_cb() stops the iteration. */
+#define N_ITER_FLOWS 600
+static int n_visits[N_ITER_FLOWS * 2];
+static int visits_left;
+
+static int
+iterate_cb(struct sw_flow *flow, void *aux UNUSED)
+{
+    assert(flow->cookie < ARRAY_SIZE(n_visits));
+    n_visits[flow->cookie]++;
+    return --visits_left ? 0 : EAGAIN;
+}
+
+/* Iterates through 'table', which initially contains the flows with cookies 0
+ * through N_ITER_FLOWS - 1, with 'wildcards' and priorities derived from
+ * their cookies, a few flows at a time as a flow stats dump does.  Between
+ * calls, inserts more flows, deletes some of the new ones, and runs the
+ * table, so that flows move around.  Checks that each of the original flows
+ * is visited exactly once and that no flow is visited twice. */
+static void
+check_resumable_iterate(struct sw_table *table, uint32_t wildcards)
+{
+    struct sw_table_position position;
+    struct sw_flow_key all;
+    unsigned int next = N_ITER_FLOWS;
+    unsigned int i;
+    int error;
+
+    memset(n_visits, 0, sizeof n_visits);
+    memset(&all, 0, sizeof all);
+    all.wildcards = OFPFW_ALL;
+    memset(&position, 0, sizeof position);
+    do {
+        visits_left = 7;
+        error = table->iterate(table, &all, htons(OFPP_NONE), &position,
+                               iterate_cb, NULL);
+        for (i = 0; i < 5 && next < ARRAY_SIZE(n_visits); i++, next++) {
+            struct flow flow;
+
+            make_nth_flow(next, &flow);
+            insert_flow(table, &flow, wildcards, next % 8, next);
+            if (next % 3 == 0) {
+                delete_flow(table, &flow, wildcards, next % 8);
+            }
+        }
+        if (table->run) {
+            table->run(table);
+        }
+    } while (error);
+
+    for (i = 0; i < ARRAY_SIZE(n_visits); i++) {
+        if (i < N_ITER_FLOWS) {
+            assert(n_visits[i] == 1);
+        } else {
+            assert(n_visits[i] <= 1);
+        }
+    }
+}
+
+/* A flow stats dump that resumes across calls visits every flow exactly
+ * once, even as other flows come and go and the tables rearrange their
+ * contents. */
+static void
+test_resumable_iterate(void)
+{
+    const uint32_t by_nw_src = OFPFW_ALL & ~(OFPFW_DL_TYPE
+                                             | OFPFW_NW_SRC_MASK);
+    const uint32_t wildcard_list[] = {
+        0,
+        by_nw_src,
+        OFPFW_ALL & ~(OFPFW_DL_TYPE | OFPFW_NW_PROTO | OFPFW_TP_SRC),
+    };
+    struct sw_table *table;
+    unsigned int i;
+
+    /* The exact-match table starts small, so inserting this many flows
+     * resizes it several times. */
+    table = table_hash2_create(4096);
+    for (i = 0; i < N_ITER_FLOWS; i++) {
+        struct flow flow;
+
+        make_nth_flow(i, &flow);
+        insert_flow(table, &flow, 0, 0, i);
+    }
+    check_resumable_iterate(table, 0);
+    table->destroy(table);
+
+    table = table_tuple_create(4096);
+    for (i = 0; i < N_ITER_FLOWS; i++) {
+        uint32_t wildcards = wildcard_list[i % ARRAY_SIZE(wildcard_list)];
+        struct flow flow;
+
+        make_nth_flow(i, &flow);
+        insert_flow(table, &flow, wildcards, i % 8, i);
+    }
+    check_resumable_iterate(table, by_nw_src);
+    table->destroy(table);
+}
+
+/* Returns the value of the counter named 'name' in 'table''s statistics. */
+static unsigned long long
+get_counter(struct sw_table *table, const char *name)
+{
+    struct sw_table_stats stats;
+    unsigned int i;
+
+    memset(&stats, 0, sizeof stats);
+    table->stats(table, &stats);
+    for (i = 0; i < stats.n_counters; i++) {
+        if (!strcmp(stats.counters[i].name, name)) {
+            return stats.counters[i].value;
+        }
+    }
+    abort();
+}
+
+/* Fills the cuckoo table to more than 90% of its maximum size, which needs
+ * flows to be displaced into their alternate buckets.  Resizes happen along
+ * the way, and with nothing calling the table's 'run' function each resize
+ * stays in progress for many inserts.  Every flow stays findable throughout,
+ * wherever it sits. */
+static void
+test_cuckoo_fill(void)
+{
+    enum { MAX_FLOWS = 1024, N_FLOWS = MAX_FLOWS * 92 / 100 };
+    struct sw_table *table = table_hash2_create(MAX_FLOWS);
+    unsigned int i, j;
+
+    for (i = 0; i < N_FLOWS; i++) {
+        unsigned long long resizes = get_counter(table, "resizes");
+        struct flow flow;
+
+        make_nth_flow(i, &flow);
+        insert_flow(table, &flow, 0, 0, i + 1);
+
+        if (get_counter(table, "resizes") != resizes || i % 64 == 0
+            || i > MAX_FLOWS * 88 / 100) {
+            for (j = 0; j <= i; j++) {
+                make_nth_flow(j, &flow);
+                assert(lookup_cookie(table, &flow) == j + 1);
+            }
+        }
+    }
+    assert(get_counter(table, "buckets") == MAX_FLOWS / 4);
+    assert(get_counter(table, "resizes") >= 4);
+    assert(get_counter(table, "displaced") > 0);
+    assert(get_counter(table, "insert_failed") == 0);
+    assert(get_counter(table, "load_pct") > 90);
+
+    /* Replacing an existing flow does not move it or need room. */
+    for (i = 0; i < N_FLOWS; i += 7) {
+        struct flow flow;
+
+        make_nth_flow(i, &flow);
+        insert_flow(table, &flow, 0, 0, i + 1);
+    }
+    for (i = 0; i < N_FLOWS; i++) {
+        struct flow flow;
+
+        make_nth_flow(i, &flow);
+        assert(lookup_cookie(table, &flow) == i + 1);
+    }
+    table->destroy(table);
+}
+
+/* Checks that a deferred callback does not run until every reader that
+ * entered a critical section before it was deferred has left it. */
+static bool ran;
+
+static void
+set_ran(void *aux UNUSED)
+{
+    ran = true;
+}
+
+static void
+test_defer(void)
+{
+    unsigned long long n_pending, n_reclaimed;
+
+    epoch_register();
+    epoch_enter();
+    epoch_defer(set_ran, NULL);
+    epoch_reclaim();
+    epoch_reclaim();
+    assert(!ran);
+    epoch_get_stats(&n_pending, &n_reclaimed);
+    assert(n_pending == 1);
+
+    epoch_exit();
+    assert(!epoch_reclaim());
+    assert(ran);
+    epoch_unregister();
+}
+
+static void
+test_concurrent_changes(void)
+{
+    unsigned long long n_pending, n_reclaimed, n_lookups;
+    pthread_t readers[N_READERS];
+    int i;
+
+    make_keys();
+    chain = chain_create(NULL);
+    assert(chain);
+
+    for (i = 0; i < N_READERS; i++) {
+        struct chain_cache *cache = chain_cache_create(chain);
+        assert(!pthread_create(&readers[i], NULL, reader_main, cache));
+    }
+
+    for (i = 0; i < N_OPS; i++) {
+        change_chain();
+        if (i % 16 == 0) {
+            /* Leaves resizes of the exact-match table half done for a
+             * while, so that readers search both arrays. */
+            chain_run(chain);
+        }
+        if (i % 64 == 0) {
+            epoch_reclaim();
+        }
+    }
+
+    __atomic_store_n(&stop, true, __ATOMIC_RELAXED);
+    n_lookups = 0;
+    for (i = 0; i < N_READERS; i++) {
+        void *retval;
+        assert(!pthread_join(readers[i], &retval));
+        n_lookups += (uintptr_t) retval;
+    }
+
+    epoch_synchronize();
+    epoch_get_stats(&n_pending, &n_reclaimed);
+    assert(n_pending == 0);
+    printf("%d changes, %llu lookups, %llu objects reclaimed\n",
+           N_OPS, n_lookups, n_reclaimed);
+
+    chain_destroy(chain);
+}
+
+/* Port whose queues test_concurrent_queue_changes() adds and deletes. */
+static struct sw_port queue_port;
+/* Fewer than the port's slots, so that deleted queues' slots are always what
+ * an addition waits for. */
+#define N_QUEUE_IDS (NETDEV_MAX_QUEUES - 3)
+
+/* Looks up queues on 'queue_port' and, like a forwarding thread that batches
+ * packets for them, checks at the end of each critical section that each
+ * queue it found still owns its slot, since the slot's counters are where the
+ * packets will be counted. */
+static void *
+queue_reader_main(void *seed_)
+{
+    unsigned int seed = (uintptr_t) seed_;
+    unsigned long long n_found = 0;
+
+    epoch_register();
+    while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+        uint32_t batch_ids[64];
+        int batch_classes[64];
+        int n = 0;
+        int i;
+
+        epoch_enter();
+        for (i = 0; i < 64; i++) {
+            uint32_t queue_id = 1 + rand_r(&seed) % N_QUEUE_IDS;
+            int class_id = sw_queue_lookup_class(&queue_port, queue_id);
+
+            if (class_id >= 0) {
+                assert(class_id >= 1 && class_id < queue_port.num_queues);
+                batch_ids[n] = queue_id;
+                batch_classes[n] = class_id;
+                n++;
+            }
+        }
+        for (i = 0; i < n; i++) {
+            const struct sw_queue *q = &queue_port.queues[batch_classes[i]];
+            assert(q->queue_id == batch_ids[i]);
+            assert(q->class_id == batch_classes[i]);
+        }
+        epoch_exit();
+        n_found += n;
+    }
+    epoch_unregister();
+    return (void *) (uintptr_t) n_found;
+}
+
+static void
+test_concurrent_queue_changes(void)
+{
+    struct sw_queue *queues[N_QUEUE_IDS + 1];
+    unsigned long long n_pending, n_reclaimed, n_found;
+    pthread_t readers[N_READERS];
+    int n_waits;
+    int i;
+
+    memset(&queue_port, 0, sizeof queue_port);
+    list_init(&queue_port.queue_list);
+    queue_port.num_queues = NETDEV_MAX_QUEUES;
+    memset(queues, 0, sizeof queues);
+
+    __atomic_store_n(&stop, false, __ATOMIC_RELAXED);
+    for (i = 0; i < N_READERS; i++) {
+        assert(!pthread_create(&readers[i], NULL, queue_reader_main,
+                               (void *) (uintptr_t) (i + 1)));
+    }
+
+    n_waits = 0;
+    for (i = 0; i < N_QUEUE_OPS; i++) {
+        uint32_t queue_id = 1 + random() % N_QUEUE_IDS;
+
+        if (queues[queue_id]) {
+            sw_queue_delete(queues[queue_id]);
+            queues[queue_id] = NULL;
+        } else {
+            /* Waits for the readers to let go of a deleted queue's slot if
+             * every slot is taken. */
+            while (sw_queue_add(&queue_port, queue_id, OFPQT_MIN_RATE, 100,
+                                &queues[queue_id])) {
+                epoch_reclaim();
+                sched_yield();
+                n_waits++;
+            }
+            assert(queues[queue_id]->class_id >= 1);
+        }
+        epoch_reclaim();
+        sched_yield();
+    }
+
+    __atomic_store_n(&stop, true, __ATOMIC_RELAXED);
+    n_found = 0;
+    for (i = 0; i < N_READERS; i++) {
+        void *retval;
+        assert(!pthread_join(readers[i], &retval));
+        n_found += (uintptr_t) retval;
+    }
+
+    for (i = 1; i <= N_QUEUE_IDS; i++) {
+        if (queues[i]) {
+            sw_queue_delete(queues[i]);
+        }
+    }
+    epoch_synchronize();
+    epoch_get_stats(&n_pending, &n_reclaimed);
+    assert(n_pending == 0);
+    assert(queue_port.queue_map == NULL);
+    for (i = 0; i < NETDEV_MAX_QUEUES; i++) {
+        assert(queue_port.queues[i].port == NULL);
+    }
+    printf("%d queue changes (%d waits for a slot), %llu queues found\n",
+           N_QUEUE_OPS, n_waits, n_found);
+}
+
+int
+main(void)
+{
+    time_init();
+    epoch_register();
+    test_tuple_priorities();
+    test_resumable_iterate();
+    test_cuckoo_fill();
+    epoch_synchronize();
+    epoch_unregister();
+    test_defer();
+    test_concurrent_changes();
+    test_concurrent_queue_changes();
+    return 0;
+}
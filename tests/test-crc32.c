@@ -0,0 +1,209 @@
+/* Tests and benchmarks for the CRC implementations in udatapath/crc32.c.
+ *
+ * Checks that CRC-32C gives the standard check value, that the hardware and
+ * software implementations agree, and that CRC-32C spreads flow keys over
+ * hash buckets at least as evenly as would be expected of a random function,
+ * alongside the table-driven CRCs with the polynomials used by the exact-match
+ * tables.  Also prints the cost per flow key of each. */
+
+#include <config.h>
+#include "crc32.h"
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "flow.h"
+#include "util.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+#define N_KEYS (1u << 16)
+#define BUCKET_BITS 12
+#define N_BUCKETS (1u << BUCKET_BITS)
+
+/* Mean plus 6 standard deviations of the chi-squared statistic for
+ * N_BUCKETS - 1 degrees of freedom, i.e. 4095 + 6 * sqrt(2 * 4095). */
+#define CHI2_LIMIT 4638.0
+
+static volatile uint32_t sink;
+
+static struct flow *keys;
+
+/* Fills 'keys' with TCP flows between a /16 of clients and a handful of
+ * servers, much like the exact-match entries of a busy switch. */
+static void
+make_keys(void)
+{
+    unsigned int i;
+
+    keys = xcalloc(N_KEYS, sizeof *keys);
+    for (i = 0; i < N_KEYS; i++) {
+        struct flow *f = &keys[i];
+
+        f->in_port = htons(1 + i % 4);
+        f->dl_vlan = htons(0xffff);
+        f->dl_type = htons(0x0800);
+        f->dl_src[5] = i;
+        f->dl_dst[5] = 1;
+        f->nw_src = htonl(0x0a000000 | i);
+        f->nw_dst = htonl(0xc0a80001 + i % 8);
+        f->nw_proto = 6;
+        f->tp_src = htons(1024 + (i * 7) % 50000);
+        f->tp_dst = htons(80);
+    }
+}
+
+static uint32_t
+get_bits(uint32_t hash, int shift)
+{
+    return (hash >> shift) & (N_BUCKETS - 1);
+}
+
+/* Returns the chi-squared statistic for the distribution of N_KEYS hashes
+ * across N_BUCKETS buckets. */
+static double
+chi_squared(const unsigned int counts[])
+{
+    double expected = (double) N_KEYS / N_BUCKETS;
+    double chi2 = 0;
+    unsigned int i;
+
+    for (i = 0; i < N_BUCKETS; i++) {
+        double d = counts[i] - expected;
+        chi2 += d * d / expected;
+    }
+    return chi2;
+}
+
+static double
+elapsed_ns(const struct timespec *start, const struct timespec *end)
+{
+    return ((end->tv_sec - start->tv_sec) * 1e9
+            + (end->tv_nsec - start->tv_nsec));
+}
+
+static void
+test_check_value(void)
+{
+    static const char check[] = "123456789";
+
+    assert(crc32c(check, 9, 0) == 0xe3069283);
+    assert(crc32c_sw(check, 9, 0) == 0xe3069283);
+    assert(crc32c("", 0, 0) == 0);
+
+    /* Chaining. */
+    assert(crc32c(check + 4, 5, crc32c(check, 4, 0)) == 0xe3069283);
+    assert(crc32c_sw(check + 3, 6, crc32c_sw(check, 3, 0)) == 0xe3069283);
+}
+
+static void
+test_hw_matches_sw(void)
+{
+    uint8_t buf[128];
+    size_t ofs, len;
+
+    for (len = 0; len < sizeof buf; len++) {
+        buf[len] = random();
+    }
+    for (ofs = 0; ofs < 8; ofs++) {
+        for (len = 0; len + ofs <= sizeof buf; len++) {
+            uint32_t basis = random();
+            assert(crc32c(buf + ofs, len, basis)
+                   == crc32c_sw(buf + ofs, len, basis));
+        }
+    }
+}
+
+/* Checks that 'hash' distributes the keys well when the bucket is taken from
+ * the bits starting at 'shift', and returns the time per key in ns. */
+static double
+check_distribution(const char *name, uint32_t (*hash)(const struct flow *),
+                   int shift)
+{
+    unsigned int *counts = xcalloc(N_BUCKETS, sizeof *counts);
+    struct timespec start, end;
+    uint32_t sum = 0;
+    unsigned int i;
+    double chi2;
+    double ns;
+
+    for (i = 0; i < N_KEYS; i++) {
+        counts[get_bits(hash(&keys[i]), shift)]++;
+    }
+    chi2 = chi_squared(counts);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < N_KEYS; i++) {
+        sum += hash(&keys[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    ns = elapsed_ns(&start, &end) / N_KEYS;
+    sink = sum;
+
+    printf("%-24s bits %2d-%2d: chi^2 %8.1f (limit %.1f), %5.1f ns/key\n",
+           name, shift, shift + BUCKET_BITS - 1, chi2, CHI2_LIMIT, ns);
+    free(counts);
+    assert(chi2 < CHI2_LIMIT);
+    return ns;
+}
+
+static struct crc32 crc_poly0, crc_poly1;
+
+static uint32_t
+hash_poly0(const struct flow *flow)
+{
+    return crc32_calculate(&crc_poly0, flow, sizeof *flow);
+}
+
+static uint32_t
+hash_poly1(const struct flow *flow)
+{
+    return crc32_calculate(&crc_poly1, flow, sizeof *flow);
+}
+
+static uint32_t
+hash_crc32c(const struct flow *flow)
+{
+    return crc32c(flow, sizeof *flow, 0);
+}
+
+/* The signature hash used by the exact-match table in table-hash.c. */
+static uint32_t
+hash_crc32c_sig(const struct flow *flow)
+{
+    return crc32c(flow, sizeof *flow, 0) * 0x9e3779b1u;
+}
+
+static uint32_t
+hash_crc32c_sw(const struct flow *flow)
+{
+    return crc32c_sw(flow, sizeof *flow, 0);
+}
+
+int
+main(void)
+{
+    double old_ns, new_ns;
+
+    test_check_value();
+    test_hw_matches_sw();
+
+    make_keys();
+    crc32_init(&crc_poly0, 0x1EDC6F41);
+    crc32_init(&crc_poly1, 0x741B8CD7);
+
+    printf("crc32c: %s implementation\n",
+           crc32c_hw_available() ? "SSE4.2" : "software");
+    old_ns = check_distribution("crc32 poly 0x1EDC6F41", hash_poly0, 0);
+    old_ns += check_distribution("crc32 poly 0x741B8CD7", hash_poly1, 0);
+    new_ns = check_distribution("crc32c", hash_crc32c, 0);
+    check_distribution("crc32c signature", hash_crc32c_sig, 16);
+    check_distribution("crc32c software", hash_crc32c_sw, 0);
+    printf("two table-driven CRCs: %.1f ns/key, one crc32c: %.1f ns/key\n",
+           old_ns, new_ns);
+
+    free(keys);
+    return 0;
+}
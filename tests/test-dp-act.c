@@ -0,0 +1,395 @@
+/* Tests for compiling and executing actions in udatapath/dp_act.c. */
+
+#include <config.h>
+#include "dp_act.h"
+#include <arpa/inet.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "datapath.h"
+#include "flow.h"
+#include "ofpbuf.h"
+#include "openflow/openflow.h"
+#include "packets.h"
+#include "switch-flow.h"
+#include "util.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+#define IN_PORT 1
+
+/* Packets output by the actions, in order, with the port each went to. */
+static struct ofpbuf *outputs[8];
+static int output_ports[8];
+static size_t n_outputs;
+
+void
+dp_output_port(struct datapath *dp UNUSED, struct ofpbuf *buffer,
+               int in_port UNUSED, int out_port, uint32_t queue_id UNUSED,
+               bool ignore_no_fwd UNUSED)
+{
+    assert(n_outputs < ARRAY_SIZE(outputs));
+    output_ports[n_outputs] = out_port;
+    outputs[n_outputs++] = buffer;
+}
+
+void
+dp_output_control(struct datapath *dp UNUSED, struct ofpbuf *buffer,
+                  int in_port UNUSED, size_t max_len UNUSED,
+                  int reason UNUSED)
+{
+    dp_output_port(NULL, buffer, 0, OFPP_CONTROLLER, 0, false);
+}
+
+static void
+clear_outputs(void)
+{
+    size_t i;
+
+    for (i = 0; i < n_outputs; i++) {
+        ofpbuf_delete(outputs[i]);
+    }
+    n_outputs = 0;
+}
+
+/* A list of OpenFlow actions under construction. */
+struct actions {
+    uint8_t data[256];
+    size_t len;
+};
+
+static void *
+put_action(struct actions *a, uint16_t type, size_t len)
+{
+    struct ofp_action_header *ah = (void *) &a->data[a->len];
+
+    assert(a->len + len <= sizeof a->data);
+    memset(ah, 0, len);
+    ah->type = htons(type);
+    ah->len = htons(len);
+    a->len += len;
+    return ah;
+}
+
+static void
+put_output(struct actions *a, uint16_t port)
+{
+    struct ofp_action_output *oa = put_action(a, OFPAT_OUTPUT, sizeof *oa);
+    oa->port = htons(port);
+}
+
+static void
+put_tp_port(struct actions *a, uint16_t type, uint16_t port)
+{
+    struct ofp_action_tp_port *ta = put_action(a, type, sizeof *ta);
+    ta->tp_port = htons(port);
+}
+
+static void
+put_nw_addr(struct actions *a, uint16_t type, uint32_t addr)
+{
+    struct ofp_action_nw_addr *na = put_action(a, type, sizeof *na);
+    na->nw_addr = htonl(addr);
+}
+
+static void
+put_dl_addr(struct actions *a, uint16_t type, uint8_t last)
+{
+    struct ofp_action_dl_addr *da = put_action(a, type, sizeof *da);
+    da->dl_addr[5] = last;
+}
+
+static size_t
+compile(const struct sw_flow_key *match, const struct actions *a,
+        struct act_op ops[])
+{
+    return compile_actions(match, (const struct ofp_action_header *) a->data,
+                           a->len, ops);
+}
+
+/* Returns a new UDP packet from port 1000 to port 2000, and extracts its flow
+ * into 'key'. */
+static struct ofpbuf *
+make_udp_packet(struct sw_flow_key *key)
+{
+    struct ofpbuf *b = ofpbuf_new(64);
+    struct eth_header *eth;
+    struct ip_header *ip;
+    struct udp_header *udp;
+
+    eth = ofpbuf_put_zeros(b, sizeof *eth);
+    eth->eth_src[5] = 1;
+    eth->eth_dst[5] = 2;
+    eth->eth_type = htons(ETH_TYPE_IP);
+
+    ip = ofpbuf_put_zeros(b, sizeof *ip);
+    ip->ip_ihl_ver = IP_IHL_VER(5, IP_VERSION);
+    ip->ip_tot_len = htons(IP_HEADER_LEN + UDP_HEADER_LEN);
+    ip->ip_ttl = 64;
+    ip->ip_proto = IP_TYPE_UDP;
+    ip->ip_src = htonl(0x0a000001);
+    ip->ip_dst = htonl(0x0a000002);
+
+    udp = ofpbuf_put_zeros(b, sizeof *udp);
+    udp->udp_src = htons(1000);
+    udp->udp_dst = htons(2000);
+    udp->udp_len = htons(UDP_HEADER_LEN);
+
+    memset(key, 0, sizeof *key);
+    flow_extract(b, IN_PORT, &key->flow);
+    return b;
+}
+
+static uint16_t
+udp_dst(const struct ofpbuf *b)
+{
+    const struct udp_header *udp = b->l4;
+    return ntohs(udp->udp_dst);
+}
+
+/* Header-rewriting actions are specialized on what the match pins down. */
+static void
+test_compile(void)
+{
+    struct act_op ops[ACT_MAX_OPS(256)];
+    struct sw_flow_key match;
+    struct actions a;
+    size_t n;
+
+    a.len = 0;
+    put_nw_addr(&a, OFPAT_SET_NW_DST, 0x0a000003);
+    put_tp_port(&a, OFPAT_SET_TP_DST, 99);
+    put_dl_addr(&a, OFPAT_SET_DL_DST, 7);
+    put_output(&a, 2);
+
+    /* Nothing known: every action stays, and the executor checks the
+     * packet. */
+    memset(&match, 0, sizeof match);
+    match.wildcards = OFPFW_ALL;
+    n = compile(&match, &a, ops);
+    assert(n == 4);
+    assert(ops[0].type == OFPAT_SET_NW_SRC);
+    assert(ops[0].ofs == offsetof(struct ip_header, ip_dst));
+    assert(ops[0].check_ip && ops[0].l4 == ACT_L4_KEY);
+    assert(ops[0].u.nw_addr == htonl(0x0a000003));
+    assert(ops[1].type == OFPAT_SET_TP_SRC);
+    assert(ops[1].ofs == offsetof(struct tcp_header, tcp_dst));
+    assert(ops[1].check_ip && ops[1].l4 == ACT_L4_KEY);
+    assert(ops[2].type == OFPAT_SET_DL_SRC);
+    assert(ops[2].ofs == offsetof(struct eth_header, eth_dst));
+    assert(ops[2].u.dl_addr[5] == 7);
+    assert(ops[3].type == OFPAT_OUTPUT && ops[3].u.output.port == 2);
+
+    /* Not IP: the IP and transport rewrites cannot apply. */
+    match.wildcards = OFPFW_ALL & ~OFPFW_DL_TYPE;
+    match.flow.dl_type = htons(ETH_TYPE_ARP);
+    n = compile(&match, &a, ops);
+    assert(n == 2);
+    assert(ops[0].type == OFPAT_SET_DL_SRC);
+    assert(ops[1].type == OFPAT_OUTPUT);
+
+    /* IP, any protocol: no IP check, checksum chosen per packet. */
+    match.flow.dl_type = htons(ETH_TYPE_IP);
+    n = compile(&match, &a, ops);
+    assert(n == 4);
+    assert(!ops[0].check_ip && ops[0].l4 == ACT_L4_KEY);
+    assert(!ops[1].check_ip && ops[1].l4 == ACT_L4_KEY);
+
+    /* TCP and UDP: the checksum is chosen once. */
+    match.wildcards &= ~OFPFW_NW_PROTO;
+    match.flow.nw_proto = IP_TYPE_TCP;
+    n = compile(&match, &a, ops);
+    assert(n == 4);
+    assert(ops[0].l4 == ACT_L4_TCP && ops[1].l4 == ACT_L4_TCP);
+    match.flow.nw_proto = IP_TYPE_UDP;
+    n = compile(&match, &a, ops);
+    assert(n == 4);
+    assert(ops[0].l4 == ACT_L4_UDP && ops[1].l4 == ACT_L4_UDP);
+
+    /* ICMP has no ports to set. */
+    match.flow.nw_proto = IP_TYPE_ICMP;
+    n = compile(&match, &a, ops);
+    assert(n == 3);
+    assert(ops[0].type == OFPAT_SET_NW_SRC && ops[0].l4 == ACT_L4_NONE);
+    assert(ops[1].type == OFPAT_SET_DL_SRC);
+    assert(ops[2].type == OFPAT_OUTPUT);
+}
+
+/* Actions that map onto others keep their operands. */
+static void
+test_compile_aliases(void)
+{
+    struct act_op ops[ACT_MAX_OPS(256)];
+    struct ofp_action_vlan_pcp *vp;
+    struct ofp_action_enqueue *ea;
+    struct sw_flow_key match;
+    struct actions a;
+
+    a.len = 0;
+    vp = put_action(&a, OFPAT_SET_VLAN_PCP, sizeof *vp);
+    vp->vlan_pcp = 5;
+    ea = put_action(&a, OFPAT_ENQUEUE, sizeof *ea);
+    ea->port = htons(3);
+    ea->queue_id = htonl(7);
+
+    memset(&match, 0, sizeof match);
+    match.wildcards = OFPFW_ALL;
+    assert(compile(&match, &a, ops) == 2);
+    assert(ops[0].type == OFPAT_SET_VLAN_VID);
+    assert(ops[0].u.vlan.tci == 5 << 13);
+    assert(ops[0].u.vlan.mask == VLAN_PCP_MASK);
+    assert(ops[1].type == OFPAT_OUTPUT);
+    assert(ops[1].u.output.port == 3 && ops[1].u.output.queue_id == 7);
+}
+
+/* Runs the compiled form of 'a', compiled against 'match', on 'packet', whose
+ * flow is 'key'. */
+static void
+run(const struct sw_flow_key *match, const struct actions *a,
+    struct ofpbuf *packet, struct sw_flow_key *key)
+{
+    struct act_op ops[ACT_MAX_OPS(256)];
+    size_t n = compile(match, a, ops);
+
+    execute_compiled_actions(NULL, packet, key, ops, n, false);
+}
+
+/* A packet that goes out more than once is shared, not copied, unless an
+ * action modifies it after an earlier output, and then only the later
+ * outputs see the change. */
+static void
+test_copy_on_write(void)
+{
+    struct sw_flow_key key, match;
+    struct ofpbuf *packet;
+    struct actions a;
+
+    /* A single output gets the packet itself. */
+    packet = make_udp_packet(&key);
+    match = key;
+    a.len = 0;
+    put_tp_port(&a, OFPAT_SET_TP_DST, 99);
+    put_output(&a, 2);
+    run(&match, &a, packet, &key);
+    assert(n_outputs == 1);
+    assert(outputs[0] == packet);
+    assert(!ofpbuf_is_shared(packet));
+    assert(udp_dst(packet) == 99);
+    clear_outputs();
+
+    /* Two outputs with nothing in between share the data. */
+    packet = make_udp_packet(&key);
+    a.len = 0;
+    put_output(&a, 2);
+    put_output(&a, 3);
+    run(&match, &a, packet, &key);
+    assert(n_outputs == 2);
+    assert(output_ports[0] == 2 && output_ports[1] == 3);
+    assert(outputs[0]->data == outputs[1]->data);
+    assert(ofpbuf_is_shared(outputs[0]));
+    clear_outputs();
+
+    /* A rewrite between outputs copies the packet first. */
+    packet = make_udp_packet(&key);
+    a.len = 0;
+    put_output(&a, 2);
+    put_tp_port(&a, OFPAT_SET_TP_DST, 99);
+    put_output(&a, 3);
+    put_tp_port(&a, OFPAT_SET_TP_DST, 100);
+    put_output(&a, OFPP_CONTROLLER);
+    run(&match, &a, packet, &key);
+    assert(n_outputs == 3);
+    assert(output_ports[2] == OFPP_CONTROLLER);
+    assert(udp_dst(outputs[0]) == 2000);
+    assert(udp_dst(outputs[1]) == 99);
+    assert(udp_dst(outputs[2]) == 100);
+    assert(outputs[0]->data != outputs[1]->data);
+    assert(outputs[1]->data != outputs[2]->data);
+    assert(!ofpbuf_is_shared(outputs[0]));
+    clear_outputs();
+}
+
+/* Rewrites compiled for any kind of packet leave non-IP packets alone. */
+static void
+test_check_ip(void)
+{
+    struct sw_flow_key key, match;
+    struct ofpbuf *packet;
+    struct actions a;
+    uint8_t copy[64];
+
+    packet = make_udp_packet(&key);
+    ((struct eth_header *) packet->l2)->eth_type = htons(ETH_TYPE_ARP);
+    key.flow.dl_type = htons(ETH_TYPE_ARP);
+    memcpy(copy, packet->data, packet->size);
+
+    memset(&match, 0, sizeof match);
+    match.wildcards = OFPFW_ALL;
+    a.len = 0;
+    put_nw_addr(&a, OFPAT_SET_NW_SRC, 0x0a000009);
+    put_tp_port(&a, OFPAT_SET_TP_SRC, 99);
+    put_output(&a, 2);
+    run(&match, &a, packet, &key);
+    assert(n_outputs == 1);
+    assert(!memcmp(outputs[0]->data, copy, outputs[0]->size));
+    clear_outputs();
+}
+
+/* Rewriting the addresses or ports of a UDP packet updates its checksum,
+ * unless it has none: zero means no checksum, so it stays zero, and an
+ * updated checksum that comes out zero is sent as all-ones instead. */
+static void
+test_udp_checksum(void)
+{
+    struct sw_flow_key key, match;
+    struct udp_header *udp;
+    struct ofpbuf *packet;
+    struct actions a;
+    size_t i;
+
+    for (i = 0; i < 2; i++) {
+        packet = make_udp_packet(&key);
+        match = key;
+        a.len = 0;
+        if (i == 0) {
+            put_nw_addr(&a, OFPAT_SET_NW_DST, 0x0a000009);
+        } else {
+            put_tp_port(&a, OFPAT_SET_TP_DST, 99);
+        }
+        put_output(&a, 2);
+        run(&match, &a, packet, &key);
+        assert(n_outputs == 1);
+        udp = outputs[0]->l4;
+        assert(udp->udp_csum == 0);
+        clear_outputs();
+    }
+
+    /* A checksum that the port rewrite brings to zero.  Changing the port
+     * from 2000 to 99 takes 2000 - 99 from the one's complement sum that
+     * the checksum complements, so a sum of exactly that leaves zero. */
+    packet = make_udp_packet(&key);
+    udp = packet->l4;
+    udp->udp_csum = htons(0xffff - (2000 - 99));
+    match = key;
+    a.len = 0;
+    put_tp_port(&a, OFPAT_SET_TP_DST, 99);
+    put_output(&a, 2);
+    run(&match, &a, packet, &key);
+    udp = outputs[0]->l4;
+    assert(udp->udp_csum == htons(0xffff));
+    assert(udp_dst(outputs[0]) == 99);
+    clear_outputs();
+}
+
+int
+main(void)
+{
+    test_compile();
+    test_compile_aliases();
+    test_copy_on_write();
+    test_check_ip();
+    test_udp_checksum();
+    return 0;
+}
@@ -0,0 +1,269 @@
+/* Tests for the dispatch of relayed messages to packet callbacks in
+ * secchan/hook-dispatch.c. */
+
+#include <config.h>
+#include "hook-dispatch.h"
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ofpbuf.h"
+#include "openflow/nicira-ext.h"
+#include "openflow/openflow.h"
+#include "openflow/private-ext.h"
+#include "secchan.h"
+#include "util.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+/* A packet callback's identity and what it returns. */
+struct hook_aux {
+    char name;
+    bool takes;
+};
+
+/* The names of the callbacks called so far, in order. */
+static char calls[64];
+static size_t n_calls;
+
+/* The relay that the callbacks should be passed. */
+static struct relay *the_relay;
+
+static bool
+log_cb(struct relay *r, void *aux_)
+{
+    struct hook_aux *aux = aux_;
+
+    assert(r == the_relay);
+    assert(n_calls < sizeof calls - 1);
+    calls[n_calls++] = aux->name;
+    calls[n_calls] = '\0';
+    return aux->takes;
+}
+
+/* Dispatches a message with the given 'type', 'vendor', and 'subtype' through
+ * 'table'.  Returns the names of the callbacks called, in order, and stores
+ * whether one took the message into '*taken'. */
+static const char *
+dispatch(const struct hook_dispatch table[], int type, uint32_t vendor,
+         uint32_t subtype, bool *taken)
+{
+    struct hook_msg hm;
+
+    hm.type = type;
+    hm.vendor = vendor;
+    hm.subtype = subtype;
+    n_calls = 0;
+    calls[0] = '\0';
+    *taken = hook_dispatch_call(table, &hm, the_relay);
+    return calls;
+}
+
+static void
+destroy_table(struct hook_dispatch table[])
+{
+    int i;
+
+    for (i = 0; i < N_MSG_TYPES; i++) {
+        free(table[i].subs);
+    }
+}
+
+/* Callbacks see only the message types they asked for, in the order they
+ * were added, and a callback that takes a message hides it from the rest. */
+static void
+test_order(void)
+{
+    static const struct hook_msg a_msgs[] = {
+        { OFPT_PACKET_IN, 0, 0 },
+        { OFPT_ECHO_REQUEST, 0, 0 },
+        HOOK_MSG_END,
+    };
+    static const struct hook_msg c_msgs[] = {
+        { OFPT_ECHO_REQUEST, 0, 0 },
+        HOOK_MSG_END,
+    };
+    static const struct hook_msg none[] = {
+        HOOK_MSG_END,
+    };
+    struct hook_dispatch table[N_MSG_TYPES];
+    struct hook_aux a = { 'a', false };
+    struct hook_aux b = { 'b', false };
+    struct hook_aux c = { 'c', false };
+    struct hook_aux d = { 'd', false };
+    struct relay relay;
+    bool taken;
+
+    the_relay = &relay;
+    memset(table, 0, sizeof table);
+    hook_dispatch_add(table, log_cb, &a, a_msgs);
+    hook_dispatch_add(table, log_cb, &b, NULL);
+    hook_dispatch_add(table, log_cb, &c, c_msgs);
+    hook_dispatch_add(table, log_cb, &d, none);
+    hook_dispatch_add(table, NULL, &d, NULL);
+
+    assert(!strcmp(dispatch(table, OFPT_PACKET_IN, 0, 0, &taken), "ab"));
+    assert(!taken);
+    assert(!strcmp(dispatch(table, OFPT_ECHO_REQUEST, 0, 0, &taken), "abc"));
+    assert(!taken);
+    assert(!strcmp(dispatch(table, OFPT_FLOW_MOD, 0, 0, &taken), "b"));
+    assert(!taken);
+    assert(!strcmp(dispatch(table, N_MSG_TYPES - 1, 0, 0, &taken), "b"));
+    assert(!taken);
+
+    b.takes = true;
+    assert(!strcmp(dispatch(table, OFPT_ECHO_REQUEST, 0, 0, &taken), "ab"));
+    assert(taken);
+    a.takes = true;
+    assert(!strcmp(dispatch(table, OFPT_ECHO_REQUEST, 0, 0, &taken), "a"));
+    assert(taken);
+    assert(!strcmp(dispatch(table, OFPT_FLOW_MOD, 0, 0, &taken), "b"));
+    assert(taken);
+
+    destroy_table(table);
+}
+
+/* Callbacks for vendor messages see only the vendors and subtypes they asked
+ * for, and a callback for other types does not filter on vendor. */
+static void
+test_vendor(void)
+{
+    static const struct hook_msg nx_msgs[] = {
+        { OFPT_VENDOR, NX_VENDOR_ID, HOOK_ANY },
+        HOOK_MSG_END,
+    };
+    static const struct hook_msg nx_cmd_msgs[] = {
+        { OFPT_VENDOR, NX_VENDOR_ID, NXT_COMMAND_REQUEST },
+        HOOK_MSG_END,
+    };
+    static const struct hook_msg private_msgs[] = {
+        { OFPT_VENDOR, PRIVATE_VENDOR_ID, PRIVATEOPT_EMERG_FLOW_PROTECTION },
+        { OFPT_PACKET_IN, PRIVATE_VENDOR_ID, 1 },
+        HOOK_MSG_END,
+    };
+    static const struct hook_msg any_msgs[] = {
+        { OFPT_VENDOR, HOOK_ANY, HOOK_ANY },
+        HOOK_MSG_END,
+    };
+    struct hook_dispatch table[N_MSG_TYPES];
+    struct hook_aux a = { 'a', false };
+    struct hook_aux b = { 'b', false };
+    struct hook_aux c = { 'c', false };
+    struct hook_aux d = { 'd', false };
+    bool taken;
+
+    the_relay = NULL;
+    memset(table, 0, sizeof table);
+    hook_dispatch_add(table, log_cb, &a, nx_msgs);
+    hook_dispatch_add(table, log_cb, &b, nx_cmd_msgs);
+    hook_dispatch_add(table, log_cb, &c, private_msgs);
+    hook_dispatch_add(table, log_cb, &d, any_msgs);
+
+    assert(!strcmp(dispatch(table, OFPT_VENDOR, NX_VENDOR_ID,
+                            NXT_COMMAND_REQUEST, &taken), "abd"));
+    assert(!strcmp(dispatch(table, OFPT_VENDOR, NX_VENDOR_ID,
+                            NXT_COMMAND_REPLY, &taken), "ad"));
+    assert(!strcmp(dispatch(table, OFPT_VENDOR, PRIVATE_VENDOR_ID,
+                            PRIVATEOPT_EMERG_FLOW_PROTECTION, &taken), "cd"));
+    assert(!strcmp(dispatch(table, OFPT_VENDOR, PRIVATE_VENDOR_ID,
+                            PRIVATEOPT_EMERG_FLOW_RESTORATION, &taken), "d"));
+    assert(!strcmp(dispatch(table, OFPT_VENDOR, 0x1234, 0, &taken), "d"));
+    assert(!strcmp(dispatch(table, OFPT_PACKET_IN, 0, 0, &taken), "c"));
+    assert(!taken);
+
+    b.takes = true;
+    assert(!strcmp(dispatch(table, OFPT_VENDOR, NX_VENDOR_ID,
+                            NXT_COMMAND_REQUEST, &taken), "ab"));
+    assert(taken);
+
+    destroy_table(table);
+}
+
+/* Returns a new message of the given 'type' whose first 'size' bytes are
+ * zeros except for the header's type. */
+static struct ofpbuf *
+make_msg(uint8_t type, size_t size)
+{
+    struct ofpbuf *b = ofpbuf_new(size);
+    struct ofp_header *oh = ofpbuf_put_zeros(b, size);
+
+    oh->version = OFP_VERSION;
+    oh->type = type;
+    oh->length = htons(size);
+    return b;
+}
+
+/* Message headers decode into the type and, for the vendor messages that the
+ * hooks know, the vendor and subtype. */
+static void
+test_parse(void)
+{
+    struct private_vxhdr *pvh;
+    struct private_vxopt *pvo;
+    struct nicira_header *nh;
+    struct ofp_vendor_header *ovh;
+    struct hook_msg hm;
+    struct ofpbuf *b;
+
+    b = make_msg(OFPT_PACKET_IN, sizeof(struct ofp_packet_in));
+    hook_msg_parse(b, &hm);
+    assert(hm.type == OFPT_PACKET_IN);
+    assert(hm.vendor == 0 && hm.subtype == 0);
+    ofpbuf_delete(b);
+
+    b = make_msg(OFPT_VENDOR, sizeof *nh);
+    nh = b->data;
+    nh->vendor = htonl(NX_VENDOR_ID);
+    nh->subtype = htonl(NXT_COMMAND_REQUEST);
+    hook_msg_parse(b, &hm);
+    assert(hm.type == OFPT_VENDOR);
+    assert(hm.vendor == NX_VENDOR_ID);
+    assert(hm.subtype == NXT_COMMAND_REQUEST);
+
+    /* Too short for the subtype. */
+    b->size = sizeof(struct ofp_vendor_header);
+    hook_msg_parse(b, &hm);
+    assert(hm.vendor == NX_VENDOR_ID);
+    assert(hm.subtype == 0);
+
+    /* Too short for the vendor. */
+    b->size = sizeof(struct ofp_header);
+    hook_msg_parse(b, &hm);
+    assert(hm.type == OFPT_VENDOR);
+    assert(hm.vendor == 0 && hm.subtype == 0);
+    ofpbuf_delete(b);
+
+    b = make_msg(OFPT_VENDOR, sizeof *pvh + sizeof *pvo);
+    pvh = b->data;
+    pvh->ofp_vxid = htonl(PRIVATE_VENDOR_ID);
+    pvo = (struct private_vxopt *) (pvh + 1);
+    pvo->pvo_type = htons(PRIVATEOPT_EMERG_FLOW_RESTORATION);
+    hook_msg_parse(b, &hm);
+    assert(hm.vendor == PRIVATE_VENDOR_ID);
+    assert(hm.subtype == PRIVATEOPT_EMERG_FLOW_RESTORATION);
+
+    b->size = sizeof *pvh;
+    hook_msg_parse(b, &hm);
+    assert(hm.vendor == PRIVATE_VENDOR_ID);
+    assert(hm.subtype == 0);
+    ofpbuf_delete(b);
+
+    /* Some other vendor has no subtype that the hooks know of. */
+    b = make_msg(OFPT_VENDOR, sizeof *nh);
+    ovh = b->data;
+    ovh->vendor = htonl(0x1234);
+    hook_msg_parse(b, &hm);
+    assert(hm.vendor == 0x1234);
+    assert(hm.subtype == 0);
+    ofpbuf_delete(b);
+}
+
+int
+main(void)
+{
+    test_order();
+    test_vendor();
+    test_parse();
+    return 0;
+}
@@ -0,0 +1,179 @@
+/* A non-exhaustive test for the ofpbuf pool and for shared, copy-on-write
+ * ofpbufs, as declared in ofpbuf.h. */
+
+#include <config.h>
+#include "ofpbuf.h"
+#include <stdio.h>
+#include <string.h>
+
+#undef NDEBUG
+#include <assert.h>
+
+#define HEADROOM 16
+#define SIZE 128
+
+static const char packet[] = "0123456789abcdef0123456789abcdef";
+
+/* Returns a buffer from 'pool' that contains 'packet', with its layer
+ * pointers set. */
+static struct ofpbuf *
+make_packet(struct ofpbuf_pool *pool)
+{
+    struct ofpbuf *b = ofpbuf_pool_get(pool);
+
+    ofpbuf_put(b, packet, sizeof packet);
+    b->l2 = b->data;
+    b->l3 = (char *) b->data + 14;
+    return b;
+}
+
+static void
+test_pool_recycles(void)
+{
+    struct ofpbuf_pool pool;
+    struct ofpbuf *a, *b, *c;
+
+    ofpbuf_pool_init(&pool, HEADROOM, SIZE, 2);
+
+    a = ofpbuf_pool_get(&pool);
+    assert(ofpbuf_headroom(a) == HEADROOM);
+    assert(ofpbuf_tailroom(a) >= SIZE);
+    ofpbuf_put(a, packet, sizeof packet);
+    ofpbuf_delete(a);
+    assert(pool.n_buffers == 1 && pool.n_free == 1);
+
+    /* The same buffer comes back, empty. */
+    b = ofpbuf_pool_get(&pool);
+    assert(b == a);
+    assert(b->size == 0 && ofpbuf_headroom(b) == HEADROOM);
+
+    /* Beyond 'max_buffers', buffers are allocated but not kept. */
+    a = ofpbuf_pool_get(&pool);
+    c = ofpbuf_pool_get(&pool);
+    assert(pool.n_buffers == 2 && pool.n_exhausted == 1);
+    assert(!c->pool);
+    ofpbuf_delete(a);
+    ofpbuf_delete(b);
+    ofpbuf_delete(c);
+    assert(pool.n_free == 2);
+
+    /* Growing the pool discards smaller buffers. */
+    ofpbuf_pool_set_size(&pool, SIZE * 2);
+    assert(pool.n_buffers == 0 && pool.n_free == 0);
+    a = ofpbuf_pool_get(&pool);
+    assert(ofpbuf_tailroom(a) >= SIZE * 2);
+    ofpbuf_delete(a);
+    ofpbuf_pool_set_size(&pool, SIZE * 4);
+}
+
+static void
+test_share_without_copy(void)
+{
+    struct ofpbuf_pool pool;
+    struct ofpbuf *a, *b, *c;
+
+    ofpbuf_pool_init(&pool, HEADROOM, SIZE, 8);
+    a = make_packet(&pool);
+    b = ofpbuf_share(a);
+    c = ofpbuf_share(a);
+
+    assert(b->data == a->data && c->data == a->data);
+    assert(b->l3 == a->l3);
+    assert(ofpbuf_is_shared(a) && ofpbuf_is_shared(b));
+
+    /* Pulling data off one sharer does not affect the others. */
+    ofpbuf_pull(b, 14);
+    assert(a->size == sizeof packet && b->size == sizeof packet - 14);
+
+    /* The data lives until the last sharer is deleted, then goes back to the
+     * pool. */
+    ofpbuf_delete(a);
+    ofpbuf_delete(c);
+    assert(!ofpbuf_is_shared(b));
+    assert(!memcmp(b->data, packet + 14, sizeof packet - 14));
+    assert(pool.n_free == 0);
+    ofpbuf_delete(b);
+    assert(pool.n_buffers == 1 && pool.n_free == 1);
+}
+
+static void
+test_copy_on_write(void)
+{
+    struct ofpbuf_pool pool;
+    struct ofpbuf *a, *b;
+    char *l3;
+
+    ofpbuf_pool_init(&pool, HEADROOM, SIZE, 8);
+    a = make_packet(&pool);
+    b = ofpbuf_share(a);
+
+    /* Modifying 'b' in place copies it, and moves its layer pointers. */
+    ofpbuf_make_writable(b);
+    assert(b->data != a->data);
+    assert(!ofpbuf_is_shared(a) && !ofpbuf_is_shared(b));
+    assert(ofpbuf_headroom(b) == HEADROOM);
+    assert((char *) b->l3 - (char *) b->l2 == 14);
+    l3 = b->l3;
+    l3[0] = 'X';
+    assert(((char *) a->l3)[0] == 'e');
+    assert(!memcmp(b->data, packet, 14));
+
+    /* The copy came from the same pool. */
+    assert(pool.n_buffers == 2);
+
+    /* Pushing a header is a modification too. */
+    ofpbuf_delete(b);
+    b = ofpbuf_share(a);
+    memcpy(ofpbuf_push_uninit(b, 4), "HDR:", 4);
+    assert(a->size == sizeof packet);
+    assert(ofpbuf_headroom(a) == HEADROOM);
+    assert(!memcmp(a->data, packet, sizeof packet));
+    assert(!memcmp(b->data, "HDR:", 4));
+    assert(!memcmp((char *) b->data + 4, packet, sizeof packet));
+
+    /* An ofpbuf that is no longer shared is not copied again. */
+    l3 = a->l3;
+    ofpbuf_make_writable(a);
+    assert(a->l3 == l3);
+
+    ofpbuf_delete(a);
+    ofpbuf_delete(b);
+    assert(pool.n_free == pool.n_buffers);
+}
+
+static void
+test_clone_of_shared(void)
+{
+    struct ofpbuf_pool pool;
+    struct ofpbuf *a, *b, *c;
+
+    ofpbuf_pool_init(&pool, HEADROOM, SIZE, 8);
+    a = make_packet(&pool);
+    b = ofpbuf_share(a);
+    c = ofpbuf_clone(b);
+    assert(c->pool == &pool);
+    assert(c->data != a->data);
+    assert(!memcmp(c->data, packet, sizeof packet));
+    ofpbuf_delete(a);
+    ofpbuf_delete(b);
+    ofpbuf_delete(c);
+    assert(pool.n_free == pool.n_buffers);
+}
+
+static void
+run_test(void (*function)(void))
+{
+    function();
+    printf(".");
+}
+
+int
+main(void)
+{
+    run_test(test_pool_recycles);
+    run_test(test_share_without_copy);
+    run_test(test_copy_on_write);
+    run_test(test_clone_of_shared);
+    printf("\n");
+    return 0;
+}
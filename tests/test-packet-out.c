@@ -0,0 +1,201 @@
+/* Tests for packet_out handling in udatapath/datapath.c, through a real
+ * connection to a datapath, so that messages arrive the way they do in
+ * ofdatapath, as slices of the connection's receive ring. */
+
+#include <config.h>
+#include "datapath.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "buffer-store.h"
+#include "chain.h"
+#include "ofpbuf.h"
+#include "openflow/openflow.h"
+#include "packets.h"
+#include "poll-loop.h"
+#include "timeval.h"
+#include "util.h"
+#include "vconn.h"
+#include "xtoxll.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+#define SOCKET_NAME "test-packet-out.sock"
+
+/* Descriptions that ofdatapath defines in udatapath.c. */
+char mfr_desc[DESC_STR_LEN] = "mfr";
+char hw_desc[DESC_STR_LEN] = "hw";
+char sw_desc[DESC_STR_LEN] = "sw";
+char dp_desc[DESC_STR_LEN] = "dp";
+char serial_num[SERIAL_NUM_LEN] = "serial";
+
+/* There is no way to destroy a datapath, so it lives here until the end. */
+static struct datapath *dp;
+
+/* Returns a new Ethernet frame 'size' bytes long. */
+static struct ofpbuf *
+make_frame(size_t size)
+{
+    struct ofpbuf *b = ofpbuf_new(size);
+    struct eth_header *eth = ofpbuf_put_zeros(b, size);
+    size_t i;
+
+    eth->eth_dst[5] = 2;
+    eth->eth_src[5] = 1;
+    eth->eth_type = htons(0x88b5);
+    for (i = ETH_HEADER_LEN; i < size; i++) {
+        ((uint8_t *) b->data)[i] = i;
+    }
+    return b;
+}
+
+/* Runs 'dp' and the connection 'client' to it, sending 'msg' as soon as the
+ * connection is up, until 'client' receives a message of the given 'type',
+ * which it returns. */
+static struct ofpbuf *
+transact(struct vconn *client, struct ofpbuf *msg, uint8_t type)
+{
+    int i;
+
+    for (i = 0; i < 1000; i++) {
+        struct ofpbuf *reply;
+        int error;
+
+        dp_run(dp);
+        if (msg) {
+            error = vconn_connect(client);
+            if (!error) {
+                assert(!vconn_send(client, msg));
+                msg = NULL;
+            } else {
+                assert(error == EAGAIN);
+            }
+        }
+        if (!msg) {
+            error = vconn_recv(client, &reply);
+            if (!error) {
+                const struct ofp_header *oh = reply->data;
+                if (oh->type == type) {
+                    return reply;
+                }
+                ofpbuf_delete(reply);
+                continue;
+            }
+            assert(error == EAGAIN);
+        }
+
+        dp_wait(dp);
+        if (msg) {
+            vconn_connect_wait(client);
+        } else {
+            vconn_recv_wait(client);
+        }
+        poll_block();
+    }
+    NOT_REACHED();
+}
+
+/* A frame in an unbuffered packet_out is sent out without copying it, as a
+ * slice of the receive ring.  If its actions send it to the controller, the
+ * datapath saves it in the buffer store, which must not keep the ring alive
+ * with it. */
+static void
+test_packet_out_to_controller(struct vconn *client)
+{
+    const struct ofp_packet_in *opi;
+    struct ofpbuf *frame, *msg, *saved;
+    uint32_t buffer_id;
+
+    frame = make_frame(200);
+    msg = make_unbuffered_packet_out(frame, 1, OFPP_CONTROLLER);
+    msg = transact(client, msg, OFPT_PACKET_IN);
+    opi = msg->data;
+    assert(ntohs(opi->total_len) == frame->size);
+    buffer_id = ntohl(opi->buffer_id);
+    assert(buffer_id != UINT32_MAX);
+    ofpbuf_delete(msg);
+
+    saved = buffer_store_retrieve(&dp->buffers, buffer_id);
+    assert(saved != NULL);
+    assert(!ofpbuf_is_shared(saved));
+    assert(saved->allocated < 4096);
+    assert(saved->size == frame->size);
+    assert(!memcmp(saved->data, frame->data, frame->size));
+    ofpbuf_delete(saved);
+
+    ofpbuf_delete(frame);
+}
+
+/* A frame sent to OFPP_TABLE is looked up in the flow tables through the
+ * microflow cache, which table stats report as a pseudo-table with ID 0xff
+ * after the real tables.  The real tables count every lookup whether or not
+ * the cache answered it. */
+static void
+test_packet_out_to_table(struct vconn *client)
+{
+    const struct ofp_stats_reply *osr;
+    const struct ofp_table_stats *ots;
+    struct ofp_stats_request *rq;
+    struct ofpbuf *frame, *msg;
+    size_t n;
+    int i;
+
+    frame = make_frame(200);
+
+    /* The first lookup misses the cache and the tables.  The second misses
+     * the tables again but hits the cache.  The connection is already up, and
+     * the datapath handles its messages in order, so the stats reply follows
+     * both. */
+    for (i = 0; i < 2; i++) {
+        msg = make_unbuffered_packet_out(frame, 1, OFPP_TABLE);
+        assert(!vconn_send(client, msg));
+    }
+
+    rq = make_openflow(sizeof *rq, OFPT_STATS_REQUEST, &msg);
+    rq->type = htons(OFPST_TABLE);
+    msg = transact(client, msg, OFPT_STATS_REPLY);
+    osr = msg->data;
+    assert(ntohs(osr->type) == OFPST_TABLE);
+    n = (msg->size - sizeof *osr) / sizeof *ots;
+    assert(n == dp->chain->n_tables + 1);
+
+    ots = (const struct ofp_table_stats *) osr->body;
+    assert(ots[0].table_id == 0);
+    assert(ntohll(ots[0].lookup_count) == 2);
+    assert(ntohll(ots[0].matched_count) == 0);
+
+    ots += n - 1;
+    assert(ots->table_id == 0xff);
+    assert(!strcmp(ots->name, "microflow cache"));
+    assert(ntohll(ots->lookup_count) == 2);
+    assert(ntohll(ots->matched_count) == 1);
+    ofpbuf_delete(msg);
+
+    ofpbuf_delete(frame);
+}
+
+int
+main(void)
+{
+    struct pvconn *pvconn;
+    struct vconn *client;
+
+    time_init();
+    alarm(30);
+
+    unlink(SOCKET_NAME);
+    assert(!dp_new(&dp, 1));
+    assert(!pvconn_open("punix:" SOCKET_NAME, &pvconn));
+    dp_add_pvconn(dp, pvconn);
+    assert(!vconn_open("unix:" SOCKET_NAME, OFP_VERSION, &client));
+
+    test_packet_out_to_controller(client);
+    test_packet_out_to_table(client);
+
+    vconn_close(client);
+    unlink(SOCKET_NAME);
+    return 0;
+}
@@ -0,0 +1,348 @@
+/* Tests for the pending misses in udatapath/pending-miss.c. */
+
+#include <config.h>
+#include "pending-miss.h"
+#include <arpa/inet.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "datapath.h"
+#include "flow.h"
+#include "ofpbuf.h"
+#include "openflow/openflow.h"
+#include "packets.h"
+#include "switch-flow.h"
+#include "util.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+#define IN_PORT 1
+
+/* Stubs for the parts of the datapath that the actions call. */
+void
+dp_output_port(struct datapath *dp UNUSED, struct ofpbuf *buffer UNUSED,
+               int in_port UNUSED, int out_port UNUSED,
+               uint32_t queue_id UNUSED, bool ignore_no_fwd UNUSED)
+{
+}
+
+void
+dp_output_control(struct datapath *dp UNUSED, struct ofpbuf *buffer UNUSED,
+                  int in_port UNUSED, size_t max_len UNUSED,
+                  int reason UNUSED)
+{
+}
+
+/* Returns a new UDP packet from port 'tp_src' to port 'tp_dst'. */
+static struct ofpbuf *
+make_packet(uint16_t tp_src, uint16_t tp_dst)
+{
+    struct ofpbuf *b = ofpbuf_new(ETH_HEADER_LEN + IP_HEADER_LEN
+                                  + UDP_HEADER_LEN);
+    struct eth_header *eth;
+    struct ip_header *ip;
+    struct udp_header *udp;
+
+    eth = ofpbuf_put_zeros(b, sizeof *eth);
+    eth->eth_src[5] = 1;
+    eth->eth_dst[5] = 2;
+    eth->eth_type = htons(ETH_TYPE_IP);
+
+    ip = ofpbuf_put_zeros(b, sizeof *ip);
+    ip->ip_ihl_ver = IP_IHL_VER(5, IP_VERSION);
+    ip->ip_tot_len = htons(IP_HEADER_LEN + UDP_HEADER_LEN);
+    ip->ip_ttl = 64;
+    ip->ip_proto = IP_TYPE_UDP;
+    ip->ip_src = htonl(0x0a000001);
+    ip->ip_dst = htonl(0x0a000002);
+
+    udp = ofpbuf_put_zeros(b, sizeof *udp);
+    udp->udp_src = htons(tp_src);
+    udp->udp_dst = htons(tp_dst);
+    udp->udp_len = htons(UDP_HEADER_LEN);
+    return b;
+}
+
+/* Initializes 'key' to match exactly the microflow of 'packet'. */
+static void
+exact_key(struct sw_flow_key *key, struct ofpbuf *packet)
+{
+    memset(key, 0, sizeof *key);
+    flow_extract(packet, IN_PORT, &key->flow);
+    key->nw_src_mask = key->nw_dst_mask = htonl(0xffffffff);
+}
+
+/* Holds 'packet' in 'pms' at time 'now' and returns what pending_miss_hold()
+ * returned.  Stores the new pending miss, if any, into '*pmp', or a null
+ * pointer. */
+static bool
+hold(struct pending_misses *pms, struct ofpbuf *packet, long long int now,
+     struct pending_miss **pmp)
+{
+    *pmp = NULL;
+    return pending_miss_hold(pms, packet, IN_PORT, 128, now, pmp);
+}
+
+static void
+free_pending_miss(struct pending_miss *pm)
+{
+    unsigned int i;
+
+    for (i = 0; i < pm->n_packets; i++) {
+        ofpbuf_delete(pm->packets[i]);
+    }
+    pending_miss_destroy(pm);
+}
+
+/* Frees the pending misses in 'taken' and returns how many there were. */
+static size_t
+free_taken(struct list *taken)
+{
+    struct pending_miss *pm, *next;
+    size_t n = 0;
+
+    LIST_FOR_EACH_SAFE (pm, next, struct pending_miss, list_node, taken) {
+        free_pending_miss(pm);
+        n++;
+    }
+    return n;
+}
+
+/* The first packet of a microflow goes up, later ones are held, up to a
+ * limit, and microflows beyond PENDING_MISS_MAX are not tracked. */
+static void
+test_hold(void)
+{
+    struct pending_misses pms;
+    struct pending_miss *a, *b, *pm;
+    struct ofpbuf *first;
+    int i;
+
+    pending_misses_init(&pms);
+
+    first = make_packet(1, 80);
+    assert(!hold(&pms, first, 0, &a));
+    assert(a != NULL);
+    assert(a->n_packets == 0);
+    pending_miss_set_buffer_id(&pms, a, 7);
+    ofpbuf_delete(first);
+
+    for (i = 0; i < PENDING_MISS_MAX_PACKETS; i++) {
+        struct ofpbuf *packet = make_packet(1, 80);
+        assert(hold(&pms, packet, 0, &pm));
+        assert(pm == NULL);
+        assert(a->packets[i] == packet);
+    }
+    assert(a->n_packets == PENDING_MISS_MAX_PACKETS);
+    assert(pms.n_held == PENDING_MISS_MAX_PACKETS);
+
+    assert(hold(&pms, make_packet(1, 80), 0, &pm));
+    assert(a->n_packets == PENDING_MISS_MAX_PACKETS);
+    assert(pms.n_dropped == 1);
+
+    first = make_packet(2, 80);
+    assert(!hold(&pms, first, 0, &b));
+    assert(b != NULL && b != a);
+    ofpbuf_delete(first);
+    assert(pending_misses_count(&pms) == 2);
+
+    for (i = 2; i < PENDING_MISS_MAX; i++) {
+        first = make_packet(i + 1, 80);
+        assert(!hold(&pms, first, 0, &pm));
+        assert(pm != NULL);
+        ofpbuf_delete(first);
+    }
+    first = make_packet(PENDING_MISS_MAX + 1, 80);
+    assert(!hold(&pms, first, 0, &pm));
+    assert(pm == NULL);
+    ofpbuf_delete(first);
+    assert(pending_misses_count(&pms) == PENDING_MISS_MAX);
+
+    pending_misses_destroy(&pms);
+}
+
+/* A flow added for a microflow releases exactly the packets held for it, in
+ * the order they arrived. */
+static void
+test_take_exact(void)
+{
+    struct pending_misses pms;
+    struct pending_miss *a, *b, *pm;
+    struct ofpbuf *packets[3];
+    struct sw_flow_key key;
+    struct ofpbuf *first;
+    struct list taken;
+    int i;
+
+    pending_misses_init(&pms);
+    first = make_packet(1, 80);
+    assert(!hold(&pms, first, 0, &a));
+    exact_key(&key, first);
+    ofpbuf_delete(first);
+    first = make_packet(2, 80);
+    assert(!hold(&pms, first, 0, &b));
+    ofpbuf_delete(first);
+    for (i = 0; i < 3; i++) {
+        packets[i] = make_packet(1, 80);
+        assert(hold(&pms, packets[i], 0, &pm));
+        assert(hold(&pms, make_packet(2, 80), 0, &pm));
+    }
+
+    list_init(&taken);
+    pending_misses_take_matches(&pms, &key, &taken);
+    assert(list_size(&taken) == 1);
+    pm = CONTAINER_OF(list_front(&taken), struct pending_miss, list_node);
+    assert(pm == a);
+    assert(pm->n_packets == 3);
+    for (i = 0; i < 3; i++) {
+        assert(pm->packets[i] == packets[i]);
+    }
+    free_taken(&taken);
+    assert(pending_misses_count(&pms) == 1);
+
+    /* The same flow again, as from a flow_mod that modifies it, finds
+     * nothing. */
+    list_init(&taken);
+    pending_misses_take_matches(&pms, &key, &taken);
+    assert(list_is_empty(&taken));
+
+    pending_misses_destroy(&pms);
+}
+
+/* A wildcarded flow releases every microflow that it matches, oldest
+ * first. */
+static void
+test_take_wild(void)
+{
+    static const uint16_t tp_dsts[] = { 80, 53, 80, 53, 80 };
+    struct pending_misses pms;
+    struct pending_miss *pms_held[ARRAY_SIZE(tp_dsts)];
+    struct pending_miss *pm;
+    struct sw_flow_key key;
+    long long int next;
+    struct list taken;
+    struct ofpbuf *packet;
+    size_t i, j;
+
+    pending_misses_init(&pms);
+    for (i = 0; i < ARRAY_SIZE(tp_dsts); i++) {
+        packet = make_packet(i + 1, tp_dsts[i]);
+        assert(!hold(&pms, packet, i, &pms_held[i]));
+        ofpbuf_delete(packet);
+    }
+
+    memset(&key, 0, sizeof key);
+    key.flow.tp_dst = htons(80);
+    key.wildcards = OFPFW_ALL & ~OFPFW_TP_DST;
+
+    list_init(&taken);
+    pending_misses_take_matches(&pms, &key, &taken);
+    j = 0;
+    LIST_FOR_EACH (pm, struct pending_miss, list_node, &taken) {
+        while (tp_dsts[j] != 80) {
+            j++;
+        }
+        assert(pm == pms_held[j++]);
+    }
+    assert(free_taken(&taken) == 3);
+    assert(pending_misses_count(&pms) == 2);
+
+    /* The rest are still in order for expiry. */
+    pm = pending_misses_take_expired(&pms, LLONG_MAX, &next);
+    assert(pm == pms_held[1]);
+    free_pending_miss(pm);
+    pm = pending_misses_take_expired(&pms, LLONG_MAX, &next);
+    assert(pm == pms_held[3]);
+    free_pending_miss(pm);
+
+    pending_misses_destroy(&pms);
+}
+
+/* A packet_out for the packet that went up finds its pending miss by buffer
+ * ID. */
+static void
+test_take_by_id(void)
+{
+    struct pending_misses pms;
+    struct pending_miss *pm[4];
+    struct ofpbuf *packet;
+    int i;
+
+    pending_misses_init(&pms);
+    for (i = 0; i < 4; i++) {
+        packet = make_packet(i + 1, 80);
+        assert(!hold(&pms, packet, 0, &pm[i]));
+        ofpbuf_delete(packet);
+        pending_miss_set_buffer_id(&pms, pm[i], i == 2 ? UINT32_MAX : i * 256);
+    }
+
+    assert(pending_misses_take_by_id(&pms, 1) == NULL);
+    assert(pending_misses_take_by_id(&pms, UINT32_MAX) == NULL);
+    assert(pending_misses_take_by_id(&pms, 256) == pm[1]);
+    free_pending_miss(pm[1]);
+    assert(pending_misses_take_by_id(&pms, 256) == NULL);
+    assert(pending_misses_take_by_id(&pms, 768) == pm[3]);
+    free_pending_miss(pm[3]);
+    assert(pending_misses_take_by_id(&pms, 0) == pm[0]);
+    free_pending_miss(pm[0]);
+    assert(pending_misses_count(&pms) == 1);
+
+    pending_misses_destroy(&pms);
+}
+
+/* Pending misses expire in the order they were created, and the caller learns
+ * when to check again. */
+static void
+test_expiry(void)
+{
+    struct pending_misses pms;
+    struct pending_miss *a, *b, *pm;
+    long long int next;
+    struct ofpbuf *packet;
+
+    pending_misses_init(&pms);
+    assert(!pending_misses_take_expired(&pms, 0, &next));
+    assert(next == LLONG_MAX);
+
+    packet = make_packet(1, 80);
+    assert(!hold(&pms, packet, 0, &a));
+    ofpbuf_delete(packet);
+    packet = make_packet(2, 80);
+    assert(!hold(&pms, packet, 500, &b));
+    ofpbuf_delete(packet);
+    pending_miss_set_buffer_id(&pms, a, 1);
+    pending_miss_set_buffer_id(&pms, b, 2);
+
+    assert(!pending_misses_take_expired(&pms, PENDING_MISS_MSECS - 1, &next));
+    assert(next == PENDING_MISS_MSECS);
+    pm = pending_misses_take_expired(&pms, PENDING_MISS_MSECS, &next);
+    assert(pm == a);
+    free_pending_miss(pm);
+    assert(!pending_misses_take_expired(&pms, PENDING_MISS_MSECS, &next));
+    assert(next == 500 + PENDING_MISS_MSECS);
+
+    /* An expired pending miss is no longer found by buffer ID. */
+    assert(pending_misses_take_by_id(&pms, 1) == NULL);
+
+    pm = pending_misses_take_expired(&pms, 2 * PENDING_MISS_MSECS, &next);
+    assert(pm == b);
+    free_pending_miss(pm);
+    assert(!pending_misses_take_expired(&pms, 2 * PENDING_MISS_MSECS, &next));
+    assert(next == LLONG_MAX);
+    assert(pending_misses_count(&pms) == 0);
+
+    pending_misses_destroy(&pms);
+}
+
+int
+main(void)
+{
+    test_hold();
+    test_take_exact();
+    test_take_wild();
+    test_take_by_id();
+    test_expiry();
+    return 0;
+}
@@ -0,0 +1,150 @@
+/* A non-exhaustive test for the fd registration behavior of poll_block() in
+ * lib/poll-loop.c. */
+
+#include <config.h>
+#include "poll-loop.h"
+#include <stdio.h>
+#include <unistd.h>
+#include "timeval.h"
+#include "util.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+static int n_calls;
+static short int last_revents;
+
+static void
+count_cb(int fd UNUSED, short int revents, void *aux UNUSED)
+{
+    n_calls++;
+    last_revents = revents;
+}
+
+/* Runs one poll_block() that waits on 'fd' for 'events', with a timeout of
+ * 'msec' ms, or no timeout if 'msec' is negative.  Returns the events that
+ * woke 'fd', or 0 if none did. */
+static short int
+wait_once(int fd, short int events, int msec)
+{
+    struct poll_waiter *pw;
+
+    n_calls = 0;
+    last_revents = 0;
+    pw = poll_fd_callback(fd, events, count_cb, NULL);
+    if (msec >= 0) {
+        poll_timer_wait(msec);
+    }
+    poll_block();
+    if (!n_calls) {
+        poll_cancel(pw);
+    }
+    return last_revents;
+}
+
+static void
+make_pipe(int fds[2])
+{
+    assert(!pipe(fds));
+}
+
+static void
+close_pipe(int fds[2])
+{
+    close(fds[0]);
+    close(fds[1]);
+}
+
+/* A registered fd wakes poll_block() when it becomes ready, whether or not the
+ * events waited for change from one call to the next. */
+static void
+test_registered(void)
+{
+    int fds[2];
+
+    make_pipe(fds);
+    poll_fd_register(fds[0]);
+    poll_fd_register(fds[1]);
+
+    assert(!wait_once(fds[0], POLLIN, 0));
+    assert(write(fds[1], "x", 1) == 1);
+    assert(wait_once(fds[0], POLLIN, -1) == POLLIN);
+    assert(wait_once(fds[0], POLLIN, -1) == POLLIN);
+    assert(wait_once(fds[1], POLLOUT, -1) == POLLOUT);
+    assert(wait_once(fds[0], POLLIN | POLLOUT, -1) == POLLIN);
+
+    poll_fd_unregister(fds[0]);
+    poll_fd_unregister(fds[1]);
+    close_pipe(fds);
+}
+
+/* A registered fd that becomes ready while nothing waits on it does not cut
+ * short a wait on something else. */
+static void
+test_not_waited(void)
+{
+    int a[2], b[2];
+
+    make_pipe(a);
+    make_pipe(b);
+    poll_fd_register(a[0]);
+
+    assert(!wait_once(a[0], POLLIN, 0));
+    assert(write(a[1], "x", 1) == 1);
+    assert(!wait_once(b[0], POLLIN, 50));
+    assert(wait_once(a[0], POLLIN, -1) == POLLIN);
+
+    poll_fd_unregister(a[0]);
+    close_pipe(a);
+    close_pipe(b);
+}
+
+/* An fd number that is closed and reused refers to the new file, whether or
+ * not the old fd was registered. */
+static void
+test_reuse(void)
+{
+    int fds[2];
+    int old_fd;
+
+    make_pipe(fds);
+    poll_fd_register(fds[0]);
+    assert(!wait_once(fds[0], POLLIN, 0));
+    poll_fd_unregister(fds[0]);
+    old_fd = fds[0];
+    close_pipe(fds);
+
+    make_pipe(fds);
+    assert(fds[0] == old_fd);
+    assert(!wait_once(fds[0], POLLIN, 0));
+    close_pipe(fds);
+
+    make_pipe(fds);
+    assert(fds[0] == old_fd);
+    assert(write(fds[1], "x", 1) == 1);
+    assert(wait_once(fds[0], POLLIN, -1) == POLLIN);
+    close_pipe(fds);
+}
+
+/* A regular file is always ready, as with poll(). */
+static void
+test_regular_file(void)
+{
+    FILE *file = tmpfile();
+
+    assert(file != NULL);
+    assert(wait_once(fileno(file), POLLIN, -1) == POLLIN);
+    fclose(file);
+}
+
+int
+main(void)
+{
+    time_init();
+    alarm(30);
+    test_registered();
+    test_not_waited();
+    test_reuse();
+    test_regular_file();
+    return 0;
+}
@@ -0,0 +1,244 @@
+/* Tests for the rate limiter's per-port packet_in queues in
+ * secchan/port-queue.c. */
+
+#include <config.h>
+#include "port-queue.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ofpbuf.h"
+#include "util.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+/* Size of the biggest packet_in in the tests. */
+#define MAX_SIZE 1500
+
+/* Returns a new message 'size' bytes long whose first bytes record 'port' and
+ * 'seq', so that the test can check where it came from. */
+static struct ofpbuf *
+make_msg(uint16_t port, unsigned int seq, size_t size)
+{
+    struct ofpbuf *b = ofpbuf_new(size);
+    unsigned int *p = ofpbuf_put_zeros(b, size);
+
+    p[0] = port;
+    p[1] = seq;
+    return b;
+}
+
+static uint16_t
+msg_port(const struct ofpbuf *b)
+{
+    return ((const unsigned int *) b->data)[0];
+}
+
+static unsigned int
+msg_seq(const struct ofpbuf *b)
+{
+    return ((const unsigned int *) b->data)[1];
+}
+
+/* Checks that 'pqs''s active list, length index, longest length, and packet
+ * count all agree with the queues themselves. */
+static void
+check_queues(const struct port_queues *pqs)
+{
+    const struct port_queue *pq;
+    int n_active, n_indexed, n_queued, max_len;
+    int i;
+
+    n_active = n_queued = max_len = 0;
+    HMAP_FOR_EACH (pq, struct port_queue, hmap_node, &pqs->ports) {
+        n_active += pq->q.n > 0;
+        n_queued += pq->q.n;
+        max_len = MAX(max_len, pq->q.n);
+    }
+    assert(n_queued == pqs->n_queued);
+    assert(max_len == pqs->max_len);
+    assert(list_size(&pqs->active) == n_active);
+
+    n_indexed = 0;
+    for (i = 0; i < pqs->n_by_len; i++) {
+        LIST_FOR_EACH (pq, struct port_queue, len_node, &pqs->by_len[i]) {
+            assert(pq->q.n == i);
+            n_indexed++;
+        }
+    }
+    assert(n_indexed == n_active);
+    assert(!pqs->n_by_len || list_is_empty(&pqs->by_len[0]));
+}
+
+/* Random enqueues, dequeues, and drops across many ports keep the index of
+ * queues by length consistent. */
+static void
+test_by_len(void)
+{
+    struct port_queues pqs;
+    unsigned int seq = 0;
+    int i;
+
+    srand(1);
+    port_queues_init(&pqs);
+    for (i = 0; i < 20000; i++) {
+        int op = rand() % 8;
+
+        if (op < 4 || !pqs.n_queued) {
+            /* Skew toward a few ports so that some queues grow long. */
+            uint16_t port = rand() % 4 ? rand() % 4 : rand() % 200;
+            port_queues_enqueue(&pqs, port, make_msg(port, seq++, 64));
+        } else if (op < 7) {
+            struct port_queue *pq;
+            struct ofpbuf *msg = port_queues_dequeue(&pqs, &pq);
+            assert(msg_port(msg) == pq->port);
+            ofpbuf_delete(msg);
+        } else {
+            port_queues_drop(&pqs);
+        }
+        check_queues(&pqs);
+    }
+    while (pqs.n_queued) {
+        struct port_queue *pq;
+        ofpbuf_delete(port_queues_dequeue(&pqs, &pq));
+    }
+    check_queues(&pqs);
+    port_queues_destroy(&pqs);
+}
+
+/* Returns the number of packets queued for 'port' in 'pqs'. */
+static int
+queue_len(const struct port_queues *pqs, uint16_t port)
+{
+    const struct port_queue *pq;
+
+    HMAP_FOR_EACH (pq, struct port_queue, hmap_node, &pqs->ports) {
+        if (pq->port == port) {
+            return pq->q.n;
+        }
+    }
+    return 0;
+}
+
+/* Drops come from one of the longest queues, chosen at random, and take the
+ * oldest packet. */
+static void
+test_drop(void)
+{
+    enum { N_PORTS = 4, LEN = 10, N_ROUNDS = 400 };
+    int n_chosen[N_PORTS + 1];
+    int chosen[N_ROUNDS];
+    unsigned int seq[N_PORTS + 1];
+    struct port_queues pqs;
+    struct port_queue *pq;
+    int n_repeats;
+    int i, j;
+
+    port_queues_init(&pqs);
+    for (i = 1; i <= N_PORTS; i++) {
+        for (seq[i] = 0; seq[i] < LEN; seq[i]++) {
+            port_queues_enqueue(&pqs, i, make_msg(i, seq[i], 64));
+        }
+        n_chosen[i] = 0;
+    }
+    port_queues_enqueue(&pqs, 99, make_msg(99, 0, 64));
+
+    /* Drop a packet while the long queues are all the same length, then top
+     * up the queue that lost it. */
+    for (i = 0; i < N_ROUNDS; i++) {
+        port_queues_drop(&pqs);
+        check_queues(&pqs);
+        assert(pqs.max_len == LEN);
+        for (j = 1; j <= N_PORTS; j++) {
+            if (queue_len(&pqs, j) == LEN - 1) {
+                break;
+            }
+        }
+        assert(j <= N_PORTS);
+        chosen[i] = j;
+        n_chosen[j]++;
+        port_queues_enqueue(&pqs, j, make_msg(j, seq[j]++, 64));
+    }
+    assert(queue_len(&pqs, 99) == 1);
+
+    /* Every queue is chosen about a quarter of the time, and not in a fixed
+     * rotation. */
+    n_repeats = 0;
+    for (i = N_PORTS; i < N_ROUNDS; i++) {
+        n_repeats += chosen[i] == chosen[i - N_PORTS];
+    }
+    assert(n_repeats < N_ROUNDS / 2);
+    for (j = 1; j <= N_PORTS; j++) {
+        assert(n_chosen[j] > N_ROUNDS / N_PORTS / 2);
+    }
+
+    /* What is left is the newest packets of each queue, in order. */
+    while (pqs.n_queued) {
+        struct ofpbuf *msg = port_queues_dequeue(&pqs, &pq);
+        if (pq->port != 99) {
+            assert(msg_seq(msg) == seq[pq->port] - pq->q.n - 1);
+        }
+        ofpbuf_delete(msg);
+    }
+    port_queues_destroy(&pqs);
+}
+
+/* Over time, deficit round robin sends about the same number of bytes from
+ * each busy port, whatever the size of its packets. */
+static void
+test_drr(void)
+{
+    static const size_t sizes[] = { 64, 500, MAX_SIZE, 1400 };
+    enum { N_PORTS = ARRAY_SIZE(sizes), N_MSGS = 1000 };
+    unsigned long long bytes[N_PORTS];
+    unsigned int next_seq[N_PORTS];
+    struct port_queues pqs;
+    size_t i, j;
+
+    port_queues_init(&pqs);
+    for (i = 0; i < N_MSGS; i++) {
+        for (j = 0; j < N_PORTS; j++) {
+            port_queues_enqueue(&pqs, j, make_msg(j, i, sizes[j]));
+        }
+    }
+
+    memset(bytes, 0, sizeof bytes);
+    memset(next_seq, 0, sizeof next_seq);
+    for (;;) {
+        unsigned long long min = ULLONG_MAX, max = 0;
+        struct port_queue *pq;
+        struct ofpbuf *msg;
+
+        msg = port_queues_dequeue(&pqs, &pq);
+        assert(msg_port(msg) == pq->port);
+        assert(msg_seq(msg) == next_seq[pq->port]++);
+        bytes[pq->port] += msg->size;
+        ofpbuf_delete(msg);
+        if (!pq->q.n) {
+            break;
+        }
+
+        /* While every port still has packets queued, no port gets more than
+         * about a round's worth of bytes ahead of any other. */
+        for (j = 0; j < N_PORTS; j++) {
+            min = MIN(min, bytes[j]);
+            max = MAX(max, bytes[j]);
+        }
+        assert(max - min <= PORT_QUEUE_QUANTUM + 2 * MAX_SIZE);
+    }
+
+    /* The port with the smallest packets sent many more of them. */
+    assert(next_seq[0] > 10 * next_seq[2]);
+
+    port_queues_destroy(&pqs);
+}
+
+int
+main(void)
+{
+    test_by_len();
+    test_drop();
+    test_drr();
+    return 0;
+}
@@ -0,0 +1,105 @@
+/* Tests for the slab allocator in udatapath/slab.c. */
+
+#include <config.h>
+#include "slab.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "util.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+#define N_OBJS 5000
+
+static struct slab slab = SLAB_INITIALIZER(slab, "test", 100);
+
+/* Fills 'obj', the object with the given 'serial' number, with a pattern
+ * that check_obj() can verify. */
+static void
+fill_obj(void *obj, int serial)
+{
+    memset(obj, serial & 0xff, slab.size);
+}
+
+static void
+check_obj(const void *obj, int serial)
+{
+    const uint8_t *p = obj;
+    size_t i;
+
+    for (i = 0; i < slab.size; i++) {
+        assert(p[i] == (serial & 0xff));
+    }
+}
+
+/* Checks that objects are aligned, do not overlap, and survive allocation and
+ * freeing of other objects, and that empty chunks are given back. */
+static void
+test_alloc_free(void)
+{
+    static void *objs[N_OBJS];
+    unsigned long long peak_chunks;
+    int i;
+
+    assert(slab.size == 112);
+    for (i = 0; i < N_OBJS; i++) {
+        objs[i] = slab_alloc(&slab);
+        assert(objs[i]);
+        assert(!((uintptr_t) objs[i] % SLAB_ALIGN));
+        fill_obj(objs[i], i);
+    }
+    assert(slab.n_used == N_OBJS);
+    assert(slab.n_chunks == ROUND_UP(N_OBJS, slab.per_chunk) / slab.per_chunk);
+    peak_chunks = slab.n_chunks;
+    for (i = 0; i < N_OBJS; i++) {
+        check_obj(objs[i], i);
+    }
+
+    /* Free every other object, then reallocate them.  Nothing should need a
+     * new chunk. */
+    for (i = 0; i < N_OBJS; i += 2) {
+        slab_free(objs[i]);
+    }
+    assert(slab.n_used == N_OBJS / 2);
+    for (i = 0; i < N_OBJS; i += 2) {
+        objs[i] = slab_alloc(&slab);
+        fill_obj(objs[i], i);
+    }
+    assert(slab.n_chunks == peak_chunks);
+    for (i = 0; i < N_OBJS; i++) {
+        check_obj(objs[i], i);
+    }
+
+    /* Freeing everything keeps only one chunk. */
+    for (i = 0; i < N_OBJS; i++) {
+        slab_free(objs[i]);
+    }
+    slab_free(NULL);
+    assert(slab.n_used == 0);
+    assert(slab.n_chunks == 1);
+    assert(slab.n_allocs == N_OBJS + N_OBJS / 2);
+}
+
+/* Checks that the slab shows up for statistics. */
+static void
+test_slab_all(void)
+{
+    const struct slab *iter;
+    int n = 0;
+
+    LIST_FOR_EACH (iter, struct slab, node, slab_all()) {
+        assert(iter == &slab);
+        n++;
+    }
+    assert(n == 1);
+}
+
+int
+main(void)
+{
+    test_alloc_free();
+    test_slab_all();
+    return 0;
+}
@@ -0,0 +1,202 @@
+/* A non-exhaustive test for the shared memory vconn in lib/vconn-shm.c.  Both
+ * ends of each connection live in this process, which drives them in turn
+ * through the public vconn interface. */
+
+#include <config.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "ofpbuf.h"
+#include "openflow/openflow.h"
+#include "poll-loop.h"
+#include "timeval.h"
+#include "util.h"
+#include "vconn-provider.h"
+#include "vconn.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+#define SOCKET_NAME "test-vconn-shm.sock"
+
+static struct pvconn *pvconn;
+static struct vconn *client, *server;
+
+static void
+open_pair(void)
+{
+    int client_error, server_error;
+
+    assert(!pvconn_open("pshm:" SOCKET_NAME, &pvconn));
+    assert(!vconn_open("shm:" SOCKET_NAME, OFP_VERSION, &client));
+    for (;;) {
+        int error = pvconn_accept(pvconn, OFP_VERSION, &server);
+        if (error != EAGAIN) {
+            assert(!error);
+            break;
+        }
+        pvconn_wait(pvconn);
+        poll_block();
+    }
+
+    /* Runs the hello exchange on both ends. */
+    for (;;) {
+        client_error = vconn_connect(client);
+        server_error = vconn_connect(server);
+        if (client_error != EAGAIN && server_error != EAGAIN) {
+            break;
+        }
+        vconn_connect_wait(client);
+        vconn_connect_wait(server);
+        poll_block();
+    }
+    assert(!client_error);
+    assert(!server_error);
+}
+
+static void
+close_pair(void)
+{
+    vconn_close(client);
+    vconn_close(server);
+    pvconn_close(pvconn);
+    unlink(SOCKET_NAME);
+}
+
+/* Returns a message 'length' bytes long whose bytes after the header are
+ * derived from 'xid'. */
+static struct ofpbuf *
+make_msg(size_t length, uint32_t xid)
+{
+    struct ofpbuf *b = ofpbuf_new(length);
+    struct ofp_header *oh = ofpbuf_put_uninit(b, length);
+    size_t i;
+
+    oh->version = OFP_VERSION;
+    oh->type = OFPT_VENDOR;
+    oh->length = htons(length);
+    oh->xid = htonl(xid);
+    for (i = sizeof *oh; i < length; i++) {
+        ((uint8_t *) oh)[i] = xid + i;
+    }
+    return b;
+}
+
+static void
+check_msg(struct ofpbuf *msg, size_t length, uint32_t xid)
+{
+    struct ofpbuf *expected = make_msg(length, xid);
+
+    assert(msg->size == length);
+    assert(!memcmp(msg->data, expected->data, length));
+    assert(ofpbuf_headroom(msg) >= VCONN_RX_HEADROOM);
+    ofpbuf_delete(expected);
+    ofpbuf_delete(msg);
+}
+
+static size_t
+msg_length(uint32_t xid)
+{
+    return sizeof(struct ofp_header) + xid * 7 % 2000;
+}
+
+/* Messages go both ways, and those that wrap around the end of a ring arrive
+ * intact. */
+static void
+test_exchange(void)
+{
+    struct ofpbuf *msg;
+    uint32_t xid;
+
+    open_pair();
+    for (xid = 0; xid < 5000; xid++) {
+        assert(!vconn_send(client, make_msg(msg_length(xid), xid)));
+        assert(!vconn_send(server, make_msg(msg_length(xid + 1), xid + 1)));
+        if (xid % 3 == 2) {
+            uint32_t i;
+
+            for (i = xid - 2; i <= xid; i++) {
+                assert(!vconn_recv(server, &msg));
+                check_msg(msg, msg_length(i), i);
+                assert(!vconn_recv(client, &msg));
+                check_msg(msg, msg_length(i + 1), i + 1);
+            }
+        }
+    }
+    assert(!vconn_recv(server, &msg));
+    check_msg(msg, msg_length(4998), 4998);
+    assert(!vconn_recv(server, &msg));
+    check_msg(msg, msg_length(4999), 4999);
+    assert(vconn_recv(server, &msg) == EAGAIN);
+    close_pair();
+}
+
+/* A full ring makes sending fail with EAGAIN, and a receiver that makes room
+ * wakes up a sender waiting for it.  A receiver waiting for data is woken up
+ * by a sender, too. */
+static void
+test_doorbells(void)
+{
+    struct ofpbuf *msg;
+    uint32_t n, xid;
+
+    open_pair();
+
+    /* The receiver sleeps until a message arrives. */
+    vconn_recv_wait(server);
+    assert(!vconn_send(client, make_msg(100, 0)));
+    poll_block();
+    assert(!vconn_recv(server, &msg));
+    check_msg(msg, 100, 0);
+
+    /* The sender sleeps until the receiver makes room. */
+    for (n = 0; ; n++) {
+        msg = make_msg(60000, n);
+        if (vconn_send(client, msg)) {
+            ofpbuf_delete(msg);
+            break;
+        }
+    }
+    assert(n > 1);
+    vconn_send_wait(client);
+    for (xid = 0; xid < n; xid++) {
+        assert(!vconn_recv(server, &msg));
+        check_msg(msg, 60000, xid);
+    }
+    poll_block();
+    assert(!vconn_send(client, make_msg(60000, n)));
+    assert(!vconn_recv(server, &msg));
+    check_msg(msg, 60000, n);
+
+    close_pair();
+}
+
+/* Messages sent before a close are still received, then end of file. */
+static void
+test_eof(void)
+{
+    struct ofpbuf *msg;
+
+    open_pair();
+    assert(!vconn_send(client, make_msg(50, 1)));
+    vconn_close(client);
+    assert(!vconn_recv(server, &msg));
+    check_msg(msg, 50, 1);
+    assert(vconn_recv(server, &msg) == EOF);
+    vconn_close(server);
+    pvconn_close(pvconn);
+    unlink(SOCKET_NAME);
+}
+
+int
+main(void)
+{
+    time_init();
+    alarm(30);
+    test_exchange();
+    test_doorbells();
+    test_eof();
+    return 0;
+}
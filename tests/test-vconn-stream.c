@@ -0,0 +1,369 @@
+/* A non-exhaustive test for receiving messages through the receive ring in
+ * lib/vconn-stream.c, and for sending them through its transmit queue.  Talks
+ * to the stream vconn through its class directly, to bypass the hello
+ * exchange in vconn.c. */
+
+#include <config.h>
+#include "vconn-stream.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "ofpbuf.h"
+#include "openflow/openflow.h"
+#include "poll-loop.h"
+#include "socket-util.h"
+#include "timeval.h"
+#include "util.h"
+#include "vconn-provider.h"
+#include "vconn.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+static struct vconn *vconn;
+static int peer;
+
+static void
+open_pair(void)
+{
+    int fds[2];
+
+    assert(!socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    assert(!set_nonblocking(fds[0]));
+    assert(!new_stream_vconn("test", fds[0], 0, 0, false, &vconn));
+    peer = fds[1];
+}
+
+static void
+close_pair(void)
+{
+    vconn_close(vconn);
+    close(peer);
+}
+
+static int
+recv_msg(struct ofpbuf **msgp)
+{
+    *msgp = NULL;
+    return vconn->class->recv(vconn, msgp);
+}
+
+/* Appends to 'b' a message 'length' bytes long whose bytes after the header
+ * are derived from 'xid'. */
+static void
+put_msg(struct ofpbuf *b, size_t length, uint32_t xid)
+{
+    struct ofp_header *oh = ofpbuf_put_uninit(b, length);
+    size_t i;
+
+    oh->version = OFP_VERSION;
+    oh->type = OFPT_VENDOR;
+    oh->length = htons(length);
+    oh->xid = htonl(xid);
+    for (i = sizeof *oh; i < length; i++) {
+        ((uint8_t *) oh)[i] = xid + i;
+    }
+}
+
+/* Checks that the 'length' bytes at 'data' are the message that put_msg()
+ * makes for 'xid'. */
+static void
+check_data(const void *data, size_t length, uint32_t xid)
+{
+    struct ofpbuf expected;
+
+    ofpbuf_init(&expected, length);
+    put_msg(&expected, length, xid);
+    assert(!memcmp(data, expected.data, length));
+    ofpbuf_uninit(&expected);
+}
+
+static void
+check_msg(const struct ofpbuf *msg, size_t length, uint32_t xid)
+{
+    assert(msg->size == length);
+    check_data(msg->data, length, xid);
+    assert(ofpbuf_headroom((struct ofpbuf *) msg) >= VCONN_RX_HEADROOM);
+}
+
+static void
+write_all(const void *data, size_t size)
+{
+    assert(write(peer, data, size) == size);
+}
+
+/* Many small messages sent at once all come out of one read. */
+static void
+test_burst(void)
+{
+    struct ofpbuf *msg, b;
+    uint32_t xid;
+
+    open_pair();
+    ofpbuf_init(&b, 0);
+    for (xid = 0; xid < 300; xid++) {
+        put_msg(&b, sizeof(struct ofp_header) + xid % 200, xid);
+    }
+    write_all(b.data, b.size);
+
+    for (xid = 0; xid < 300; xid++) {
+        assert(!recv_msg(&msg));
+        check_msg(msg, sizeof(struct ofp_header) + xid % 200, xid);
+        ofpbuf_delete(msg);
+
+        /* With messages left in the ring, waiting must not block. */
+        if (xid == 0) {
+            vconn->class->wait(vconn, WAIT_RECV);
+            poll_block();
+        }
+    }
+    assert(recv_msg(&msg) == EAGAIN);
+    assert(!msg);
+
+    ofpbuf_uninit(&b);
+    close_pair();
+}
+
+/* Messages that arrive one byte at a time. */
+static void
+test_fragments(void)
+{
+    struct ofpbuf *msg, b;
+    size_t i;
+
+    open_pair();
+    ofpbuf_init(&b, 0);
+    put_msg(&b, 100, 1);
+    put_msg(&b, 8, 2);
+    put_msg(&b, 30, 3);
+    for (i = 0; i < b.size; i++) {
+        write_all((uint8_t *) b.data + i, 1);
+        if (i == 99 || i == 107 || i == 137) {
+            assert(!recv_msg(&msg));
+            check_msg(msg, i == 99 ? 100 : i == 107 ? 8 : 30,
+                      i == 99 ? 1 : i == 107 ? 2 : 3);
+            ofpbuf_delete(msg);
+        } else {
+            assert(recv_msg(&msg) == EAGAIN);
+        }
+    }
+
+    ofpbuf_uninit(&b);
+    close_pair();
+}
+
+/* A long message that arrives in parts, behind a short one, is read straight
+ * into its own buffer. */
+static void
+test_long(void)
+{
+    struct ofpbuf *msg, b;
+
+    open_pair();
+    ofpbuf_init(&b, 0);
+    put_msg(&b, 50, 1);
+    put_msg(&b, 60000, 2);
+    put_msg(&b, 20, 3);
+
+    write_all(b.data, 1000);
+    assert(!recv_msg(&msg));
+    check_msg(msg, 50, 1);
+    ofpbuf_delete(msg);
+    assert(recv_msg(&msg) == EAGAIN);
+
+    write_all((uint8_t *) b.data + 1000, 30000);
+    assert(recv_msg(&msg) == EAGAIN);
+    write_all((uint8_t *) b.data + 31000, b.size - 31000);
+    assert(!recv_msg(&msg));
+    check_msg(msg, 60000, 2);
+    ofpbuf_delete(msg);
+    assert(!recv_msg(&msg));
+    check_msg(msg, 20, 3);
+    ofpbuf_delete(msg);
+
+    ofpbuf_uninit(&b);
+    close_pair();
+}
+
+/* Messages share the ring's memory.  Ones that are kept while much more data
+ * arrives stay intact, and adding to one does not disturb its neighbours. */
+static void
+test_shared(void)
+{
+    enum { N_MSGS = 2000, LENGTH = 100, CHUNK = 4050 };
+    static struct ofpbuf *msgs[N_MSGS];
+    struct ofpbuf *msg, b;
+    size_t ofs;
+    int error;
+    int i;
+
+    open_pair();
+    ofpbuf_init(&b, 0);
+    for (i = 0; i < N_MSGS; i++) {
+        put_msg(&b, LENGTH, i);
+    }
+
+    /* The kept messages fill the ring a few times over, and most chunks end
+     * in the middle of a message. */
+    i = 0;
+    for (ofs = 0; ofs < b.size; ofs += CHUNK) {
+        write_all((uint8_t *) b.data + ofs, MIN(CHUNK, b.size - ofs));
+        while (!(error = recv_msg(&msg))) {
+            check_msg(msg, LENGTH, i);
+            msgs[i++] = msg;
+        }
+        assert(error == EAGAIN);
+    }
+    assert(i == N_MSGS);
+    for (i = 0; i < N_MSGS; i++) {
+        check_msg(msgs[i], LENGTH, i);
+    }
+
+    /* Pushing onto a message and appending to it leave its neighbours
+     * alone. */
+    memset(ofpbuf_push_uninit(msgs[1], VCONN_RX_HEADROOM), 0,
+           VCONN_RX_HEADROOM);
+    memset(ofpbuf_put_uninit(msgs[1], 16), 0xff, 16);
+    check_msg(msgs[0], LENGTH, 0);
+    check_data((uint8_t *) msgs[1]->data + VCONN_RX_HEADROOM, LENGTH, 1);
+    check_msg(msgs[2], LENGTH, 2);
+
+    for (i = 0; i < N_MSGS; i++) {
+        ofpbuf_delete(msgs[i]);
+    }
+    ofpbuf_uninit(&b);
+    close_pair();
+}
+
+static void
+test_errors(void)
+{
+    struct ofpbuf *msg, b;
+
+    /* A length shorter than the header. */
+    open_pair();
+    ofpbuf_init(&b, 0);
+    put_msg(&b, 8, 1);
+    ((struct ofp_header *) b.data)->length = htons(4);
+    write_all(b.data, b.size);
+    assert(recv_msg(&msg) == EPROTO);
+    close_pair();
+
+    /* End of file between messages, then in the middle of one. */
+    open_pair();
+    write_all(b.data, 4);
+    assert(recv_msg(&msg) == EAGAIN);
+    shutdown(peer, SHUT_WR);
+    assert(recv_msg(&msg) == EPROTO);
+    close_pair();
+
+    open_pair();
+    ofpbuf_clear(&b);
+    put_msg(&b, 8, 1);
+    write_all(b.data, b.size);
+    shutdown(peer, SHUT_WR);
+    assert(!recv_msg(&msg));
+    ofpbuf_delete(msg);
+    assert(recv_msg(&msg) == EOF);
+    close_pair();
+
+    ofpbuf_uninit(&b);
+}
+
+static int
+send_msg(size_t length, uint32_t xid)
+{
+    struct ofpbuf *b = ofpbuf_new(length);
+    int error;
+
+    put_msg(b, length, xid);
+    error = vconn->class->send(vconn, b);
+    if (error) {
+        ofpbuf_delete(b);
+    }
+    return error;
+}
+
+/* Reads from the peer's end and checks that it receives 'n' messages each
+ * 'length' bytes long, with xids starting from 'xid'.  Runs the poll loop,
+ * which lets the vconn write more, whenever the peer runs out of data. */
+static void
+check_peer(int n, size_t length, uint32_t xid)
+{
+    struct ofpbuf b;
+
+    ofpbuf_init(&b, 0);
+    while (n > 0) {
+        ssize_t retval;
+
+        ofpbuf_prealloc_tailroom(&b, length);
+        retval = recv(peer, ofpbuf_tail(&b), length, MSG_DONTWAIT);
+        if (retval > 0) {
+            b.size += retval;
+        } else {
+            assert(retval < 0 && errno == EAGAIN);
+            poll_block();
+        }
+
+        while (n > 0 && b.size >= length) {
+            check_data(b.data, length, xid);
+            ofpbuf_pull(&b, length);
+            n--;
+            xid++;
+        }
+    }
+    assert(!b.size);
+    ofpbuf_uninit(&b);
+}
+
+/* Messages are queued and written together in the next poll_block(). */
+static void
+test_send(void)
+{
+    uint32_t xid;
+
+    open_pair();
+    for (xid = 0; xid < 1000; xid++) {
+        assert(!send_msg(100, xid));
+    }
+    check_peer(1000, 100, 0);
+    assert(!vconn->class->flush(vconn));
+    close_pair();
+}
+
+/* Sending fails with EAGAIN once VCONN_TX_HIGH_WATER bytes are queued, and
+ * works again after the queue drains. */
+static void
+test_backpressure(void)
+{
+    uint32_t xid;
+
+    open_pair();
+    for (xid = 0; !send_msg(60000, xid); xid++) {
+        assert(xid < 1000);
+    }
+    assert(xid * 60000 >= VCONN_TX_HIGH_WATER);
+    check_peer(xid, 60000, 0);
+    assert(!vconn->class->flush(vconn));
+    assert(!send_msg(60000, xid));
+    check_peer(1, 60000, xid);
+    close_pair();
+}
+
+int
+main(void)
+{
+    time_init();
+    alarm(30);
+    test_burst();
+    test_fragments();
+    test_long();
+    test_shared();
+    test_errors();
+    test_send();
+    test_backpressure();
+    return 0;
+}
@@ -6,26 +6,40 @@ bin_PROGRAMS += udatapath/ofdatapath
 man_MANS += udatapath/ofdatapath.8
 
 udatapath_ofdatapath_SOURCES = \
+	udatapath/buffer-store.c \
+	udatapath/buffer-store.h \
 	udatapath/chain.c \
 	udatapath/chain.h \
+	udatapath/counter.h \
 	udatapath/crc32.c \
 	udatapath/crc32.h \
 	udatapath/datapath.c \
 	udatapath/datapath.h \
 	udatapath/dp_act.c \
 	udatapath/dp_act.h \
+	udatapath/epoch.c \
+	udatapath/epoch.h \
 	udatapath/of_ext_msg.c \
 	udatapath/of_ext_msg.h \
+	udatapath/pending-miss.c \
+	udatapath/pending-miss.h \
 	udatapath/udatapath.c \
 	udatapath/private-msg.c \
 	udatapath/private-msg.h \
+	udatapath/slab.c \
+	udatapath/slab.h \
 	udatapath/switch-flow.c \
 	udatapath/switch-flow.h \
+	udatapath/sw-queue.c \
+	udatapath/sw-queue.h \
 	udatapath/table.h \
 	udatapath/table-hash.c \
-	udatapath/table-linear.c
+	udatapath/table-linear.c \
+	udatapath/table-tuple.c \
+	udatapath/timer-wheel.c \
+	udatapath/timer-wheel.h
 
-udatapath_ofdatapath_LDADD = lib/libopenflow.a $(SSL_LIBS) $(FAULT_LIBS)
+udatapath_ofdatapath_LDADD = lib/libopenflow.a $(SSL_LIBS) $(FAULT_LIBS) -lpthread
 udatapath_ofdatapath_CPPFLAGS = $(AM_CPPFLAGS)
 
 EXTRA_DIST += udatapath/ofdatapath.8.in
@@ -50,24 +64,38 @@ if BUILD_HW_LIBS
 noinst_LIBRARIES += udatapath/libudatapath.a
 
 udatapath_libudatapath_a_SOURCES = \
+	udatapath/buffer-store.c \
+	udatapath/buffer-store.h \
 	udatapath/chain.c \
 	udatapath/chain.h \
+	udatapath/counter.h \
 	udatapath/crc32.c \
 	udatapath/crc32.h \
 	udatapath/datapath.c \
 	udatapath/datapath.h \
 	udatapath/dp_act.c \
 	udatapath/dp_act.h \
+	udatapath/epoch.c \
+	udatapath/epoch.h \
 	udatapath/of_ext_msg.c \
 	udatapath/of_ext_msg.h \
+	udatapath/pending-miss.c \
+	udatapath/pending-miss.h \
 	udatapath/udatapath.c \
 	udatapath/private-msg.c \
 	udatapath/private-msg.h \
+	udatapath/slab.c \
+	udatapath/slab.h \
 	udatapath/switch-flow.c \
 	udatapath/switch-flow.h \
+	udatapath/sw-queue.c \
+	udatapath/sw-queue.h \
 	udatapath/table.h \
 	udatapath/table-hash.c \
-	udatapath/table-linear.c
+	udatapath/table-linear.c \
+	udatapath/table-tuple.c \
+	udatapath/timer-wheel.c \
+	udatapath/timer-wheel.h
 
 udatapath_libudatapath_a_CPPFLAGS = $(AM_CPPFLAGS)
 udatapath_libudatapath_a_CPPFLAGS += -DOF_HW_PLAT -DUDATAPATH_AS_LIB -g
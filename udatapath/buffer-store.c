@@ -0,0 +1,195 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+
+#include <config.h>
+#include "buffer-store.h"
+#include <limits.h>
+#include <stdlib.h>
+#include "ofpbuf.h"
+#include "util.h"
+
+/* Initializes 'bs' with 'n_buffers' buffers, as buffer_store_set_n_buffers()
+ * rounds it. */
+void
+buffer_store_init(struct buffer_store *bs, unsigned int n_buffers)
+{
+    bs->buffers = NULL;
+    list_init(&bs->used);
+    bs->n_expired = 0;
+    bs->n_full = 0;
+    buffer_store_set_n_buffers(bs, n_buffers);
+}
+
+/* Frees 'bs' and the packets saved in it. */
+void
+buffer_store_destroy(struct buffer_store *bs)
+{
+    struct packet_buffer *p;
+
+    LIST_FOR_EACH (p, struct packet_buffer, node, &bs->used) {
+        ofpbuf_delete(p->buffer);
+    }
+    free(bs->buffers);
+}
+
+/* Sets the number of buffers in 'bs' to 'n_buffers', rounded up to a power of
+ * 2 no less than 2.  Discards any packets already saved. */
+void
+buffer_store_set_n_buffers(struct buffer_store *bs, unsigned int n_buffers)
+{
+    unsigned int i;
+
+    buffer_store_destroy(bs);
+
+    bs->buffer_bits = 1;
+    while (1u << bs->buffer_bits < n_buffers) {
+        bs->buffer_bits++;
+    }
+    bs->buffers = xcalloc(1u << bs->buffer_bits, sizeof *bs->buffers);
+    list_init(&bs->used);
+    list_init(&bs->free);
+    for (i = 0; i < 1u << bs->buffer_bits; i++) {
+        list_push_back(&bs->free, &bs->buffers[i].node);
+    }
+    bs->n_used = 0;
+}
+
+/* Returns the number of buffers in 'bs'. */
+unsigned int
+buffer_store_n_buffers(const struct buffer_store *bs)
+{
+    return 1u << bs->buffer_bits;
+}
+
+/* Takes ownership of 'buffer', saved at time 'now', and returns an ID by which
+ * the controller can refer to it, or leaves it with the caller and returns
+ * UINT32_MAX if every buffer is in use. */
+uint32_t
+buffer_store_save(struct buffer_store *bs, struct ofpbuf *buffer,
+                  long long int now)
+{
+    uint32_t max_cookie = (1u << (32 - bs->buffer_bits)) - 1;
+    struct packet_buffer *p;
+
+    if (list_is_empty(&bs->free)) {
+        bs->n_full++;
+        return UINT32_MAX;
+    }
+    p = CONTAINER_OF(list_pop_front(&bs->free), struct packet_buffer, node);
+    list_push_back(&bs->used, &p->node);
+    bs->n_used++;
+
+    /* Don't use maximum cookie value since the all-bits-1 id is
+     * special. */
+    if (++p->cookie >= max_cookie)
+        p->cookie = 0;
+    p->buffer = buffer;
+    p->expires = now + BUFFER_EXPIRE_MSECS;
+
+    return (p - bs->buffers) | (p->cookie << bs->buffer_bits);
+}
+
+/* Returns the packet buffer that 'id' refers to, or a null pointer if 'id' is
+ * stale. */
+static struct packet_buffer *
+lookup_buffer(struct buffer_store *bs, uint32_t id)
+{
+    struct packet_buffer *p;
+
+    p = &bs->buffers[id & ((1u << bs->buffer_bits) - 1)];
+    if (p->cookie != id >> bs->buffer_bits || !p->buffer) {
+        return NULL;
+    }
+    return p;
+}
+
+static void
+free_buffer(struct buffer_store *bs, struct packet_buffer *p)
+{
+    p->buffer = NULL;
+    list_remove(&p->node);
+    list_push_front(&bs->free, &p->node);
+    bs->n_used--;
+}
+
+/* Frees the buffer that 'id' refers to and returns the packet saved in it,
+ * which now belongs to the caller, or returns a null pointer if 'id' is
+ * stale. */
+struct ofpbuf *
+buffer_store_retrieve(struct buffer_store *bs, uint32_t id)
+{
+    struct ofpbuf *buffer = NULL;
+    struct packet_buffer *p;
+
+    p = lookup_buffer(bs, id);
+    if (p) {
+        buffer = p->buffer;
+        free_buffer(bs, p);
+    }
+    return buffer;
+}
+
+/* Frees the buffer that 'id' refers to and the packet saved in it, if 'id' is
+ * not stale. */
+void
+buffer_store_discard(struct buffer_store *bs, uint32_t id)
+{
+    struct packet_buffer *p;
+
+    p = lookup_buffer(bs, id);
+    if (p) {
+        ofpbuf_delete(p->buffer);
+        free_buffer(bs, p);
+    }
+}
+
+/* Frees the saved packets that the controller has not claimed by time 'now'.
+ * Returns the time when the next one expires, or LLONG_MAX if no packets are
+ * saved.  Packets are saved for the same length of time, so the oldest one
+ * always expires first. */
+long long int
+buffer_store_expire(struct buffer_store *bs, long long int now)
+{
+    while (!list_is_empty(&bs->used)) {
+        struct packet_buffer *p = CONTAINER_OF(list_front(&bs->used),
+                                               struct packet_buffer, node);
+        if (now < p->expires) {
+            return p->expires;
+        }
+        ofpbuf_delete(p->buffer);
+        free_buffer(bs, p);
+        bs->n_expired++;
+    }
+    return LLONG_MAX;
+}
@@ -0,0 +1,87 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+
+#ifndef BUFFER_STORE_H
+#define BUFFER_STORE_H 1
+
+/* Packets sent to the controller that it may refer to by buffer ID.
+ *
+ * Buffers are identified by a 32-bit opaque ID.  We divide the ID into a
+ * buffer number (low 'buffer_bits' bits) and a cookie (high bits).  The
+ * buffer number is an index into an array of buffers.  The cookie
+ * distinguishes between different packets that have occupied a single buffer.
+ * Thus, the more buffers we have, the lower-quality the cookie...
+ *
+ * A saved packet belongs to the buffer until the controller refers to it or
+ * it expires BUFFER_EXPIRE_MSECS after it was saved.  Until then, the buffer
+ * is not reused, and a packet that finds every buffer in use goes to the
+ * controller unbuffered.  Free buffers are kept on a list, most recently
+ * freed first, so that saving a packet does not have to search for one. */
+
+#include <stdint.h>
+#include "list.h"
+
+struct ofpbuf;
+
+#define BUFFER_EXPIRE_MSECS 1000
+
+struct packet_buffer {
+    struct ofpbuf *buffer;      /* Saved packet, or NULL if free. */
+    struct list node;           /* In 'used' or 'free' of buffer_store. */
+    uint32_t cookie;
+    long long int expires;      /* time_msec() when it may be discarded. */
+};
+
+struct buffer_store {
+    struct packet_buffer *buffers;
+    unsigned int buffer_bits;       /* log2 of the number of buffers. */
+    struct list used;               /* In use, oldest first. */
+    struct list free;
+    unsigned int n_used;
+    unsigned long long n_expired;   /* Never claimed by controller. */
+    unsigned long long n_full;      /* Packets sent up unbuffered. */
+};
+
+void buffer_store_init(struct buffer_store *, unsigned int n_buffers);
+void buffer_store_destroy(struct buffer_store *);
+void buffer_store_set_n_buffers(struct buffer_store *, unsigned int);
+unsigned int buffer_store_n_buffers(const struct buffer_store *);
+
+uint32_t buffer_store_save(struct buffer_store *, struct ofpbuf *,
+                           long long int now);
+struct ofpbuf *buffer_store_retrieve(struct buffer_store *, uint32_t id);
+void buffer_store_discard(struct buffer_store *, uint32_t id);
+long long int buffer_store_expire(struct buffer_store *, long long int now);
+
+#endif /* buffer-store.h */
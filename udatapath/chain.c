@@ -36,8 +36,13 @@
 #include <assert.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
+#include "epoch.h"
+#include "flow.h"
 #include "switch-flow.h"
 #include "table.h"
+#include "timeval.h"
+#include "util.h"
 #include "datapath.h"
 
 #if defined(OF_HW_PLAT)
@@ -47,6 +52,16 @@
 #define THIS_MODULE VLM_chain
 #include "vlog.h"
 
+/* An entry in the microflow cache: the result of looking up 'flow' in the
+ * working tables, which is 'sw_flow' from tables[table_idx], or a miss if
+ * 'sw_flow' is null. */
+struct chain_cache_entry {
+    struct flow flow;
+    uint64_t generation;
+    struct sw_flow *sw_flow;
+    int table_idx;
+};
+
 /* Attempts to append 'table' to the set of tables in 'chain'.  Returns 0 or
  * negative error.  If 'table' is null it is assumed that table creation failed
  * due to out-of-memory. */
@@ -75,6 +90,11 @@ struct sw_chain *chain_create(struct datapath *dp)
         return NULL;
 
     chain->dp = dp;
+    list_init(&chain->caches);
+    chain->generation = 1;
+    timer_wheel_init(&chain->timers, time_now());
+    list_init(&chain->expired);
+    chain->last_scan = time_now();
 #if defined(OF_HW_PLAT)
     if (dp && dp->hw_drv) {
         if (add_table(chain, (struct sw_table *)dp->hw_drv, 0) != 0) {
@@ -82,10 +102,8 @@ struct sw_chain *chain_create(struct datapath *dp)
         }
     }
 #endif
-    if (add_table(chain, table_hash2_create(0x1EDC6F41, TABLE_HASH_MAX_FLOWS,
-                                            0x741B8CD7, TABLE_HASH_MAX_FLOWS),
-                                            0)
-        || add_table(chain, table_linear_create(TABLE_LINEAR_MAX_FLOWS), 0)
+    if (add_table(chain, table_hash2_create(TABLE_HASH_MAX_FLOWS), 0)
+        || add_table(chain, table_tuple_create(TABLE_TUPLE_MAX_FLOWS), 0)
         || add_table(chain, table_linear_create(TABLE_LINEAR_MAX_FLOWS), 1)) {
         chain_destroy(chain);
         return NULL;
@@ -94,36 +112,160 @@ struct sw_chain *chain_create(struct datapath *dp)
     return chain;
 }
 
+/* Creates and returns a new microflow cache for looking up flows in 'chain'.
+ * Each thread that calls chain_lookup() needs its own, but only the thread
+ * that modifies 'chain' may create them.  The cache is destroyed along with
+ * 'chain'. */
+struct chain_cache *
+chain_cache_create(struct sw_chain *chain)
+{
+    struct chain_cache *cache = counter_alloc(sizeof *cache);
+
+    if (!cache) {
+        out_of_memory();
+    }
+    cache->entries = xcalloc(CHAIN_CACHE_SIZE, sizeof *cache->entries);
+    list_push_back(&chain->caches, &cache->node);
+    return cache;
+}
+
+/* Stores the total number of hits and misses in all of 'chain''s microflow
+ * caches into '*n_hit' and '*n_miss'. */
+void
+chain_cache_stats(struct sw_chain *chain, unsigned long long *n_hit,
+                  unsigned long long *n_miss)
+{
+    struct chain_cache *cache;
+
+    *n_hit = *n_miss = 0;
+    LIST_FOR_EACH (cache, struct chain_cache, node, &chain->caches) {
+        *n_hit += counter_get(cache->n_hit);
+        *n_miss += counter_get(cache->n_miss);
+    }
+}
+
+/* Sets the 'n_lookup' and 'n_matched' members of each of 'chain''s tables to
+ * the totals counted by the microflow caches, for the tables' 'stats'
+ * functions to report. */
+void
+chain_sum_lookups(struct sw_chain *chain)
+{
+    struct chain_table_counts totals[CHAIN_MAX_TABLES + 1];
+    struct chain_cache *cache;
+    int i;
+
+    memset(totals, 0, sizeof totals);
+    LIST_FOR_EACH (cache, struct chain_cache, node, &chain->caches) {
+        for (i = 0; i <= CHAIN_MAX_TABLES; i++) {
+            totals[i].n_lookup += counter_get(cache->tables[i].n_lookup);
+            totals[i].n_matched += counter_get(cache->tables[i].n_matched);
+        }
+    }
+
+    for (i = 0; i < chain->n_tables; i++) {
+        chain->tables[i]->n_lookup = totals[i].n_lookup;
+        chain->tables[i]->n_matched = totals[i].n_matched;
+    }
+    if (chain->emerg_table) {
+        chain->emerg_table->n_lookup = totals[CHAIN_MAX_TABLES].n_lookup;
+        chain->emerg_table->n_matched = totals[CHAIN_MAX_TABLES].n_matched;
+    }
+}
+
+/* Invalidates every entry in 'chain''s microflow caches.
+ *
+ * A flow that is removed from the chain is freed only after every lookup that
+ * was in progress has finished, and any later lookup sees the new generation
+ * first, so a cache entry that names a freed flow is never used. */
+static void
+chain_flush_cache(struct sw_chain *chain)
+{
+    __atomic_store_n(&chain->generation, chain->generation + 1,
+                     __ATOMIC_RELEASE);
+}
+
+/* Searches 'chain''s working tables for a flow matching 'key'.  Returns the
+ * flow and stores its table index into '*table_idx' if successful, otherwise
+ * returns a null pointer and stores 'chain->n_tables'. */
+static struct sw_flow *
+chain_lookup_tables(struct sw_chain *chain, struct chain_cache *cache,
+                    const struct sw_flow_key *key, int *table_idx)
+{
+    int i;
+
+    for (i = 0; i < chain->n_tables; i++) {
+        struct sw_table *t = chain->tables[i];
+        struct sw_flow *flow = t->lookup(t, key);
+        counter_add(cache->tables[i].n_lookup, 1);
+        if (flow) {
+            counter_add(cache->tables[i].n_matched, 1);
+            *table_idx = i;
+            return flow;
+        }
+    }
+    *table_idx = chain->n_tables;
+    return NULL;
+}
+
 /* Searches 'chain' for a flow matching 'key', which must not have any wildcard
- * fields.  Returns the flow if successful, otherwise a null pointer. */
+ * fields, using the calling thread's microflow 'cache'.  Returns the flow if
+ * successful, otherwise a null pointer. */
 struct sw_flow *
-chain_lookup(struct sw_chain *chain, const struct sw_flow_key *key, int emerg)
+chain_lookup(struct sw_chain *chain, struct chain_cache *cache,
+             const struct sw_flow_key *key, int emerg)
 {
+    struct chain_cache_entry *e;
+    uint64_t generation;
     int i;
 
     assert(!key->wildcards);
 
     if (emerg) {
+        struct chain_table_counts *c = &cache->tables[CHAIN_MAX_TABLES];
         struct sw_table *t = chain->emerg_table;
         struct sw_flow *flow = t->lookup(t, key);
-        t->n_lookup++;
+        counter_add(c->n_lookup, 1);
         if (flow) {
-            t->n_matched++;
+            counter_add(c->n_matched, 1);
             return flow;
         }
-    } else {
-        for (i = 0; i < chain->n_tables; i++) {
-            struct sw_table *t = chain->tables[i];
-            struct sw_flow *flow = t->lookup(t, key);
-            t->n_lookup++;
-            if (flow) {
-                t->n_matched++;
-                return flow;
-            }
+        return NULL;
+    }
+
+    generation = __atomic_load_n(&chain->generation, __ATOMIC_ACQUIRE);
+    e = &cache->entries[flow_hash(&key->flow, 0) & CHAIN_CACHE_MASK];
+    if (e->generation == generation
+        && flow_equal(&e->flow, &key->flow)) {
+        /* Account for the lookup as if the tables had been searched, so that
+         * table statistics do not depend on the cache. */
+        counter_add(cache->n_hit, 1);
+        for (i = 0; i < e->table_idx; i++) {
+            counter_add(cache->tables[i].n_lookup, 1);
+        }
+        if (e->sw_flow) {
+            counter_add(cache->tables[i].n_lookup, 1);
+            counter_add(cache->tables[i].n_matched, 1);
         }
+        return e->sw_flow;
     }
 
-    return NULL;
+    counter_add(cache->n_miss, 1);
+    e->flow = key->flow;
+    e->generation = generation;
+    e->sw_flow = chain_lookup_tables(chain, cache, key, &e->table_idx);
+    return e->sw_flow;
+}
+
+/* Arms 'flow''s expiration timer for its current deadline, if it has one. */
+static void
+chain_schedule(struct sw_chain *chain, struct sw_flow *flow)
+{
+    uint64_t deadline = flow_deadline(flow);
+
+    if (deadline != UINT64_MAX) {
+        /* flow_timeout() only fires strictly after the deadline. */
+        timer_wheel_insert(&chain->timers, &flow->timer, deadline / 1000 + 1);
+    }
 }
 
 /* Inserts 'flow' into 'chain', replacing any duplicate flow.  Returns 0 if
@@ -143,8 +285,14 @@ chain_insert(struct sw_chain *chain, struct sw_flow *flow, int emerg)
     } else {
         for (i = 0; i < chain->n_tables; i++) {
             struct sw_table *t = chain->tables[i];
-            if (t->insert(t, flow))
+            if (t->insert(t, flow)) {
+                flow->table = t;
+                if (t->remove) {
+                    chain_schedule(chain, flow);
+                }
+                chain_flush_cache(chain);
                 return 0;
+            }
         }
     }
 
@@ -174,6 +322,9 @@ chain_modify(struct sw_chain *chain, const struct sw_flow_key *key,
             struct sw_table *t = chain->tables[i];
             count += t->modify(t, key, priority, strict, actions, actions_len);
         }
+        if (count) {
+            chain_flush_cache(chain);
+        }
     }
 
     return count;
@@ -223,25 +374,79 @@ chain_delete(struct sw_chain *chain, const struct sw_flow_key *key,
             struct sw_table *t = chain->tables[i];
             count += t->delete(chain->dp, t, key, out_port, priority, strict);
         }
+        if (count) {
+            chain_flush_cache(chain);
+        }
     }
 
     return count;
 }
 
-/* Deletes timed-out flow entries from all the tables in 'chain' and appends
- * the deleted flows to 'deleted'.
+/* Deletes timed-out flow entries from the tables in 'chain' and appends the
+ * deleted flows to 'deleted'.  Intended to be called on every pass through
+ * the main loop.
  *
- * Expensive as currently implemented, since it iterates through the entire
- * contents of each table. */
-void
+ * Flows in tables that implement 'remove' are found through the timer wheel,
+ * so the cost is proportional to the number of flows whose timers fire, and
+ * at most CHAIN_EXPIRE_BATCH of those are handled per call.  Returns true if
+ * more remain, in which case the caller should call again soon.  Other tables
+ * are scanned in full once a second. */
+bool
 chain_timeout(struct sw_chain *chain, struct list *deleted)
 {
+    struct list *last = deleted->prev;
+    time_t now = time_now();
+    int i;
+
+    if (now != chain->last_scan) {
+        for (i = 0; i < chain->n_tables; i++) {
+            struct sw_table *t = chain->tables[i];
+            if (!t->remove) {
+                t->timeout(t, deleted);
+            }
+        }
+        chain->last_scan = now;
+    }
+
+    timer_wheel_advance(&chain->timers, now, &chain->expired);
+    for (i = 0; i < CHAIN_EXPIRE_BATCH && !list_is_empty(&chain->expired);
+         i++) {
+        struct sw_flow *flow = CONTAINER_OF(list_front(&chain->expired),
+                                            struct sw_flow, timer.node);
+
+        wheel_timer_cancel(&flow->timer);
+        if (flow_timeout(flow)) {
+            flow->table->remove(flow->table, flow);
+            list_push_back(deleted, &flow->node);
+        } else {
+            /* Used since the timer was armed. */
+            chain_schedule(chain, flow);
+        }
+    }
+
+    if (deleted->prev != last) {
+        chain_flush_cache(chain);
+    }
+    return !list_is_empty(&chain->expired);
+}
+
+/* Lets each table in 'chain' do a bounded amount of background work, such as
+ * resizing.  Intended to be called on every pass through the main loop.
+ * Returns true if more work remains, in which case the caller should call
+ * again soon. */
+bool
+chain_run(struct sw_chain *chain)
+{
+    bool more = false;
     int i;
 
     for (i = 0; i < chain->n_tables; i++) {
         struct sw_table *t = chain->tables[i];
-        t->timeout(t, deleted);
+        if (t->run && t->run(t)) {
+            more = true;
+        }
     }
+    return more;
 }
 
 /* Destroys 'chain', which must not have any users. */
@@ -250,6 +455,7 @@ chain_destroy(struct sw_chain *chain)
 {
     int i;
     struct sw_table *t;
+    struct chain_cache *cache, *next;
 
     for (i = 0; i < chain->n_tables; i++) {
         t = chain->tables[i];
@@ -257,5 +463,10 @@ chain_destroy(struct sw_chain *chain)
     }
     t = chain->emerg_table;
     t->destroy(t);
+    LIST_FOR_EACH_SAFE (cache, next, struct chain_cache, node,
+                        &chain->caches) {
+        free(cache->entries);
+        free(cache);
+    }
     free(chain);
 }
@@ -34,33 +34,93 @@
 #ifndef CHAIN_H
 #define CHAIN_H 1
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <time.h>
+#include "counter.h"
+#include "list.h"
+#include "timer-wheel.h"
 
 struct sw_flow;
 struct sw_flow_key;
 struct ofp_action_header;
-struct list;
 struct datapath;
 
 #define TABLE_LINEAR_MAX_FLOWS  100
-#define TABLE_HASH_MAX_FLOWS    65536
+#define TABLE_TUPLE_MAX_FLOWS   65536
+#define TABLE_HASH_MAX_FLOWS    4194304
 #define TABLE_MAC_MAX_FLOWS      1024
 #define TABLE_MAC_NUM_BUCKETS   1024
 
-/* Set of tables chained together in sequence from cheap to expensive. */
+/* Exact-match cache of recent lookups in front of the working tables. */
+#define CHAIN_CACHE_BITS 12
+#define CHAIN_CACHE_SIZE (1u << CHAIN_CACHE_BITS)
+#define CHAIN_CACHE_MASK (CHAIN_CACHE_SIZE - 1)
+
+/* Maximum number of expired flows handled by one call to chain_timeout(). */
+#define CHAIN_EXPIRE_BATCH 64
+
 #define CHAIN_MAX_TABLES 4
+
+/* Lookups in one table, as counted by one thread. */
+struct chain_table_counts {
+    unsigned long long n_lookup;
+    unsigned long long n_matched;
+};
+
+/* Microflow cache, one per thread that looks up flows.
+ *
+ * The cache also holds the thread's shard of the lookup counters, for the
+ * working tables and then the emergency table.  chain_sum_lookups() adds them
+ * up into the tables' own counters.  See counter.h. */
+struct chain_cache {
+    struct list node;           /* In sw_chain.caches. */
+    struct chain_cache_entry *entries;
+    unsigned long long n_hit;
+    unsigned long long n_miss;
+    struct chain_table_counts tables[CHAIN_MAX_TABLES + 1];
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+/* Set of tables chained together in sequence from cheap to expensive.
+ *
+ * Only one thread modifies a chain.  Other threads may look up flows with
+ * chain_lookup() at the same time, without locking, but only between
+ * epoch_enter() and epoch_exit(), and must not keep pointers to flows
+ * afterward.  Flows removed from the chain are freed with
+ * flow_deferred_free(). */
 struct sw_chain {
     int n_tables;                /* Number of working tables, not includes
                                   * protection (emergency) table. */
     struct sw_table *tables[CHAIN_MAX_TABLES];
     struct sw_table *emerg_table;
 
+    /* Microflow caches.  An entry is valid only if its generation equals
+     * 'generation', which is incremented whenever any flow is added to,
+     * modified in, or removed from the chain.  It is 64 bits wide so that it
+     * never wraps around, because the caches belong to other threads and
+     * cannot be flushed. */
+    struct list caches;
+    uint64_t generation;
+
+    /* Flow expiration.  Flows in tables that implement 'remove' are timed out
+     * by 'timers', whose ticks are seconds; flows whose timers have fired
+     * wait on 'expired' to be checked.  Other tables are scanned by their
+     * 'timeout' functions when 'last_scan' changes. */
+    struct timer_wheel timers;
+    struct list expired;
+    time_t last_scan;
+
     struct datapath *dp;
 };
 
 struct sw_chain *chain_create(struct datapath *);
-struct sw_flow *chain_lookup(struct sw_chain *, const struct sw_flow_key *, int);
+struct chain_cache *chain_cache_create(struct sw_chain *);
+void chain_cache_stats(struct sw_chain *, unsigned long long *n_hit,
+                       unsigned long long *n_miss);
+void chain_sum_lookups(struct sw_chain *);
+struct sw_flow *chain_lookup(struct sw_chain *, struct chain_cache *,
+                             const struct sw_flow_key *, int);
 int chain_insert(struct sw_chain *, struct sw_flow *, int);
 int chain_modify(struct sw_chain *, const struct sw_flow_key *,
                  uint16_t, int, const struct ofp_action_header *, size_t, int);
@@ -68,7 +128,8 @@ int chain_has_conflict(struct sw_chain *, const struct sw_flow_key *,
                        uint16_t, int);
 int chain_delete(struct sw_chain *, const struct sw_flow_key *, uint16_t,
                  uint16_t, int, int);
-void chain_timeout(struct sw_chain *, struct list *deleted);
+bool chain_timeout(struct sw_chain *, struct list *deleted);
+bool chain_run(struct sw_chain *);
 void chain_destroy(struct sw_chain *);
 
 #endif /* chain.h */
@@ -0,0 +1,80 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#ifndef COUNTER_H
+#define COUNTER_H 1
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Per-thread counters.
+ *
+ * Statistics that several threads would otherwise update at once, e.g. the
+ * packet counts of a flow or a port, are split into one shard per thread.
+ * Each thread updates only its own shard, so it needs neither a lock nor an
+ * atomic read-modify-write, and threads do not pass the cache line back and
+ * forth.  A thread that wants the total, usually the main thread answering a
+ * statistics request, sums the shards with counter_get().
+ *
+ * Shards that different threads update should not share a cache line, so
+ * structures that hold them are aligned to CACHE_LINE_SIZE and allocated with
+ * counter_alloc(). */
+
+/* Size of a cache line, in bytes, on the machines we care about. */
+#define CACHE_LINE_SIZE 64
+
+/* Adds 'N' to counter 'C', which only the calling thread updates. */
+#define counter_add(C, N) \
+    __atomic_store_n(&(C), (C) + (N), __ATOMIC_RELAXED)
+
+/* Stores 'V' into 'C', which only the calling thread updates. */
+#define counter_set(C, V) __atomic_store_n(&(C), (V), __ATOMIC_RELAXED)
+
+/* Returns the value of counter 'C', which another thread may be updating. */
+#define counter_get(C) __atomic_load_n(&(C), __ATOMIC_RELAXED)
+
+/* Allocates 'size' bytes of zeros, aligned on a cache line.  Returns a null
+ * pointer if memory is exhausted.  Free the result with free(). */
+static inline void *
+counter_alloc(size_t size)
+{
+    void *p;
+
+    if (posix_memalign(&p, CACHE_LINE_SIZE, size)) {
+        return NULL;
+    }
+    memset(p, 0, size);
+    return p;
+}
+
+#endif /* counter.h */
@@ -33,6 +33,15 @@
 
 #include <config.h>
 #include "crc32.h"
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_CRC32C_HW 1
+#include <cpuid.h>
+#include <nmmintrin.h>
+#else
+#define HAVE_CRC32C_HW 0
+#endif
 
 void
 crc32_init(struct crc32 *crc, unsigned int polynomial)
@@ -66,3 +75,138 @@ crc32_calculate(const struct crc32 *crc, const void *data_, size_t n_bytes)
     }
     return result;
 }
+
+/* CRC-32C. */
+
+#define CRC32C_POLY 0x82f63b78  /* Castagnoli polynomial, bit-reversed. */
+
+/* crc32c_tables[0] is the usual byte-at-a-time table.  crc32c_tables[i][b] is
+ * the CRC of byte 'b' followed by 'i' zero bytes, so that 8 bytes can be
+ * folded into the CRC with 8 independent lookups. */
+static uint32_t crc32c_tables[8][256];
+static bool crc32c_tables_inited;
+
+static void
+crc32c_init_tables(void)
+{
+    int i, j;
+
+    for (i = 0; i < 256; i++) {
+        uint32_t reg = i;
+        for (j = 0; j < 8; j++) {
+            reg = reg & 1 ? (reg >> 1) ^ CRC32C_POLY : reg >> 1;
+        }
+        crc32c_tables[0][i] = reg;
+    }
+    for (i = 0; i < 256; i++) {
+        for (j = 1; j < 8; j++) {
+            uint32_t prev = crc32c_tables[j - 1][i];
+            crc32c_tables[j][i] = (prev >> 8) ^ crc32c_tables[0][prev & 0xff];
+        }
+    }
+    crc32c_tables_inited = true;
+}
+
+static inline uint32_t
+get_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint32_t
+crc32c_sw__(const uint8_t *data, size_t n_bytes, uint32_t crc)
+{
+    const uint32_t (*t)[256] = crc32c_tables;
+
+    for (; n_bytes >= 8; n_bytes -= 8, data += 8) {
+        uint32_t lo = get_le32(data) ^ crc;
+        uint32_t hi = get_le32(data + 4);
+
+        crc = (t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff]
+               ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24]
+               ^ t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff]
+               ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24]);
+    }
+    for (; n_bytes; n_bytes--) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xff];
+    }
+    return crc;
+}
+
+uint32_t
+crc32c_sw(const void *data, size_t n_bytes, uint32_t basis)
+{
+    if (!crc32c_tables_inited) {
+        crc32c_init_tables();
+    }
+    return ~crc32c_sw__(data, n_bytes, ~basis);
+}
+
+#if HAVE_CRC32C_HW
+static uint32_t __attribute__((target("sse4.2")))
+crc32c_hw(const void *data_, size_t n_bytes, uint32_t basis)
+{
+    const uint8_t *data = data_;
+    uint32_t crc = ~basis;
+
+#ifdef __x86_64__
+    for (; n_bytes >= 8; n_bytes -= 8, data += 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        crc = _mm_crc32_u64(crc, word);
+    }
+#endif
+    for (; n_bytes >= 4; n_bytes -= 4, data += 4) {
+        uint32_t word;
+        memcpy(&word, data, 4);
+        crc = _mm_crc32_u32(crc, word);
+    }
+    for (; n_bytes; n_bytes--) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return ~crc;
+}
+#endif
+
+bool
+crc32c_hw_available(void)
+{
+#if HAVE_CRC32C_HW
+    unsigned int eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2);
+#else
+    return false;
+#endif
+}
+
+static uint32_t crc32c_select(const void *, size_t, uint32_t basis);
+
+/* The implementation chosen on first use.  Selection is idempotent, so it is
+ * harmless if more than one thread performs it, but the tables must be
+ * visible to any thread that sees crc32c_sw selected. */
+static uint32_t (*crc32c_impl)(const void *, size_t, uint32_t) = crc32c_select;
+
+static uint32_t
+crc32c_select(const void *data, size_t n_bytes, uint32_t basis)
+{
+#if HAVE_CRC32C_HW
+    if (crc32c_hw_available()) {
+        __atomic_store_n(&crc32c_impl, crc32c_hw, __ATOMIC_RELEASE);
+        return crc32c_hw(data, n_bytes, basis);
+    }
+#endif
+    if (!crc32c_tables_inited) {
+        crc32c_init_tables();
+    }
+    __atomic_store_n(&crc32c_impl, crc32c_sw, __ATOMIC_RELEASE);
+    return crc32c_sw(data, n_bytes, basis);
+}
+
+uint32_t
+crc32c(const void *data, size_t n_bytes, uint32_t basis)
+{
+    uint32_t (*impl)(const void *, size_t, uint32_t);
+
+    impl = __atomic_load_n(&crc32c_impl, __ATOMIC_ACQUIRE);
+    return impl(data, n_bytes, basis);
+}
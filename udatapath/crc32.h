@@ -34,6 +34,7 @@
 #ifndef CRC32_H
 #define CRC32_H 1
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
@@ -47,4 +48,13 @@ struct crc32 {
 void crc32_init(struct crc32 *, unsigned int polynomial);
 unsigned int crc32_calculate(const struct crc32 *, const void *, size_t);
 
+/* CRC-32C (Castagnoli), as used by iSCSI and computed by the SSE4.2 "crc32"
+ * instruction.  crc32c() uses the instruction if the CPU supports it and
+ * otherwise falls back to crc32c_sw(), which processes 8 bytes per step.  Both
+ * return the same values.  'basis' allows chaining: passing the CRC of one
+ * buffer as the basis for the next yields the CRC of their concatenation. */
+uint32_t crc32c(const void *, size_t, uint32_t basis);
+uint32_t crc32c_sw(const void *, size_t, uint32_t basis);
+bool crc32c_hw_available(void);
+
 #endif /* crc32.h */
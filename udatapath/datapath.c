@@ -36,11 +36,18 @@
 #include <assert.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>
 #include <unistd.h>
+#include "buffer-store.h"
 #include "chain.h"
 #include "csum.h"
+#include "epoch.h"
 #include "flow.h"
 #include "ofpbuf.h"
 #include "openflow/openflow.h"
@@ -50,8 +57,10 @@
 #include "packets.h"
 #include "poll-loop.h"
 #include "rconn.h"
+#include "socket-util.h"
 #include "stp.h"
 #include "switch-flow.h"
+#include "sw-queue.h"
 #include "table.h"
 #include "vconn.h"
 #include "xtoxll.h"
@@ -64,7 +73,6 @@
 
 #if defined(OF_HW_PLAT)
 #include <openflow/of_hw_api.h>
-#include <pthread.h>
 #endif
 
 #if defined(OF_HW_PLAT) && !defined(USE_NETDEV)
@@ -159,6 +167,11 @@ extern char serial_num;
 struct sender {
     struct remote *remote;      /* The device that sent the message. */
     uint32_t xid;               /* The OpenFlow transaction ID. */
+
+    /* The ofpbuf that holds the message, or a null pointer.  A handler may
+     * take the ofpbuf over for its own use, e.g. to send out the frame in a
+     * packet_out without copying it, by storing a null pointer here. */
+    struct ofpbuf **msgp;
 };
 
 /* A connection to a secure channel. */
@@ -178,36 +191,42 @@ struct remote {
     void *cb_aux;
 };
 
+/* A packet sent to the controller by a forwarding thread. */
+struct dp_packet_in {
+    struct list node;           /* In datapath.packet_in_queue. */
+    struct ofpbuf *buffer;
+    int in_port;
+    size_t max_len;
+    int reason;
+};
+
+/* The running thread's forwarding state, if it is a forwarding thread, or a
+ * null pointer in the main thread. */
+static __thread struct dp_thread *cur_thread;
+
 static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
 
 static struct remote *remote_create(struct datapath *, struct rconn *);
 static void remote_run(struct datapath *, struct remote *);
+static void dp_flush_tx(struct dp_thread *);
 static void remote_wait(struct remote *);
 static void remote_destroy(struct remote *);
 
 static void update_port_flags(struct datapath *, const struct ofp_port_mod *);
 static void send_port_status(struct sw_port *p, uint8_t status);
 
-/* Buffers are identified by a 31-bit opaque ID.  We divide the ID
- * into a buffer number (low bits) and a cookie (high bits).  The buffer number
- * is an index into an array of buffers.  The cookie distinguishes between
- * different packets that have occupied a single buffer.  Thus, the more
- * buffers we have, the lower-quality the cookie... */
-#define PKT_BUFFER_BITS 8
-#define N_PKT_BUFFERS (1 << PKT_BUFFER_BITS)
-#define PKT_BUFFER_MASK (N_PKT_BUFFERS - 1)
-
-#define PKT_COOKIE_BITS (32 - PKT_BUFFER_BITS)
-
 int run_flow_through_tables(struct datapath *, struct ofpbuf *,
                             struct sw_port *);
 void fwd_port_input(struct datapath *, struct ofpbuf *, struct sw_port *);
 int fwd_control_input(struct datapath *, const struct sender *,
                       const void *, size_t);
 
-uint32_t save_buffer(struct ofpbuf *);
-static struct ofpbuf *retrieve_buffer(uint32_t id);
-static void discard_buffer(uint32_t id);
+static struct ofpbuf *retrieve_buffer(struct datapath *, uint32_t id);
+static void expire_buffers(struct datapath *);
+
+static void release_pending_misses(struct datapath *, const struct sw_flow *);
+static void answer_pending_miss(struct datapath *, uint32_t buffer_id);
+static void expire_pending_misses(struct datapath *);
 
 struct sw_port *
 dp_lookup_port(struct datapath *dp, uint16_t port_no)
@@ -217,6 +236,9 @@ dp_lookup_port(struct datapath *dp, uint16_t port_no)
             : NULL);
 }
 
+/* Returns the queue on 'p' with the given 'queue_id', or a null pointer if
+ * there is none.  Only for the main thread; forwarding threads use
+ * sw_queue_lookup_class() instead. */
 struct sw_queue *
 dp_lookup_queue(struct sw_port *p, uint32_t queue_id)
 {
@@ -325,6 +347,98 @@ dp_hw_drv_init(struct datapath *dp)
 
 #endif
 
+/* Creates and returns forwarding state for a thread in 'dp'. */
+static struct dp_thread *
+dp_thread_create(struct datapath *dp)
+{
+    struct dp_thread *t = xcalloc(1, sizeof *t);
+
+    t->dp = dp;
+    t->cache = chain_cache_create(dp->chain);
+    ofpbuf_pool_init(&t->pool, DP_HEADROOM,
+                     VLAN_ETH_HEADER_LEN + ETH_PAYLOAD_MAX,
+                     DP_POOL_MAX_BUFFERS);
+    t->tx = xcalloc(DP_MAX_PORTS + 1, sizeof *t->tx);
+    list_init(&t->tx_batches);
+    t->port_stats = counter_alloc((DP_MAX_PORTS + 1) * sizeof *t->port_stats);
+    if (!t->port_stats) {
+        out_of_memory();
+    }
+    return t;
+}
+
+/* Returns the forwarding state for the running thread. */
+static struct dp_thread *
+dp_thread_self(struct datapath *dp)
+{
+    return cur_thread ? cur_thread : dp->main_thread;
+}
+
+/* Returns the index of 'p' in a dp_thread's 'tx' and 'port_stats'. */
+static int
+port_idx(const struct sw_port *p)
+{
+    return p->port_no == OFPP_LOCAL ? DP_MAX_PORTS : p->port_no;
+}
+
+/* Stores into 'sum' the sum of every thread's counters for 'p'. */
+static void
+sum_port_shards(const struct sw_port *p, struct dp_port_shard *sum)
+{
+    const struct datapath *dp = p->dp;
+    int idx = port_idx(p);
+    int i, j;
+
+    memset(sum, 0, sizeof *sum);
+    for (i = -1; i < dp->n_threads; i++) {
+        const struct dp_thread *t = i < 0 ? dp->main_thread : dp->threads[i];
+        const struct dp_port_shard *s = &t->port_stats[idx];
+
+        sum->rx_packets += counter_get(s->rx_packets);
+        sum->tx_packets += counter_get(s->tx_packets);
+        sum->rx_bytes += counter_get(s->rx_bytes);
+        sum->tx_bytes += counter_get(s->tx_bytes);
+        sum->tx_dropped += counter_get(s->tx_dropped);
+        for (j = 0; j < NETDEV_MAX_QUEUES; j++) {
+            sum->queue_tx_packets[j] += counter_get(s->queue_tx_packets[j]);
+            sum->queue_tx_bytes[j] += counter_get(s->queue_tx_bytes[j]);
+        }
+    }
+}
+
+/* Zeros 'p''s counters. */
+static void
+reset_port_stats(struct sw_port *p)
+{
+    struct dp_port_shard sum;
+
+    sum_port_shards(p, &sum);
+    p->rx_packets = -sum.rx_packets;
+    p->tx_packets = -sum.tx_packets;
+    p->rx_bytes = -sum.rx_bytes;
+    p->tx_bytes = -sum.tx_bytes;
+    p->tx_dropped = -sum.tx_dropped;
+}
+
+/* Zeros 'q''s counters.  'q->port' must be set. */
+void
+dp_reset_queue_stats(struct sw_queue *q)
+{
+    struct dp_port_shard sum;
+    int j = q - q->port->queues;
+
+    sum_port_shards(q->port, &sum);
+    q->tx_packets = -sum.queue_tx_packets[j];
+    q->tx_bytes = -sum.queue_tx_bytes[j];
+}
+
+/* Returns the current time in ms, for the running thread. */
+static long long int
+dp_now(void)
+{
+    return cur_thread ? cur_thread->now : time_msec();
+}
+
 int
 dp_new(struct datapath **dp_, uint64_t dpid)
 {
@@ -335,7 +449,6 @@ dp_new(struct datapath **dp_, uint64_t dpid)
         return ENOMEM;
     }
 
-    dp->last_timeout = time_now();
     list_init(&dp->remotes);
     dp->listeners = NULL;
     dp->n_listeners = 0;
@@ -352,6 +465,12 @@ dp_new(struct datapath **dp_, uint64_t dpid)
     }
 
     list_init(&dp->port_list);
+    dp->main_thread = dp_thread_create(dp);
+    pthread_mutex_init(&dp->packet_in_mutex, NULL);
+    list_init(&dp->packet_in_queue);
+    dp->wakeup_pipe[0] = dp->wakeup_pipe[1] = -1;
+    pending_misses_init(&dp->pending_misses);
+    buffer_store_init(&dp->buffers, DP_DEFAULT_N_BUFFERS);
     dp->flags = 0;
     dp->miss_send_len = OFP_DEFAULT_MISS_SEND_LEN;
 
@@ -430,6 +549,7 @@ new_port(struct datapath *dp, struct sw_port *port, uint16_t port_no,
     port->netdev = netdev;
     port->port_no = port_no;
     port->num_queues = num_queues;
+    reset_port_stats(port);
     list_push_back(&dp->port_list, &port->node);
 
     /* Notify the ctlpath that this port has been added */
@@ -524,28 +644,282 @@ dp_add_pvconn(struct datapath *dp, struct pvconn *pvconn)
     dp->listeners[dp->n_listeners++] = pvconn;
 }
 
+/* Makes sure that each of 't''s receive buffers can hold a packet from a
+ * port with the given 'mtu'. */
+static void
+dp_fill_rx_bufs(struct dp_thread *t, int mtu)
+{
+    int i;
+
+    ofpbuf_pool_set_size(&t->pool, VLAN_ETH_HEADER_LEN + mtu);
+    for (i = 0; i < DP_RX_BATCH; i++) {
+        struct ofpbuf *buffer = t->rx_bufs[i];
+
+        if (buffer && ofpbuf_tailroom(buffer) < t->pool.size) {
+            ofpbuf_delete(buffer);
+            buffer = NULL;
+        }
+        if (!buffer) {
+            t->rx_bufs[i] = ofpbuf_pool_get(&t->pool);
+        }
+    }
+}
+
+/* Receives a batch of packets on 'p' into 't''s buffers and forwards them.
+ * The caller must flush 't''s transmit batches afterward.  Returns the number
+ * of packets received. */
+static int
+dp_recv_port(struct dp_thread *t, struct sw_port *p)
+{
+    struct dp_port_shard *stats = &t->port_stats[port_idx(p)];
+    struct ofpbuf *batch[DP_RX_BATCH];
+    int error, n_recv;
+    int i;
+
+    dp_fill_rx_bufs(t, netdev_get_mtu(p->netdev));
+    error = netdev_recv_batch(p->netdev, t->rx_bufs, DP_RX_BATCH, &n_recv);
+    if (error) {
+        if (error != EAGAIN) {
+            VLOG_ERR_RL(&rl, "error receiving data from %s: %s",
+                        netdev_get_name(p->netdev), strerror(error));
+        }
+        return 0;
+    }
+
+    /* Forwarding takes ownership of the buffers, so take them out of
+     * 't->rx_bufs' first.  They get replaced on the next pass. */
+    for (i = 0; i < n_recv; i++) {
+        batch[i] = t->rx_bufs[i];
+        t->rx_bufs[i] = NULL;
+        counter_add(stats->rx_bytes, batch[i]->size);
+    }
+    counter_add(stats->rx_packets, n_recv);
+    for (i = 0; i < n_recv; i++) {
+        fwd_port_input(t->dp, batch[i], p);
+    }
+    return n_recv;
+}
+
+/* Main loop of a forwarding thread, which receives on the ports assigned to
+ * it and forwards the packets, and otherwise leaves 'dp' to the main
+ * thread. */
+static void *
+dp_thread_main(void *t_)
+{
+    struct dp_thread *t = t_;
+    struct pollfd *pollfds;
+    size_t i;
+
+    cur_thread = t;
+    flow_set_shard(t->idx);
+    epoch_register();
+    pollfds = xmalloc(t->n_ports * sizeof *pollfds);
+    for (i = 0; i < t->n_ports; i++) {
+        pollfds[i].fd = netdev_get_fd(t->ports[i]->netdev);
+        pollfds[i].events = POLLIN;
+    }
+
+    for (;;) {
+        struct timeval tv;
+        int n_recv = 0;
+
+        gettimeofday(&tv, NULL);
+        t->now = (long long int) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+
+        /* The packets waiting in 't''s batches are for queues looked up in
+         * this critical section, so send them before leaving it. */
+        epoch_enter();
+        for (i = 0; i < t->n_ports; i++) {
+            n_recv += dp_recv_port(t, t->ports[i]);
+        }
+        dp_flush_tx(t);
+        epoch_exit();
+
+        if (!n_recv) {
+            /* The timeout bounds how stale 't->now' can get, although it is
+             * refreshed whenever a packet arrives anyway. */
+            poll(pollfds, t->n_ports, 1000);
+        }
+    }
+    return NULL;
+}
+
+/* Starts 'n_threads' forwarding threads for 'dp' and divides its ports among
+ * them.  From then on, the main thread only forwards packets sent by the
+ * controller.  Must be called after all of the ports have been added but
+ * before any flows have been (see flow_set_n_shards()), and after daemonizing,
+ * because threads do not survive fork().  Returns 0 if successful, otherwise a
+ * positive errno value. */
+int
+dp_start_threads(struct datapath *dp, int n_threads)
+{
+    sigset_t all_signals, old_signals;
+    struct sw_port *p;
+    int n_ports;
+    int error;
+    int i;
+
+    assert(!dp->n_threads);
+    if (n_threads <= 0 || n_threads > DP_MAX_THREADS) {
+        return EINVAL;
+    }
+
+    n_ports = 0;
+    LIST_FOR_EACH (p, struct sw_port, node, &dp->port_list) {
+        n_ports += !IS_HW_PORT(p);
+    }
+    if (n_threads > n_ports) {
+        VLOG_WARN("only %d ports, so starting only %d forwarding threads",
+                  n_ports, n_ports);
+        n_threads = n_ports;
+        if (!n_threads) {
+            return 0;
+        }
+    }
+
+    if (pipe(dp->wakeup_pipe)) {
+        return errno;
+    }
+    set_nonblocking(dp->wakeup_pipe[0]);
+    set_nonblocking(dp->wakeup_pipe[1]);
+    poll_fd_register(dp->wakeup_pipe[0]);
+
+    flow_set_n_shards(n_threads);
+    dp->threads = xmalloc(n_threads * sizeof *dp->threads);
+    for (i = 0; i < n_threads; i++) {
+        struct dp_thread *t = dp_thread_create(dp);
+        t->idx = i;
+        t->ports = xmalloc(n_ports * sizeof *t->ports);
+        dp->threads[i] = t;
+    }
+    i = 0;
+    LIST_FOR_EACH (p, struct sw_port, node, &dp->port_list) {
+        if (!IS_HW_PORT(p)) {
+            struct dp_thread *t = dp->threads[i++ % n_threads];
+            t->ports[t->n_ports++] = p;
+        }
+    }
+
+    /* Leave signal handling to the main thread. */
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_BLOCK, &all_signals, &old_signals);
+    error = 0;
+    for (i = 0; i < n_threads && !error; i++) {
+        error = pthread_create(&dp->threads[i]->thread, NULL,
+                               dp_thread_main, dp->threads[i]);
+        if (!error) {
+            dp->n_threads++;
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+
+    if (error) {
+        VLOG_ERR("failed to start forwarding thread: %s", strerror(error));
+    } else {
+        VLOG_INFO("forwarding on %d threads", dp->n_threads);
+    }
+    return error;
+}
+
+/* Queues 'buffer' to be sent to the controller by the main thread, on behalf
+ * of a forwarding thread.  Takes ownership of 'buffer'.
+ *
+ * The queued packet is copied into a fresh buffer, both to leave room for the
+ * packet_in header and because the main thread may keep it in the buffer store
+ * long after the forwarding thread has reused its own buffer. */
+static void
+queue_packet_in(struct datapath *dp, struct ofpbuf *buffer, int in_port,
+                size_t max_len, int reason)
+{
+    struct dp_packet_in *pi;
+    bool wake;
+
+    pi = xmalloc(sizeof *pi);
+    pi->buffer = ofpbuf_new(offsetof(struct ofp_packet_in, data)
+                            + buffer->size);
+    ofpbuf_reserve(pi->buffer, offsetof(struct ofp_packet_in, data));
+    ofpbuf_put(pi->buffer, buffer->data, buffer->size);
+    pi->in_port = in_port;
+    pi->max_len = max_len;
+    pi->reason = reason;
+    ofpbuf_delete(buffer);
+
+    pthread_mutex_lock(&dp->packet_in_mutex);
+    if (dp->n_packet_in_queued < DP_MAX_PACKET_IN_QUEUE) {
+        wake = list_is_empty(&dp->packet_in_queue);
+        list_push_back(&dp->packet_in_queue, &pi->node);
+        dp->n_packet_in_queued++;
+        pi = NULL;
+    } else {
+        wake = false;
+        dp->n_packet_in_dropped++;
+    }
+    pthread_mutex_unlock(&dp->packet_in_mutex);
+
+    if (pi) {
+        ofpbuf_delete(pi->buffer);
+        free(pi);
+    } else if (wake && write(dp->wakeup_pipe[1], "", 1) < 0) {
+        /* The pipe is full, so the main thread will wake up anyway. */
+    }
+}
+
+/* Sends the packets queued by forwarding threads to the controller. */
+static void
+dp_send_queued_packet_ins(struct datapath *dp)
+{
+    struct list queue = LIST_INITIALIZER(&queue);
+    struct dp_packet_in *pi, *next;
+    char buf[64];
+
+    /* Drain the pipe first, so that a packet queued after we take the queue
+     * below wakes us up again. */
+    while (read(dp->wakeup_pipe[0], buf, sizeof buf) > 0) {
+        continue;
+    }
+
+    pthread_mutex_lock(&dp->packet_in_mutex);
+    if (!list_is_empty(&dp->packet_in_queue)) {
+        list_splice(&queue, list_front(&dp->packet_in_queue),
+                    &dp->packet_in_queue);
+    }
+    dp->n_packet_in_queued = 0;
+    pthread_mutex_unlock(&dp->packet_in_mutex);
+
+    LIST_FOR_EACH_SAFE (pi, next, struct dp_packet_in, node, &queue) {
+        dp_output_control(dp, pi->buffer, pi->in_port, pi->max_len,
+                          pi->reason);
+        free(pi);
+    }
+}
+
 void
 dp_run(struct datapath *dp)
 {
-    time_t now = time_now();
+    struct list deleted = LIST_INITIALIZER(&deleted);
+    struct sw_flow *f;
     struct sw_port *p, *pn;
     struct remote *r, *rn;
-    struct ofpbuf *buffer = NULL;
     size_t i;
 
-    if (now != dp->last_timeout) {
-        struct list deleted = LIST_INITIALIZER(&deleted);
-        struct sw_flow *f, *n;
-
-        chain_timeout(dp->chain, &deleted);
-        LIST_FOR_EACH_SAFE (f, n, struct sw_flow, node, &deleted) {
-            dp_send_flow_end(dp, f, f->reason);
-            list_remove(&f->node);
-            flow_free(f);
-        }
-        dp->last_timeout = now;
+    if (chain_timeout(dp->chain, &deleted)) {
+        poll_immediate_wake();
+    }
+    if (chain_run(dp->chain)) {
+        poll_immediate_wake();
+    }
+    LIST_FOR_EACH (f, struct sw_flow, node, &deleted) {
+        dp_send_flow_end(dp, f, f->reason);
+    }
+    flow_deferred_free_list(&deleted);
+    expire_pending_misses(dp);
+    expire_buffers(dp);
+    if (epoch_reclaim()) {
+        /* Forwarding threads were still using some of them. */
+        poll_timer_wait(100);
+    } else {
+        poll_timer_wait(1000);
     }
-    poll_timer_wait(1000);
 
 #if defined(OF_HW_PLAT) && !defined(USE_NETDEV)
     { /* Process packets received from callback thread */
@@ -562,40 +936,25 @@ dp_run(struct datapath *dp)
     }
 #endif
 
-    LIST_FOR_EACH_SAFE (p, pn, struct sw_port, node, &dp->port_list) {
-        int error;
-
-        if (IS_HW_PORT(p)) {
-            continue;
-        }
-        if (!buffer) {
-            /* Allocate buffer with some headroom to add headers in forwarding
-             * to the controller or adding a vlan tag, plus an extra 2 bytes to
-             * allow IP headers to be aligned on a 4-byte boundary.  */
-            const int headroom = 128 + 2;
-            const int hard_header = VLAN_ETH_HEADER_LEN;
-            const int mtu = netdev_get_mtu(p->netdev);
-            buffer = ofpbuf_new(headroom + hard_header + mtu);
-            buffer->data = (char*)buffer->data + headroom;
-        }
-        error = netdev_recv(p->netdev, buffer);
-        if (!error) {
-            p->rx_packets++;
-            p->rx_bytes += buffer->size;
-            fwd_port_input(dp, buffer, p);
-            buffer = NULL;
-        } else if (error != EAGAIN) {
-            VLOG_ERR_RL(&rl, "error receiving data from %s: %s",
-                        netdev_get_name(p->netdev), strerror(error));
+    if (!dp->n_threads) {
+        LIST_FOR_EACH_SAFE (p, pn, struct sw_port, node, &dp->port_list) {
+            if (!IS_HW_PORT(p)) {
+                dp_recv_port(dp->main_thread, p);
+                dp_flush_tx(dp->main_thread);
+            }
         }
+    } else {
+        dp_send_queued_packet_ins(dp);
     }
-    ofpbuf_delete(buffer);
 
     /* Talk to remotes. */
     LIST_FOR_EACH_SAFE (r, rn, struct remote, node, &dp->remotes) {
         remote_run(dp, r);
     }
 
+    /* Send packets output by the controller and by the hardware callback. */
+    dp_flush_tx(dp->main_thread);
+
     for (i = 0; i < dp->n_listeners; ) {
         struct pvconn *pvconn = dp->listeners[i];
         struct vconn *new_vconn;
@@ -636,6 +995,7 @@ remote_run(struct datapath *dp, struct remote *r)
                 oh = (struct ofp_header *)buffer->data;
                 sender.remote = r;
                 sender.xid = oh->xid;
+                sender.msgp = &buffer;
                 fwd_control_input(dp, &sender, buffer->data, buffer->size);
             } else {
                 VLOG_WARN_RL(&rl, "received too-short OpenFlow message");
@@ -727,11 +1087,15 @@ dp_wait(struct datapath *dp)
     struct remote *r;
     size_t i;
 
-    LIST_FOR_EACH (p, struct sw_port, node, &dp->port_list) {
-        if (IS_HW_PORT(p)) {
-            continue;
+    if (!dp->n_threads) {
+        LIST_FOR_EACH (p, struct sw_port, node, &dp->port_list) {
+            if (IS_HW_PORT(p)) {
+                continue;
+            }
+            netdev_recv_wait(p->netdev);
         }
-        netdev_recv_wait(p->netdev);
+    } else {
+        poll_fd_wait(dp->wakeup_pipe[0], POLLIN);
     }
     LIST_FOR_EACH (r, struct remote, node, &dp->remotes) {
         remote_wait(r);
@@ -748,7 +1112,7 @@ static int
 output_all(struct datapath *dp, struct ofpbuf *buffer, int in_port, int flood)
 {
     struct sw_port *p;
-    int prev_port; /* Buffer is cloned for multiple transmits */
+    int prev_port; /* Buffer is shared for multiple transmits */
 
     prev_port = -1;
     LIST_FOR_EACH (p, struct sw_port, node, &dp->port_list) {
@@ -759,7 +1123,7 @@ output_all(struct datapath *dp, struct ofpbuf *buffer, int in_port, int flood)
             continue;
         }
         if (prev_port != -1) {
-            dp_output_port(dp, ofpbuf_clone(buffer), in_port, prev_port,
+            dp_output_port(dp, ofpbuf_share(buffer), in_port, prev_port,
                            0,false);
         }
         prev_port = p->port_no;
@@ -772,15 +1136,63 @@ output_all(struct datapath *dp, struct ofpbuf *buffer, int in_port, int flood)
     return 0;
 }
 
+/* Sends the packets in 'b', which belongs to 't', and frees them. */
+static void
+flush_tx_batch(struct dp_thread *t, struct dp_tx_batch *b)
+{
+    struct sw_port *p = b->port;
+    struct dp_port_shard *stats = &t->port_stats[port_idx(p)];
+    int errors[DP_TX_BATCH];
+    uint64_t n_bytes = 0;
+    int n_sent = 0;
+    int i;
+
+    netdev_send_batch(p->netdev, b->bufs, b->n, b->class_id, errors);
+    for (i = 0; i < b->n; i++) {
+        struct ofpbuf *buffer = b->bufs[i];
+
+        if (!errors[i]) {
+            n_sent++;
+            n_bytes += buffer->size;
+        }
+        ofpbuf_delete(buffer);
+    }
+    if (n_sent) {
+        counter_add(stats->tx_packets, n_sent);
+        counter_add(stats->tx_bytes, n_bytes);
+        if (b->class_id) {
+            /* A queue's class_id is its index in the port's 'queues'. */
+            counter_add(stats->queue_tx_packets[b->class_id], n_sent);
+            counter_add(stats->queue_tx_bytes[b->class_id], n_bytes);
+        }
+    }
+    if (n_sent < b->n) {
+        counter_add(stats->tx_dropped, b->n - n_sent);
+    }
+    b->n = 0;
+    list_remove(&b->node);
+}
+
+/* Sends all of the packets that 't' has queued for transmission. */
+static void
+dp_flush_tx(struct dp_thread *t)
+{
+    struct dp_tx_batch *b, *next;
+
+    LIST_FOR_EACH_SAFE (b, next, struct dp_tx_batch, node, &t->tx_batches) {
+        flush_tx_batch(t, b);
+    }
+}
+
 static void
 output_packet(struct datapath *dp, struct ofpbuf *buffer, uint16_t out_port,
               uint32_t queue_id)
 {
     uint16_t class_id;
-    struct sw_queue * q;
     struct sw_port *p;
+    struct dp_thread *t;
+    struct dp_tx_batch *b;
 
-    q = NULL;
     p = dp_lookup_port(dp, out_port);
 
 /* FIXME:  Needs update for queuing */
@@ -816,25 +1228,30 @@ output_packet(struct datapath *dp, struct ofpbuf *buffer, uint16_t out_port,
             }
             else {
                 /* silently drop the packet if queue doesn't exist */
-                q = dp_lookup_queue(p, queue_id);
-                if (q) {
-                    class_id = q->class_id;
+                int class = sw_queue_lookup_class(p, queue_id);
+                if (class >= 0) {
+                    class_id = class;
                 }
                 else {
                     goto error;
                 }
             }
 
-            if (!netdev_send(p->netdev, buffer, class_id)) {
-                p->tx_packets++;
-                p->tx_bytes += buffer->size;
-                if (q) {
-                    q->tx_packets++;
-                    q->tx_bytes += buffer->size;
-                }
-            } else {
-                p->tx_dropped++;
+            t = dp_thread_self(dp);
+            b = &t->tx[port_idx(p)];
+            if (b->n && b->class_id != class_id) {
+                flush_tx_batch(t, b);
+            }
+            if (!b->n) {
+                list_push_back(&t->tx_batches, &b->node);
+                b->port = p;
+                b->class_id = class_id;
             }
+            b->bufs[b->n++] = buffer;
+            if (b->n >= DP_TX_BATCH) {
+                flush_tx_batch(t, b);
+            }
+            return;
         }
         ofpbuf_delete(buffer);
         return;
@@ -924,7 +1341,7 @@ send_openflow_buffer(struct datapath *dp, struct ofpbuf *buffer,
         struct remote *r, *prev = NULL;
         LIST_FOR_EACH (r, struct remote, node, &dp->remotes) {
             if (prev) {
-                send_openflow_buffer_to_remote(ofpbuf_clone(buffer), prev);
+                send_openflow_buffer_to_remote(ofpbuf_share(buffer), prev);
             }
             prev = r;
         }
@@ -937,36 +1354,82 @@ send_openflow_buffer(struct datapath *dp, struct ofpbuf *buffer,
     }
 }
 
-/* Takes ownership of 'buffer' and transmits it to 'dp''s controller.  If the
- * packet can be saved in a buffer, then only the first max_len bytes of
- * 'buffer' are sent; otherwise, all of 'buffer' is sent.  'reason' indicates
- * why 'buffer' is being sent. 'max_len' sets the maximum number of bytes that
- * the caller wants to be sent. */
-void
-dp_output_control(struct datapath *dp, struct ofpbuf *buffer, int in_port,
-                  size_t max_len, int reason)
+/* Sends 'buffer' to 'dp''s controller in a packet_in, as described for
+ * dp_output_control(), and returns the ID of the buffer in which the packet
+ * was saved, or UINT32_MAX if it could not be saved. */
+static uint32_t
+send_packet_in(struct datapath *dp, struct ofpbuf *buffer, int in_port,
+               size_t max_len, int reason)
 {
     struct ofp_packet_in *opi;
+    struct ofpbuf *msg;
     size_t total_len;
     uint32_t buffer_id;
 
-    buffer_id = save_buffer(buffer);
     total_len = buffer->size;
-    if (buffer_id != UINT32_MAX && buffer->size > max_len) {
-        buffer->size = max_len;
+    buffer_id = buffer_store_save(&dp->buffers, buffer, time_msec());
+    if (buffer_id != UINT32_MAX) {
+        /* The packet now belongs to the buffer, so send a copy of its first
+         * 'max_len' bytes. */
+        size_t len = MIN(buffer->size, max_len);
+
+        msg = ofpbuf_new(offsetof(struct ofp_packet_in, data) + len);
+        ofpbuf_put_uninit(msg, offsetof(struct ofp_packet_in, data));
+        ofpbuf_put(msg, buffer->data, len);
+    } else {
+        msg = buffer;
+        ofpbuf_push_uninit(msg, offsetof(struct ofp_packet_in, data));
     }
 
-    opi = ofpbuf_push_uninit(buffer, offsetof(struct ofp_packet_in, data));
+    opi = msg->data;
     opi->header.version = OFP_VERSION;
     opi->header.type    = OFPT_PACKET_IN;
-    opi->header.length  = htons(buffer->size);
+    opi->header.length  = htons(msg->size);
     opi->header.xid     = htonl(0);
     opi->buffer_id      = htonl(buffer_id);
     opi->total_len      = htons(total_len);
     opi->in_port        = htons(in_port);
     opi->reason         = reason;
     opi->pad            = 0;
-    send_openflow_buffer(dp, buffer, NULL);
+    send_openflow_buffer(dp, msg, NULL);
+    return buffer_id;
+}
+
+/* Takes ownership of 'buffer' and transmits it to 'dp''s controller.  If the
+ * packet can be saved in a buffer, then only the first max_len bytes of
+ * 'buffer' are sent; otherwise, all of 'buffer' is sent.  'reason' indicates
+ * why 'buffer' is being sent. 'max_len' sets the maximum number of bytes that
+ * the caller wants to be sent.
+ *
+ * A packet that did not match any flow may instead be held back, if one of
+ * the same microflow was sent up a moment ago. */
+void
+dp_output_control(struct datapath *dp, struct ofpbuf *buffer, int in_port,
+                  size_t max_len, int reason)
+{
+    struct pending_miss *pm = NULL;
+    uint32_t buffer_id;
+
+    if (cur_thread) {
+        queue_packet_in(dp, buffer, in_port, max_len, reason);
+        return;
+    }
+
+    /* The packet may be kept in a pending miss or the buffer store long after
+     * the message that carried it, e.g. the frame of a packet_out, which is a
+     * slice of its connection's whole receive ring.  Copy it rather than keep
+     * all of that memory alive. */
+    ofpbuf_make_writable(buffer);
+
+    if (reason == OFPR_NO_MATCH
+        && pending_miss_hold(&dp->pending_misses, buffer, in_port, max_len,
+                             time_msec(), &pm)) {
+        return;
+    }
+    buffer_id = send_packet_in(dp, buffer, in_port, max_len, reason);
+    if (pm) {
+        pending_miss_set_buffer_id(&dp->pending_misses, pm, buffer_id);
+    }
 }
 
 static void
@@ -1042,7 +1505,7 @@ dp_send_features_reply(struct datapath *dp, const struct sender *sender)
                                sender, &buffer);
     ofr->datapath_id  = htonll(dp->id);
     ofr->n_tables     = dp->chain->n_tables;
-    ofr->n_buffers    = htonl(N_PKT_BUFFERS);
+    ofr->n_buffers    = htonl(buffer_store_n_buffers(&dp->buffers));
     ofr->capabilities = htonl(OFP_SUPPORTED_CAPABILITIES);
     ofr->actions      = htonl(OFP_SUPPORTED_ACTIONS);
     LIST_FOR_EACH (p, struct sw_port, node, &dp->port_list) {
@@ -1093,6 +1556,7 @@ dp_send_flow_end(struct datapath *dp, struct sw_flow *flow,
     struct ofp_flow_removed *ofr;
     uint64_t tdiff = time_msec() - flow->created;
     uint32_t sec = tdiff / 1000;
+    uint64_t packet_count, byte_count;
 
     if (!flow->send_flow_rem) {
         return;
@@ -1117,8 +1581,9 @@ dp_send_flow_end(struct datapath *dp, struct sw_flow *flow,
     ofr->duration_nsec = htonl((tdiff - (sec * 1000)) * 1000000);
     ofr->idle_timeout = htons(flow->idle_timeout);
 
-    ofr->packet_count = htonll(flow->packet_count);
-    ofr->byte_count   = htonll(flow->byte_count);
+    flow_get_stats(flow, &packet_count, &byte_count);
+    ofr->packet_count = htonll(packet_count);
+    ofr->byte_count   = htonll(byte_count);
 
     send_openflow_buffer(dp, buffer, NULL);
 }
@@ -1144,6 +1609,9 @@ fill_flow_stats(struct ofpbuf *buffer, struct sw_flow *flow,
     int length = sizeof *ofs + flow->sf_acts->actions_len;
     uint64_t tdiff = now - flow->created;
     uint32_t sec = tdiff / 1000;
+    uint64_t packet_count, byte_count;
+
+    flow_get_stats(flow, &packet_count, &byte_count);
     ofs = ofpbuf_put_uninit(buffer, length);
     ofs->length          = htons(length);
     ofs->table_id        = table_idx;
@@ -1168,8 +1636,8 @@ fill_flow_stats(struct ofpbuf *buffer, struct sw_flow *flow,
     ofs->idle_timeout    = htons(flow->idle_timeout);
     ofs->hard_timeout    = htons(flow->hard_timeout);
     memset(&ofs->pad2, 0, sizeof ofs->pad2);
-    ofs->packet_count    = htonll(flow->packet_count);
-    ofs->byte_count      = htonll(flow->byte_count);
+    ofs->packet_count    = htonll(packet_count);
+    ofs->byte_count      = htonll(byte_count);
     memcpy(ofs->actions, flow->sf_acts->actions, flow->sf_acts->actions_len);
 }
 
@@ -1199,11 +1667,13 @@ int run_flow_through_tables(struct datapath *dp, struct ofpbuf *buffer,
         return 0;
     }
 
-    flow = chain_lookup(dp->chain, &key, 0);
+    flow = chain_lookup(dp->chain, dp_thread_self(dp)->cache, &key, 0);
     if (flow != NULL) {
-        flow_used(flow, buffer);
-        execute_actions(dp, buffer, &key, flow->sf_acts->actions,
-                        flow->sf_acts->actions_len, false);
+        struct sw_flow_actions *sf_acts = epoch_get(flow->sf_acts);
+
+        flow_used(flow, buffer, dp_now());
+        execute_compiled_actions(dp, buffer, &key, sf_acts->ops,
+                                 sf_acts->n_ops, false);
         return 0;
     } else {
         return -ESRCH;
@@ -1297,12 +1767,25 @@ recv_packet_out(struct datapath *dp, const struct sender *sender,
     }
 
     if (ntohl(opo->buffer_id) == (uint32_t) -1) {
-        /* FIXME: can we avoid copying data here? */
-        int data_len = ntohs(opo->header.length) - sizeof *opo - actions_len;
-        buffer = ofpbuf_new(data_len);
-        ofpbuf_put(buffer, (uint8_t *)opo->actions + actions_len, data_len);
+        size_t header_len = sizeof *opo + actions_len;
+        size_t data_len = ntohs(opo->header.length) - header_len;
+
+        if (sender->msgp && *sender->msgp && (*sender->msgp)->data == msg) {
+            /* Send the frame out of the message itself.  The message header
+             * and the actions stay behind as headroom, where the actions can
+             * still be read until they are compiled by execute_actions(). */
+            buffer = *sender->msgp;
+            *sender->msgp = NULL;
+            ofpbuf_pull(buffer, header_len);
+            buffer->size = data_len;
+        } else {
+            buffer = ofpbuf_new(DP_HEADROOM + data_len);
+            ofpbuf_reserve(buffer, DP_HEADROOM);
+            ofpbuf_put(buffer, (uint8_t *)opo->actions + actions_len, data_len);
+        }
     } else {
-        buffer = retrieve_buffer(ntohl(opo->buffer_id));
+        answer_pending_miss(dp, ntohl(opo->buffer_id));
+        buffer = retrieve_buffer(dp, ntohl(opo->buffer_id));
         if (!buffer) {
             return -ESRCH;
         }
@@ -1405,25 +1888,26 @@ add_flow(struct datapath *dp, const struct sender *sender,
 
     error = 0;
     if (ntohl(ofm->buffer_id) != UINT32_MAX) {
-        struct ofpbuf *buffer = retrieve_buffer(ntohl(ofm->buffer_id));
+        struct ofpbuf *buffer = retrieve_buffer(dp, ntohl(ofm->buffer_id));
         if (buffer) {
             struct sw_flow_key key;
             uint16_t in_port = ntohs(ofm->match.in_port);
             flow_extract(buffer, in_port, &key.flow);
-            flow_used(flow, buffer);
+            flow_used(flow, buffer, time_msec());
             execute_actions(dp, buffer, &key,
                     ofm->actions, actions_len, false);
         } else {
             error = -ESRCH;
         }
     }
+    release_pending_misses(dp, flow);
     return error;
 
 error_free_flow:
     flow_free(flow);
 error:
     if (ntohl(ofm->buffer_id) != (uint32_t) -1)
-        discard_buffer(ntohl(ofm->buffer_id));
+        buffer_store_discard(&dp->buffers, ntohl(ofm->buffer_id));
     return error;
 }
 
@@ -1435,6 +1919,7 @@ mod_flow(struct datapath *dp, const struct sender *sender,
     uint16_t v_code;
     size_t actions_len = ntohs(ofm->header.length) - sizeof *ofm;
     struct sw_flow *flow;
+    bool inserted = false;
     int strict;
 
     /* Allocate memory. */
@@ -1476,11 +1961,12 @@ mod_flow(struct datapath *dp, const struct sender *sender,
         } else if (error) {
             goto error_free_flow;
         }
+        inserted = true;
     }
 
     error = 0;
     if (ntohl(ofm->buffer_id) != UINT32_MAX) {
-      struct ofpbuf *buffer = retrieve_buffer(ntohl(ofm->buffer_id));
+      struct ofpbuf *buffer = retrieve_buffer(dp, ntohl(ofm->buffer_id));
       if (buffer) {
             struct sw_flow_key skb_key;
             uint16_t in_port = ntohs(ofm->match.in_port);
@@ -1491,13 +1977,16 @@ mod_flow(struct datapath *dp, const struct sender *sender,
             error = -ESRCH;
         }
     }
+    if (inserted) {
+        release_pending_misses(dp, flow);
+    }
     return error;
 
 error_free_flow:
     flow_free(flow);
 error:
     if (ntohl(ofm->buffer_id) != (uint32_t) -1)
-        discard_buffer(ntohl(ofm->buffer_id));
+        buffer_store_discard(&dp->buffers, ntohl(ofm->buffer_id));
     return error;
 }
 
@@ -1631,8 +2120,11 @@ aggregate_stats_init(const void *body, int body_len UNUSED, void **state)
 static int aggregate_stats_dump_callback(struct sw_flow *flow, void *private)
 {
     struct ofp_aggregate_stats_reply *rpy = private;
-    rpy->packet_count += flow->packet_count;
-    rpy->byte_count += flow->byte_count;
+    uint64_t packet_count, byte_count;
+
+    flow_get_stats(flow, &packet_count, &byte_count);
+    rpy->packet_count += packet_count;
+    rpy->byte_count += byte_count;
     rpy->flow_count++;
     return 0;
 }
@@ -1689,14 +2181,37 @@ static void aggregate_stats_done(void *state)
     free(state);
 }
 
+/* Appends to 'buffer' a pseudo-table for the microflow caches in front of
+ * 'chain''s tables, which every lookup passes through first.  Its lookup
+ * count is the number of packets looked up in the caches and its matched
+ * count the number of cache hits; it holds no flows of its own.  Its ID is
+ * 0xff, which requests use to mean all tables, so that no controller can
+ * mistake it for a table that holds flows. */
+static void
+table_stats_dump_cache(struct sw_chain *chain, struct ofpbuf *buffer)
+{
+    struct ofp_table_stats *ots = ofpbuf_put_zeros(buffer, sizeof *ots);
+    unsigned long long n_hit, n_miss;
+
+    chain_cache_stats(chain, &n_hit, &n_miss);
+    strcpy(ots->name, "microflow cache");
+    ots->table_id = 0xff;
+    ots->max_entries = htonl(CHAIN_CACHE_SIZE * list_size(&chain->caches));
+    ots->lookup_count = htonll(n_hit + n_miss);
+    ots->matched_count = htonll(n_hit);
+}
+
 static int
 table_stats_dump(struct datapath *dp, void *state UNUSED,
                  struct ofpbuf *buffer)
 {
     int i;
+
+    chain_sum_lookups(dp->chain);
     for (i = 0; i < dp->chain->n_tables; i++) {
         struct ofp_table_stats *ots = ofpbuf_put_uninit(buffer, sizeof *ots);
         struct sw_table_stats stats;
+        stats.n_counters = 0;
         dp->chain->tables[i]->stats(dp->chain->tables[i], &stats);
         strncpy(ots->name, stats.name, sizeof ots->name);
         ots->table_id = i;
@@ -1707,6 +2222,7 @@ table_stats_dump(struct datapath *dp, void *state UNUSED,
         ots->lookup_count = htonll(stats.n_lookup);
         ots->matched_count = htonll(stats.n_matched);
     }
+    table_stats_dump_cache(dp->chain, buffer);
     return 0;
 }
 
@@ -1765,12 +2281,15 @@ dump_port_stats(struct datapath *dp, struct sw_port *port,
         ops->collisions   = htonll(stats.collisions);
 #endif
     } else {
-        ops->rx_packets   = htonll(port->rx_packets);
-        ops->tx_packets   = htonll(port->tx_packets);
-        ops->rx_bytes     = htonll(port->rx_bytes);
-        ops->tx_bytes     = htonll(port->tx_bytes);
+        struct dp_port_shard sum;
+
+        sum_port_shards(port, &sum);
+        ops->rx_packets   = htonll(port->rx_packets + sum.rx_packets);
+        ops->tx_packets   = htonll(port->tx_packets + sum.tx_packets);
+        ops->rx_bytes     = htonll(port->rx_bytes + sum.rx_bytes);
+        ops->tx_bytes     = htonll(port->tx_bytes + sum.tx_bytes);
         ops->rx_dropped   = htonll(-1);
-        ops->tx_dropped   = htonll(port->tx_dropped);
+        ops->tx_dropped   = htonll(port->tx_dropped + sum.tx_dropped);
         ops->rx_errors    = htonll(-1);
         ops->tx_errors    = htonll(-1);
         ops->rx_frame_err = htonll(-1);
@@ -1833,10 +2352,14 @@ static void
 dump_queue_stats(struct sw_queue *q, struct ofpbuf *buffer)
 {
     struct ofp_queue_stats *oqs = ofpbuf_put_uninit(buffer, sizeof *oqs);
+    struct dp_port_shard sum;
+    int j = q - q->port->queues;
+
+    sum_port_shards(q->port, &sum);
     oqs->port_no = htons(q->port->port_no);
     oqs->queue_id = htonl(q->queue_id);
-    oqs->tx_bytes = htonll(q->tx_bytes);
-    oqs->tx_packets = htonll(q->tx_packets);
+    oqs->tx_bytes = htonll(q->tx_bytes + sum.queue_tx_bytes[j]);
+    oqs->tx_packets = htonll(q->tx_packets + sum.queue_tx_packets[j]);
     oqs->tx_errors = htonll(q->tx_errors);
 }
 
@@ -1905,14 +2428,16 @@ queue_stats_done(void *state)
  * };
  */
 static int
-vendor_stats_init(const void *body, int body_len UNUSED,
-                  void **state UNUSED)
+vendor_stats_init(const void *body, int body_len, void **state)
 {
         /* min_body was checked, this should be safe */
         const uint32_t vendor = ntohl(*((uint32_t *)body));
         int err;
 
         switch (vendor) {
+        case OPENFLOW_VENDOR_ID:
+                err = of_ext_stats_init(body, body_len, state);
+                break;
         default:
                 err = -EINVAL;
         }
@@ -1921,13 +2446,15 @@ vendor_stats_init(const void *body, int body_len UNUSED,
 }
 
 static int
-vendor_stats_dump(struct datapath *dp UNUSED, void *state,
-                  struct ofpbuf *buffer UNUSED)
+vendor_stats_dump(struct datapath *dp, void *state, struct ofpbuf *buffer)
 {
         const uint32_t vendor = *((uint32_t *)state);
         int err;
 
         switch (vendor) {
+        case OPENFLOW_VENDOR_ID:
+                err = of_ext_stats_dump(dp, state, buffer);
+                break;
         default:
                 /* Should never happen */
                 err = 0;
@@ -1942,6 +2469,9 @@ vendor_stats_done(void *state)
         const uint32_t vendor = *((uint32_t *) state);
 
         switch (vendor) {
+        case OPENFLOW_VENDOR_ID:
+                of_ext_stats_done(state);
+                break;
         default:
                 /* Should never happen */
                 free(state);
@@ -2120,6 +2650,7 @@ recv_stats_request(struct datapath *dp UNUSED, const struct sender *sender,
     cb->done = false;
     cb->rq = xmemdup(rq, rq_len);
     cb->sender = *sender;
+    cb->sender.msgp = NULL;
     cb->s = st;
     cb->state = NULL;
 
@@ -2308,68 +2839,116 @@ fwd_control_input(struct datapath *dp, const struct sender *sender,
 
 /* Packet buffering. */
 
-#define OVERWRITE_SECS  1
+/* Sets the number of buffers in which 'dp' saves packets sent to the
+ * controller to 'n_buffers', rounded up to a power of 2 between 2 and
+ * DP_MAX_N_BUFFERS.  Discards any packets already saved. */
+void
+dp_set_n_buffers(struct datapath *dp, unsigned int n_buffers)
+{
+    buffer_store_set_n_buffers(&dp->buffers,
+                               MIN(n_buffers, DP_MAX_N_BUFFERS));
+}
+
+static struct ofpbuf *retrieve_buffer(struct datapath *dp, uint32_t id)
+{
+    struct ofpbuf *buffer = buffer_store_retrieve(&dp->buffers, id);
 
-struct packet_buffer {
-    struct ofpbuf *buffer;
-    uint32_t cookie;
-    time_t timeout;
-};
+    if (!buffer) {
+        VLOG_DBG_RL(&rl, "no packet in buffer %"PRIx32, id);
+    }
+    return buffer;
+}
 
-static struct packet_buffer buffers[N_PKT_BUFFERS];
-static unsigned int buffer_idx;
+/* Frees the saved packets that the controller has not claimed in time, and
+ * arranges to wake up when the next one is due. */
+static void
+expire_buffers(struct datapath *dp)
+{
+    long long int now = time_msec();
+    long long int next = buffer_store_expire(&dp->buffers, now);
+
+    if (next != LLONG_MAX) {
+        poll_timer_wait(next - now);
+    }
+}
+
+/* Pending misses.  See pending-miss.h. */
 
-uint32_t save_buffer(struct ofpbuf *buffer)
+/* Passes the packets held for 'pm' through the flow table, which now has a
+ * flow for them, and frees 'pm'. */
+static void
+release_pending_miss(struct datapath *dp, struct pending_miss *pm)
 {
-    struct packet_buffer *p;
-    uint32_t id;
+    struct sw_port *p = dp_lookup_port(dp, pm->in_port);
+    unsigned int i;
 
-    buffer_idx = (buffer_idx + 1) & PKT_BUFFER_MASK;
-    p = &buffers[buffer_idx];
-    if (p->buffer) {
-        /* Don't buffer packet if existing entry is less than
-         * OVERWRITE_SECS old. */
-        if (time_now() < p->timeout) { /* FIXME */
-                return (uint32_t)-1;
+    for (i = 0; i < pm->n_packets; i++) {
+        if (p) {
+            fwd_port_input(dp, pm->packets[i], p);
         } else {
-            ofpbuf_delete(p->buffer);
+            ofpbuf_delete(pm->packets[i]);
         }
     }
-    /* Don't use maximum cookie value since the all-bits-1 id is
-     * special. */
-    if (++p->cookie >= (1u << PKT_COOKIE_BITS) - 1)
-        p->cookie = 0;
-    p->buffer = ofpbuf_clone(buffer);      /* FIXME */
-    p->timeout = time_now() + OVERWRITE_SECS; /* FIXME */
-    id = buffer_idx | (p->cookie << PKT_BUFFER_BITS);
+    pending_miss_destroy(pm);
+}
+
+/* Sends the packets held for 'pm' to the controller and frees 'pm'. */
+static void
+flush_pending_miss(struct datapath *dp, struct pending_miss *pm)
+{
+    unsigned int i;
 
-    return id;
+    for (i = 0; i < pm->n_packets; i++) {
+        send_packet_in(dp, pm->packets[i], pm->in_port, pm->max_len,
+                       OFPR_NO_MATCH);
+    }
+    pending_miss_destroy(pm);
 }
 
-static struct ofpbuf *retrieve_buffer(uint32_t id)
+/* Releases the packets held for microflows that 'flow', which was just added
+ * to the flow table, matches. */
+static void
+release_pending_misses(struct datapath *dp, const struct sw_flow *flow)
 {
-    struct ofpbuf *buffer = NULL;
-    struct packet_buffer *p;
+    struct pending_miss *pm, *next;
+    struct list taken;
 
-    p = &buffers[id & PKT_BUFFER_MASK];
-    if (p->cookie == id >> PKT_BUFFER_BITS) {
-        buffer = p->buffer;
-        p->buffer = NULL;
-    } else {
-        printf("cookie mismatch: %x != %x\n",
-               id >> PKT_BUFFER_BITS, p->cookie);
+    list_init(&taken);
+    pending_misses_take_matches(&dp->pending_misses, &flow->key, &taken);
+    LIST_FOR_EACH_SAFE (pm, next, struct pending_miss, list_node, &taken) {
+        release_pending_miss(dp, pm);
     }
+}
 
-    return buffer;
+/* Called when the controller sends a packet_out for the packet in
+ * 'buffer_id'.  If that packet was the first of a microflow whose later
+ * packets are being held back, the controller is not going to set up a flow
+ * for it, so sends them up too. */
+static void
+answer_pending_miss(struct datapath *dp, uint32_t buffer_id)
+{
+    struct pending_miss *pm;
+
+    pm = pending_misses_take_by_id(&dp->pending_misses, buffer_id);
+    if (pm) {
+        flush_pending_miss(dp, pm);
+    }
 }
 
-static void discard_buffer(uint32_t id)
+/* Sends up the packets held for microflows that the controller has not
+ * answered in time, and arranges to wake up when the next one is due. */
+static void
+expire_pending_misses(struct datapath *dp)
 {
-    struct packet_buffer *p;
+    long long int now = time_msec();
+    struct pending_miss *pm;
+    long long int next;
 
-    p = &buffers[id & PKT_BUFFER_MASK];
-    if (p->cookie == id >> PKT_BUFFER_BITS) {
-        ofpbuf_delete(p->buffer);
-        p->buffer = NULL;
+    while ((pm = pending_misses_take_expired(&dp->pending_misses, now,
+                                             &next)) != NULL) {
+        flush_pending_miss(dp, pm);
+    }
+    if (next != LLONG_MAX) {
+        poll_timer_wait(next - now);
     }
 }
@@ -36,26 +36,36 @@
 #ifndef DATAPATH_H
 #define DATAPATH_H 1
 
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include "openflow/nicira-ext.h"
+#include "buffer-store.h"
+#include "counter.h"
+#include "hmap.h"
 #include "ofpbuf.h"
 #include "timeval.h"
 #include "list.h"
 #include "netdev.h"
+#include "pending-miss.h"
 
 /* FIXME:  Can declare struct of_hw_driver instead */
 #if defined(OF_HW_PLAT)
 #include <openflow/of_hw_api.h>
 #endif
 
+struct chain_cache;
 struct rconn;
 struct pvconn;
 struct sw_flow;
 struct sender;
+struct packet_buffer;
+struct sw_queue_map;
 
 struct sw_queue {
     struct list node; /* element in port.queues */
+    /* Offsets for the counters in the threads' dp_port_shards, see
+     * sw_port. */
     unsigned long long int tx_packets;
     unsigned long long int tx_bytes;
     unsigned long long int tx_errors;
@@ -80,6 +90,10 @@ enum sw_port_flags {
 
 #define PORT_IN_USE(p) (((p) != NULL) && (p)->flags & SWP_USED)
 
+/* Maximum number of packets queued for transmission on a port before they are
+ * sent. */
+#define DP_TX_BATCH 32
+
 struct sw_port {
     uint32_t config;            /* Some subset of OFPPC_* flags. */
     uint32_t state;             /* Some subset of OFPPS_* flags. */
@@ -88,6 +102,10 @@ struct sw_port {
     struct netdev *netdev;
     char hw_name[OFP_MAX_PORT_NAME_LEN];
     struct list node; /* Element in datapath.ports. */
+    /* Counters.  Threads count packets in their own dp_port_shards, and
+     * these members are added to the sum of the shards.  They start out as
+     * the negated sums, because the shards may still hold counts for an
+     * earlier port with the same number. */
     unsigned long long int rx_packets, tx_packets;
     unsigned long long int rx_bytes, tx_bytes;
     unsigned long long int tx_dropped;
@@ -96,6 +114,8 @@ struct sw_port {
     uint16_t num_queues;
     struct sw_queue queues[NETDEV_MAX_QUEUES];
     struct list queue_list; /* list of all queues for this port */
+    struct sw_queue_map *queue_map; /* For forwarding threads, see
+                                     * sw-queue.h. */
 };
 
 #if defined(OF_HW_PLAT)
@@ -110,6 +130,84 @@ struct hw_pkt_q_entry {
 #define DP_MAX_PORTS 255
 BUILD_ASSERT_DECL(DP_MAX_PORTS <= OFPP_MAX);
 
+/* Headroom in packet buffers, to add headers in forwarding to the controller
+ * or adding a vlan tag, plus an extra 2 bytes to allow IP headers to be
+ * aligned on a 4-byte boundary. */
+#define DP_HEADROOM (128 + 2)
+
+/* Maximum number of packet buffers kept in a datapath's pool. */
+#define DP_POOL_MAX_BUFFERS 4096
+
+/* Maximum number of packets received from one port at a time. */
+#define DP_RX_BATCH 32
+BUILD_ASSERT_DECL(DP_RX_BATCH <= NETDEV_MAX_BATCH);
+
+/* Packets waiting to be sent on a port by one thread, all to the same
+ * queue. */
+struct dp_tx_batch {
+    struct sw_port *port;
+    struct ofpbuf *bufs[DP_TX_BATCH];
+    uint16_t class_id;          /* netdev class_id for 'bufs', 0 if none. */
+    int n;                      /* Number of packets in 'bufs'. */
+    struct list node;           /* In dp_thread.tx_batches, if 'n' > 0. */
+};
+
+/* Counters for a port kept by one thread.  See counter.h. */
+struct dp_port_shard {
+    unsigned long long int rx_packets, tx_packets;
+    unsigned long long int rx_bytes, tx_bytes;
+    unsigned long long int tx_dropped;
+    unsigned long long int queue_tx_packets[NETDEV_MAX_QUEUES];
+    unsigned long long int queue_tx_bytes[NETDEV_MAX_QUEUES];
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+/* Forwarding state private to one thread.  The main thread has one, for the
+ * packets that it forwards itself, and so does each forwarding thread started
+ * by dp_start_threads(). */
+struct dp_thread {
+    struct datapath *dp;
+    pthread_t thread;
+    int idx;                    /* Index in datapath's 'threads', and of the
+                                 * thread's shard of flow statistics
+                                 * (forwarding threads only). */
+
+    /* Ports that this thread receives packets on (forwarding threads only). */
+    struct sw_port **ports;
+    size_t n_ports;
+
+    /* Time at the start of the current pass over 'ports', in ms.  Forwarding
+     * threads use this instead of time_msec(), which is not thread-safe. */
+    long long int now;
+
+    struct chain_cache *cache;  /* For looking up flows in the chain. */
+    struct ofpbuf_pool pool;    /* Packet buffers. */
+
+    /* Empty buffers for receiving packets, kept across passes. */
+    struct ofpbuf *rx_bufs[DP_RX_BATCH];
+
+    /* Packets waiting to be sent.  'tx' is indexed by port number, except
+     * that the OFPP_LOCAL port uses index DP_MAX_PORTS.  'tx_batches' lists
+     * the members of 'tx' with packets in them. */
+    struct dp_tx_batch *tx;
+    struct list tx_batches;
+
+    /* Counters for the packets that this thread receives and sends, indexed
+     * like 'tx'. */
+    struct dp_port_shard *port_stats;
+};
+
+/* Maximum number of forwarding threads. */
+#define DP_MAX_THREADS 64
+
+/* Maximum number of packets that forwarding threads may queue for the main
+ * thread to send to the controller.  Beyond this, they are dropped. */
+#define DP_MAX_PACKET_IN_QUEUE 1024
+
+/* Default and maximum number of packets saved for the controller to refer to
+ * by buffer ID.  See dp_set_n_buffers(). */
+#define DP_DEFAULT_N_BUFFERS 256
+#define DP_MAX_N_BUFFERS (1u << 20)
+
 struct datapath {
     /* Remote connections. */
     struct list remotes;        /* All connections (including controller). */
@@ -118,8 +216,6 @@ struct datapath {
     struct pvconn **listeners;
     size_t n_listeners;
 
-    time_t last_timeout;
-
     /* Unique identifier for this datapath */
     uint64_t  id;
     char dp_desc[DESC_STR_LEN];	/* human readible comment to ID this DP */
@@ -135,6 +231,28 @@ struct datapath {
     struct sw_port *local_port;  /* OFPP_LOCAL port, if any. */
     struct list port_list; /* All ports, including local_port. */
 
+    /* Forwarding.  The main thread receives on all of the ports, unless
+     * forwarding threads have been started. */
+    struct dp_thread *main_thread;
+    struct dp_thread **threads;
+    int n_threads;
+
+    /* Packets sent to the controller by forwarding threads, since only the
+     * main thread may talk to remotes.  A byte written to 'wakeup_pipe' wakes
+     * up the main thread when the queue becomes nonempty. */
+    pthread_mutex_t packet_in_mutex;
+    struct list packet_in_queue;
+    int n_packet_in_queued;
+    unsigned long long n_packet_in_dropped;
+    int wakeup_pipe[2];
+
+    /* Packets sent to the controller that it may refer to by buffer ID. */
+    struct buffer_store buffers;
+
+    /* Microflows that missed in the flow table and were recently sent to the
+     * controller, whose later packets are held back.  Main thread only. */
+    struct pending_misses pending_misses;
+
 #if defined(OF_HW_PLAT)
     /* Although the chain maintains the pointer to the HW driver
      * for flow operations, the datapath needs the port functions
@@ -149,6 +267,9 @@ int dp_new(struct datapath **, uint64_t dpid);
 int dp_add_port(struct datapath *, const char *netdev, uint16_t);
 int dp_add_local_port(struct datapath *, const char *netdev, uint16_t);
 void dp_add_pvconn(struct datapath *, struct pvconn *);
+int dp_start_threads(struct datapath *, int n_threads);
+void dp_set_n_buffers(struct datapath *, unsigned int n_buffers);
+void dp_reset_queue_stats(struct sw_queue *);
 void dp_run(struct datapath *);
 void dp_wait(struct datapath *);
 void dp_send_error_msg(struct datapath *, const struct sender *,
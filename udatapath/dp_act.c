@@ -34,10 +34,14 @@
 /* Functions for executing OpenFlow actions. */
 
 #include <arpa/inet.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 #include "csum.h"
 #include "packets.h"
 #include "dp_act.h"
 #include "openflow/nicira-ext.h"
+#include "util.h"
 
 static uint16_t
 validate_output(struct datapath *dp UNUSED, const struct sw_flow_key *key, 
@@ -137,128 +141,81 @@ vlan_pull_tag(struct ofpbuf *buffer)
 }
 
 static void
-set_vlan_vid(struct ofpbuf *buffer, struct sw_flow_key *key, 
-        const struct ofp_action_header *ah)
-{
-    struct ofp_action_vlan_vid *va = (struct ofp_action_vlan_vid *)ah;
-    uint16_t tci = ntohs(va->vlan_vid);
-
-    modify_vlan_tci(buffer, key, tci, VLAN_VID_MASK);
-}
-
-static void
-set_vlan_pcp(struct ofpbuf *buffer, struct sw_flow_key *key, 
-        const struct ofp_action_header *ah)
-{
-    struct ofp_action_vlan_pcp *va = (struct ofp_action_vlan_pcp *)ah;
-    uint16_t tci = (uint16_t)va->vlan_pcp << 13;
-
-    modify_vlan_tci(buffer, key, tci, VLAN_PCP_MASK);
-}
-
-static void
-strip_vlan(struct ofpbuf *buffer, struct sw_flow_key *key, 
-        const struct ofp_action_header *ah UNUSED)
+strip_vlan(struct ofpbuf *buffer, struct sw_flow_key *key)
 {
     vlan_pull_tag(buffer);
     key->flow.dl_vlan = htons(OFP_VLAN_NONE);
 }
 
 static void
-set_dl_addr(struct ofpbuf *buffer, struct sw_flow_key *key UNUSED, 
-        const struct ofp_action_header *ah)
+set_dl_addr(struct ofpbuf *buffer, const struct act_op *op)
 {
-    struct ofp_action_dl_addr *da = (struct ofp_action_dl_addr *)ah;
-    struct eth_header *eh = buffer->l2;
-
-    if (da->type == htons(OFPAT_SET_DL_SRC)) {
-        memcpy(eh->eth_src, da->dl_addr, sizeof eh->eth_src);
-    } else {
-        memcpy(eh->eth_dst, da->dl_addr, sizeof eh->eth_dst);
-    }
+    memcpy((uint8_t *) buffer->l2 + op->ofs, op->u.dl_addr, ETH_ADDR_LEN);
 }
 
 static void
-set_nw_addr(struct ofpbuf *buffer, struct sw_flow_key *key, 
-        const struct ofp_action_header *ah)
+set_nw_addr(struct ofpbuf *buffer, uint8_t l4, const struct act_op *op)
 {
-    struct ofp_action_nw_addr *na = (struct ofp_action_nw_addr *)ah;
-    uint16_t eth_proto = ntohs(key->flow.dl_type);
-
-    if (eth_proto == ETH_TYPE_IP) {
-        struct ip_header *nh = buffer->l3;
-        uint8_t nw_proto = key->flow.nw_proto;
-        uint32_t new, *field;
-
-        new = na->nw_addr;
-        field = na->type == htons(OFPAT_SET_NW_SRC) ? &nh->ip_src : &nh->ip_dst;
-        if (nw_proto == IP_TYPE_TCP) {
-            struct tcp_header *th = buffer->l4;
-            th->tcp_csum = recalc_csum32(th->tcp_csum, *field, new);
-        } else if (nw_proto == IP_TYPE_UDP) {
-            struct udp_header *th = buffer->l4;
-            if (th->udp_csum) {
-                th->udp_csum = recalc_csum32(th->udp_csum, *field, new);
-                if (!th->udp_csum) {
-                    th->udp_csum = 0xffff;
-                }
+    struct ip_header *nh = buffer->l3;
+    uint32_t new = op->u.nw_addr;
+    uint32_t *field = (uint32_t *) ((uint8_t *) nh + op->ofs);
+
+    if (l4 == ACT_L4_TCP) {
+        struct tcp_header *th = buffer->l4;
+        th->tcp_csum = recalc_csum32(th->tcp_csum, *field, new);
+    } else if (l4 == ACT_L4_UDP) {
+        struct udp_header *th = buffer->l4;
+        if (th->udp_csum) {
+            th->udp_csum = recalc_csum32(th->udp_csum, *field, new);
+            if (!th->udp_csum) {
+                th->udp_csum = 0xffff;
             }
         }
-        nh->ip_csum = recalc_csum32(nh->ip_csum, *field, new);
-        *field = new;
     }
+    nh->ip_csum = recalc_csum32(nh->ip_csum, *field, new);
+    *field = new;
 }
 
 static void
-set_nw_tos(struct ofpbuf *buffer, struct sw_flow_key *key, 
-           const struct ofp_action_header *ah)
+set_nw_tos(struct ofpbuf *buffer, const struct act_op *op)
 {
-    struct ofp_action_nw_tos *nt = (struct ofp_action_nw_tos *)ah;
-    uint16_t eth_proto = ntohs(key->flow.dl_type);
+    struct ip_header *nh = buffer->l3;
+    uint8_t new, *field;
 
-   if (eth_proto == ETH_TYPE_IP) {
-       struct ip_header *nh = buffer->l3;
-       uint8_t new, *field;
+    /* JeanII : Set only 6 bits, don't clobber ECN */
+    new = (op->u.nw_tos & 0xFC) | (nh->ip_tos & 0x03);
 
-       /* JeanII : Set only 6 bits, don't clobber ECN */
-       new = (nt->nw_tos & 0xFC) | (nh->ip_tos & 0x03);
+    /* Get address of field */
+    field = &nh->ip_tos;
 
-       /* Get address of field */
-       field = &nh->ip_tos;
+    /* jklee : ip tos field is not included in TCP pseudo header.
+     * Need magic as update_csum() don't work with 8 bits. */
+    nh->ip_csum = recalc_csum32(nh->ip_csum, htons((uint16_t)*field),
+                                htons((uint16_t)new));
 
-        /* jklee : ip tos field is not included in TCP pseudo header.
-         * Need magic as update_csum() don't work with 8 bits. */
-       nh->ip_csum = recalc_csum32(nh->ip_csum, htons((uint16_t)*field),
-                                   htons((uint16_t)new));
-
-       /* Change the IP ToS bits */
-       *field = new;
-    }
+    /* Change the IP ToS bits */
+    *field = new;
 }
 
 static void
-set_tp_port(struct ofpbuf *buffer, struct sw_flow_key *key, 
-        const struct ofp_action_header *ah)
+set_tp_port(struct ofpbuf *buffer, uint8_t l4, const struct act_op *op)
 {
-    struct ofp_action_tp_port *ta = (struct ofp_action_tp_port *)ah;
-    uint16_t eth_proto = ntohs(key->flow.dl_type);
-
-    if (eth_proto == ETH_TYPE_IP) {
-        uint8_t nw_proto = key->flow.nw_proto;
-        uint16_t new, *field;
-
-        new = ta->tp_port;
-        if (nw_proto == IP_TYPE_TCP) {
-            struct tcp_header *th = buffer->l4;
-            field = ta->type == htons(OFPAT_SET_TP_SRC) ? &th->tcp_src : &th->tcp_dst;
-            th->tcp_csum = recalc_csum16(th->tcp_csum, *field, new);
-            *field = new;
-        } else if (nw_proto == IP_TYPE_UDP) {
-            struct udp_header *th = buffer->l4;
-            field = ta->type == htons(OFPAT_SET_TP_SRC) ? &th->udp_src : &th->udp_dst;
+    uint16_t new = op->u.tp_port;
+    uint16_t *field = (uint16_t *) ((uint8_t *) buffer->l4 + op->ofs);
+
+    if (l4 == ACT_L4_TCP) {
+        struct tcp_header *th = buffer->l4;
+        th->tcp_csum = recalc_csum16(th->tcp_csum, *field, new);
+        *field = new;
+    } else if (l4 == ACT_L4_UDP) {
+        struct udp_header *th = buffer->l4;
+        if (th->udp_csum) {
             th->udp_csum = recalc_csum16(th->udp_csum, *field, new);
-            *field = new;
+            if (!th->udp_csum) {
+                th->udp_csum = 0xffff;
+            }
         }
+        *field = new;
     }
 }
 
@@ -268,83 +225,68 @@ struct openflow_action {
     uint16_t (*validate)(struct datapath *dp, 
             const struct sw_flow_key *key,
             const struct ofp_action_header *ah);
-    void (*execute)(struct ofpbuf *buffer,
-            struct sw_flow_key *key, 
-            const struct ofp_action_header *ah);
 };
 
 static const struct openflow_action of_actions[] = {
     [OFPAT_OUTPUT] = {
         sizeof(struct ofp_action_output),
         sizeof(struct ofp_action_output),
-        validate_output,
-        NULL                   /* This is optimized into execute_actions */
+        validate_output
     },
     [OFPAT_ENQUEUE] = {
         sizeof(struct ofp_action_enqueue),
         sizeof(struct ofp_action_enqueue),
-        validate_queue,
-        NULL         /* This is optimized into execute_actions */
+        validate_queue
     },
     [OFPAT_SET_VLAN_VID] = {
         sizeof(struct ofp_action_vlan_vid),
         sizeof(struct ofp_action_vlan_vid),
-        NULL,
-        set_vlan_vid
+        NULL
     },
     [OFPAT_SET_VLAN_PCP] = {
         sizeof(struct ofp_action_vlan_pcp),
         sizeof(struct ofp_action_vlan_pcp),
-        NULL,
-        set_vlan_pcp
+        NULL
     },
     [OFPAT_STRIP_VLAN] = {
         sizeof(struct ofp_action_header),
         sizeof(struct ofp_action_header),
-        NULL,
-        strip_vlan
+        NULL
     },
     [OFPAT_SET_DL_SRC] = {
         sizeof(struct ofp_action_dl_addr),
         sizeof(struct ofp_action_dl_addr),
-        NULL,
-        set_dl_addr
+        NULL
     },
     [OFPAT_SET_DL_DST] = {
         sizeof(struct ofp_action_dl_addr),
         sizeof(struct ofp_action_dl_addr),
-        NULL,
-        set_dl_addr
+        NULL
     },
     [OFPAT_SET_NW_SRC] = {
         sizeof(struct ofp_action_nw_addr),
         sizeof(struct ofp_action_nw_addr),
-        NULL,
-        set_nw_addr
+        NULL
     },
     [OFPAT_SET_NW_DST] = {
         sizeof(struct ofp_action_nw_addr),
         sizeof(struct ofp_action_nw_addr),
-        NULL,
-        set_nw_addr
+        NULL
     },
     [OFPAT_SET_NW_TOS] = {
         sizeof(struct ofp_action_nw_tos),
         sizeof(struct ofp_action_nw_tos),
-        NULL,
-        set_nw_tos
+        NULL
     },
     [OFPAT_SET_TP_SRC] = {
         sizeof(struct ofp_action_tp_port),
         sizeof(struct ofp_action_tp_port),
-        NULL,
-        set_tp_port
+        NULL
     },
     [OFPAT_SET_TP_DST] = {
         sizeof(struct ofp_action_tp_port),
         sizeof(struct ofp_action_tp_port),
-        NULL,
-        set_tp_port
+        NULL
     }
     /* OFPAT_VENDOR is not here, since it would blow up the array size. */
 };
@@ -440,92 +382,233 @@ validate_actions(struct datapath *dp, const struct sw_flow_key *key,
     return ACT_VALIDATION_OK;
 }
 
-/* Execute a built-in OpenFlow action against 'buffer'. */
-static void
-execute_ofpat(struct ofpbuf *buffer, struct sw_flow_key *key, 
-        const struct ofp_action_header *ah, uint16_t type)
+/* Returns the ACT_L4_* value for IP protocol 'nw_proto'. */
+static uint8_t
+l4_type(uint8_t nw_proto)
 {
-    const struct openflow_action *act = &of_actions[type];
-
-    if (act->execute) {
-        act->execute(buffer, key, ah);
-    }
+    return (nw_proto == IP_TYPE_TCP ? ACT_L4_TCP
+            : nw_proto == IP_TYPE_UDP ? ACT_L4_UDP
+            : ACT_L4_NONE);
 }
 
-/* Execute a vendor-defined action against 'buffer'. */
-static void
-execute_vendor(struct ofpbuf *buffer UNUSED, const struct sw_flow_key *key UNUSED, 
-        const struct ofp_action_header *ah)
+/* Compiles the 'actions_len' bytes of validated OpenFlow actions in 'actions'
+ * into 'ops', which must have room for ACT_MAX_OPS(actions_len) elements, and
+ * returns the number of ops.
+ *
+ * 'match' is the match of the flow that the actions belong to.  Fields that
+ * it does not wildcard are the same in every packet the actions will see, so
+ * the header-rewriting actions that depend on them are specialized here:
+ * actions that cannot apply to such packets are left out, and the L4
+ * checksum to update is chosen once.  Otherwise the choice is left to the
+ * executor.
+ *
+ * Output ports and queues are left as numbers, because the executor's lookups
+ * are already cheap: dp_lookup_port() indexes the datapath's port array, and
+ * sw_queue_lookup_class() searches the port's few queues, which forwarding
+ * threads read without locking.  Resolving them here would mean recompiling
+ * every flow that uses a queue whenever one is added or deleted. */
+size_t
+compile_actions(const struct sw_flow_key *match,
+                const struct ofp_action_header *actions, size_t actions_len,
+                struct act_op ops[])
 {
-    struct ofp_action_vendor_header *avh 
-            = (struct ofp_action_vendor_header *)ah;
+    bool dl_type_known = !(match->wildcards & OFPFW_DL_TYPE);
+    bool is_ip = match->flow.dl_type == htons(ETH_TYPE_IP);
+    bool nw_proto_known = dl_type_known && is_ip
+                          && !(match->wildcards & OFPFW_NW_PROTO);
+    uint8_t l4 = nw_proto_known ? l4_type(match->flow.nw_proto) : ACT_L4_KEY;
+    const uint8_t *p = (const uint8_t *) actions;
+    size_t n_ops = 0;
 
-    switch(ntohl(avh->vendor)) {
-    default:
-        /* This should not be possible due to prior validation. */
-        printf("attempt to execute action with unknown vendor: %#x\n", 
-                ntohl(avh->vendor));
-        break;
+    while (actions_len > 0) {
+        const struct ofp_action_header *ah = (const void *) p;
+        size_t len = ntohs(ah->len);
+        uint16_t type = ntohs(ah->type);
+        struct act_op *op = &ops[n_ops];
+
+        p += len;
+        actions_len -= len;
+
+        memset(op, 0, sizeof *op);
+        op->type = type;
+        switch (type) {
+        case OFPAT_OUTPUT: {
+            const struct ofp_action_output *oa = (const void *) ah;
+            op->u.output.port = ntohs(oa->port);
+            op->u.output.max_len = ntohs(oa->max_len);
+            break;
+        }
+
+        case OFPAT_ENQUEUE: {
+            const struct ofp_action_enqueue *ea = (const void *) ah;
+            op->type = OFPAT_OUTPUT;
+            op->u.output.port = ntohs(ea->port);
+            op->u.output.queue_id = ntohl(ea->queue_id);
+            break;
+        }
+
+        case OFPAT_SET_VLAN_VID: {
+            const struct ofp_action_vlan_vid *va = (const void *) ah;
+            op->u.vlan.tci = ntohs(va->vlan_vid);
+            op->u.vlan.mask = VLAN_VID_MASK;
+            break;
+        }
+
+        case OFPAT_SET_VLAN_PCP: {
+            const struct ofp_action_vlan_pcp *va = (const void *) ah;
+            op->type = OFPAT_SET_VLAN_VID;
+            op->u.vlan.tci = (uint16_t) va->vlan_pcp << 13;
+            op->u.vlan.mask = VLAN_PCP_MASK;
+            break;
+        }
+
+        case OFPAT_STRIP_VLAN:
+            break;
+
+        case OFPAT_SET_DL_SRC:
+        case OFPAT_SET_DL_DST: {
+            const struct ofp_action_dl_addr *da = (const void *) ah;
+            op->type = OFPAT_SET_DL_SRC;
+            op->ofs = (type == OFPAT_SET_DL_SRC
+                       ? offsetof(struct eth_header, eth_src)
+                       : offsetof(struct eth_header, eth_dst));
+            memcpy(op->u.dl_addr, da->dl_addr, ETH_ADDR_LEN);
+            break;
+        }
+
+        case OFPAT_SET_NW_SRC:
+        case OFPAT_SET_NW_DST:
+        case OFPAT_SET_NW_TOS:
+        case OFPAT_SET_TP_SRC:
+        case OFPAT_SET_TP_DST:
+            if (dl_type_known && !is_ip) {
+                continue;
+            }
+            op->check_ip = !dl_type_known;
+            op->l4 = l4;
+            if (type == OFPAT_SET_NW_SRC || type == OFPAT_SET_NW_DST) {
+                const struct ofp_action_nw_addr *na = (const void *) ah;
+                op->type = OFPAT_SET_NW_SRC;
+                op->ofs = (type == OFPAT_SET_NW_SRC
+                           ? offsetof(struct ip_header, ip_src)
+                           : offsetof(struct ip_header, ip_dst));
+                op->u.nw_addr = na->nw_addr;
+            } else if (type == OFPAT_SET_NW_TOS) {
+                const struct ofp_action_nw_tos *nt = (const void *) ah;
+                op->u.nw_tos = nt->nw_tos;
+            } else {
+                const struct ofp_action_tp_port *ta = (const void *) ah;
+                if (l4 == ACT_L4_NONE) {
+                    continue;
+                }
+                /* Same offsets in TCP and UDP headers. */
+                op->type = OFPAT_SET_TP_SRC;
+                op->ofs = (type == OFPAT_SET_TP_SRC
+                           ? offsetof(struct tcp_header, tcp_src)
+                           : offsetof(struct tcp_header, tcp_dst));
+                op->u.tp_port = ta->tp_port;
+            }
+            break;
+
+        default:
+            /* No vendor actions are supported, so validation rejects them. */
+            continue;
+        }
+        n_ops++;
     }
+    return n_ops;
 }
 
-/* Execute a list of actions against 'buffer'. */
-void execute_actions(struct datapath *dp, struct ofpbuf *buffer,
-             struct sw_flow_key *key,
-             const struct ofp_action_header *actions, size_t actions_len,
-             int ignore_no_fwd)
+/* Executes the 'n_ops' compiled actions in 'ops' against 'buffer', whose flow
+ * is 'key'.  Takes ownership of 'buffer'. */
+void
+execute_compiled_actions(struct datapath *dp, struct ofpbuf *buffer,
+                         struct sw_flow_key *key,
+                         const struct act_op ops[], size_t n_ops,
+                         int ignore_no_fwd)
 {
-    /* Every output action needs a separate clone of 'buffer', but the common
-     * case is just a single output action, so that doing a clone and then
+    /* Every output action needs a separate reference to 'buffer', but the
+     * common case is just a single output action, so that sharing it and then
      * freeing the original buffer is wasteful.  So the following code is
-     * slightly obscure just to avoid that. */
-    int prev_port;
-    uint32_t prev_queue;
-    size_t max_len = UINT16_MAX;
+     * slightly obscure just to avoid that.  Actions that modify the packet
+     * copy it first if an earlier output still refers to it. */
+    const struct act_op *out = NULL;
     uint16_t in_port = ntohs(key->flow.in_port);
-    uint8_t *p = (uint8_t *)actions;
+    size_t i;
 
-    prev_port = -1;
-    prev_queue = 0;
+    for (i = 0; i < n_ops; i++) {
+        const struct act_op *op = &ops[i];
+        uint8_t l4;
 
-    /* The action list was already validated, so we can be a bit looser
-     * in our sanity-checking. */
-    while (actions_len > 0) {
-        struct ofp_action_header *ah = (struct ofp_action_header *)p;
-        size_t len = htons(ah->len);
-
-        if (prev_port != -1) {
-            do_output(dp, ofpbuf_clone(buffer), in_port, max_len,
-                      prev_port, prev_queue, ignore_no_fwd);
-            prev_port = -1;
+        if (out) {
+            do_output(dp, ofpbuf_share(buffer), in_port,
+                      out->u.output.max_len, out->u.output.port,
+                      out->u.output.queue_id, ignore_no_fwd);
+            out = NULL;
         }
 
-        if (ah->type == htons(OFPAT_OUTPUT)) {
-            struct ofp_action_output *oa = (struct ofp_action_output *)p;
-            prev_port = ntohs(oa->port);
-            prev_queue = 0; /* using the default best-effort queue */
-            max_len = ntohs(oa->max_len);
-        } else if (ah->type == htons(OFPAT_ENQUEUE)) {
-            struct ofp_action_enqueue *ea = (struct ofp_action_enqueue *)p;
-            prev_port = ntohs(ea->port);
-            prev_queue = ntohl(ea->queue_id);
-            max_len = 0; /* we will not send to the controller anyways - useless */
-        } else {
-            uint16_t type = ntohs(ah->type);
-
-            if (type < ARRAY_SIZE(of_actions)) {
-                execute_ofpat(buffer, key, ah, type);
-            } else if (type == OFPAT_VENDOR) {
-                execute_vendor(buffer, key, ah);
-            }
+        if (op->type == OFPAT_OUTPUT) {
+            out = op;
+            continue;
         }
 
-        p += len;
-        actions_len -= len;
+        if (op->check_ip && key->flow.dl_type != htons(ETH_TYPE_IP)) {
+            continue;
+        }
+        l4 = op->l4 == ACT_L4_KEY ? l4_type(key->flow.nw_proto) : op->l4;
+
+        ofpbuf_make_writable(buffer);
+        switch (op->type) {
+        case OFPAT_SET_VLAN_VID:
+            modify_vlan_tci(buffer, key, op->u.vlan.tci, op->u.vlan.mask);
+            break;
+        case OFPAT_STRIP_VLAN:
+            strip_vlan(buffer, key);
+            break;
+        case OFPAT_SET_DL_SRC:
+            set_dl_addr(buffer, op);
+            break;
+        case OFPAT_SET_NW_SRC:
+            set_nw_addr(buffer, l4, op);
+            break;
+        case OFPAT_SET_NW_TOS:
+            set_nw_tos(buffer, op);
+            break;
+        case OFPAT_SET_TP_SRC:
+            set_tp_port(buffer, l4, op);
+            break;
+        }
     }
-    if (prev_port != -1) {
-        do_output(dp, buffer, in_port, max_len, prev_port, prev_queue, ignore_no_fwd);
+    if (out) {
+        do_output(dp, buffer, in_port, out->u.output.max_len,
+                  out->u.output.port, out->u.output.queue_id, ignore_no_fwd);
     } else {
         ofpbuf_delete(buffer);
     }
 }
+
+/* Execute a list of actions against 'buffer', whose flow is 'key'.  This
+ * compiles the actions each time, so it is meant for actions that are used
+ * only once, e.g. those in a packet_out. */
+void execute_actions(struct datapath *dp, struct ofpbuf *buffer,
+             struct sw_flow_key *key,
+             const struct ofp_action_header *actions, size_t actions_len,
+             int ignore_no_fwd)
+{
+    struct act_op stub[16];
+    struct act_op *ops;
+    struct sw_flow_key exact;
+    size_t n_ops;
+
+    /* 'key' was extracted from this very packet, so nothing is wild. */
+    exact.flow = key->flow;
+    exact.wildcards = 0;
+
+    ops = (ACT_MAX_OPS(actions_len) <= ARRAY_SIZE(stub) ? stub
+           : xmalloc(ACT_MAX_OPS(actions_len) * sizeof *ops));
+    n_ops = compile_actions(&exact, actions, actions_len, ops);
+    execute_compiled_actions(dp, buffer, key, ops, n_ops, ignore_no_fwd);
+    if (ops != stub) {
+        free(ops);
+    }
+}
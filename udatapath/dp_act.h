@@ -37,11 +37,58 @@
 #include "openflow/openflow.h"
 #include "switch-flow.h"
 #include "datapath.h"
+#include "packets.h"
 
 #define ACT_VALIDATION_OK ((uint16_t)-1)
 
+/* Which L4 checksum a header-rewriting act_op updates. */
+enum {
+    ACT_L4_NONE,                /* None. */
+    ACT_L4_TCP,                 /* TCP. */
+    ACT_L4_UDP,                 /* UDP. */
+    ACT_L4_KEY                  /* Depends on the packet's nw_proto. */
+};
+
+/* An OpenFlow action compiled by compile_actions(), with its operands in the
+ * form that the executor uses them in.  Several OpenFlow action types map to
+ * one 'type': OFPAT_ENQUEUE to OFPAT_OUTPUT, OFPAT_SET_VLAN_PCP to
+ * OFPAT_SET_VLAN_VID, and the destination variants of the address and port
+ * setters to their source variants with a different 'ofs'. */
+struct act_op {
+    uint16_t type;              /* OFPAT_*. */
+    uint8_t check_ip;           /* Skip unless the packet is IP? */
+    uint8_t l4;                 /* ACT_L4_*. */
+    uint8_t ofs;                /* Offset of the field to set in its header. */
+    union {
+        struct {
+            uint16_t port;      /* OFPP_* or port number. */
+            uint16_t max_len;   /* Bytes to send to the controller. */
+            uint32_t queue_id;  /* Queue, or 0 for best-effort. */
+        } output;
+        struct {
+            uint16_t tci;       /* New TCI bits. */
+            uint16_t mask;      /* TCI bits to set. */
+        } vlan;
+        uint8_t dl_addr[ETH_ADDR_LEN];
+        uint32_t nw_addr;       /* Network byte order. */
+        uint8_t nw_tos;
+        uint16_t tp_port;       /* Network byte order. */
+    } u;
+};
+
+/* Maximum number of ops that compile_actions() produces from 'ACTIONS_LEN'
+ * bytes of actions. */
+#define ACT_MAX_OPS(ACTIONS_LEN) \
+    ((ACTIONS_LEN) / sizeof(struct ofp_action_header))
+
 uint16_t validate_actions(struct datapath *, const struct sw_flow_key *,
 		const struct ofp_action_header *, size_t);
+size_t compile_actions(const struct sw_flow_key *match,
+                       const struct ofp_action_header *, size_t actions_len,
+                       struct act_op ops[]);
+void execute_compiled_actions(struct datapath *, struct ofpbuf *,
+                              struct sw_flow_key *, const struct act_op[],
+                              size_t n_ops, int ignore_no_fwd);
 void execute_actions(struct datapath *, struct ofpbuf *,
 		struct sw_flow_key *, const struct ofp_action_header *, 
 		size_t action_len, int ignore_no_fwd);
@@ -0,0 +1,231 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#include <config.h>
+#include "epoch.h"
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include "list.h"
+#include "util.h"
+
+/* A thread that reads data protected by epochs. */
+struct epoch_reader {
+    struct list node;           /* In 'readers'. */
+    unsigned long epoch;        /* Epoch when the reader entered its current
+                                 * critical section, or 0 if outside one. */
+};
+
+/* An object waiting to be freed. */
+struct epoch_callback {
+    struct list node;           /* In 'pending'. */
+    unsigned long epoch;        /* Epoch in which the object was retired. */
+    void (*function)(void *);
+    void *aux;
+};
+
+/* 'mutex' protects everything below.  Readers load 'global_epoch' without it,
+ * but only the holder of 'mutex' changes it. */
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long global_epoch = 1;
+static struct list readers = LIST_INITIALIZER(&readers);
+static struct list pending = LIST_INITIALIZER(&pending); /* Oldest first. */
+static unsigned long long n_pending;
+static unsigned long long n_reclaimed;
+
+static __thread struct epoch_reader *self;
+
+/* Registers the calling thread as one that will call epoch_enter() and
+ * epoch_exit().  The writer need not register, because it never frees
+ * anything while it is reading. */
+void
+epoch_register(void)
+{
+    struct epoch_reader *r;
+
+    assert(!self);
+    r = xmalloc(sizeof *r);
+    r->epoch = 0;
+
+    pthread_mutex_lock(&mutex);
+    list_push_back(&readers, &r->node);
+    pthread_mutex_unlock(&mutex);
+
+    self = r;
+}
+
+/* Unregisters the calling thread, which must be outside a critical
+ * section. */
+void
+epoch_unregister(void)
+{
+    assert(self && !self->epoch);
+
+    pthread_mutex_lock(&mutex);
+    list_remove(&self->node);
+    pthread_mutex_unlock(&mutex);
+
+    free(self);
+    self = NULL;
+}
+
+/* Begins a critical section, within which the calling thread may use objects
+ * that it finds in epoch-protected data structures.  Critical sections do not
+ * nest. */
+void
+epoch_enter(void)
+{
+    assert(self && !self->epoch);
+    __atomic_store_n(&self->epoch,
+                     __atomic_load_n(&global_epoch, __ATOMIC_RELAXED),
+                     __ATOMIC_RELAXED);
+
+    /* Publish our epoch before reading anything that it protects.  Pairs with
+     * the fence in epoch_try_advance(). */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/* Ends the calling thread's critical section.  The thread must not use any of
+ * the objects that it found during the critical section afterward. */
+void
+epoch_exit(void)
+{
+    assert(self && self->epoch);
+    __atomic_store_n(&self->epoch, 0, __ATOMIC_RELEASE);
+}
+
+/* Arranges for 'function' to be called with 'aux' once no reader can still be
+ * using what it has found so far.  The caller must already have made 'aux'
+ * unreachable to new readers. */
+void
+epoch_defer(void (*function)(void *), void *aux)
+{
+    struct epoch_callback *cb = xmalloc(sizeof *cb);
+
+    cb->function = function;
+    cb->aux = aux;
+
+    pthread_mutex_lock(&mutex);
+    cb->epoch = global_epoch;
+    list_push_back(&pending, &cb->node);
+    n_pending++;
+    pthread_mutex_unlock(&mutex);
+}
+
+/* Frees 'p' once no reader can still be using it. */
+void
+epoch_free(void *p)
+{
+    if (p) {
+        epoch_defer(free, p);
+    }
+}
+
+/* Advances the global epoch if every reader in a critical section entered it
+ * during the current epoch.  Returns true if successful.  The caller must hold
+ * 'mutex'. */
+static bool
+epoch_try_advance(void)
+{
+    struct epoch_reader *r;
+
+    /* Pairs with the fence in epoch_enter(): either we see a reader's epoch,
+     * or the reader sees everything we unlinked before getting here. */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    LIST_FOR_EACH (r, struct epoch_reader, node, &readers) {
+        unsigned long epoch = __atomic_load_n(&r->epoch, __ATOMIC_ACQUIRE);
+        if (epoch && epoch != global_epoch) {
+            return false;
+        }
+    }
+    __atomic_store_n(&global_epoch, global_epoch + 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+/* Advances the global epoch as far as the readers allow and runs the deferred
+ * callbacks that have become safe.  Intended to be called periodically by the
+ * writer.  Returns true if callbacks remain pending, in which case the caller
+ * should call again later. */
+bool
+epoch_reclaim(void)
+{
+    struct list ready = LIST_INITIALIZER(&ready);
+    struct epoch_callback *cb, *next;
+    bool more;
+
+    pthread_mutex_lock(&mutex);
+    if (!list_is_empty(&pending) && epoch_try_advance()) {
+        epoch_try_advance();
+    }
+    while (!list_is_empty(&pending)) {
+        cb = CONTAINER_OF(list_front(&pending), struct epoch_callback, node);
+        if (cb->epoch + 2 > global_epoch) {
+            break;
+        }
+        list_remove(&cb->node);
+        list_push_back(&ready, &cb->node);
+        n_pending--;
+        n_reclaimed++;
+    }
+    more = n_pending > 0;
+    pthread_mutex_unlock(&mutex);
+
+    LIST_FOR_EACH_SAFE (cb, next, struct epoch_callback, node, &ready) {
+        cb->function(cb->aux);
+        free(cb);
+    }
+    return more;
+}
+
+/* Waits until every callback deferred so far has run.  The calling thread
+ * must not be in a critical section. */
+void
+epoch_synchronize(void)
+{
+    while (epoch_reclaim()) {
+        sched_yield();
+    }
+}
+
+/* Stores the number of deferred callbacks that have not yet run into
+ * '*n_pendingp' and the number that have into '*n_reclaimedp'. */
+void
+epoch_get_stats(unsigned long long *n_pendingp,
+                unsigned long long *n_reclaimedp)
+{
+    pthread_mutex_lock(&mutex);
+    *n_pendingp = n_pending;
+    *n_reclaimedp = n_reclaimed;
+    pthread_mutex_unlock(&mutex);
+}
@@ -0,0 +1,120 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#ifndef EPOCH_H
+#define EPOCH_H 1
+
+/* Epoch-based reclamation.
+ *
+ * Lets threads read a data structure without taking any lock while a single
+ * writer modifies it.  A reader brackets each access with epoch_enter() and
+ * epoch_exit(), and may use whatever it found only in between.  The writer
+ * unlinks an object so that no new reader can reach it, then passes it to
+ * epoch_defer() instead of freeing it.  The object is actually freed by a
+ * later call to epoch_reclaim(), once every reader that might have seen it has
+ * left its critical section.
+ *
+ * A global epoch counter advances only when every reader that is inside a
+ * critical section entered it during the current epoch.  An object retired in
+ * epoch E can therefore be freed once the counter reaches E + 2, because by
+ * then every critical section that began before the object was unlinked has
+ * ended.  Critical sections should be short, since a reader that stays in one
+ * holds up all reclamation.
+ *
+ * Pointers and other fields that readers load while the writer changes them
+ * should be read with epoch_get() and written with epoch_set(), which order
+ * the initialization of an object before its publication. */
+
+#include <stdbool.h>
+
+void epoch_register(void);
+void epoch_unregister(void);
+void epoch_enter(void);
+void epoch_exit(void);
+
+void epoch_defer(void (*function)(void *), void *aux);
+void epoch_free(void *);
+bool epoch_reclaim(void);
+void epoch_synchronize(void);
+void epoch_get_stats(unsigned long long *n_pending,
+                     unsigned long long *n_reclaimed);
+
+/* Loads 'P', which another thread may be changing, for use in a critical
+ * section.  Everything written before the corresponding epoch_set() is visible
+ * through the result. */
+#define epoch_get(P) __atomic_load_n(&(P), __ATOMIC_ACQUIRE)
+
+/* Stores 'V' into 'P', which readers may be loading with epoch_get(). */
+#define epoch_set(P, V) __atomic_store_n(&(P), (V), __ATOMIC_RELEASE)
+
+/* Sequence counter.
+ *
+ * For a structure whose writer must move an item around in a way that a
+ * concurrent reader could miss, e.g. from one slot to another, rather than
+ * just insert or remove it.  The writer brackets such a change with
+ * seqcount_write_begin() and seqcount_write_end().  A reader that finds
+ * nothing checks seqcount_read_retry() and, if it returns true, searches
+ * again.  Fields read inside must be read and written atomically, e.g. with
+ * epoch_get() and epoch_set(). */
+static inline unsigned int
+seqcount_read_begin(const unsigned int *seq)
+{
+    unsigned int value;
+
+    while ((value = __atomic_load_n(seq, __ATOMIC_ACQUIRE)) & 1) {
+        continue;
+    }
+    return value;
+}
+
+static inline bool
+seqcount_read_retry(const unsigned int *seq, unsigned int start)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(seq, __ATOMIC_RELAXED) != start;
+}
+
+static inline void
+seqcount_write_begin(unsigned int *seq)
+{
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void
+seqcount_write_end(unsigned int *seq)
+{
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+#endif /* epoch.h */
@@ -32,59 +32,26 @@
  */
 
 #include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <arpa/inet.h>
 #include "openflow/openflow-ext.h"
 #include "of_ext_msg.h"
+#include "chain.h"
+#include "epoch.h"
+#include "table.h"
 #include "netdev.h"
 #include "datapath.h"
+#include "slab.h"
+#include "sw-queue.h"
+#include "xtoxll.h"
 
 #define THIS_MODULE VLM_experimental
 #include "vlog.h"
 
-static int
-new_queue(struct sw_port * port, struct sw_queue * queue,
-          uint32_t queue_id, uint16_t class_id,
-          struct ofp_queue_prop_min_rate * mr)
-{
-    memset(queue, '\0', sizeof *queue);
-    queue->port = port;
-    queue->queue_id = queue_id;
-    /* class_id is the internal mapping to class. It is the offset
-     * in the array of queues for each port. Note that class_id is
-     * local to port, so we don't have any conflict.
-     * tc uses 16-bit class_id, so we cannot use the queue_id
-     * field */
-    queue->class_id = class_id;
-    queue->property = ntohs(mr->prop_header.property);
-    queue->min_rate = ntohs(mr->rate);
-
-    list_push_back(&port->queue_list, &queue->node);
-
-    return 0;
-}
-
-static int
-port_add_queue(struct sw_port *p, uint32_t queue_id,
-               struct ofp_queue_prop_min_rate * mr)
-{
-    int queue_no;
-    for (queue_no = 1; queue_no < p->num_queues; queue_no++) {
-        struct sw_queue *q = &p->queues[queue_no];
-        if (!q->port) {
-            return new_queue(p,q,queue_id,queue_no,mr);
-        }
-    }
-    return EXFULL;
-}
-
-static int
-port_delete_queue(struct sw_port *p UNUSED, struct sw_queue *q)
-{
-    list_remove(&q->node);
-    memset(q,'\0', sizeof *q);
-    return 0;
-}
-
 static void
 recv_of_exp_queue_delete(struct datapath *dp,
                          const struct sender *sender,
@@ -108,7 +75,7 @@ recv_of_exp_queue_delete(struct datapath *dp,
         q = dp_lookup_queue(p,queue_id);
         if (q) {
             netdev_delete_class(p->netdev,q->class_id);
-            port_delete_queue(p,q);
+            sw_queue_delete(q);
         }
         else {
             dp_send_error_msg(dp, sender, OFPET_QUEUE_OP_FAILED,
@@ -185,14 +152,15 @@ recv_of_exp_queue_modify(struct datapath *dp,
         }
         else {
             /* create new queue */
-            error = port_add_queue(p,queue_id, mr);
+            error = sw_queue_add(p, queue_id,
+                                 ntohs(mr->prop_header.property),
+                                 ntohs(mr->rate), &q);
             if (error == EXFULL) {
                 dp_send_error_msg(dp, sender, OFPET_QUEUE_OP_FAILED,
                                   OFPQOFC_EPERM, oh,
                                   ntohs(ofq_modify->header.header.length));
                 return;
             }
-            q = dp_lookup_queue(p, queue_id);
             error = netdev_setup_class(p->netdev,q->class_id, ntohs(mr->rate));
             if (error) {
                 VLOG_ERR("Failed to configure queue %d", queue_id);
@@ -265,3 +233,131 @@ int of_ext_recv_msg(struct datapath *dp, const struct sender *sender,
 
     return -EINVAL;
 }
+
+/* State for an OFPST_VENDOR statistics request with OPENFLOW_VENDOR_ID.  As
+ * required by the datapath's vendor stats dispatch, the vendor ID comes
+ * first. */
+struct of_ext_stats_state {
+    uint32_t vendor;            /* OPENFLOW_VENDOR_ID. */
+    uint32_t subtype;           /* One of OFP_EXT_STATS_*. */
+};
+
+int
+of_ext_stats_init(const void *body, int body_len, void **state)
+{
+    const struct ofp_extension_stats_header *osh = body;
+    struct of_ext_stats_state *s;
+
+    if (body_len < sizeof *osh) {
+        return -EINVAL;
+    }
+
+    switch (ntohl(osh->subtype)) {
+    case OFP_EXT_STATS_COUNTERS:
+        break;
+    default:
+        VLOG_WARN("Received stats request of unknown subtype %"PRIu32,
+                  ntohl(osh->subtype));
+        return -EINVAL;
+    }
+
+    s = xmalloc(sizeof *s);
+    s->vendor = OPENFLOW_VENDOR_ID;
+    s->subtype = ntohl(osh->subtype);
+    *state = s;
+    return 0;
+}
+
+/* Appends a counter named by the printf-style 'format' with the given 'value'
+ * to 'buffer'. */
+static void PRINTF_FORMAT(3, 4)
+put_counter(struct ofpbuf *buffer, uint64_t value, const char *format, ...)
+{
+    struct ofp_ext_counter *oec = ofpbuf_put_zeros(buffer, sizeof *oec);
+    va_list args;
+
+    va_start(args, format);
+    vsnprintf(oec->name, sizeof oec->name, format, args);
+    va_end(args);
+    oec->value = htonll(value);
+}
+
+static void
+dump_counters(struct datapath *dp, struct ofpbuf *buffer)
+{
+    struct sw_chain *chain = dp->chain;
+    unsigned long long n_pending, n_reclaimed;
+    uint64_t n_buffers, n_free, n_exhausted;
+    struct slab *slab;
+    int i;
+
+    /* Each thread has its own pool. */
+    n_buffers = n_free = n_exhausted = 0;
+    for (i = -1; i < dp->n_threads; i++) {
+        const struct dp_thread *t = i < 0 ? dp->main_thread : dp->threads[i];
+        n_buffers += t->pool.n_buffers;
+        n_free += t->pool.n_free;
+        n_exhausted += t->pool.n_exhausted;
+    }
+    put_counter(buffer, n_buffers, "pool.buffers");
+    put_counter(buffer, n_buffers - n_free, "pool.in_use");
+    put_counter(buffer, n_exhausted, "pool.exhausted");
+
+    put_counter(buffer, dp->n_threads, "dp.threads");
+    put_counter(buffer, dp->n_packet_in_dropped, "dp.packet_in_dropped");
+    put_counter(buffer, buffer_store_n_buffers(&dp->buffers), "dp.buffers");
+    put_counter(buffer, dp->buffers.n_used, "dp.buffers_in_use");
+    put_counter(buffer, dp->buffers.n_expired, "dp.buffers_expired");
+    put_counter(buffer, dp->buffers.n_full, "dp.buffers_full");
+    put_counter(buffer, pending_misses_count(&dp->pending_misses),
+                "dp.pending_misses");
+    put_counter(buffer, dp->pending_misses.n_held, "dp.miss_held");
+    put_counter(buffer, dp->pending_misses.n_dropped, "dp.miss_dropped");
+
+    epoch_get_stats(&n_pending, &n_reclaimed);
+    put_counter(buffer, n_pending, "epoch.pending");
+    put_counter(buffer, n_reclaimed, "epoch.reclaimed");
+
+    LIST_FOR_EACH (slab, struct slab, node, slab_all()) {
+        put_counter(buffer, slab->n_used, "slab.%s.in_use", slab->name);
+        put_counter(buffer, slab->n_chunks * SLAB_CHUNK_SIZE,
+                    "slab.%s.bytes", slab->name);
+        put_counter(buffer, slab->n_allocs, "slab.%s.allocs", slab->name);
+    }
+
+    for (i = 0; i < chain->n_tables; i++) {
+        struct sw_table_stats stats;
+        unsigned int j;
+
+        memset(&stats, 0, sizeof stats);
+        chain->tables[i]->stats(chain->tables[i], &stats);
+        for (j = 0; j < stats.n_counters; j++) {
+            put_counter(buffer, stats.counters[j].value, "table%d.%s.%s",
+                        i, stats.name, stats.counters[j].name);
+        }
+    }
+}
+
+int
+of_ext_stats_dump(struct datapath *dp, void *state, struct ofpbuf *buffer)
+{
+    struct of_ext_stats_state *s = state;
+    struct ofp_extension_stats_header *osh;
+
+    osh = ofpbuf_put_uninit(buffer, sizeof *osh);
+    osh->vendor = htonl(s->vendor);
+    osh->subtype = htonl(s->subtype);
+
+    switch (s->subtype) {
+    case OFP_EXT_STATS_COUNTERS:
+        dump_counters(dp, buffer);
+        break;
+    }
+    return 0;
+}
+
+void
+of_ext_stats_done(void *state)
+{
+    free(state);
+}
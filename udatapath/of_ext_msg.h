@@ -40,4 +40,8 @@ struct sender;
 
 int of_ext_recv_msg(struct datapath *, const struct sender *, const void *);
 
+int of_ext_stats_init(const void *body, int body_len, void **state);
+int of_ext_stats_dump(struct datapath *, void *state, struct ofpbuf *);
+void of_ext_stats_done(void *state);
+
 #endif /* of_ext_msg.h */
@@ -0,0 +1,239 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+
+#include <config.h>
+#include "pending-miss.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flow.h"
+#include "hash.h"
+#include "ofpbuf.h"
+#include "util.h"
+
+void
+pending_misses_init(struct pending_misses *pms)
+{
+    hmap_init(&pms->by_flow);
+    hmap_init(&pms->by_id);
+    list_init(&pms->list);
+    pms->n_held = 0;
+    pms->n_dropped = 0;
+}
+
+/* Frees all of the pending misses in 'pms' and the packets that they hold. */
+void
+pending_misses_destroy(struct pending_misses *pms)
+{
+    struct pending_miss *pm, *next;
+
+    LIST_FOR_EACH_SAFE (pm, next, struct pending_miss, list_node, &pms->list) {
+        unsigned int i;
+
+        for (i = 0; i < pm->n_packets; i++) {
+            ofpbuf_delete(pm->packets[i]);
+        }
+        free(pm);
+    }
+    hmap_destroy(&pms->by_flow);
+    hmap_destroy(&pms->by_id);
+}
+
+/* Returns the number of microflows tracked in 'pms'. */
+size_t
+pending_misses_count(const struct pending_misses *pms)
+{
+    return hmap_count(&pms->by_flow);
+}
+
+/* Called at time 'now' for 'buffer', received on 'in_port', which did not
+ * match any flow.  If a packet of the same microflow was sent to the
+ * controller a moment ago, takes ownership of 'buffer' and returns true.
+ * Otherwise, returns false, and if there is room to track the microflow,
+ * stores a new pending miss for it into '*pmp'.  The caller should then send
+ * 'buffer' to the controller and pass its buffer ID to
+ * pending_miss_set_buffer_id(). */
+bool
+pending_miss_hold(struct pending_misses *pms, struct ofpbuf *buffer,
+                  int in_port, size_t max_len, long long int now,
+                  struct pending_miss **pmp)
+{
+    struct pending_miss *pm;
+    struct flow flow;
+    size_t hash;
+
+    flow_extract(buffer, in_port, &flow);
+    hash = flow_hash(&flow, 0);
+    HMAP_FOR_EACH_WITH_HASH (pm, struct pending_miss, node, hash,
+                             &pms->by_flow) {
+        if (flow_equal(&pm->key.flow, &flow)) {
+            if (pm->n_packets < PENDING_MISS_MAX_PACKETS) {
+                pm->packets[pm->n_packets++] = buffer;
+                pms->n_held++;
+            } else {
+                ofpbuf_delete(buffer);
+                pms->n_dropped++;
+            }
+            return true;
+        }
+    }
+
+    if (hmap_count(&pms->by_flow) < PENDING_MISS_MAX) {
+        pm = xmalloc(sizeof *pm);
+        memset(&pm->key, 0, sizeof pm->key);
+        pm->key.flow = flow;
+        pm->in_port = in_port;
+        pm->max_len = max_len;
+        pm->buffer_id = UINT32_MAX;
+        pm->expires = now + PENDING_MISS_MSECS;
+        pm->n_packets = 0;
+        hmap_insert(&pms->by_flow, &pm->node, hash);
+        list_push_back(&pms->list, &pm->list_node);
+        *pmp = pm;
+    }
+    return false;
+}
+
+static uint32_t
+hash_buffer_id(uint32_t buffer_id)
+{
+    return hash_words(&buffer_id, 1, 0);
+}
+
+/* Records that the first packet of 'pm', in 'pms', was saved for the
+ * controller with 'buffer_id', which may be UINT32_MAX if it could not be
+ * saved. */
+void
+pending_miss_set_buffer_id(struct pending_misses *pms, struct pending_miss *pm,
+                           uint32_t buffer_id)
+{
+    pm->buffer_id = buffer_id;
+    if (buffer_id != UINT32_MAX) {
+        hmap_insert(&pms->by_id, &pm->id_node, hash_buffer_id(buffer_id));
+    }
+}
+
+static void
+remove_pending_miss(struct pending_misses *pms, struct pending_miss *pm)
+{
+    hmap_remove(&pms->by_flow, &pm->node);
+    if (pm->buffer_id != UINT32_MAX) {
+        hmap_remove(&pms->by_id, &pm->id_node);
+    }
+    list_remove(&pm->list_node);
+}
+
+/* Removes from 'pms' the pending misses for the microflows that a flow with
+ * 'key', just added to the flow table, matches, and appends them to 'taken',
+ * oldest first.  The caller takes ownership of them. */
+void
+pending_misses_take_matches(struct pending_misses *pms,
+                            const struct sw_flow_key *key, struct list *taken)
+{
+    struct pending_miss *pm, *next;
+
+    if (hmap_is_empty(&pms->by_flow)) {
+        return;
+    }
+
+    if (key->wildcards == 0) {
+        HMAP_FOR_EACH_WITH_HASH (pm, struct pending_miss, node,
+                                 flow_hash(&key->flow, 0), &pms->by_flow) {
+            if (flow_equal(&pm->key.flow, &key->flow)) {
+                remove_pending_miss(pms, pm);
+                list_push_back(taken, &pm->list_node);
+                return;
+            }
+        }
+    } else {
+        LIST_FOR_EACH_SAFE (pm, next, struct pending_miss, list_node,
+                            &pms->list) {
+            if (flow_matches_1wild(&pm->key, key)) {
+                remove_pending_miss(pms, pm);
+                list_push_back(taken, &pm->list_node);
+            }
+        }
+    }
+}
+
+/* Removes from 'pms' and returns the pending miss whose first packet the
+ * controller can refer to as 'buffer_id', or returns a null pointer if there
+ * is none.  The caller takes ownership of it. */
+struct pending_miss *
+pending_misses_take_by_id(struct pending_misses *pms, uint32_t buffer_id)
+{
+    struct pending_miss *pm;
+
+    HMAP_FOR_EACH_WITH_HASH (pm, struct pending_miss, id_node,
+                             hash_buffer_id(buffer_id), &pms->by_id) {
+        if (pm->buffer_id == buffer_id) {
+            remove_pending_miss(pms, pm);
+            return pm;
+        }
+    }
+    return NULL;
+}
+
+/* Removes from 'pms' and returns the oldest pending miss whose wait for the
+ * controller has ended at time 'now', or returns a null pointer if there is
+ * none.  In the latter case, stores into '*next' the time when the next one
+ * ends, or LLONG_MAX if 'pms' is empty.  The caller takes ownership of the
+ * returned pending miss. */
+struct pending_miss *
+pending_misses_take_expired(struct pending_misses *pms, long long int now,
+                            long long int *next)
+{
+    struct pending_miss *pm;
+
+    if (list_is_empty(&pms->list)) {
+        *next = LLONG_MAX;
+        return NULL;
+    }
+
+    pm = CONTAINER_OF(list_front(&pms->list), struct pending_miss, list_node);
+    if (now < pm->expires) {
+        *next = pm->expires;
+        return NULL;
+    }
+    remove_pending_miss(pms, pm);
+    return pm;
+}
+
+/* Frees 'pm', which must have been taken out of its pending_misses, but not
+ * the packets that it holds. */
+void
+pending_miss_destroy(struct pending_miss *pm)
+{
+    free(pm);
+}
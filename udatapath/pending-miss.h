@@ -0,0 +1,106 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+
+#ifndef PENDING_MISS_H
+#define PENDING_MISS_H 1
+
+/* Pending misses.
+ *
+ * While the controller sets up a flow for a new microflow, more of its packets
+ * usually arrive, and sending each of them up in its own packet_in only adds
+ * to the controller's load and churns the packet buffers.  So, after
+ * sending up the first packet of a microflow that missed in the flow table,
+ * the datapath holds back its later packets, up to PENDING_MISS_MAX_PACKETS of
+ * them, and drops and counts the rest.  When a flow_mod adds a flow that
+ * matches, the held packets go through the flow table.  If the controller
+ * answers with a packet_out instead, or does not answer within
+ * PENDING_MISS_MSECS, they are sent up after all.
+ *
+ * This module only keeps track of the held packets.  The datapath decides
+ * what to do with them when it takes them back. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "hmap.h"
+#include "list.h"
+#include "switch-flow.h"
+
+struct ofpbuf;
+
+#define PENDING_MISS_MAX 1024           /* Max microflows tracked. */
+#define PENDING_MISS_MAX_PACKETS 16     /* Max packets held per microflow. */
+#define PENDING_MISS_MSECS 1000         /* Time to wait for the controller. */
+
+struct pending_miss {
+    struct hmap_node node;      /* In 'by_flow' of pending_misses. */
+    struct hmap_node id_node;   /* In 'by_id', if 'buffer_id' is valid. */
+    struct list list_node;      /* In 'list' of pending_misses. */
+    struct sw_flow_key key;     /* Exact key of the microflow. */
+    int in_port;
+    size_t max_len;
+    uint32_t buffer_id;         /* Buffer of the packet sent up. */
+    long long int expires;      /* time_msec() when the wait ends. */
+    unsigned int n_packets;
+    struct ofpbuf *packets[PENDING_MISS_MAX_PACKETS];
+};
+
+struct pending_misses {
+    struct hmap by_flow;        /* Indexed by microflow. */
+    struct hmap by_id;          /* Indexed by 'buffer_id'. */
+    struct list list;           /* All pending misses, oldest first. */
+    unsigned long long n_held;      /* Packets held back. */
+    unsigned long long n_dropped;   /* Dropped because too many held. */
+};
+
+void pending_misses_init(struct pending_misses *);
+void pending_misses_destroy(struct pending_misses *);
+size_t pending_misses_count(const struct pending_misses *);
+
+bool pending_miss_hold(struct pending_misses *, struct ofpbuf *, int in_port,
+                       size_t max_len, long long int now,
+                       struct pending_miss **);
+void pending_miss_set_buffer_id(struct pending_misses *, struct pending_miss *,
+                                uint32_t buffer_id);
+void pending_misses_take_matches(struct pending_misses *,
+                                 const struct sw_flow_key *,
+                                 struct list *taken);
+struct pending_miss *pending_misses_take_by_id(struct pending_misses *,
+                                               uint32_t buffer_id);
+struct pending_miss *pending_misses_take_expired(struct pending_misses *,
+                                                 long long int now,
+                                                 long long int *next);
+void pending_miss_destroy(struct pending_miss *);
+
+#endif /* pending-miss.h */
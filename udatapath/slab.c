@@ -0,0 +1,157 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#include <config.h>
+#include "slab.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* A chunk of objects.  The objects follow the header. */
+struct slab_chunk {
+    struct list node;           /* In slab's 'partial', unless full. */
+    struct slab *slab;          /* Slab that owns the chunk. */
+    void *free_list;            /* Freed objects, each pointing to the next. */
+    char *unused;               /* First object never allocated. */
+    size_t n_used;              /* Number of objects allocated. */
+};
+
+/* Offset of the first object in a chunk. */
+#define SLAB_HEADER_SIZE ROUND_UP(sizeof(struct slab_chunk), SLAB_ALIGN)
+
+/* Every slab that has ever allocated a chunk. */
+static struct list all_slabs = LIST_INITIALIZER(&all_slabs);
+
+static struct slab_chunk *
+chunk_create(struct slab *slab)
+{
+    struct slab_chunk *chunk;
+
+    if (!slab->per_chunk) {
+        slab->per_chunk = (SLAB_CHUNK_SIZE - SLAB_HEADER_SIZE) / slab->size;
+        assert(slab->per_chunk > 1);
+    }
+    if (list_is_empty(&slab->node)) {
+        list_push_back(&all_slabs, &slab->node);
+    }
+
+    if (posix_memalign((void **) &chunk, SLAB_CHUNK_SIZE, SLAB_CHUNK_SIZE)) {
+        return NULL;
+    }
+    chunk->slab = slab;
+    chunk->free_list = NULL;
+    chunk->unused = (char *) chunk + SLAB_HEADER_SIZE;
+    chunk->n_used = 0;
+    slab->n_chunks++;
+    return chunk;
+}
+
+static struct slab_chunk *
+chunk_from_object(void *p)
+{
+    return (struct slab_chunk *) ((uintptr_t) p
+                                  & ~(uintptr_t) (SLAB_CHUNK_SIZE - 1));
+}
+
+/* Allocates and returns an object from 'slab', or a null pointer if memory is
+ * exhausted.  The object's contents are indeterminate. */
+void *
+slab_alloc(struct slab *slab)
+{
+    struct slab_chunk *chunk;
+    void *p;
+
+    if (list_is_empty(&slab->partial)) {
+        chunk = chunk_create(slab);
+        if (!chunk) {
+            return NULL;
+        }
+        list_push_front(&slab->partial, &chunk->node);
+    } else {
+        chunk = CONTAINER_OF(list_front(&slab->partial),
+                             struct slab_chunk, node);
+    }
+
+    if (chunk->free_list) {
+        p = chunk->free_list;
+        chunk->free_list = *(void **) p;
+    } else {
+        p = chunk->unused;
+        chunk->unused += slab->size;
+    }
+    if (++chunk->n_used == slab->per_chunk) {
+        list_remove(&chunk->node);
+    }
+    slab->n_used++;
+    slab->n_allocs++;
+    return p;
+}
+
+/* Returns 'p', which must have been allocated with slab_alloc(), to its slab.
+ * Does nothing if 'p' is a null pointer.
+ *
+ * A chunk that becomes empty is freed, unless it is the slab's last one, so
+ * that a slab whose objects come and go does not call malloc() every time. */
+void
+slab_free(void *p)
+{
+    struct slab_chunk *chunk;
+    struct slab *slab;
+
+    if (!p) {
+        return;
+    }
+
+    chunk = chunk_from_object(p);
+    slab = chunk->slab;
+    if (chunk->n_used-- == slab->per_chunk) {
+        list_push_back(&slab->partial, &chunk->node);
+    }
+    *(void **) p = chunk->free_list;
+    chunk->free_list = p;
+    slab->n_used--;
+
+    if (!chunk->n_used && slab->n_chunks > 1) {
+        list_remove(&chunk->node);
+        free(chunk);
+        slab->n_chunks--;
+    }
+}
+
+/* Returns a list of every slab that has allocated any objects, linked through
+ * their 'node' members, for reporting statistics. */
+const struct list *
+slab_all(void)
+{
+    return &all_slabs;
+}
@@ -0,0 +1,83 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#ifndef SLAB_H
+#define SLAB_H 1
+
+/* Slab allocator for objects of a single size.
+ *
+ * A slab carves its objects out of chunks of SLAB_CHUNK_SIZE bytes, each
+ * aligned on its own size, so that slab_free() can find an object's chunk
+ * from its address alone.  Allocating or freeing an object is then just a
+ * matter of popping or pushing a free list, with no call into malloc() except
+ * when a chunk fills up or empties out.
+ *
+ * A slab is not thread-safe.  Only one thread may allocate and free its
+ * objects. */
+
+#include <stddef.h>
+#include "list.h"
+#include "util.h"
+
+/* Size and alignment of a chunk. */
+#define SLAB_CHUNK_SIZE 16384
+
+/* Every object is aligned on this many bytes. */
+#define SLAB_ALIGN 16
+
+struct slab {
+    const char *name;           /* For statistics. */
+    size_t size;                /* Object size, a multiple of SLAB_ALIGN. */
+    size_t per_chunk;           /* Number of objects that fit in a chunk. */
+    struct list partial;        /* Chunks with room for another object. */
+    struct list node;           /* In list returned by slab_all(). */
+
+    /* Statistics. */
+    unsigned long long n_chunks; /* Number of chunks allocated. */
+    unsigned long long n_used;   /* Number of objects allocated. */
+    unsigned long long n_allocs; /* Number of slab_alloc() calls, ever. */
+};
+
+/* Initializer for a slab named NAME with objects of SIZE bytes, e.g.
+ *     static struct slab slab = SLAB_INITIALIZER(slab, "foo", 100);
+ * SIZE must be small enough that a few objects fit in a chunk. */
+#define SLAB_INITIALIZER(SLAB, NAME, SIZE)                              \
+    { NAME, ROUND_UP(SIZE, SLAB_ALIGN), 0,                              \
+      LIST_INITIALIZER(&(SLAB).partial), LIST_INITIALIZER(&(SLAB).node), \
+      0, 0, 0 }
+
+void *slab_alloc(struct slab *);
+void slab_free(void *);
+const struct list *slab_all(void);
+
+#endif /* slab.h */
@@ -0,0 +1,149 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#include <config.h>
+#include "sw-queue.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "datapath.h"
+#include "epoch.h"
+#include "list.h"
+#include "util.h"
+
+/* The queue_id to class_id mapping for a port's queues, as forwarding threads
+ * see it.  Never changed once published. */
+struct sw_queue_map {
+    int n;
+    struct sw_queue_class {
+        uint32_t queue_id;
+        uint16_t class_id;
+    } classes[];
+};
+
+/* Replaces the mapping that forwarding threads see for 'p' by one built from
+ * its current 'queue_list'. */
+static void
+publish_queue_map(struct sw_port *p)
+{
+    struct sw_queue_map *old = p->queue_map;
+    struct sw_queue_map *map = NULL;
+    struct sw_queue *q;
+    size_t n;
+
+    n = list_size(&p->queue_list);
+    if (n) {
+        map = xmalloc(sizeof *map + n * sizeof *map->classes);
+        map->n = 0;
+        LIST_FOR_EACH (q, struct sw_queue, node, &p->queue_list) {
+            struct sw_queue_class *c = &map->classes[map->n++];
+            c->queue_id = q->queue_id;
+            c->class_id = q->class_id;
+        }
+    }
+    epoch_set(p->queue_map, map);
+    epoch_free(old);
+}
+
+/* Adds a queue with the given 'queue_id', 'property', and 'min_rate' to 'p',
+ * in the first free slot, and stores it into '*qp'.  Returns 0 if successful,
+ * otherwise EXFULL if every slot is in use or still held by a deleted
+ * queue. */
+int
+sw_queue_add(struct sw_port *p, uint32_t queue_id, uint16_t property,
+             uint16_t min_rate, struct sw_queue **qp)
+{
+    int queue_no;
+
+    /* class_id is the internal mapping to class. It is the offset
+     * in the array of queues for each port. Note that class_id is
+     * local to port, so we don't have any conflict.
+     * tc uses 16-bit class_id, so we cannot use the queue_id
+     * field */
+    for (queue_no = 1; queue_no < p->num_queues; queue_no++) {
+        struct sw_queue *q = &p->queues[queue_no];
+        if (!q->port) {
+            memset(q, '\0', sizeof *q);
+            q->port = p;
+            q->queue_id = queue_id;
+            q->class_id = queue_no;
+            q->property = property;
+            q->min_rate = min_rate;
+            dp_reset_queue_stats(q);
+
+            list_push_back(&p->queue_list, &q->node);
+            publish_queue_map(p);
+            *qp = q;
+            return 0;
+        }
+    }
+    return EXFULL;
+}
+
+static void
+release_queue_cb(void *q_)
+{
+    struct sw_queue *q = q_;
+
+    memset(q, '\0', sizeof *q);
+}
+
+/* Deletes 'q' from its port.  Its slot becomes free once no forwarding thread
+ * can still be using its class_id. */
+void
+sw_queue_delete(struct sw_queue *q)
+{
+    list_remove(&q->node);
+    publish_queue_map(q->port);
+    epoch_defer(release_queue_cb, q);
+}
+
+/* Returns the class_id of the queue on 'p' with the given 'queue_id', or -1 if
+ * there is none.  A forwarding thread must call this inside an epoch critical
+ * section, and may use the result only until it leaves. */
+int
+sw_queue_lookup_class(const struct sw_port *p, uint32_t queue_id)
+{
+    const struct sw_queue_map *map = epoch_get(p->queue_map);
+
+    if (map) {
+        int i;
+
+        for (i = 0; i < map->n; i++) {
+            if (map->classes[i].queue_id == queue_id) {
+                return map->classes[i].class_id;
+            }
+        }
+    }
+    return -1;
+}
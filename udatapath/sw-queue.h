@@ -0,0 +1,62 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#ifndef SW_QUEUE_H
+#define SW_QUEUE_H 1
+
+/* Queues configured on a datapath port.
+ *
+ * The main thread adds, modifies, and deletes queues as the controller asks,
+ * and keeps them in the port's 'queue_list'.  Forwarding threads never look
+ * at a "struct sw_queue".  They only need to map an OpenFlow queue_id to the
+ * queue's class_id, which they do through a read-only copy of the mapping
+ * that the main thread replaces whenever a queue comes or goes, and that
+ * threads read inside an epoch critical section (see epoch.h).
+ *
+ * A queue's class_id is also its index in the port's 'queues', where the
+ * threads count the packets they send to it.  A deleted queue's slot is not
+ * reused until every thread that might still send packets to it has left its
+ * critical section, so that those packets are not counted against a new
+ * queue. */
+
+#include <stdint.h>
+
+struct sw_port;
+struct sw_queue;
+
+int sw_queue_add(struct sw_port *, uint32_t queue_id, uint16_t property,
+                 uint16_t min_rate, struct sw_queue **);
+void sw_queue_delete(struct sw_queue *);
+int sw_queue_lookup_class(const struct sw_port *, uint32_t queue_id);
+
+#endif /* sw-queue.h */
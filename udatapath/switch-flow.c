@@ -37,15 +37,45 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#include "dp_act.h"
+#include "epoch.h"
 #include "ofpbuf.h"
 #include "openflow/openflow.h"
 #include "openflow/nicira-ext.h"
 #include "packets.h"
+#include "slab.h"
 #include "timeval.h"
+#include "util.h"
 
 #define THIS_MODULE VLM_chain
 #include "vlog.h"
 
+/* Number of forwarding threads, each of which has a shard in every flow's
+ * statistics. */
+static unsigned int n_shards;
+
+/* 1 + the index of the running thread's shard, or 0 in the main thread. */
+static __thread unsigned int cur_shard;
+
+/* Gives each flow allocated from now on a statistics shard for each of 'n'
+ * forwarding threads.  Must be called before any flow is allocated, if at
+ * all. */
+void
+flow_set_n_shards(unsigned int n)
+{
+    n_shards = n;
+}
+
+/* Makes the running thread, which must be a forwarding thread, update shard
+ * 'idx' of flows' statistics.  'idx' must be less than the number passed to
+ * flow_set_n_shards(). */
+void
+flow_set_shard(unsigned int idx)
+{
+    assert(idx < n_shards);
+    cur_shard = idx + 1;
+}
+
 /* Internal function used to compare fields in flow. */
 static inline int
 flow_fields_match(const struct flow *a, const struct flow *b, uint32_t w,
@@ -183,28 +213,135 @@ flow_extract_match(struct sw_flow_key* to, const struct ofp_match* from)
 	to->nw_dst_mask = make_nw_mask(to->wildcards >> OFPFW_NW_DST_SHIFT);
 }
 
+/* Flow memory.
+ *
+ * Flows come from slabs.  A flow whose action list is short enough, which is
+ * most of them, keeps it in the same allocation, right after the sw_flow.
+ * Other action lists, including every one installed by flow_replace_acts(),
+ * come from another set of slabs, or from malloc() if they are larger still.
+ *
+ * Slabs are not thread-safe, but only the thread that modifies the chain
+ * allocates and frees flows.  That includes the callbacks that free flows
+ * and actions after an epoch, since that thread also calls epoch_reclaim(). */
+
+/* Number of bytes in a sw_flow_actions with room for 'ACTIONS_LEN' bytes of
+ * actions and their compiled form. */
+#define SFA_SIZE(ACTIONS_LEN)                                   \
+    (sizeof(struct sw_flow_actions) + (ACTIONS_LEN)             \
+     + ACT_MAX_OPS(ACTIONS_LEN) * sizeof(struct act_op))
+
+/* Number of bytes in a flow with room for 'ACTIONS_LEN' bytes of inline
+ * actions. */
+#define FLOW_SIZE(ACTIONS_LEN) \
+    (sizeof(struct sw_flow) + SFA_SIZE(ACTIONS_LEN))
+
+static struct slab flow_slab
+    = SLAB_INITIALIZER(flow_slab, "flow", sizeof(struct sw_flow));
+static struct slab flow32_slab
+    = SLAB_INITIALIZER(flow32_slab, "flow32", FLOW_SIZE(32));
+static struct slab flow128_slab
+    = SLAB_INITIALIZER(flow128_slab, "flow128", FLOW_SIZE(128));
+
+static struct slab acts32_slab
+    = SLAB_INITIALIZER(acts32_slab, "actions32", SFA_SIZE(32));
+static struct slab acts128_slab
+    = SLAB_INITIALIZER(acts128_slab, "actions128", SFA_SIZE(128));
+static struct slab acts512_slab
+    = SLAB_INITIALIZER(acts512_slab, "actions512", SFA_SIZE(512));
+
+/* Where a sw_flow_actions is stored. */
+enum {
+    SFA_INLINE,                 /* In its flow's allocation. */
+    SFA_SLAB,                   /* In one of the 'acts*_slab's. */
+    SFA_MALLOC                  /* From malloc(). */
+};
+
+/* Initializes the 'size' bytes at 'sfa' as a sw_flow_actions with room for
+ * 'actions_len' bytes of actions, kept in the given 'storage'.  Returns
+ * 'sfa'. */
+static struct sw_flow_actions *
+init_actions(void *sfa_, size_t actions_len, int storage)
+{
+    struct sw_flow_actions *sfa = sfa_;
+
+    memset(sfa, 0, SFA_SIZE(actions_len));
+    sfa->actions_len = actions_len;
+    sfa->storage = storage;
+    sfa->ops = (struct act_op *) ((uint8_t *) sfa->actions + actions_len);
+    return sfa;
+}
+
+/* Allocates a sw_flow_actions, outside any flow, with room for 'actions_len'
+ * bytes of actions and their compiled form.  Returns a null pointer on
+ * failure. */
+static struct sw_flow_actions *
+alloc_actions(size_t actions_len)
+{
+    struct slab *slab = (actions_len <= 32 ? &acts32_slab
+                         : actions_len <= 128 ? &acts128_slab
+                         : actions_len <= 512 ? &acts512_slab
+                         : NULL);
+    void *sfa = slab ? slab_alloc(slab) : malloc(SFA_SIZE(actions_len));
+
+    return (sfa
+            ? init_actions(sfa, actions_len, slab ? SFA_SLAB : SFA_MALLOC)
+            : NULL);
+}
+
+/* Frees 'sfa', unless it is part of its flow. */
+static void
+free_actions(struct sw_flow_actions *sfa)
+{
+    if (sfa->storage == SFA_SLAB) {
+        slab_free(sfa);
+    } else if (sfa->storage == SFA_MALLOC) {
+        free(sfa);
+    }
+}
+
+static void
+free_actions_cb(void *sfa)
+{
+    free_actions(sfa);
+}
+
 /* Allocates and returns a new flow with room for 'actions_len' actions. 
  * Returns the new flow or a null pointer on failure. */
 struct sw_flow *
 flow_alloc(size_t actions_len)
 {
-    struct sw_flow_actions *sfa;
-    size_t size = sizeof *sfa + actions_len;
-    struct sw_flow *flow = calloc(1, sizeof *flow);
+    struct slab *slab = (actions_len <= 32 ? &flow32_slab
+                         : actions_len <= 128 ? &flow128_slab
+                         : &flow_slab);
+    struct sw_flow *flow = slab_alloc(slab);
     if (!flow)
         return NULL;
+    memset(flow, 0, sizeof *flow);
 
-    sfa = calloc(1, size);
-    if (!sfa) {
-        free(flow);
-        return NULL;
+    if (n_shards) {
+        flow->shards = counter_alloc(n_shards * sizeof *flow->shards);
+        if (!flow->shards) {
+            slab_free(flow);
+            return NULL;
+        }
     }
-    sfa->actions_len = actions_len;
-    flow->sf_acts = sfa;
+
+    if (slab != &flow_slab) {
+        flow->sf_acts = init_actions(flow + 1, actions_len, SFA_INLINE);
+    } else {
+        flow->sf_acts = alloc_actions(actions_len);
+        if (!flow->sf_acts) {
+            free(flow->shards);
+            slab_free(flow);
+            return NULL;
+        }
+    }
+    wheel_timer_init(&flow->timer);
     return flow;
 }
 
 /* Setup the action on the flow, just after it was created with flow_alloc().
+ * 'flow''s key must already be set, since the actions are compiled for it.
  * Jean II */
 void
 flow_setup_actions(struct sw_flow *                    flow,
@@ -222,6 +359,8 @@ flow_setup_actions(struct sw_flow *                    flow,
 	flow->byte_count = 0;
 	flow->packet_count = 0;
 	memcpy(flow->sf_acts->actions, actions, actions_len);
+	flow->sf_acts->n_ops = compile_actions(&flow->key, actions, actions_len,
+	                                       flow->sf_acts->ops);
 }
 
 /* Frees 'flow' immediately. */
@@ -231,27 +370,99 @@ flow_free(struct sw_flow *flow)
     if (!flow) {
         return; 
     }
-    free(flow->sf_acts);
-    free(flow);
+    wheel_timer_cancel(&flow->timer);
+    free_actions(flow->sf_acts);
+    free(flow->shards);
+    slab_free(flow);
 }
 
-/* Copies 'actions' into a newly allocated structure for use by 'flow'
- * and frees the structure that defined the previous actions. */
+/* Frees immediately all of the flows in 'flows', which are linked through
+ * their 'node' members, and leaves 'flows' empty. */
+void
+flow_free_list(struct list *flows)
+{
+    struct sw_flow *flow, *next;
+
+    LIST_FOR_EACH_SAFE (flow, next, struct sw_flow, node, flows) {
+        flow_free(flow);
+    }
+    list_init(flows);
+}
+
+static void
+flow_free_cb(void *flow)
+{
+    flow_free(flow);
+}
+
+/* Frees 'flow', which the caller has already removed from its table, once no
+ * forwarding thread can still be using it.  Its expiration timer, which only
+ * the chain uses, is cancelled right away. */
+void
+flow_deferred_free(struct sw_flow *flow)
+{
+    if (flow) {
+        wheel_timer_cancel(&flow->timer);
+        epoch_defer(flow_free_cb, flow);
+    }
+}
+
+/* A group of flows waiting to be freed together. */
+struct flow_batch {
+    struct list flows;
+};
+
+static void
+flow_free_batch_cb(void *batch_)
+{
+    struct flow_batch *batch = batch_;
+
+    flow_free_list(&batch->flows);
+    free(batch);
+}
+
+/* Does the same as flow_deferred_free() for each of the flows in 'flows',
+ * which are linked through their 'node' members, but with a single deferred
+ * callback for all of them.  Leaves 'flows' empty. */
+void
+flow_deferred_free_list(struct list *flows)
+{
+    struct flow_batch *batch;
+    struct sw_flow *flow;
+
+    if (list_is_empty(flows)) {
+        return;
+    }
+
+    LIST_FOR_EACH (flow, struct sw_flow, node, flows) {
+        wheel_timer_cancel(&flow->timer);
+    }
+    batch = xmalloc(sizeof *batch);
+    list_init(&batch->flows);
+    list_splice(&batch->flows, flows->next, flows);
+    epoch_defer(flow_free_batch_cb, batch);
+}
+
+/* Copies 'actions' into a newly allocated structure for use by 'flow' and
+ * frees the structure that defined the previous actions, once forwarding
+ * threads that might have loaded it are done with it. */
 void flow_replace_acts(struct sw_flow *flow, 
         const struct ofp_action_header *actions, size_t actions_len)
 {
-    struct sw_flow_actions *sfa;
-    int size = sizeof *sfa + actions_len;
+    struct sw_flow_actions *sfa, *old;
 
-    sfa = malloc(size);
+    sfa = alloc_actions(actions_len);
     if (unlikely(!sfa))
         return;
 
-    sfa->actions_len = actions_len;
     memcpy(sfa->actions, actions, actions_len);
+    sfa->n_ops = compile_actions(&flow->key, actions, actions_len, sfa->ops);
 
-    free(flow->sf_acts);
-    flow->sf_acts = sfa;
+    old = flow->sf_acts;
+    epoch_set(flow->sf_acts, sfa);
+    if (old->storage != SFA_INLINE) {
+        epoch_defer(free_actions_cb, old);
+    }
 
     return;
 }
@@ -292,7 +503,7 @@ bool flow_timeout(struct sw_flow *flow)
 {
     uint64_t now = time_msec();
     if (flow->idle_timeout != OFP_FLOW_PERMANENT
-            && now > flow->used + flow->idle_timeout * 1000) {
+            && now > flow_get_used(flow) + flow->idle_timeout * 1000) {
         flow->reason = OFPRR_IDLE_TIMEOUT;
         return true;
     } else if (flow->hard_timeout != OFP_FLOW_PERMANENT
@@ -304,6 +515,25 @@ bool flow_timeout(struct sw_flow *flow)
     }
 }
 
+/* Returns the time, in ms, after which flow_timeout() will report that 'flow'
+ * has expired if it is not used again in the meantime, or UINT64_MAX if
+ * 'flow' is permanent. */
+uint64_t flow_deadline(const struct sw_flow *flow)
+{
+    uint64_t deadline = UINT64_MAX;
+
+    if (flow->idle_timeout != OFP_FLOW_PERMANENT) {
+        deadline = flow_get_used(flow) + flow->idle_timeout * 1000;
+    }
+    if (flow->hard_timeout != OFP_FLOW_PERMANENT) {
+        uint64_t hard = flow->created + flow->hard_timeout * 1000;
+        if (hard < deadline) {
+            deadline = hard;
+        }
+    }
+    return deadline;
+}
+
 /* Returns nonzero if 'flow' contains an output action to 'out_port' or
  * has the value OFPP_NONE. 'out_port' is in network-byte order. */
 int flow_has_out_port(struct sw_flow *flow, uint16_t out_port)
@@ -332,10 +562,55 @@ int flow_has_out_port(struct sw_flow *flow, uint16_t out_port)
     return 0;
 }
 
-void flow_used(struct sw_flow *flow, struct ofpbuf *buffer)
+/* Updates 'flow''s statistics for a packet in 'buffer' seen at time 'now', in
+ * milliseconds.  Extending the idle timeout does not touch the flow's
+ * expiration timer: chain_timeout() rechecks the flow when the timer fires and
+ * re-arms it if the flow is still live.
+ *
+ * A forwarding thread updates only its own shard of the statistics. */
+void flow_used(struct sw_flow *flow, struct ofpbuf *buffer, uint64_t now)
+{
+    if (cur_shard) {
+        struct sw_flow_shard *shard = &flow->shards[cur_shard - 1];
+
+        counter_set(shard->used, now);
+        counter_add(shard->packet_count, 1);
+        counter_add(shard->byte_count, buffer->size);
+    } else {
+        flow->used = now;
+        flow->packet_count++;
+        flow->byte_count += buffer->size;
+    }
+}
+
+/* Stores the number of packets and bytes that have matched 'flow', in all
+ * threads, into '*packet_count' and '*byte_count'. */
+void
+flow_get_stats(const struct sw_flow *flow, uint64_t *packet_count,
+               uint64_t *byte_count)
+{
+    unsigned int i;
+
+    *packet_count = flow->packet_count;
+    *byte_count = flow->byte_count;
+    for (i = 0; i < n_shards; i++) {
+        *packet_count += counter_get(flow->shards[i].packet_count);
+        *byte_count += counter_get(flow->shards[i].byte_count);
+    }
+}
+
+/* Returns the last time, in ms, that any thread used 'flow'. */
+uint64_t
+flow_get_used(const struct sw_flow *flow)
 {
-    flow->used = time_msec();
+    uint64_t used = flow->used;
+    unsigned int i;
 
-    flow->packet_count++;
-    flow->byte_count += buffer->size;
+    for (i = 0; i < n_shards; i++) {
+        uint64_t shard_used = counter_get(flow->shards[i].used);
+        if (shard_used > used) {
+            used = shard_used;
+        }
+    }
+    return used;
 }
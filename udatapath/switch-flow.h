@@ -36,10 +36,14 @@
 
 #include <time.h>
 #include "openflow/openflow.h"
+#include "counter.h"
 #include "flow.h"
 #include "list.h"
+#include "timer-wheel.h"
 
+struct act_op;
 struct ofp_match;
+struct sw_table;
 
 /* Identification data for a flow. */
 struct sw_flow_key {
@@ -49,11 +53,24 @@ struct sw_flow_key {
     uint32_t nw_dst_mask;       /* 1-bit in each significant nw_dst bit. */
 };
 
+/* A flow's actions, as received from the controller and compiled for
+ * execute_compiled_actions().  'ops' points into the same allocation, just
+ * past the largest action list that it can hold. */
 struct sw_flow_actions {
     size_t actions_len;
+    size_t n_ops;
+    struct act_op *ops;
+    int storage;                /* Private to switch-flow.c. */
     struct ofp_action_header actions[0];
 };
 
+/* Statistics for a flow kept by one forwarding thread.  See counter.h. */
+struct sw_flow_shard {
+    uint64_t used;              /* Last used time. */
+    uint64_t packet_count;      /* Number of packets seen. */
+    uint64_t byte_count;        /* Number of bytes seen. */
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
 struct sw_flow {
     struct sw_flow_key key;
 
@@ -61,15 +78,22 @@ struct sw_flow {
     uint16_t priority;          /* Only used on entries with wildcards. */
     uint16_t idle_timeout;      /* Idle time before discarding (seconds). */
     uint16_t hard_timeout;      /* Hard expiration time (seconds) */
-    uint64_t used;              /* Last used time. */
     uint64_t created;           /* When the flow was created. */
+
+    /* Statistics.  These members count the packets forwarded by the main
+     * thread (or by hardware), and 'shards' the packets forwarded by each
+     * forwarding thread.  Use flow_get_stats() and flow_get_used() for the
+     * totals. */
+    uint64_t used;              /* Last used time. */
     uint64_t packet_count;      /* Number of packets seen. */
     uint64_t byte_count;        /* Number of bytes seen. */
+    struct sw_flow_shard *shards;
     uint8_t reason;             /* Reason flow removed (one of OFPRR_*). */
     uint8_t send_flow_rem;      /* Send a flow removed to the controller */
     uint8_t emerg_flow;         /* Emergency flow indicator */
 
-    struct sw_flow_actions *sf_acts;
+    struct sw_flow_actions *sf_acts; /* Replaced by flow_replace_acts(), so
+                                      * load with epoch_get() to use it. */
 
     /* Private to table implementations. */
     struct list node;
@@ -77,6 +101,10 @@ struct sw_flow {
     unsigned long int serial;
 
     void *private;              /* Cookie for tables */
+
+    /* Private to the chain. */
+    struct sw_table *table;     /* Table that holds this flow. */
+    struct wheel_timer timer;   /* Expiration timer, if any. */
 };
 
 int flow_matches_1wild(const struct sw_flow_key *, const struct sw_flow_key *);
@@ -89,12 +117,22 @@ int flow_has_out_port(struct sw_flow *flow, uint16_t out_port);
 struct sw_flow *flow_alloc(size_t);
 void flow_setup_actions(struct sw_flow *, const struct ofp_action_header *, int);
 void flow_free(struct sw_flow *);
+void flow_free_list(struct list *);
+void flow_deferred_free(struct sw_flow *);
+void flow_deferred_free_list(struct list *);
 void flow_replace_acts(struct sw_flow *, const struct ofp_action_header *, 
         size_t);
 void flow_extract_match(struct sw_flow_key* to, const struct ofp_match* from);
 
 void print_flow(const struct sw_flow_key *);
 bool flow_timeout(struct sw_flow *flow);
-void flow_used(struct sw_flow *flow, struct ofpbuf *buffer);
+uint64_t flow_deadline(const struct sw_flow *flow);
+void flow_used(struct sw_flow *flow, struct ofpbuf *buffer, uint64_t now);
+void flow_get_stats(const struct sw_flow *, uint64_t *packet_count,
+                    uint64_t *byte_count);
+uint64_t flow_get_used(const struct sw_flow *);
+
+void flow_set_n_shards(unsigned int);
+void flow_set_shard(unsigned int);
 
 #endif /* switch-flow.h */
@@ -39,6 +39,7 @@
 #include "openflow/nicira-ext.h"
 #include "crc32.h"
 #include "datapath.h"
+#include "epoch.h"
 #include "flow.h"
 #include "switch-flow.h"
 
@@ -62,7 +63,7 @@ static struct sw_flow **find_bucket(struct sw_table *swt,
 static struct sw_flow *table_hash_lookup(struct sw_table *swt,
                                          const struct sw_flow_key *key)
 {
-    struct sw_flow *flow = *find_bucket(swt, key);
+    struct sw_flow *flow = epoch_get(*find_bucket(swt, key));
     return flow && !flow_compare(&flow->key.flow, &key->flow) ? flow : NULL;
 }
 
@@ -78,13 +79,13 @@ static int table_hash_insert(struct sw_table *swt, struct sw_flow *flow)
     bucket = find_bucket(swt, &flow->key);
     if (*bucket == NULL) {
         th->n_flows++;
-        *bucket = flow;
+        epoch_set(*bucket, flow);
         retval = 1;
     } else {
         struct sw_flow *old_flow = *bucket;
         if (!flow_compare(&old_flow->key.flow, &flow->key.flow)) {
-            *bucket = flow;
-            flow_free(old_flow);
+            epoch_set(*bucket, flow);
+            flow_deferred_free(old_flow);
             retval = 1;
         } else {
             retval = 0;
@@ -156,8 +157,10 @@ static int table_hash_has_conflict(struct sw_table *swt,
 static void
 do_delete(struct sw_flow **bucket)
 {
-    flow_free(*bucket);
-    *bucket = NULL;
+    struct sw_flow *flow = *bucket;
+
+    epoch_set(*bucket, NULL);
+    flow_deferred_free(flow);
 }
 
 /* Returns number of deleted flows.  We ignore the priority
@@ -208,7 +211,7 @@ static void table_hash_timeout(struct sw_table *swt, struct list *deleted)
         struct sw_flow *flow = *bucket;
         if (flow && flow_timeout(flow)) {
             list_push_back(deleted, &flow->node);
-            *bucket = NULL;
+            epoch_set(*bucket, NULL);
             th->n_flows--;
         }
     }
@@ -312,34 +315,556 @@ struct sw_table *table_hash_create(unsigned int polynomial,
     return swt;
 }
 
-/* Double-hashing table. */
+/* Bucketized cuckoo hash table.
+ *
+ * Each flow may live in one of two buckets.  Both are derived from a single
+ * CRC-32C of the flow key: the primary bucket from its low bits, and the
+ * alternate by XORing the primary bucket index with a hash of a 16-bit
+ * signature derived from the CRC ("partial-key cuckoo hashing").  Since
+ * the signature is stored alongside each flow, a flow's other bucket can be
+ * found without touching the flow itself.
+ *
+ * Each bucket holds CUCKOO_SLOTS flows and their signatures, so that a lookup
+ * usually reads only the signatures of one or two buckets and the key of the
+ * flow that actually matches.  When both of a new flow's buckets are full, a
+ * breadth-first search looks for a short chain of flows that can each be moved
+ * to their alternate bucket to make room.
+ *
+ * The table starts with CUCKOO_MIN_BUCKETS buckets and doubles when it is
+ * three-quarters full, or halves when it is less than one-eighth full.  A
+ * resize does not rehash every flow at once, which would stall the main
+ * thread for a long time in a big table.  Instead it allocates a new array of
+ * buckets and moves the flows from the old array into it a few buckets at a
+ * time: CUCKOO_REHASH_BATCH buckets per call to the table's 'run' function and
+ * CUCKOO_REHASH_INSERT more on each insert, which is enough to empty the old
+ * array well before the new one fills up.  In the meantime, new flows go into
+ * the new array, and lookups that miss in the new array search the old one.
+ *
+ * Forwarding threads look up flows without locking while the main thread
+ * changes the table.  Slots are written with epoch_set(), so a lookup sees
+ * either the old or the new contents of each slot.  A flow being moved to its
+ * alternate bucket or to the new array is copied before it is cleared, but a
+ * lookup that reads the two places in the wrong order could still miss it, so
+ * moves happen under 'seq' and a lookup that misses while 'seq' changed looks
+ * again. */
+
+#define CUCKOO_SLOTS 4          /* Flows per bucket. */
+#define CUCKOO_MAX_PATH 256     /* Maximum buckets examined by one insert. */
+#define CUCKOO_MIN_BUCKETS 16   /* Initial and minimum number of buckets. */
+#define CUCKOO_REHASH_BATCH 256 /* Buckets rehashed per call to 'run'. */
+#define CUCKOO_REHASH_INSERT 4  /* Buckets rehashed per insert. */
+
+struct cuckoo_bucket {
+    uint16_t sigs[CUCKOO_SLOTS];
+    struct sw_flow *flows[CUCKOO_SLOTS];
+};
+
+/* An array of buckets, whose size is a power of 2. */
+struct cuckoo_array {
+    unsigned int mask;          /* Number of buckets minus 1. */
+    struct cuckoo_bucket buckets[0];
+};
 
 struct sw_table_hash2 {
     struct sw_table swt;
-    struct sw_table *subtable[2];
+    struct cuckoo_array *cur;   /* Receives new flows. */
+    struct cuckoo_array *old;   /* Being emptied into 'cur', or NULL. */
+    unsigned int n_rehashed;    /* Number of buckets of 'old' emptied. */
+    unsigned int max_buckets;   /* Largest allowed size of 'cur'. */
+    unsigned int max_flows;
+    unsigned int n_flows;
+    unsigned int seq;               /* Sequence counter for moves. */
+    unsigned long long n_displaced; /* Flows moved to make room. */
+    unsigned long long n_failed;    /* Inserts rejected because full. */
+    unsigned long long n_resizes;   /* Resizes started. */
+    struct list iter_flows;         /* In decreasing order of serial. */
+    unsigned long int next_serial;
+};
+
+/* Location of a flow within a sw_table_hash2. */
+struct cuckoo_pos {
+    struct cuckoo_bucket *bucket;
+    int slot;
 };
 
+static uint32_t
+cuckoo_hash(const struct sw_flow_key *key)
+{
+    return crc32c(key, offsetof(struct sw_flow_key, wildcards), 0);
+}
+
+/* The high bits of a CRC are poorly distributed across keys that differ only
+ * in a few fields, so multiply to fold every bit of 'hash' into the top half
+ * before taking the signature from it. */
+static uint16_t
+cuckoo_sig(uint32_t hash)
+{
+    return (hash * 0x9e3779b1u) >> 16;
+}
+
+static struct cuckoo_array *
+cuckoo_array_create(unsigned int n_buckets)
+{
+    struct cuckoo_array *a;
+
+    a = calloc(1, sizeof *a + n_buckets * sizeof *a->buckets);
+    if (a) {
+        a->mask = n_buckets - 1;
+    }
+    return a;
+}
+
+static unsigned int
+cuckoo_n_buckets(const struct cuckoo_array *a)
+{
+    return a->mask + 1;
+}
+
+/* Returns the bucket in 'a' where a flow with the given 'hash' belongs. */
+static struct cuckoo_bucket *
+cuckoo_primary_bucket(struct cuckoo_array *a, uint32_t hash)
+{
+    return &a->buckets[hash & a->mask];
+}
+
+/* Returns the other bucket in which a flow with signature 'sig' that could be
+ * in 'b', which is in 'a', might be found.  The mapping is its own inverse,
+ * and the low bit of the value XORed in is forced on so that the two buckets
+ * always differ. */
+static struct cuckoo_bucket *
+cuckoo_alt_bucket(struct cuckoo_array *a, const struct cuckoo_bucket *b,
+                  uint16_t sig)
+{
+    unsigned int idx = b - a->buckets;
+    return &a->buckets[(idx ^ ((sig * 0x5bd1e995u) | 1)) & a->mask];
+}
+
+static int
+cuckoo_find_slot(const struct cuckoo_bucket *b, uint16_t sig,
+                 const struct sw_flow_key *key)
+{
+    int i;
+
+    for (i = 0; i < CUCKOO_SLOTS; i++) {
+        if (b->sigs[i] == sig && b->flows[i]
+            && !flow_compare(&b->flows[i]->key.flow, &key->flow)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Returns the flow in 'b' with signature 'sig' and the same key as 'key', if
+ * any, reading 'b' in a way that is safe against concurrent changes. */
+static struct sw_flow *
+cuckoo_lookup_bucket(const struct cuckoo_bucket *b, uint16_t sig,
+                     const struct sw_flow_key *key)
+{
+    int i;
+
+    for (i = 0; i < CUCKOO_SLOTS; i++) {
+        if (__atomic_load_n(&b->sigs[i], __ATOMIC_RELAXED) == sig) {
+            struct sw_flow *flow = epoch_get(b->flows[i]);
+            if (flow && !flow_compare(&flow->key.flow, &key->flow)) {
+                return flow;
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Looks up 'key', whose hash is 'hash', in both of its buckets in 'a', in a
+ * way that is safe against concurrent changes. */
+static struct sw_flow *
+cuckoo_lookup_array(struct cuckoo_array *a, uint32_t hash,
+                    uint16_t sig, const struct sw_flow_key *key)
+{
+    struct cuckoo_bucket *b = cuckoo_primary_bucket(a, hash);
+    struct sw_flow *flow;
+
+    flow = cuckoo_lookup_bucket(b, sig, key);
+    if (!flow) {
+        flow = cuckoo_lookup_bucket(cuckoo_alt_bucket(a, b, sig), sig, key);
+    }
+    return flow;
+}
+
+/* Stores 'flow', with signature 'sig', into slot 'slot' of 'b'. */
+static void
+cuckoo_set_slot(struct cuckoo_bucket *b, int slot, uint16_t sig,
+                struct sw_flow *flow)
+{
+    __atomic_store_n(&b->sigs[slot], sig, __ATOMIC_RELAXED);
+    epoch_set(b->flows[slot], flow);
+}
+
+static int
+cuckoo_free_slot(const struct cuckoo_bucket *b)
+{
+    int i;
+
+    for (i = 0; i < CUCKOO_SLOTS; i++) {
+        if (!b->flows[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Searches 'a' for an exact match for 'key', whose hash is 'hash'.  Returns
+ * true and stores the flow's location in '*pos' if found, otherwise returns
+ * false. */
+static bool
+cuckoo_find_in_array(struct cuckoo_array *a, uint32_t hash,
+                     const struct sw_flow_key *key, struct cuckoo_pos *pos)
+{
+    uint16_t sig = cuckoo_sig(hash);
+    struct cuckoo_bucket *b;
+    int slot;
+
+    b = cuckoo_primary_bucket(a, hash);
+    slot = cuckoo_find_slot(b, sig, key);
+    if (slot < 0) {
+        b = cuckoo_alt_bucket(a, b, sig);
+        slot = cuckoo_find_slot(b, sig, key);
+        if (slot < 0) {
+            return false;
+        }
+    }
+    pos->bucket = b;
+    pos->slot = slot;
+    return true;
+}
+
+/* Searches 't2' for an exact match for 'key', whose hash is 'hash'.  Returns
+ * true and stores the flow's location in '*pos' if found, otherwise returns
+ * false. */
+static bool
+cuckoo_find(const struct sw_table_hash2 *t2, uint32_t hash,
+            const struct sw_flow_key *key, struct cuckoo_pos *pos)
+{
+    return (cuckoo_find_in_array(t2->cur, hash, key, pos)
+            || (t2->old && cuckoo_find_in_array(t2->old, hash, key, pos)));
+}
+
 static struct sw_flow *table_hash2_lookup(struct sw_table *swt,
                                           const struct sw_flow_key *key)
 {
     struct sw_table_hash2 *t2 = (struct sw_table_hash2 *) swt;
-    int i;
-        
-    for (i = 0; i < 2; i++) {
-        struct sw_flow *flow = *find_bucket(t2->subtable[i], key);
-        if (flow && !flow_compare(&flow->key.flow, &key->flow))
-            return flow;
+    uint32_t hash = cuckoo_hash(key);
+    uint16_t sig = cuckoo_sig(hash);
+    struct sw_flow *flow;
+    unsigned int seq;
+
+    do {
+        seq = seqcount_read_begin(&t2->seq);
+        flow = cuckoo_lookup_array(epoch_get(t2->cur), hash, sig, key);
+        if (!flow) {
+            struct cuckoo_array *old = epoch_get(t2->old);
+            if (old) {
+                flow = cuckoo_lookup_array(old, hash, sig, key);
+            }
+        }
+    } while (!flow && seqcount_read_retry(&t2->seq, seq));
+    return flow;
+}
+
+/* A node in the breadth-first search for a displacement path.  'bucket' was
+ * reached by moving the flow in slot 'parent_slot' of node 'parent' into it,
+ * or 'parent' is -1 for one of the new flow's own buckets. */
+struct cuckoo_node {
+    struct cuckoo_bucket *bucket;
+    int parent;
+    int parent_slot;
+};
+
+/* Returns true if 'b' is the bucket of node 'n' of 'path' or one of its
+ * ancestors.  Such a bucket must not appear twice in one displacement path,
+ * because each move along the path fills the slot vacated by the next. */
+static bool
+cuckoo_on_path(const struct cuckoo_node path[], int n,
+               const struct cuckoo_bucket *b)
+{
+    for (; n >= 0; n = path[n].parent) {
+        if (path[n].bucket == b) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Moves flows along the path that ends at node 'n' of 'path', whose bucket
+ * has a free slot, so that the bucket of the root of the path has a free slot.
+ * Returns that bucket and stores the free slot into '*slotp'. */
+static struct cuckoo_bucket *
+cuckoo_shift(struct sw_table_hash2 *t2, struct cuckoo_node path[], int n,
+             int *slotp)
+{
+    int dst_slot = cuckoo_free_slot(path[n].bucket);
+
+    seqcount_write_begin(&t2->seq);
+    while (path[n].parent >= 0) {
+        struct cuckoo_bucket *dst = path[n].bucket;
+        struct cuckoo_bucket *src = path[path[n].parent].bucket;
+        int src_slot = path[n].parent_slot;
+
+        /* Copy before clearing so that the flow is always findable. */
+        cuckoo_set_slot(dst, dst_slot, src->sigs[src_slot],
+                        src->flows[src_slot]);
+        epoch_set(src->flows[src_slot], NULL);
+        t2->n_displaced++;
+
+        dst_slot = src_slot;
+        n = path[n].parent;
+    }
+    seqcount_write_end(&t2->seq);
+    *slotp = dst_slot;
+    return path[n].bucket;
+}
+
+/* Finds a free slot in 'a' for a flow whose candidate buckets are 'b0' and
+ * 'b1', displacing other flows if necessary.  Returns the bucket and stores
+ * the slot into '*slotp', or returns a null pointer if no path was found. */
+static struct cuckoo_bucket *
+cuckoo_make_room(struct sw_table_hash2 *t2, struct cuckoo_array *a,
+                 struct cuckoo_bucket *b0, struct cuckoo_bucket *b1,
+                 int *slotp)
+{
+    struct cuckoo_node path[CUCKOO_MAX_PATH];
+    int head, tail;
+
+    path[0].bucket = b0;
+    path[0].parent = -1;
+    path[1].bucket = b1;
+    path[1].parent = -1;
+    tail = 2;
+
+    for (head = 0; head < tail; head++) {
+        struct cuckoo_bucket *b = path[head].bucket;
+        int slot;
+
+        if (cuckoo_free_slot(b) >= 0) {
+            return cuckoo_shift(t2, path, head, slotp);
+        }
+        for (slot = 0; slot < CUCKOO_SLOTS && tail < CUCKOO_MAX_PATH; slot++) {
+            struct cuckoo_bucket *alt = cuckoo_alt_bucket(a, b,
+                                                          b->sigs[slot]);
+            if (cuckoo_on_path(path, head, alt)) {
+                continue;
+            }
+            path[tail].bucket = alt;
+            path[tail].parent = head;
+            path[tail].parent_slot = slot;
+            tail++;
+        }
     }
     return NULL;
 }
 
+/* Stores 'flow', whose key has the given 'hash', into 'a', displacing other
+ * flows if necessary.  Returns false if no room could be found. */
+static bool
+cuckoo_place(struct sw_table_hash2 *t2, struct cuckoo_array *a,
+             struct sw_flow *flow, uint32_t hash)
+{
+    uint16_t sig = cuckoo_sig(hash);
+    struct cuckoo_bucket *b0 = cuckoo_primary_bucket(a, hash);
+    struct cuckoo_bucket *b;
+    int slot;
+
+    b = cuckoo_make_room(t2, a, b0, cuckoo_alt_bucket(a, b0, sig), &slot);
+    if (!b) {
+        return false;
+    }
+    cuckoo_set_slot(b, slot, sig, flow);
+    return true;
+}
+
+/* Starts moving the flows in 't2', which must not already be resizing, into a
+ * new array of 'n_buckets' buckets.  Returns false if memory is short. */
+static bool
+cuckoo_resize(struct sw_table_hash2 *t2, unsigned int n_buckets)
+{
+    struct cuckoo_array *a = cuckoo_array_create(n_buckets);
+
+    if (!a) {
+        return false;
+    }
+    t2->n_rehashed = 0;
+    epoch_set(t2->old, t2->cur);
+    epoch_set(t2->cur, a);
+    t2->n_resizes++;
+    return true;
+}
+
+/* Moves the flows in up to 'n' buckets of 't2->old' into 't2->cur', and frees
+ * 't2->old' once it is empty.  Returns true if there is more to do. */
+static bool
+cuckoo_rehash(struct sw_table_hash2 *t2, unsigned int n)
+{
+    struct cuckoo_array *old = t2->old;
+
+    if (!old) {
+        return false;
+    }
+
+    for (; n > 0 && t2->n_rehashed <= old->mask; n--) {
+        struct cuckoo_bucket *b = &old->buckets[t2->n_rehashed];
+        int slot;
+
+        for (slot = 0; slot < CUCKOO_SLOTS; slot++) {
+            struct sw_flow *flow = b->flows[slot];
+
+            if (!flow) {
+                continue;
+            }
+            if (!cuckoo_place(t2, t2->cur, flow, cuckoo_hash(&flow->key))) {
+                /* Very unlikely at the loads where resizes happen.  Leave
+                 * the rest where it is and try again on a later call, after
+                 * some flows have gone away. */
+                t2->n_failed++;
+                return false;
+            }
+            seqcount_write_begin(&t2->seq);
+            epoch_set(b->flows[slot], NULL);
+            seqcount_write_end(&t2->seq);
+        }
+        t2->n_rehashed++;
+    }
+
+    if (t2->n_rehashed <= old->mask) {
+        return true;
+    }
+    epoch_set(t2->old, NULL);
+    epoch_free(old);
+    return false;
+}
+
+/* Starts doubling the size of 't2', if it is not already resizing and has
+ * not reached its maximum size.  Returns true if successful. */
+static bool
+cuckoo_grow(struct sw_table_hash2 *t2)
+{
+    unsigned int n_buckets = cuckoo_n_buckets(t2->cur);
+
+    return (!t2->old && n_buckets < t2->max_buckets
+            && cuckoo_resize(t2, n_buckets * 2));
+}
+
 static int table_hash2_insert(struct sw_table *swt, struct sw_flow *flow)
 {
     struct sw_table_hash2 *t2 = (struct sw_table_hash2 *) swt;
+    struct cuckoo_pos pos;
+    uint32_t hash;
+
+    if (flow->key.wildcards != 0)
+        return 0;
 
-    if (table_hash_insert(t2->subtable[0], flow))
+    /* Replace an identical flow. */
+    hash = cuckoo_hash(&flow->key);
+    if (cuckoo_find(t2, hash, &flow->key, &pos)) {
+        struct sw_flow *old_flow = pos.bucket->flows[pos.slot];
+        flow->serial = old_flow->serial;
+        epoch_set(pos.bucket->flows[pos.slot], flow);
+        list_replace(&flow->iter_node, &old_flow->iter_node);
+        flow_deferred_free(old_flow);
         return 1;
-    return table_hash_insert(t2->subtable[1], flow);
+    }
+
+    if (t2->n_flows >= t2->max_flows) {
+        t2->n_failed++;
+        return 0;
+    }
+
+    cuckoo_rehash(t2, CUCKOO_REHASH_INSERT);
+    if ((t2->n_flows + 1) * 4 > cuckoo_n_buckets(t2->cur) * CUCKOO_SLOTS * 3) {
+        cuckoo_grow(t2);
+    }
+    if (!cuckoo_place(t2, t2->cur, flow, hash)
+        && (!cuckoo_grow(t2) || !cuckoo_place(t2, t2->cur, flow, hash))) {
+        t2->n_failed++;
+        return 0;
+    }
+    flow->serial = t2->next_serial++;
+    list_push_front(&t2->iter_flows, &flow->iter_node);
+    t2->n_flows++;
+    return 1;
+}
+
+/* Calls 'function' with 'aux' for each flow in 'a' that might match 'key',
+ * whose hash is 'hash' if it is exact, stopping early if 'function' returns
+ * false.  If 'key' is exact, that is at most the one flow with the same key;
+ * otherwise it is every flow.  Returns false if 'function' did. */
+static bool
+cuckoo_for_each_in_array(struct sw_table_hash2 *t2,
+                         struct cuckoo_array *a,
+                         const struct sw_flow_key *key, uint32_t hash,
+                         bool (*function)(struct sw_table_hash2 *,
+                                          struct cuckoo_bucket *, int slot,
+                                          void *aux),
+                         void *aux)
+{
+    unsigned int i;
+
+    if (key->wildcards == 0) {
+        struct cuckoo_pos pos;
+        return (!cuckoo_find_in_array(a, hash, key, &pos)
+                || function(t2, pos.bucket, pos.slot, aux));
+    }
+
+    for (i = 0; i <= a->mask; i++) {
+        struct cuckoo_bucket *b = &a->buckets[i];
+        int slot;
+
+        for (slot = 0; slot < CUCKOO_SLOTS; slot++) {
+            if (b->flows[slot] && !function(t2, b, slot, aux)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/* Calls 'function' with 'aux' for each flow in 't2' that might match 'key',
+ * stopping early if 'function' returns false. */
+static void
+cuckoo_for_each_candidate(struct sw_table_hash2 *t2,
+                          const struct sw_flow_key *key,
+                          bool (*function)(struct sw_table_hash2 *,
+                                           struct cuckoo_bucket *, int slot,
+                                           void *aux),
+                          void *aux)
+{
+    uint32_t hash = key->wildcards ? 0 : cuckoo_hash(key);
+
+    if (cuckoo_for_each_in_array(t2, t2->cur, key, hash, function, aux)
+        && t2->old) {
+        cuckoo_for_each_in_array(t2, t2->old, key, hash, function, aux);
+    }
+}
+
+struct modify_aux {
+    const struct sw_flow_key *key;
+    uint16_t priority;
+    int strict;
+    const struct ofp_action_header *actions;
+    size_t actions_len;
+    int count;
+};
+
+static bool
+modify_cb(struct sw_table_hash2 *t2 UNUSED, struct cuckoo_bucket *b,
+          int slot, void *aux_)
+{
+    struct modify_aux *aux = aux_;
+    struct sw_flow *flow = b->flows[slot];
+
+    if (flow_matches_desc(&flow->key, aux->key, aux->strict)
+        && (!aux->strict || flow->priority == aux->priority)) {
+        flow_replace_acts(flow, aux->actions, aux->actions_len);
+        aux->count++;
+    }
+    return true;
 }
 
 static int table_hash2_modify(struct sw_table *swt, 
@@ -347,10 +872,38 @@ static int table_hash2_modify(struct sw_table *swt,
         const struct ofp_action_header *actions, size_t actions_len) 
 {
     struct sw_table_hash2 *t2 = (struct sw_table_hash2 *) swt;
-    return (table_hash_modify(t2->subtable[0], key, priority, strict,
-                    actions, actions_len)
-            + table_hash_modify(t2->subtable[1], key, priority, strict,
-                    actions, actions_len));
+    struct modify_aux aux;
+
+    aux.key = key;
+    aux.priority = priority;
+    aux.strict = strict;
+    aux.actions = actions;
+    aux.actions_len = actions_len;
+    aux.count = 0;
+    cuckoo_for_each_candidate(t2, key, modify_cb, &aux);
+    return aux.count;
+}
+
+struct conflict_aux {
+    const struct sw_flow_key *key;
+    uint16_t priority;
+    int strict;
+    bool conflict;
+};
+
+static bool
+conflict_cb(struct sw_table_hash2 *t2 UNUSED, struct cuckoo_bucket *b,
+            int slot, void *aux_)
+{
+    struct conflict_aux *aux = aux_;
+    struct sw_flow *flow = b->flows[slot];
+
+    if (flow_matches_2desc(&flow->key, aux->key, aux->strict)
+        && flow->priority == aux->priority) {
+        aux->conflict = true;
+        return false;
+    }
+    return true;
 }
 
 static int table_hash2_has_conflict(struct sw_table *swt, 
@@ -358,34 +911,147 @@ static int table_hash2_has_conflict(struct sw_table *swt,
                                     uint16_t priority, int strict)
 {
     struct sw_table_hash2 *t2 = (struct sw_table_hash2 *) swt;
-    return (table_hash_has_conflict(t2->subtable[0], key, priority, strict) ||
-            table_hash_has_conflict(t2->subtable[1], key, priority, strict));
+    struct conflict_aux aux;
+
+    aux.key = key;
+    aux.priority = priority;
+    aux.strict = strict;
+    aux.conflict = false;
+    cuckoo_for_each_candidate(t2, key, conflict_cb, &aux);
+    return aux.conflict;
 }
 
+struct delete_aux {
+    struct datapath *dp;
+    const struct sw_flow_key *key;
+    uint16_t out_port;
+    int strict;
+    int count;
+};
+
+static bool
+delete_cb(struct sw_table_hash2 *t2, struct cuckoo_bucket *b, int slot,
+          void *aux_)
+{
+    struct delete_aux *aux = aux_;
+    struct sw_flow *flow = b->flows[slot];
+
+    if (flow_matches_desc(&flow->key, aux->key, aux->strict)
+        && flow_has_out_port(flow, aux->out_port)) {
+        dp_send_flow_end(aux->dp, flow, OFPRR_DELETE);
+        epoch_set(b->flows[slot], NULL);
+        list_remove(&flow->iter_node);
+        flow_deferred_free(flow);
+        t2->n_flows--;
+        aux->count++;
+    }
+    return true;
+}
+
+/* Returns number of deleted flows.  We ignore the priority
+ * argument, since all exact-match entries are the same (highest)
+ * priority. */
 static int table_hash2_delete(struct datapath *dp, struct sw_table *swt,
                               const struct sw_flow_key *key, 
                               uint16_t out_port,
-                              uint16_t priority, int strict)
+                              uint16_t priority UNUSED, int strict)
 {
     struct sw_table_hash2 *t2 = (struct sw_table_hash2 *) swt;
-    return (table_hash_delete(dp, t2->subtable[0], key, out_port, 
-                priority, strict)
-            + table_hash_delete(dp, t2->subtable[1], key, out_port, 
-                priority, strict));
+    struct delete_aux aux;
+
+    aux.dp = dp;
+    aux.key = key;
+    aux.out_port = out_port;
+    aux.strict = strict;
+    aux.count = 0;
+    cuckoo_for_each_candidate(t2, key, delete_cb, &aux);
+    return aux.count;
+}
+
+static void
+cuckoo_timeout_array(struct sw_table_hash2 *t2, struct cuckoo_array *a,
+                     struct list *deleted)
+{
+    unsigned int i;
+
+    for (i = 0; i <= a->mask; i++) {
+        struct cuckoo_bucket *b = &a->buckets[i];
+        int slot;
+
+        for (slot = 0; slot < CUCKOO_SLOTS; slot++) {
+            struct sw_flow *flow = b->flows[slot];
+            if (flow && flow_timeout(flow)) {
+                list_push_back(deleted, &flow->node);
+                epoch_set(b->flows[slot], NULL);
+                list_remove(&flow->iter_node);
+                t2->n_flows--;
+            }
+        }
+    }
 }
 
 static void table_hash2_timeout(struct sw_table *swt, struct list *deleted)
 {
     struct sw_table_hash2 *t2 = (struct sw_table_hash2 *) swt;
-    table_hash_timeout(t2->subtable[0], deleted);
-    table_hash_timeout(t2->subtable[1], deleted);
+
+    cuckoo_timeout_array(t2, t2->cur, deleted);
+    if (t2->old) {
+        cuckoo_timeout_array(t2, t2->old, deleted);
+    }
+}
+
+static void table_hash2_remove(struct sw_table *swt, struct sw_flow *flow)
+{
+    struct sw_table_hash2 *t2 = (struct sw_table_hash2 *) swt;
+    struct cuckoo_pos pos;
+
+    if (cuckoo_find(t2, cuckoo_hash(&flow->key), &flow->key, &pos)
+        && pos.bucket->flows[pos.slot] == flow) {
+        epoch_set(pos.bucket->flows[pos.slot], NULL);
+        list_remove(&flow->iter_node);
+        t2->n_flows--;
+    }
+}
+
+/* Shrinks 't2' if it has become mostly empty and continues any resize in
+ * progress. */
+static bool table_hash2_run(struct sw_table *swt)
+{
+    struct sw_table_hash2 *t2 = (struct sw_table_hash2 *) swt;
+    unsigned int n_buckets = cuckoo_n_buckets(t2->cur);
+
+    if (!t2->old && n_buckets > CUCKOO_MIN_BUCKETS
+        && t2->n_flows * 8 < n_buckets * CUCKOO_SLOTS) {
+        cuckoo_resize(t2, n_buckets / 2);
+    }
+    return cuckoo_rehash(t2, CUCKOO_REHASH_BATCH);
+}
+
+static void
+cuckoo_destroy_array(struct cuckoo_array *a)
+{
+    unsigned int i;
+
+    for (i = 0; i <= a->mask; i++) {
+        int slot;
+
+        for (slot = 0; slot < CUCKOO_SLOTS; slot++) {
+            if (a->buckets[i].flows[slot]) {
+                flow_free(a->buckets[i].flows[slot]);
+            }
+        }
+    }
+    free(a);
 }
 
 static void table_hash2_destroy(struct sw_table *swt)
 {
     struct sw_table_hash2 *t2 = (struct sw_table_hash2 *) swt;
-    table_hash_destroy(t2->subtable[0]);
-    table_hash_destroy(t2->subtable[1]);
+
+    cuckoo_destroy_array(t2->cur);
+    if (t2->old) {
+        cuckoo_destroy_array(t2->old);
+    }
     free(t2);
 }
 
@@ -397,41 +1063,76 @@ static int table_hash2_iterate(struct sw_table *swt,
                                void *private)
 {
     struct sw_table_hash2 *t2 = (struct sw_table_hash2 *) swt;
-    int i;
+    struct sw_flow *flow;
+    unsigned long start;
+
+    if (key->wildcards == 0) {
+        if (position->private[0])
+            return 0;
+        position->private[0] = 1;
+        flow = table_hash2_lookup(swt, key);
+        if (!flow || !flow_has_out_port(flow, out_port)) {
+            return 0;
+        }
+        return callback(flow, private);
+    }
 
-    for (i = position->private[1]; i < 2; i++) {
-        int error = table_hash_iterate(t2->subtable[i], key, out_port, 
-                                       position, callback, private);
-        if (error) {
-            return error;
+    /* Flows move between buckets as other flows are inserted and as the
+     * table is resized, so iterate in order of serial number instead, as
+     * table-tuple does.  Resume with the first flow whose serial number is at
+     * most 'start'. */
+    start = ~position->private[0];
+    LIST_FOR_EACH (flow, struct sw_flow, iter_node, &t2->iter_flows) {
+        if (flow->serial <= start
+                && flow_matches_1wild(&flow->key, key)
+                && flow_has_out_port(flow, out_port)) {
+            int error = callback(flow, private);
+            if (error) {
+                position->private[0] = ~(flow->serial - 1);
+                return error;
+            }
         }
-        position->private[0] = 0;
-        position->private[1]++;
     }
     return 0;
 }
 
+static void
+add_counter(struct sw_table_stats *stats, const char *name,
+            unsigned long long value)
+{
+    if (stats->n_counters < SW_TABLE_MAX_COUNTERS) {
+        struct sw_table_counter *c = &stats->counters[stats->n_counters++];
+        c->name = name;
+        c->value = value;
+    }
+}
+
 static void table_hash2_stats(struct sw_table *swt,
                               struct sw_table_stats *stats)
 {
     struct sw_table_hash2 *t2 = (struct sw_table_hash2 *) swt;
-    struct sw_table_stats substats[2];
-    int i;
+    unsigned int n_buckets = cuckoo_n_buckets(t2->cur);
 
-    for (i = 0; i < 2; i++)
-        table_hash_stats(t2->subtable[i], &substats[i]);
     stats->name = "hash2";
     stats->wildcards = 0;        /* No wildcards are supported. */
-    stats->n_flows   = substats[0].n_flows + substats[1].n_flows;
-    stats->max_flows = substats[0].max_flows + substats[1].max_flows;
+    stats->n_flows   = t2->n_flows;
+    stats->max_flows = t2->max_flows;
     stats->n_lookup  = swt->n_lookup;
     stats->n_matched = swt->n_matched;
+    add_counter(stats, "load_pct",
+                t2->n_flows * 100ULL / (n_buckets * CUCKOO_SLOTS));
+    add_counter(stats, "displaced", t2->n_displaced);
+    add_counter(stats, "insert_failed", t2->n_failed);
+    add_counter(stats, "buckets", n_buckets);
+    add_counter(stats, "resizes", t2->n_resizes);
 }
 
-struct sw_table *table_hash2_create(unsigned int poly0, unsigned int buckets0,
-                                    unsigned int poly1, unsigned int buckets1)
-
+/* Creates an exact-match table that starts out small and grows as needed to
+ * hold up to 'max_flows' flows, which must be a power of 2 no smaller than
+ * CUCKOO_MIN_BUCKETS * CUCKOO_SLOTS. */
+struct sw_table *table_hash2_create(unsigned int max_flows)
 {
+    unsigned int max_buckets = max_flows / CUCKOO_SLOTS;
     struct sw_table_hash2 *t2;
     struct sw_table *swt;
 
@@ -440,13 +1141,16 @@ struct sw_table *table_hash2_create(unsigned int poly0, unsigned int buckets0,
         return NULL;
     memset(t2, '\0', sizeof *t2);
 
-    t2->subtable[0] = table_hash_create(poly0, buckets0);
-    if (t2->subtable[0] == NULL)
-        goto out_free_t2;
-
-    t2->subtable[1] = table_hash_create(poly1, buckets1);
-    if (t2->subtable[1] == NULL)
-        goto out_free_subtable0;
+    assert(max_buckets >= CUCKOO_MIN_BUCKETS
+           && !(max_buckets & (max_buckets - 1)));
+    t2->cur = cuckoo_array_create(CUCKOO_MIN_BUCKETS);
+    if (t2->cur == NULL) {
+        free(t2);
+        return NULL;
+    }
+    t2->max_buckets = max_buckets;
+    t2->max_flows = max_flows;
+    list_init(&t2->iter_flows);
 
     swt = &t2->swt;
     swt->lookup = table_hash2_lookup;
@@ -455,15 +1159,11 @@ struct sw_table *table_hash2_create(unsigned int poly0, unsigned int buckets0,
     swt->has_conflict = table_hash2_has_conflict;
     swt->delete = table_hash2_delete;
     swt->timeout = table_hash2_timeout;
+    swt->remove = table_hash2_remove;
+    swt->run = table_hash2_run;
     swt->destroy = table_hash2_destroy;
     swt->iterate = table_hash2_iterate;
     swt->stats = table_hash2_stats;
 
     return swt;
-
-out_free_subtable0:
-    table_hash_destroy(t2->subtable[0]);
-out_free_t2:
-    free(t2);
-    return NULL;
 }
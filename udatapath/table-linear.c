@@ -34,6 +34,7 @@
 #include <config.h>
 #include "table.h"
 #include <stdlib.h>
+#include "epoch.h"
 #include "flow.h"
 #include "list.h"
 #include "openflow/openflow.h"
@@ -41,22 +42,54 @@
 #include "switch-flow.h"
 #include "datapath.h"
 
+/* The flows in lookup order, as seen by lookups.  Forwarding threads look up
+ * flows without locking while the main thread changes 'flows', so they use a
+ * copy of it that is replaced after every change. */
+struct linear_vector {
+    size_t n;
+    struct sw_flow *flows[0];
+};
+
 struct sw_table_linear {
     struct sw_table swt;
 
     unsigned int max_flows;
     unsigned int n_flows;
     struct list flows;
+    struct linear_vector *vector; /* Copy of 'flows' for lookups. */
     struct list iter_flows;
     unsigned long int next_serial;
 };
 
+/* Replaces 'tl->vector' by a new copy of 'tl->flows'. */
+static void
+publish_flows(struct sw_table_linear *tl)
+{
+    struct linear_vector *vector, *old;
+    struct sw_flow *flow;
+    size_t n;
+
+    vector = xmalloc(sizeof *vector + tl->n_flows * sizeof *vector->flows);
+    n = 0;
+    LIST_FOR_EACH (flow, struct sw_flow, node, &tl->flows) {
+        vector->flows[n++] = flow;
+    }
+    vector->n = n;
+
+    old = tl->vector;
+    epoch_set(tl->vector, vector);
+    epoch_free(old);
+}
+
 static struct sw_flow *table_linear_lookup(struct sw_table *swt,
                                            const struct sw_flow_key *key)
 {
     struct sw_table_linear *tl = (struct sw_table_linear *) swt;
-    struct sw_flow *flow;
-    LIST_FOR_EACH (flow, struct sw_flow, node, &tl->flows) {
+    struct linear_vector *vector = epoch_get(tl->vector);
+    size_t i;
+
+    for (i = 0; vector && i < vector->n; i++) {
+        struct sw_flow *flow = vector->flows[i];
         if (flow_matches_1wild(key, &flow->key))
             return flow;
     }
@@ -79,7 +112,8 @@ static int table_linear_insert(struct sw_table *swt, struct sw_flow *flow)
             flow->serial = f->serial;
             list_replace(&flow->node, &f->node);
             list_replace(&flow->iter_node, &f->iter_node);
-            flow_free(f);
+            publish_flows(tl);
+            flow_deferred_free(f);
             return 1;
         }
 
@@ -97,6 +131,7 @@ static int table_linear_insert(struct sw_table *swt, struct sw_flow *flow)
     flow->serial = tl->next_serial++;
     list_insert(&f->node, &flow->node);
     list_push_front(&tl->iter_flows, &flow->iter_node);
+    publish_flows(tl);
 
     return 1;
 }
@@ -135,20 +170,13 @@ static int table_linear_has_conflict(struct sw_table *swt,
     return false;
 }
 
-static void
-do_delete(struct sw_flow *flow) 
-{
-    list_remove(&flow->node);
-    list_remove(&flow->iter_node);
-    flow_free(flow);
-}
-
 static int table_linear_delete(struct datapath *dp, struct sw_table *swt,
                                const struct sw_flow_key *key, 
                                uint16_t out_port, 
                                uint16_t priority, int strict)
 {
     struct sw_table_linear *tl = (struct sw_table_linear *) swt;
+    struct list deleted = LIST_INITIALIZER(&deleted);
     struct sw_flow *flow, *n;
     unsigned int count = 0;
 
@@ -157,17 +185,26 @@ static int table_linear_delete(struct datapath *dp, struct sw_table *swt,
                 && flow_has_out_port(flow, out_port)
                 && (!strict || (flow->priority == priority))) {
             dp_send_flow_end(dp, flow, OFPRR_DELETE);
-            do_delete(flow);
+            list_remove(&flow->node);
+            list_remove(&flow->iter_node);
+            list_push_back(&deleted, &flow->node);
             count++;
         }
     }
     tl->n_flows -= count;
+
+    /* Free the flows only after lookups can no longer find them. */
+    if (count) {
+        publish_flows(tl);
+        flow_deferred_free_list(&deleted);
+    }
     return count;
 }
 
 static void table_linear_timeout(struct sw_table *swt, struct list *deleted)
 {
     struct sw_table_linear *tl = (struct sw_table_linear *) swt;
+    unsigned int n_flows = tl->n_flows;
     struct sw_flow *flow, *n;
 
     LIST_FOR_EACH_SAFE (flow, n, struct sw_flow, node, &tl->flows) {
@@ -178,18 +215,27 @@ static void table_linear_timeout(struct sw_table *swt, struct list *deleted)
             tl->n_flows--;
         }
     }
+    if (tl->n_flows != n_flows) {
+        publish_flows(tl);
+    }
+}
+
+static void table_linear_remove(struct sw_table *swt, struct sw_flow *flow)
+{
+    struct sw_table_linear *tl = (struct sw_table_linear *) swt;
+
+    list_remove(&flow->node);
+    list_remove(&flow->iter_node);
+    tl->n_flows--;
+    publish_flows(tl);
 }
 
 static void table_linear_destroy(struct sw_table *swt)
 {
     struct sw_table_linear *tl = (struct sw_table_linear *) swt;
 
-    while (!list_is_empty(&tl->flows)) {
-        struct sw_flow *flow = CONTAINER_OF(list_front(&tl->flows),
-                                            struct sw_flow, node);
-        list_remove(&flow->node);
-        flow_free(flow);
-    }
+    flow_free_list(&tl->flows);
+    free(tl->vector);
     free(tl);
 }
 
@@ -248,6 +294,7 @@ struct sw_table *table_linear_create(unsigned int max_flows)
     swt->has_conflict = table_linear_has_conflict;
     swt->delete = table_linear_delete;
     swt->timeout = table_linear_timeout;
+    swt->remove = table_linear_remove;
     swt->destroy = table_linear_destroy;
     swt->iterate = table_linear_iterate;
     swt->stats = table_linear_stats;
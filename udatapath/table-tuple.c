@@ -0,0 +1,657 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+/* Tuple space search table.
+ *
+ * Flows are grouped into subtables according to their wildcards, so that all
+ * of the flows in a subtable care about exactly the same bits of the flow.
+ * Each subtable is a hash table keyed on the flow with the wildcarded bits
+ * masked off, so that looking up a packet in a subtable takes a single hash
+ * probe regardless of how many flows it contains.
+ *
+ * The subtables are kept sorted in decreasing order of the highest-priority
+ * flow that each one contains, so that a lookup can stop as soon as it reaches
+ * a subtable that cannot contain a better match than the one already found.
+ *
+ * Forwarding threads look up flows without locking while the main thread
+ * changes the table, so nothing that a lookup reads is changed in place except
+ * by a single atomic store.  Lookups walk a copy of the sorted list of
+ * subtables that is replaced whenever the order changes, and each subtable's
+ * flows are in an open-addressed array that is replaced, rather than resized,
+ * when it fills up.  Removed flows leave a marker behind in their slots, so
+ * that a lookup probing past them still finds what lies beyond.  Everything
+ * that is replaced or removed is freed through epoch_defer(). */
+
+#include <config.h>
+#include "table.h"
+#include <stdlib.h>
+#include "epoch.h"
+#include "flow.h"
+#include "hash.h"
+#include "list.h"
+#include "openflow/openflow.h"
+#include "openflow/nicira-ext.h"
+#include "switch-flow.h"
+#include "datapath.h"
+
+#define FLOW_N_WORDS (sizeof(struct flow) / sizeof(uint32_t))
+BUILD_ASSERT_DECL(sizeof(struct flow) % sizeof(uint32_t) == 0);
+
+/* Initial number of slots in a subtable's index. */
+#define TUPLE_MIN_SLOTS 8
+
+/* Marks the slot of a flow that has been removed. */
+static struct sw_flow removed_flow;
+#define TUPLE_REMOVED (&removed_flow)
+
+struct tuple_slot {
+    uint32_t hash;              /* Hash of 'flow' under the subtable's mask. */
+    struct sw_flow *flow;       /* Null if never used, or TUPLE_REMOVED. */
+};
+
+/* Flows in a subtable, hashed with linear probing.  At least a quarter of the
+ * slots are always null, so that every probe sequence ends. */
+struct tuple_index {
+    size_t mask;                /* Number of slots minus 1. */
+    size_t n_used;              /* Number of nonnull slots. */
+    struct tuple_slot slots[0];
+};
+
+/* A set of flows that all have the same wildcards. */
+struct tuple_subtable {
+    struct list node;           /* Element in sw_table_tuple.subtables. */
+    struct tuple_index *index;  /* Contains "struct sw_flow"s. */
+    uint32_t wildcards;         /* Wildcards shared by all flows. */
+    struct flow mask;           /* 1-bit in each significant flow bit. */
+    unsigned int n_flows;       /* Number of flows in 'index'. */
+    uint16_t max_priority;      /* Highest priority in 'index'. */
+};
+
+/* The subtables in lookup order, as seen by lookups.  Each subtable's
+ * max_priority is copied too, since it changes along with the order. */
+struct tuple_vector {
+    size_t n;
+    struct {
+        struct tuple_subtable *st;
+        uint16_t max_priority;
+    } subtables[0];
+};
+
+struct sw_table_tuple {
+    struct sw_table swt;
+
+    unsigned int max_flows;
+    unsigned int n_flows;
+    struct list subtables;      /* In decreasing order of max_priority. */
+    struct tuple_vector *vector; /* Copy of 'subtables' for lookups. */
+    struct list iter_flows;
+    unsigned long int next_serial;
+};
+
+/* Returns a hash of the bits of 'flow' that are significant in 'mask'. */
+static uint32_t
+hash_masked_flow(const struct flow *flow, const struct flow *mask)
+{
+    const uint32_t *f = (const uint32_t *) flow;
+    const uint32_t *m = (const uint32_t *) mask;
+    uint32_t words[FLOW_N_WORDS];
+    size_t i;
+
+    for (i = 0; i < FLOW_N_WORDS; i++) {
+        words[i] = f[i] & m[i];
+    }
+    return hash_words(words, FLOW_N_WORDS, 0);
+}
+
+/* Initializes 'mask' with a 1-bit in each bit of a flow that is significant
+ * for 'key', that is, that is not wildcarded by 'key'. */
+static void
+make_flow_mask(const struct sw_flow_key *key, struct flow *mask)
+{
+    uint32_t w = key->wildcards;
+
+    memset(mask, 0, sizeof *mask);
+    mask->nw_src = key->nw_src_mask;
+    mask->nw_dst = key->nw_dst_mask;
+    if (!(w & OFPFW_IN_PORT)) {
+        mask->in_port = UINT16_MAX;
+    }
+    if (!(w & OFPFW_DL_VLAN)) {
+        mask->dl_vlan = UINT16_MAX;
+    }
+    if (!(w & OFPFW_DL_TYPE)) {
+        mask->dl_type = UINT16_MAX;
+    }
+    if (!(w & OFPFW_TP_SRC)) {
+        mask->tp_src = UINT16_MAX;
+    }
+    if (!(w & OFPFW_TP_DST)) {
+        mask->tp_dst = UINT16_MAX;
+    }
+    if (!(w & OFPFW_DL_SRC)) {
+        memset(mask->dl_src, 0xff, sizeof mask->dl_src);
+    }
+    if (!(w & OFPFW_DL_DST)) {
+        memset(mask->dl_dst, 0xff, sizeof mask->dl_dst);
+    }
+    if (!(w & OFPFW_DL_VLAN_PCP)) {
+        mask->dl_vlan_pcp = UINT8_MAX;
+    }
+    if (!(w & OFPFW_NW_TOS)) {
+        mask->nw_tos = UINT8_MAX;
+    }
+    if (!(w & OFPFW_NW_PROTO)) {
+        mask->nw_proto = UINT8_MAX;
+    }
+}
+
+/* Returns true if 'a' should be preferred over 'b' when both match a packet:
+ * higher priority wins, and among equal priorities the older flow wins, as in
+ * table-linear. */
+static inline bool
+flow_is_better(const struct sw_flow *a, const struct sw_flow *b)
+{
+    return (a->priority > b->priority
+            || (a->priority == b->priority && a->serial < b->serial));
+}
+
+static struct tuple_index *
+create_index(size_t n_slots)
+{
+    struct tuple_index *index;
+
+    index = xcalloc(1, sizeof *index + n_slots * sizeof *index->slots);
+    index->mask = n_slots - 1;
+    return index;
+}
+
+/* Adds 'flow', whose hash is 'hash', to 'index', which must have room. */
+static void
+index_insert(struct tuple_index *index, uint32_t hash, struct sw_flow *flow)
+{
+    size_t i;
+
+    for (i = hash & index->mask; ; i = (i + 1) & index->mask) {
+        struct tuple_slot *slot = &index->slots[i];
+        if (!slot->flow || slot->flow == TUPLE_REMOVED) {
+            index->n_used += !slot->flow;
+            __atomic_store_n(&slot->hash, hash, __ATOMIC_RELAXED);
+            epoch_set(slot->flow, flow);
+            return;
+        }
+    }
+}
+
+/* Returns the slot in 'st''s index that holds 'flow'. */
+static struct tuple_slot *
+find_slot(const struct tuple_subtable *st, const struct sw_flow *flow)
+{
+    struct tuple_index *index = st->index;
+    size_t i;
+
+    for (i = hash_masked_flow(&flow->key.flow, &st->mask) & index->mask; ;
+         i = (i + 1) & index->mask) {
+        if (index->slots[i].flow == flow) {
+            return &index->slots[i];
+        }
+    }
+}
+
+/* Adds 'flow' to 'st''s index, first replacing the index by a larger one if it
+ * is getting full.  Lookups may keep using the old index until they are
+ * done with it. */
+static void
+subtable_insert(struct tuple_subtable *st, struct sw_flow *flow)
+{
+    struct tuple_index *index = st->index;
+
+    if ((index->n_used + 1) * 4 > (index->mask + 1) * 3) {
+        struct tuple_index *new;
+        size_t n_slots;
+        size_t i;
+
+        /* Size the new index for twice the live flows, which may be no
+         * bigger than before if many slots were left by removed flows. */
+        n_slots = TUPLE_MIN_SLOTS;
+        while (n_slots < (st->n_flows + 1) * 2) {
+            n_slots *= 2;
+        }
+        new = create_index(n_slots);
+        for (i = 0; i <= index->mask; i++) {
+            struct tuple_slot *slot = &index->slots[i];
+            if (slot->flow && slot->flow != TUPLE_REMOVED) {
+                index_insert(new, slot->hash, slot->flow);
+            }
+        }
+        epoch_set(st->index, new);
+        epoch_free(index);
+        index = new;
+    }
+    index_insert(index, hash_masked_flow(&flow->key.flow, &st->mask), flow);
+}
+
+/* Replaces 'tt->vector' by a new copy of 'tt->subtables'. */
+static void
+publish_subtables(struct sw_table_tuple *tt)
+{
+    struct tuple_vector *vector, *old;
+    struct tuple_subtable *st;
+    size_t n;
+
+    vector = xmalloc(sizeof *vector
+                     + list_size(&tt->subtables) * sizeof *vector->subtables);
+    n = 0;
+    LIST_FOR_EACH (st, struct tuple_subtable, node, &tt->subtables) {
+        vector->subtables[n].st = st;
+        vector->subtables[n].max_priority = st->max_priority;
+        n++;
+    }
+    vector->n = n;
+
+    old = tt->vector;
+    epoch_set(tt->vector, vector);
+    epoch_free(old);
+}
+
+/* Moves 'st' to its proper place in 'tt->subtables' according to its
+ * max_priority. */
+static void
+reposition_subtable(struct sw_table_tuple *tt, struct tuple_subtable *st)
+{
+    struct tuple_subtable *iter;
+
+    list_remove(&st->node);
+    LIST_FOR_EACH (iter, struct tuple_subtable, node, &tt->subtables) {
+        if (iter->max_priority < st->max_priority) {
+            break;
+        }
+    }
+    list_insert(&iter->node, &st->node);
+    publish_subtables(tt);
+}
+
+static struct tuple_subtable *
+find_subtable(const struct sw_table_tuple *tt, uint32_t wildcards)
+{
+    struct tuple_subtable *st;
+
+    LIST_FOR_EACH (st, struct tuple_subtable, node, &tt->subtables) {
+        if (st->wildcards == wildcards) {
+            return st;
+        }
+    }
+    return NULL;
+}
+
+static struct tuple_subtable *
+create_subtable(struct sw_table_tuple *tt, const struct sw_flow_key *key)
+{
+    struct tuple_subtable *st = xmalloc(sizeof *st);
+
+    st->index = create_index(TUPLE_MIN_SLOTS);
+    st->wildcards = key->wildcards;
+    make_flow_mask(key, &st->mask);
+    st->n_flows = 0;
+    st->max_priority = 0;
+    list_push_back(&tt->subtables, &st->node);
+    return st;
+}
+
+/* Removes 'st' from 'tt' and frees it once lookups are done with it. */
+static void
+destroy_subtable(struct sw_table_tuple *tt, struct tuple_subtable *st)
+{
+    list_remove(&st->node);
+    publish_subtables(tt);
+    epoch_free(st->index);
+    epoch_free(st);
+}
+
+/* Searches 'st' for a flow that is identical to 'key' modulo the wildcards
+ * in 'key', which must be the same as those of 'st', and that has the given
+ * 'priority'. */
+static struct sw_flow *
+find_flow_strict(const struct tuple_subtable *st,
+                 const struct sw_flow_key *key, uint16_t priority)
+{
+    struct tuple_index *index = st->index;
+    size_t i;
+
+    for (i = hash_masked_flow(&key->flow, &st->mask) & index->mask;
+         index->slots[i].flow; i = (i + 1) & index->mask) {
+        struct sw_flow *flow = index->slots[i].flow;
+        if (flow != TUPLE_REMOVED && flow->priority == priority
+            && flow_matches_1wild(&flow->key, key)) {
+            return flow;
+        }
+    }
+    return NULL;
+}
+
+/* Removes 'flow' from 'tt' without freeing it. */
+static void
+remove_flow(struct sw_table_tuple *tt, struct sw_flow *flow)
+{
+    struct tuple_subtable *st = flow->private;
+
+    epoch_set(find_slot(st, flow)->flow, TUPLE_REMOVED);
+    list_remove(&flow->iter_node);
+    tt->n_flows--;
+
+    if (!--st->n_flows) {
+        destroy_subtable(tt, st);
+    } else if (flow->priority == st->max_priority) {
+        struct tuple_index *index = st->index;
+        size_t i;
+
+        st->max_priority = 0;
+        for (i = 0; i <= index->mask; i++) {
+            struct sw_flow *f = index->slots[i].flow;
+            if (f && f != TUPLE_REMOVED && f->priority > st->max_priority) {
+                st->max_priority = f->priority;
+            }
+        }
+        reposition_subtable(tt, st);
+    }
+}
+
+static void
+do_delete(struct sw_table_tuple *tt, struct sw_flow *flow)
+{
+    remove_flow(tt, flow);
+    flow_deferred_free(flow);
+}
+
+static struct sw_flow *table_tuple_lookup(struct sw_table *swt,
+                                          const struct sw_flow_key *key)
+{
+    struct sw_table_tuple *tt = (struct sw_table_tuple *) swt;
+    struct tuple_vector *vector = epoch_get(tt->vector);
+    struct sw_flow *best = NULL;
+    size_t i;
+
+    for (i = 0; vector && i < vector->n; i++) {
+        struct tuple_subtable *st = vector->subtables[i].st;
+        struct tuple_index *index;
+        uint32_t hash;
+        size_t j;
+
+        if (best && vector->subtables[i].max_priority < best->priority) {
+            break;
+        }
+
+        index = epoch_get(st->index);
+        hash = hash_masked_flow(&key->flow, &st->mask);
+        for (j = hash & index->mask; ; j = (j + 1) & index->mask) {
+            struct tuple_slot *slot = &index->slots[j];
+            struct sw_flow *flow = epoch_get(slot->flow);
+
+            if (!flow) {
+                break;
+            } else if (flow != TUPLE_REMOVED
+                       && __atomic_load_n(&slot->hash, __ATOMIC_RELAXED) == hash
+                       && flow_matches_1wild(key, &flow->key)
+                       && (!best || flow_is_better(flow, best))) {
+                best = flow;
+            }
+        }
+    }
+    return best;
+}
+
+static int table_tuple_insert(struct sw_table *swt, struct sw_flow *flow)
+{
+    struct sw_table_tuple *tt = (struct sw_table_tuple *) swt;
+    struct tuple_subtable *st;
+    struct sw_flow *old;
+
+    st = find_subtable(tt, flow->key.wildcards);
+    if (st) {
+        /* Just replace any flow that matches exactly. */
+        old = find_flow_strict(st, &flow->key, flow->priority);
+        if (old) {
+            flow->serial = old->serial;
+            flow->private = st;
+            epoch_set(find_slot(st, old)->flow, flow);
+            list_replace(&flow->iter_node, &old->iter_node);
+            flow_deferred_free(old);
+            return 1;
+        }
+    }
+
+    /* Make sure there's room in the table. */
+    if (tt->n_flows >= tt->max_flows) {
+        return 0;
+    }
+    tt->n_flows++;
+
+    if (!st) {
+        st = create_subtable(tt, &flow->key);
+    }
+    flow->serial = tt->next_serial++;
+    flow->private = st;
+    subtable_insert(st, flow);
+    list_push_front(&tt->iter_flows, &flow->iter_node);
+    if (!st->n_flows++ || flow->priority > st->max_priority) {
+        st->max_priority = flow->priority;
+        reposition_subtable(tt, st);
+    }
+
+    return 1;
+}
+
+static int table_tuple_modify(struct sw_table *swt,
+                const struct sw_flow_key *key, uint16_t priority, int strict,
+                const struct ofp_action_header *actions, size_t actions_len)
+{
+    struct sw_table_tuple *tt = (struct sw_table_tuple *) swt;
+    struct sw_flow *flow;
+    unsigned int count = 0;
+
+    if (strict) {
+        struct tuple_subtable *st = find_subtable(tt, key->wildcards);
+        flow = st ? find_flow_strict(st, key, priority) : NULL;
+        if (flow) {
+            flow_replace_acts(flow, actions, actions_len);
+            count = 1;
+        }
+    } else {
+        LIST_FOR_EACH (flow, struct sw_flow, iter_node, &tt->iter_flows) {
+            if (flow_matches_desc(&flow->key, key, strict)) {
+                flow_replace_acts(flow, actions, actions_len);
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+static int table_tuple_has_conflict(struct sw_table *swt,
+                                    const struct sw_flow_key *key,
+                                    uint16_t priority, int strict)
+{
+    struct sw_table_tuple *tt = (struct sw_table_tuple *) swt;
+    struct sw_flow *flow;
+
+    if (strict) {
+        struct tuple_subtable *st = find_subtable(tt, key->wildcards);
+        return st && find_flow_strict(st, key, priority);
+    }
+
+    LIST_FOR_EACH (flow, struct sw_flow, iter_node, &tt->iter_flows) {
+        if (flow_matches_2desc(&flow->key, key, strict)
+                && (flow->priority == priority)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int table_tuple_delete(struct datapath *dp, struct sw_table *swt,
+                              const struct sw_flow_key *key,
+                              uint16_t out_port,
+                              uint16_t priority, int strict)
+{
+    struct sw_table_tuple *tt = (struct sw_table_tuple *) swt;
+    struct sw_flow *flow, *n;
+    unsigned int count = 0;
+
+    if (strict) {
+        struct tuple_subtable *st = find_subtable(tt, key->wildcards);
+        flow = st ? find_flow_strict(st, key, priority) : NULL;
+        if (flow && flow_has_out_port(flow, out_port)) {
+            dp_send_flow_end(dp, flow, OFPRR_DELETE);
+            do_delete(tt, flow);
+            count = 1;
+        }
+    } else {
+        LIST_FOR_EACH_SAFE (flow, n, struct sw_flow, iter_node,
+                            &tt->iter_flows) {
+            if (flow_matches_desc(&flow->key, key, strict)
+                    && flow_has_out_port(flow, out_port)) {
+                dp_send_flow_end(dp, flow, OFPRR_DELETE);
+                do_delete(tt, flow);
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+static void table_tuple_timeout(struct sw_table *swt, struct list *deleted)
+{
+    struct sw_table_tuple *tt = (struct sw_table_tuple *) swt;
+    struct sw_flow *flow, *n;
+
+    LIST_FOR_EACH_SAFE (flow, n, struct sw_flow, iter_node, &tt->iter_flows) {
+        if (flow_timeout(flow)) {
+            remove_flow(tt, flow);
+            list_push_back(deleted, &flow->node);
+        }
+    }
+}
+
+static void table_tuple_remove(struct sw_table *swt, struct sw_flow *flow)
+{
+    remove_flow((struct sw_table_tuple *) swt, flow);
+}
+
+static void table_tuple_destroy(struct sw_table *swt)
+{
+    struct sw_table_tuple *tt = (struct sw_table_tuple *) swt;
+    struct tuple_subtable *st, *next_st;
+    struct sw_flow *flow, *next_flow;
+
+    LIST_FOR_EACH_SAFE (flow, next_flow, struct sw_flow, iter_node,
+                        &tt->iter_flows) {
+        flow_free(flow);
+    }
+    LIST_FOR_EACH_SAFE (st, next_st, struct tuple_subtable, node,
+                        &tt->subtables) {
+        free(st->index);
+        free(st);
+    }
+    free(tt->vector);
+    free(tt);
+}
+
+static int table_tuple_iterate(struct sw_table *swt,
+                               const struct sw_flow_key *key,
+                               uint16_t out_port,
+                               struct sw_table_position *position,
+                               int (*callback)(struct sw_flow *, void *),
+                               void *private)
+{
+    struct sw_table_tuple *tt = (struct sw_table_tuple *) swt;
+    struct sw_flow *flow;
+    unsigned long start;
+
+    /* Flows are pushed onto the front of 'iter_flows' as they are inserted,
+     * so 'iter_flows' is in decreasing order of serial number.  Resume with
+     * the first flow whose serial number is at most 'start'. */
+    start = ~position->private[0];
+    LIST_FOR_EACH (flow, struct sw_flow, iter_node, &tt->iter_flows) {
+        if (flow->serial <= start
+                && flow_matches_2wild(key, &flow->key)
+                && flow_has_out_port(flow, out_port)) {
+            int error = callback(flow, private);
+            if (error) {
+                position->private[0] = ~(flow->serial - 1);
+                return error;
+            }
+        }
+    }
+    return 0;
+}
+
+static void table_tuple_stats(struct sw_table *swt,
+                              struct sw_table_stats *stats)
+{
+    struct sw_table_tuple *tt = (struct sw_table_tuple *) swt;
+    stats->name = "tuple";
+    stats->wildcards = OFPFW_ALL;
+    stats->n_flows   = tt->n_flows;
+    stats->max_flows = tt->max_flows;
+    stats->n_lookup  = swt->n_lookup;
+    stats->n_matched = swt->n_matched;
+}
+
+struct sw_table *table_tuple_create(unsigned int max_flows)
+{
+    struct sw_table_tuple *tt;
+    struct sw_table *swt;
+
+    tt = calloc(1, sizeof *tt);
+    if (tt == NULL)
+        return NULL;
+
+    swt = &tt->swt;
+    swt->lookup = table_tuple_lookup;
+    swt->insert = table_tuple_insert;
+    swt->modify = table_tuple_modify;
+    swt->has_conflict = table_tuple_has_conflict;
+    swt->delete = table_tuple_delete;
+    swt->timeout = table_tuple_timeout;
+    swt->remove = table_tuple_remove;
+    swt->destroy = table_tuple_destroy;
+    swt->iterate = table_tuple_iterate;
+    swt->stats = table_tuple_stats;
+
+    tt->max_flows = max_flows;
+    tt->n_flows = 0;
+    list_init(&tt->subtables);
+    list_init(&tt->iter_flows);
+    tt->next_serial = 0;
+
+    return swt;
+}
@@ -37,6 +37,7 @@
 #ifndef TABLE_H
 #define TABLE_H 1
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -46,6 +47,14 @@ struct sw_flow_key;
 struct ofp_action_header;
 struct list;
 
+/* An implementation-specific table counter. */
+struct sw_table_counter {
+    const char *name;            /* Human-readable name. */
+    unsigned long long value;
+};
+
+#define SW_TABLE_MAX_COUNTERS 6
+
 /* Table statistics. */
 struct sw_table_stats {
     const char *name;            /* Human-readable name. */
@@ -55,6 +64,11 @@ struct sw_table_stats {
     unsigned int max_flows;      /* Flow capacity. */
     unsigned long int n_lookup;  /* Number of packets looked up. */
     unsigned long int n_matched; /* Number of packets that have hit. */
+
+    /* Optional implementation-specific counters.  The caller must zero
+     * 'n_counters' before calling the table's 'stats' function. */
+    unsigned int n_counters;
+    struct sw_table_counter counters[SW_TABLE_MAX_COUNTERS];
 };
 
 /* Position within an iteration of a sw_table.
@@ -68,8 +82,8 @@ struct sw_table_position {
 /* A single table of flows.  */
 struct sw_table {
     /* The number of packets that have been looked up and matched,
-     * respecitvely.  To make these 100% accurate, they should be atomic.  
-     * However, we're primarily concerned about speed. */
+     * respecitvely.  Forwarding threads count lookups in their own chain
+     * caches, and chain_sum_lookups() stores the totals here. */
     unsigned long long n_lookup;
     unsigned long long n_matched;
 
@@ -115,6 +129,18 @@ struct sw_table {
      * caller to free. */
     void (*timeout)(struct sw_table *table, struct list *deleted);
 
+    /* Removes 'flow', which must be in 'table', from 'table' without freeing
+     * it.  Optional.  The chain expires the flows in a table that provides
+     * this function with its timer wheel, calling this function for each
+     * flow as it expires, instead of calling 'timeout' once a second. */
+    void (*remove)(struct sw_table *table, struct sw_flow *flow);
+
+    /* Does a bounded amount of background work on 'table', such as moving
+     * some of its flows into a resized hash array.  Optional.  Called on
+     * every pass through the main loop.  Returns true if more work remains,
+     * in which case it should be called again soon. */
+    bool (*run)(struct sw_table *table);
+
     /* Destroys 'table', which must not have any users. */
     void (*destroy)(struct sw_table *table);
 
@@ -143,8 +169,8 @@ struct sw_table {
 
 struct sw_table *table_hash_create(unsigned int polynomial,
                                    unsigned int n_buckets);
-struct sw_table *table_hash2_create(unsigned int poly0, unsigned int buckets0,
-                                    unsigned int poly1, unsigned int buckets1);
+struct sw_table *table_hash2_create(unsigned int max_flows);
 struct sw_table *table_linear_create(unsigned int max_flows);
+struct sw_table *table_tuple_create(unsigned int max_flows);
 
 #endif /* table.h */
@@ -0,0 +1,122 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#include <config.h>
+#include "timer-wheel.h"
+
+/* Initializes 'wheel' as empty, with 'now' as the current tick. */
+void
+timer_wheel_init(struct timer_wheel *wheel, uint64_t now)
+{
+    int level, i;
+
+    wheel->now = now;
+    for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        for (i = 0; i < TIMER_WHEEL_SIZE; i++) {
+            list_init(&wheel->slots[level][i]);
+        }
+    }
+}
+
+/* Puts 'timer' into the slot of 'wheel' that corresponds to its expiration
+ * tick, which is treated as the next tick if it has already passed. */
+static void
+place_timer(struct timer_wheel *wheel, struct wheel_timer *timer)
+{
+    uint64_t base = wheel->now + 1;
+    uint64_t expires = timer->expires > base ? timer->expires : base;
+    uint64_t hi;
+
+    if (expires - base < TIMER_WHEEL_SIZE) {
+        list_push_back(&wheel->slots[0][expires & TIMER_WHEEL_MASK],
+                       &timer->node);
+        return;
+    }
+
+    hi = expires >> TIMER_WHEEL_BITS;
+    if (hi - (base >> TIMER_WHEEL_BITS) >= TIMER_WHEEL_SIZE) {
+        hi = (base >> TIMER_WHEEL_BITS) + TIMER_WHEEL_SIZE - 1;
+    }
+    list_push_back(&wheel->slots[1][hi & TIMER_WHEEL_MASK], &timer->node);
+}
+
+/* Schedules 'timer', which must not already be scheduled, to fire at tick
+ * 'expires'. */
+void
+timer_wheel_insert(struct timer_wheel *wheel, struct wheel_timer *timer,
+                   uint64_t expires)
+{
+    timer->expires = expires;
+    place_timer(wheel, timer);
+}
+
+/* Redistributes the timers in level 1 slot 'idx' of 'wheel'. */
+static void
+cascade(struct timer_wheel *wheel, unsigned int idx)
+{
+    struct list *slot = &wheel->slots[1][idx];
+    struct list timers;
+
+    if (list_is_empty(slot)) {
+        return;
+    }
+    list_init(&timers);
+    list_splice(&timers, slot->next, slot);
+    while (!list_is_empty(&timers)) {
+        struct wheel_timer *timer = CONTAINER_OF(list_pop_front(&timers),
+                                                 struct wheel_timer, node);
+        place_timer(wheel, timer);
+    }
+}
+
+/* Advances 'wheel' to tick 'now', appending each timer that expires at or
+ * before 'now' to 'expired'.  The timers remain scheduled, in the sense of
+ * wheel_timer_is_scheduled(), until the caller removes them from
+ * 'expired'. */
+void
+timer_wheel_advance(struct timer_wheel *wheel, uint64_t now,
+                    struct list *expired)
+{
+    while (wheel->now < now) {
+        uint64_t tick = wheel->now + 1;
+        struct list *slot;
+
+        if (!(tick & TIMER_WHEEL_MASK)) {
+            cascade(wheel, (tick >> TIMER_WHEEL_BITS) & TIMER_WHEEL_MASK);
+        }
+        wheel->now = tick;
+
+        slot = &wheel->slots[0][tick & TIMER_WHEEL_MASK];
+        list_splice(expired, slot->next, slot);
+    }
+}
@@ -0,0 +1,97 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H 1
+
+/* Hierarchical timer wheel.
+ *
+ * Time is measured in integer "ticks" chosen by the user.  Level 0 of the
+ * wheel has one slot per tick for the next TIMER_WHEEL_SIZE ticks; level 1
+ * has one slot per TIMER_WHEEL_SIZE ticks beyond that.  Timers in a level 1
+ * slot are redistributed into level 0 ("cascaded") when the wheel reaches
+ * that slot, so inserting, cancelling, and firing a timer all take constant
+ * time regardless of how many timers are pending.  Timers further away than
+ * the wheel spans are parked in its last slot and cascaded again later. */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "list.h"
+
+#define TIMER_WHEEL_BITS 8
+#define TIMER_WHEEL_SIZE (1u << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SIZE - 1)
+#define TIMER_WHEEL_LEVELS 2
+
+/* A timer, normally embedded in the object that it times out. */
+struct wheel_timer {
+    struct list node;           /* In a slot of a timer_wheel, or on a list
+                                 * of expired timers. */
+    uint64_t expires;           /* Tick at which the timer fires. */
+};
+
+struct timer_wheel {
+    uint64_t now;               /* Last tick processed. */
+    struct list slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SIZE];
+};
+
+void timer_wheel_init(struct timer_wheel *, uint64_t now);
+void timer_wheel_insert(struct timer_wheel *, struct wheel_timer *,
+                        uint64_t expires);
+void timer_wheel_advance(struct timer_wheel *, uint64_t now,
+                         struct list *expired);
+
+/* Initializes 'timer' as not scheduled. */
+static inline void
+wheel_timer_init(struct wheel_timer *timer)
+{
+    list_init(&timer->node);
+}
+
+/* Returns true if 'timer' is in a wheel or on a list of expired timers. */
+static inline bool
+wheel_timer_is_scheduled(const struct wheel_timer *timer)
+{
+    return !list_is_empty(&timer->node);
+}
+
+/* Removes 'timer' from the wheel or expired list that it is on, if any.  The
+ * wheel itself is not needed. */
+static inline void
+wheel_timer_cancel(struct wheel_timer *timer)
+{
+    list_remove(&timer->node);
+    list_init(&timer->node);
+}
+
+#endif /* timer-wheel.h */
@@ -78,6 +78,8 @@ static uint64_t dpid = UINT64_MAX;
 static char *port_list;
 static char *local_port = "tap:";
 static uint16_t num_queues = NETDEV_MAX_QUEUES;
+static int n_threads;
+static unsigned int n_buffers = DP_DEFAULT_N_BUFFERS;
 
 static void add_ports(struct datapath *dp, char *port_list);
 
@@ -119,6 +121,7 @@ udatapath_cmd(int argc, char *argv[])
     }
 
     error = dp_new(&dp, dpid);
+    dp_set_n_buffers(dp, n_buffers);
 
     n_listeners = 0;
     for (i = optind; i < argc; i++) {
@@ -156,6 +159,13 @@ udatapath_cmd(int argc, char *argv[])
     die_if_already_running();
     daemonize();
 
+    if (n_threads) {
+        error = dp_start_threads(dp, n_threads);
+        if (error) {
+            OFP_FATAL(error, "failed to start forwarding threads");
+        }
+    }
+
     for (;;) {
         dp_run(dp);
         dp_wait(dp);
@@ -194,7 +204,9 @@ parse_options(int argc, char *argv[])
         OPT_SERIAL_NUM,
         OPT_BOOTSTRAP_CA_CERT,
         OPT_NO_LOCAL_PORT,
-        OPT_NO_SLICING
+        OPT_NO_SLICING,
+        OPT_N_THREADS,
+        OPT_N_BUFFERS
     };
 
     static struct option long_options[] = {
@@ -206,6 +218,8 @@ parse_options(int argc, char *argv[])
         {"help",        no_argument, 0, 'h'},
         {"version",     no_argument, 0, 'V'},
         {"no-slicing",  no_argument, 0, OPT_NO_SLICING},
+        {"n-threads",   required_argument, 0, OPT_N_THREADS},
+        {"n-buffers",   required_argument, 0, OPT_N_BUFFERS},
         {"mfr-desc",    required_argument, 0, OPT_MFR_DESC},
         {"hw-desc",     required_argument, 0, OPT_HW_DESC},
         {"sw-desc",     required_argument, 0, OPT_SW_DESC},
@@ -295,6 +309,22 @@ parse_options(int argc, char *argv[])
             num_queues = 0;
             break;
 
+        case OPT_N_THREADS:
+            n_threads = atoi(optarg);
+            if (n_threads < 1 || n_threads > DP_MAX_THREADS) {
+                ofp_fatal(0, "argument to --n-threads must be between 1 "
+                          "and %d", DP_MAX_THREADS);
+            }
+            break;
+
+        case OPT_N_BUFFERS:
+            n_buffers = atoi(optarg);
+            if (n_buffers < 1 || n_buffers > DP_MAX_N_BUFFERS) {
+                ofp_fatal(0, "argument to --n-buffers must be between 1 "
+                          "and %u", DP_MAX_N_BUFFERS);
+            }
+            break;
+
         DAEMON_OPTION_HANDLERS
 
 #ifdef HAVE_OPENSSL
@@ -332,6 +362,8 @@ usage(void)
            "  -d, --datapath-id=ID    Use ID as the OpenFlow switch ID\n"
            "                          (ID must consist of 12 hex digits)\n"
            "  --no-slicing            disable slicing\n"
+           "  --n-threads=N           forward packets on N threads\n"
+           "  --n-buffers=N           save up to N packets for controller\n"
            "\nOther options:\n"
            "  -D, --detach            run in background as daemon\n"
            "  -P, --pidfile[=FILE]    create pidfile (default: %s/ofdatapath.pid)\n"
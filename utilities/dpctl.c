@@ -230,6 +230,7 @@ usage(void)
            "  show-protostat SWITCH       report protocol statistics\n"
            "  dump-desc SWITCH            print switch description\n"
            "  dump-tables SWITCH          print table stats\n"
+           "  dump-counters SWITCH        print implementation counters\n"
            "  mod-port SWITCH IFACE ACT   modify port behavior\n"
            "  dump-ports SWITCH [PORT]    print port statistics\n"
            "  desc SWITCH STRING          set switch description\n"
@@ -732,6 +733,19 @@ do_dump_tables(const struct settings *s UNUSED, int argc UNUSED, char *argv[])
   dump_trivial_stats_transaction(argv[1], OFPST_TABLE);
 }
 
+static void
+do_dump_counters(const struct settings *s UNUSED, int argc UNUSED,
+                 char *argv[])
+{
+    struct ofp_extension_stats_header *osh;
+    struct ofpbuf *request;
+
+    osh = alloc_stats_request(sizeof *osh, OFPST_VENDOR, &request);
+    osh->vendor = htonl(OPENFLOW_VENDOR_ID);
+    osh->subtype = htonl(OFP_EXT_STATS_COUNTERS);
+    dump_stats_transaction(argv[1], request);
+}
+
 static uint32_t
 str_to_u32(const char *str)
 {
@@ -1752,6 +1766,7 @@ static struct command all_commands[] = {
     { "monitor", 1, 1, do_monitor },
     { "dump-desc", 1, 1, do_dump_desc },
     { "dump-tables", 1, 1, do_dump_tables },
+    { "dump-counters", 1, 1, do_dump_counters },
     { "desc", 2, 2, do_desc },
     { "dump-flows", 1, 2, do_dump_flows },
     { "dump-aggregate", 1, 2, do_dump_aggregate },